@@ -0,0 +1,24 @@
+#version 450
+layout (location = 0) in vec3 inPosition;
+
+struct ObjectData
+{
+    mat4 model;
+};
+
+// caster transforms in the engine's renderable order
+layout (std140, set = 0, binding = 0) readonly buffer ObjectBuffer
+{
+    ObjectData objects[];
+} objectBuffer;
+
+// the cascade's light view projection
+layout (push_constant) uniform constants
+{
+    mat4 viewProjection;
+} PushConstant;
+
+void main()
+{
+    gl_Position = PushConstant.viewProjection * objectBuffer.objects[gl_InstanceIndex].model * vec4(inPosition, 1.0f);
+}
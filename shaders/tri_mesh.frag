@@ -1,13 +1,164 @@
 #version 450
 layout (location = 0) in vec3 inColor;
 layout (location = 1) in vec2 inUVs;
+layout (location = 2) in vec3 inViewPosition;
+layout (location = 3) in vec3 inViewNormal;
 
 layout (location = 0) out vec4 outFragColor;
 
 layout(set = 0, binding = 1) uniform sampler2D tex1;
 
+// finest lod each streamed texture was sampled at, biased by 16, reset to 0xffffffff every frame
+layout(std430, set = 0, binding = 2) buffer TextureFeedback
+{
+	uint requestedLod[];
+} feedback;
+
+struct PointLight
+{
+	vec4 positionRadius;
+	vec4 color;
+};
+
+// written on the CPU every frame, lights are in view space
+layout(std430, set = 0, binding = 3) readonly buffer LightBuffer
+{
+	mat4 inverseProjection;
+	// width, height, cluster tiles per pixel in x and y
+	vec4 screen;
+	// near, far, scale and bias from log(view depth) to the depth slice
+	vec4 depthSlices;
+	uvec4 grid;
+	PointLight lights[];
+} lightData;
+
+// filled by light_cull.comp
+layout(std430, set = 0, binding = 4) readonly buffer ClusterGrid
+{
+	uvec2 clusters[];
+} clusterGrid;
+
+layout(std430, set = 0, binding = 5) readonly buffer LightIndices
+{
+	uint count;
+	uint indices[];
+} lightIndices;
+
+// matches SHADOWMAPS_CASCADES
+#define SHADOW_CASCADES 4
+
+// static casters cached per cascade plus the dynamic ones drawn on top this frame
+layout(set = 0, binding = 6) uniform sampler2DShadow shadowMaps[SHADOW_CASCADES];
+
+layout(std140, set = 0, binding = 7) uniform ShadowData
+{
+	// view space to each cascade's shadow clip space
+	mat4 cascades[SHADOW_CASCADES];
+	vec4 splitDepths;
+	// view space direction towards the sun, w is its intensity
+	vec4 lightDirection;
+} shadowData;
+
+layout(push_constant) uniform constants
+{
+	vec4 data;
+	mat4 renderMatrix;
+} PushConstant;
+
+layout(constant_id = 0) const bool WRITE_FEEDBACK = true;
+// foliage and glass materials cut out their transparent texels
+layout(constant_id = 1) const bool ALPHA_TEST = false;
+
+// what the scene gets in the shadow with no point light nearby
+const float AMBIENT = 0.35;
+
+// 1 when the sun reaches the point, 0 in full shadow
+float SampleSunShadow(vec3 position, vec3 normal)
+{
+	float depth = -position.z;
+	if (depth > shadowData.splitDepths[SHADOW_CASCADES - 1])
+	{
+		return 1.0;
+	}
+	int cascade = 0;
+	for (int i = 0; i < SHADOW_CASCADES - 1; ++i)
+	{
+		cascade += depth > shadowData.splitDepths[i] ? 1 : 0;
+	}
+
+	// pushing the lookup out along the normal keeps surfaces from shadowing themselves
+	vec4 shadowPosition = shadowData.cascades[cascade] * vec4(position + normal * 0.05, 1.0);
+	vec3 coords = shadowPosition.xyz / shadowPosition.w;
+	coords.xy = coords.xy * 0.5 + 0.5;
+
+	// the loop index keeps the sampler array access uniform, 3x3 taps on top of the 2x2 compare filtering
+	float lit = 0.0;
+	for (int i = 0; i < SHADOW_CASCADES; ++i)
+	{
+		if (i == cascade)
+		{
+			vec2 texel = 1.0 / vec2(textureSize(shadowMaps[i], 0));
+			for (int x = -1; x <= 1; ++x)
+			{
+				for (int y = -1; y <= 1; ++y)
+				{
+					lit += textureLod(shadowMaps[i], vec3(coords.xy + vec2(x, y) * texel, coords.z), 0.0);
+				}
+			}
+		}
+	}
+	return lit / 9.0;
+}
+
+// only the lights binned into this pixel's cluster are visited
+vec3 ShadeClusteredLights(vec3 position, vec3 normal)
+{
+	uvec3 grid = lightData.grid.xyz;
+	uvec3 cell;
+	cell.xy = min(uvec2(gl_FragCoord.xy * lightData.screen.zw), grid.xy - 1u);
+	cell.z = uint(clamp(log(-position.z) * lightData.depthSlices.z - lightData.depthSlices.w, 0.0, float(grid.z - 1u)));
+	uvec2 range = clusterGrid.clusters[cell.x + grid.x * (cell.y + grid.y * cell.z)];
+
+	vec3 result = vec3(0.0);
+	for (uint i = 0; i < range.y; ++i)
+	{
+		PointLight light = lightData.lights[lightIndices.indices[range.x + i]];
+		vec3 toLight = light.positionRadius.xyz - position;
+		float distanceSquared = dot(toLight, toLight);
+		float radiusSquared = light.positionRadius.w * light.positionRadius.w;
+		if (distanceSquared >= radiusSquared)
+		{
+			continue;
+		}
+		// inverse square falloff windowed to reach zero at the radius
+		float window = 1.0 - distanceSquared / radiusSquared;
+		float attenuation = window * window / max(distanceSquared, 0.01);
+		float diffuse = max(dot(normal, toLight * inversesqrt(distanceSquared)), 0.0);
+		result += light.color.rgb * (light.color.w * attenuation * diffuse);
+	}
+	return result;
+}
+
 void main()
 {
-vec3 color = texture(tex1, inUVs).xyz;
-    outFragColor = vec4(color, 1.0f);
-}
\ No newline at end of file
+	vec4 texel = texture(tex1, inUVs);
+	if (ALPHA_TEST && texel.a < 0.5)
+	{
+		discard;
+	}
+	vec3 normal = normalize(inViewNormal);
+	float sun = max(dot(normal, shadowData.lightDirection.xyz), 0.0) * shadowData.lightDirection.w;
+	if (sun > 0.0)
+	{
+		sun *= SampleSunShadow(inViewPosition, normal);
+	}
+	vec3 color = texel.xyz * (AMBIENT + sun + ShadeClusteredLights(inViewPosition, normal));
+	float lod = textureQueryLod(tex1, inUVs).y;
+
+	// one pixel in every 8x8 block is enough to find the finest lod and keeps the atomics cheap
+	if (WRITE_FEEDBACK && ((uint(gl_FragCoord.x) | uint(gl_FragCoord.y)) & 7u) == 0u)
+	{
+		atomicMin(feedback.requestedLod[uint(PushConstant.data.x)], uint(clamp(floor(lod) + 16.0, 0.0, 255.0)));
+	}
+	outFragColor = vec4(color, 1.0f);
+}
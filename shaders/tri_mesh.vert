@@ -6,6 +6,9 @@ layout (location = 3) in vec2 inUVs;
 
 layout (location = 0) out vec3 outColor;
 layout (location = 1) out vec2 outUVs;
+// view space, the clustered lights are shaded there
+layout (location = 2) out vec3 outViewPosition;
+layout (location = 3) out vec3 outViewNormal;
 
 layout (set = 0, binding = 0) uniform CameraBuffer
 {
@@ -14,6 +17,16 @@ layout (set = 0, binding = 0) uniform CameraBuffer
     mat4 viewproj;
 } cameraData;
 
+struct ObjectData
+{
+    mat4 model;
+};
+
+layout (std140, set = 1, binding = 0) readonly buffer ObjectBuffer
+{
+    ObjectData objects[];
+} objectBuffer;
+
 layout (push_constant) uniform push_constants
 {
     vec4 data;
@@ -22,8 +35,13 @@ layout (push_constant) uniform push_constants
 
 void main()
 {    
-    mat4 transformMatrix = (cameraData.viewproj * PushConstant.renderMatrix);
+    mat4 modelMatrix = objectBuffer.objects[gl_InstanceIndex].model;
+    mat4 transformMatrix = (cameraData.viewproj * modelMatrix);
     gl_Position = transformMatrix * vec4(inPosition, 1.0f);
     outColor = inColor;
     outUVs = inUVs;
+
+    mat4 modelView = cameraData.view * modelMatrix;
+    outViewPosition = (modelView * vec4(inPosition, 1.0f)).xyz;
+    outViewNormal = mat3(modelView) * inNormal;
 }
\ No newline at end of file
@@ -0,0 +1,247 @@
+#include "AssetCache.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "CpuProfiler.h"
+#include "VirtualFileSystem.h"
+
+namespace
+{
+	constexpr uint64_t c_Prime1 = 11400714785074694791ull;
+	constexpr uint64_t c_Prime2 = 14029467366897019727ull;
+	constexpr uint64_t c_Prime3 = 1609587929392839161ull;
+	constexpr uint64_t c_Prime4 = 9650029242287828579ull;
+	constexpr uint64_t c_Prime5 = 2870177450012600261ull;
+
+	inline uint64_t Rotate(uint64_t value, int bits)
+	{
+		return (value << bits) | (value >> (64 - bits));
+	}
+
+	inline uint64_t Read64(const uint8_t* p)
+	{
+		uint64_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	inline uint32_t Read32(const uint8_t* p)
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	inline uint64_t Round(uint64_t accumulator, uint64_t input)
+	{
+		accumulator += input * c_Prime2;
+		return Rotate(accumulator, 31) * c_Prime1;
+	}
+
+	inline uint64_t Merge(uint64_t hash, uint64_t accumulator)
+	{
+		hash ^= Round(0, accumulator);
+		return hash * c_Prime1 + c_Prime4;
+	}
+
+	std::string ToHex(uint64_t value)
+	{
+		char text[17];
+		snprintf(text, sizeof(text), "%016" PRIx64, value);
+		return text;
+	}
+
+	uint64_t ToMicroseconds(std::chrono::steady_clock::duration duration)
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+	}
+}
+
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	const uint8_t* end = p + size;
+
+	uint64_t hash;
+	if (size >= 32)
+	{
+		// four independent lanes so the multiplies overlap
+		uint64_t lanes[4] = { seed + c_Prime1 + c_Prime2, seed + c_Prime2, seed, seed - c_Prime1 };
+		for (; p + 32 <= end; p += 32)
+		{
+			lanes[0] = Round(lanes[0], Read64(p));
+			lanes[1] = Round(lanes[1], Read64(p + 8));
+			lanes[2] = Round(lanes[2], Read64(p + 16));
+			lanes[3] = Round(lanes[3], Read64(p + 24));
+		}
+		hash = Rotate(lanes[0], 1) + Rotate(lanes[1], 7) + Rotate(lanes[2], 12) + Rotate(lanes[3], 18);
+		for (uint64_t lane : lanes)
+		{
+			hash = Merge(hash, lane);
+		}
+	}
+	else
+	{
+		hash = seed + c_Prime5;
+	}
+	hash += size;
+
+	for (; p + 8 <= end; p += 8)
+	{
+		hash ^= Round(0, Read64(p));
+		hash = Rotate(hash, 27) * c_Prime1 + c_Prime4;
+	}
+	if (p + 4 <= end)
+	{
+		hash ^= Read32(p) * c_Prime1;
+		hash = Rotate(hash, 23) * c_Prime2 + c_Prime3;
+		p += 4;
+	}
+	for (; p < end; ++p)
+	{
+		hash ^= *p * c_Prime5;
+		hash = Rotate(hash, 11) * c_Prime1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= c_Prime2;
+	hash ^= hash >> 29;
+	hash *= c_Prime3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+bool AssetCache::Open(const std::string& directory)
+{
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(directory) / "outputs", error);
+	if (error)
+	{
+		std::cout << "failed to create the asset cache " << directory << ": " << error.message() << std::endl;
+		return false;
+	}
+	m_Directory = directory;
+	return true;
+}
+
+bool AssetCache::Build(const std::string& sourcePath, const std::string& parameters, const std::string& outputPath, const BakeFunction& bake)
+{
+	PROFILE_FUNCTION();
+	if (!IsOpen())
+	{
+		const auto start = std::chrono::steady_clock::now();
+		const bool baked = bake(sourcePath, outputPath);
+		(baked ? m_Misses : m_Failures)++;
+		m_BakeMicroseconds += ToMicroseconds(std::chrono::steady_clock::now() - start);
+		return baked;
+	}
+
+	MappedFile source;
+	if (!source.Open(sourcePath.c_str()))
+	{
+		std::cout << "cannot read " << sourcePath << std::endl;
+		m_Failures++;
+		return false;
+	}
+	const uint64_t contentHash = HashBytes(source.GetData(), source.GetSize(), ASSETCACHE_VERSION);
+	const std::string key = ToHex(HashBytes(parameters.data(), parameters.size(), contentHash));
+	const std::string entryPath = (std::filesystem::path(m_Directory) / (key + ".bin")).string();
+	const std::string metaPath = (std::filesystem::path(m_Directory) / (key + ".meta")).string();
+
+	std::error_code error;
+	if (std::filesystem::exists(entryPath, error))
+	{
+		double seconds = 0.0;
+		std::ifstream meta(metaPath);
+		meta >> seconds;
+		m_Hits++;
+		m_SavedMicroseconds += static_cast<uint64_t>(seconds * 1e6);
+		return IsMaterialized(outputPath, key, entryPath) || Materialize(outputPath, key, entryPath);
+	}
+
+	// another thread may bake the same contents for a different source, each writes its own temporary
+	const std::string temporaryPath = entryPath + "." + ToHex(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+	const auto start = std::chrono::steady_clock::now();
+	const bool baked = bake(sourcePath, temporaryPath);
+	const uint64_t microseconds = ToMicroseconds(std::chrono::steady_clock::now() - start);
+	m_BakeMicroseconds += microseconds;
+	if (!baked)
+	{
+		std::filesystem::remove(temporaryPath, error);
+		m_Failures++;
+		return false;
+	}
+	m_Misses++;
+
+	// the entry only appears once it is complete, an interrupted bake leaves nothing that could be hit
+	std::filesystem::rename(temporaryPath, entryPath, error);
+	if (error)
+	{
+		std::filesystem::remove(temporaryPath, error);
+	}
+	std::ofstream(metaPath) << microseconds / 1e6 << std::endl;
+	return Materialize(outputPath, key, entryPath);
+}
+
+std::string AssetCache::ManifestPath(const std::string& outputPath) const
+{
+	std::error_code error;
+	const std::string absolute = std::filesystem::absolute(outputPath, error).lexically_normal().generic_string();
+	return (std::filesystem::path(m_Directory) / "outputs" / ToHex(HashBytes(absolute.data(), absolute.size()))).string();
+}
+
+bool AssetCache::IsMaterialized(const std::string& outputPath, const std::string& key, const std::string& entryPath) const
+{
+	std::string writtenKey;
+	std::ifstream manifest(ManifestPath(outputPath));
+	manifest >> writtenKey;
+
+	std::error_code error;
+	return writtenKey == key && std::filesystem::file_size(outputPath, error) == std::filesystem::file_size(entryPath, error) && !error;
+}
+
+bool AssetCache::Materialize(const std::string& outputPath, const std::string& key, const std::string& entryPath) const
+{
+	std::error_code error;
+	std::filesystem::copy_file(entryPath, outputPath, std::filesystem::copy_options::overwrite_existing, error);
+	if (error)
+	{
+		std::cout << "failed to write " << outputPath << ": " << error.message() << std::endl;
+		return false;
+	}
+	// written after the copy, a copy cut short is redone next time
+	std::ofstream(ManifestPath(outputPath)) << key << std::endl;
+	return true;
+}
+
+AssetCacheStats AssetCache::GetStats() const
+{
+	AssetCacheStats stats;
+	stats.hits = m_Hits;
+	stats.misses = m_Misses;
+	stats.failures = m_Failures;
+	stats.bakeSeconds = m_BakeMicroseconds / 1e6;
+	stats.savedSeconds = m_SavedMicroseconds / 1e6;
+	return stats;
+}
+
+void AssetCache::PrintReport(const char* label) const
+{
+	const AssetCacheStats stats = GetStats();
+	const uint32_t total = stats.hits + stats.misses + stats.failures;
+	if (total == 0)
+	{
+		return;
+	}
+	char line[200];
+	snprintf(line, sizeof(line), "%s: %u assets, %u cached (%.0f%% hit rate), %u baked in %.2f s, %u failed, %.2f s saved",
+		label, total, stats.hits, 100.0 * stats.hits / total, stats.misses, stats.bakeSeconds, stats.failures, stats.savedSeconds);
+	std::cout << line << std::endl;
+}
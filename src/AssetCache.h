@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// bumped when the layout of the cache directory changes, older entries are never hit again
+#define ASSETCACHE_VERSION 1
+
+// xxHash64, fast enough to hash every source on every build
+uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 0);
+
+struct AssetCacheStats
+{
+	uint32_t hits = 0;
+	uint32_t misses = 0;
+	uint32_t failures = 0;
+	// seconds spent baking the misses, and what the hits took when they were baked
+	double bakeSeconds = 0.0;
+	double savedSeconds = 0.0;
+};
+
+// Content addressed store for bake outputs. The key of an output is the hash of its source's contents and of
+// the parameters it is baked with, so a source that only got touched, or went back to an earlier version,
+// is not baked again. Entries live in the cache directory as <key>.bin with the bake time next to them in <key>.meta,
+// outputs/<hash of the output path> remembers which key each output was last written from.
+// Build may be called from several threads at once.
+class AssetCache
+{
+public:
+	// writes outputPath from sourcePath, false when baking fails
+	using BakeFunction = std::function<bool(const std::string& sourcePath, const std::string& outputPath)>;
+
+	// creates the directory, without a cache Build bakes every time
+	bool Open(const std::string& directory);
+	bool IsOpen() const { return !m_Directory.empty(); }
+
+	// parameters is everything besides the source that changes the output: baker version, formats, tool flags
+	bool Build(const std::string& sourcePath, const std::string& parameters, const std::string& outputPath, const BakeFunction& bake);
+
+	AssetCacheStats GetStats() const;
+	void PrintReport(const char* label) const;
+
+private:
+	bool IsMaterialized(const std::string& outputPath, const std::string& key, const std::string& entryPath) const;
+	bool Materialize(const std::string& outputPath, const std::string& key, const std::string& entryPath) const;
+	std::string ManifestPath(const std::string& outputPath) const;
+
+	std::string m_Directory;
+	std::atomic<uint32_t> m_Hits{ 0 };
+	std::atomic<uint32_t> m_Misses{ 0 };
+	std::atomic<uint32_t> m_Failures{ 0 };
+	std::atomic<uint64_t> m_BakeMicroseconds{ 0 };
+	std::atomic<uint64_t> m_SavedMicroseconds{ 0 };
+};
@@ -0,0 +1,337 @@
+#include "AssetPack.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "CpuProfiler.h"
+#include "ParallelFor.h"
+
+namespace
+{
+	// the format's end rules: the last 5 bytes are always literals and no match starts in the last 12
+	constexpr size_t c_MinMatch = 4;
+	constexpr size_t c_LastLiterals = 5;
+	constexpr size_t c_MatchLimit = 12;
+	constexpr size_t c_MaxOffset = 65535;
+	constexpr uint32_t c_HashBits = 12;
+
+	inline uint32_t Read32(const uint8_t* p)
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	inline uint32_t Hash(uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - c_HashBits);
+	}
+
+	// 15 in the token's nibble, then 255s until the rest fits a byte
+	inline void WriteLength(uint8_t*& out, size_t length)
+	{
+		for (; length >= 255; length -= 255)
+		{
+			*out++ = 255;
+		}
+		*out++ = static_cast<uint8_t>(length);
+	}
+
+	inline bool ReadLength(const uint8_t*& in, const uint8_t* end, size_t& length)
+	{
+		uint8_t byte;
+		do
+		{
+			if (in >= end)
+			{
+				return false;
+			}
+			byte = *in++;
+			length += byte;
+		} while (byte == 255);
+		return true;
+	}
+
+	// a sequence without a match is the last one of a block
+	bool WriteSequence(uint8_t*& out, const uint8_t* outEnd, const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength)
+	{
+		const size_t worstCase = 1 + literalCount / 255 + 1 + literalCount + 2 + matchLength / 255 + 1;
+		if (worstCase > static_cast<size_t>(outEnd - out))
+		{
+			return false;
+		}
+
+		uint8_t* token = out++;
+		*token = static_cast<uint8_t>(std::min<size_t>(literalCount, 15) << 4);
+		if (literalCount >= 15)
+		{
+			WriteLength(out, literalCount - 15);
+		}
+		memcpy(out, literals, literalCount);
+		out += literalCount;
+
+		if (matchLength == 0)
+		{
+			return true;
+		}
+		*out++ = static_cast<uint8_t>(offset);
+		*out++ = static_cast<uint8_t>(offset >> 8);
+		const size_t length = matchLength - c_MinMatch;
+		*token |= static_cast<uint8_t>(std::min<size_t>(length, 15));
+		if (length >= 15)
+		{
+			WriteLength(out, length - 15);
+		}
+		return true;
+	}
+}
+
+size_t Lz4CompressBound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+size_t Lz4Compress(const uint8_t* source, size_t sourceSize, uint8_t* destination, size_t capacity)
+{
+	uint8_t* out = destination;
+	const uint8_t* outEnd = destination + capacity;
+
+	// positions of the last 4 byte sequence with each hash
+	std::array<uint32_t, 1 << c_HashBits> table;
+	table.fill(UINT32_MAX);
+
+	size_t anchor = 0;
+	size_t position = 0;
+	if (sourceSize > c_MatchLimit)
+	{
+		const size_t lastMatchStart = sourceSize - c_MatchLimit;
+		const size_t matchEnd = sourceSize - c_LastLiterals;
+		while (position < lastMatchStart)
+		{
+			const uint32_t sequence = Read32(source + position);
+			const uint32_t hash = Hash(sequence);
+			const size_t candidate = table[hash];
+			table[hash] = static_cast<uint32_t>(position);
+			if (candidate == UINT32_MAX || position - candidate > c_MaxOffset || Read32(source + candidate) != sequence)
+			{
+				position++;
+				continue;
+			}
+
+			size_t length = c_MinMatch;
+			while (position + length < matchEnd && source[candidate + length] == source[position + length])
+			{
+				length++;
+			}
+			if (!WriteSequence(out, outEnd, source + anchor, position - anchor, position - candidate, length))
+			{
+				return 0;
+			}
+			position += length;
+			anchor = position;
+		}
+	}
+
+	if (!WriteSequence(out, outEnd, source + anchor, sourceSize - anchor, 0, 0))
+	{
+		return 0;
+	}
+	return static_cast<size_t>(out - destination);
+}
+
+bool Lz4Decompress(const uint8_t* source, size_t sourceSize, uint8_t* destination, size_t destinationSize)
+{
+	const uint8_t* in = source;
+	const uint8_t* inEnd = source + sourceSize;
+	uint8_t* out = destination;
+	uint8_t* outEnd = destination + destinationSize;
+
+	while (in < inEnd)
+	{
+		const uint8_t token = *in++;
+		size_t literalCount = token >> 4;
+		if (literalCount == 15 && !ReadLength(in, inEnd, literalCount))
+		{
+			return false;
+		}
+		if (literalCount > static_cast<size_t>(inEnd - in) || literalCount > static_cast<size_t>(outEnd - out))
+		{
+			return false;
+		}
+		memcpy(out, in, literalCount);
+		in += literalCount;
+		out += literalCount;
+
+		// the last sequence ends after its literals
+		if (in == inEnd)
+		{
+			break;
+		}
+
+		if (inEnd - in < 2)
+		{
+			return false;
+		}
+		const size_t offset = static_cast<size_t>(in[0]) | (static_cast<size_t>(in[1]) << 8);
+		in += 2;
+		if (offset == 0 || offset > static_cast<size_t>(out - destination))
+		{
+			return false;
+		}
+
+		size_t length = token & 15;
+		if (length == 15 && !ReadLength(in, inEnd, length))
+		{
+			return false;
+		}
+		length += c_MinMatch;
+		if (length > static_cast<size_t>(outEnd - out))
+		{
+			return false;
+		}
+
+		// a match closer than its length repeats the bytes it is still writing, so it is copied forwards
+		const uint8_t* match = out - offset;
+		if (offset >= length)
+		{
+			memcpy(out, match, length);
+		}
+		else
+		{
+			for (size_t i = 0; i < length; ++i)
+			{
+				out[i] = match[i];
+			}
+		}
+		out += length;
+	}
+	return out == outEnd;
+}
+
+void AssetPackWriter::AddFile(const std::string& name, std::vector<uint8_t>&& data, bool compress)
+{
+	PendingEntry entry;
+	entry.name = name;
+	entry.data = std::move(data);
+	entry.compress = compress;
+	entry.blockCount = 0;
+	m_Entries.push_back(std::move(entry));
+}
+
+void AssetPackWriter::Compress(PendingEntry& entry)
+{
+	PROFILE_FUNCTION();
+	const size_t size = entry.data.size();
+	const uint32_t blockCount = static_cast<uint32_t>((size + ASSETPACK_BLOCK_SIZE - 1) / ASSETPACK_BLOCK_SIZE);
+
+	std::vector<uint8_t> compressed(blockCount * sizeof(uint32_t));
+	std::vector<uint8_t> block(Lz4CompressBound(ASSETPACK_BLOCK_SIZE));
+	for (uint32_t i = 0; i < blockCount; ++i)
+	{
+		const uint8_t* source = entry.data.data() + static_cast<size_t>(i) * ASSETPACK_BLOCK_SIZE;
+		const size_t sourceSize = std::min<size_t>(ASSETPACK_BLOCK_SIZE, size - static_cast<size_t>(i) * ASSETPACK_BLOCK_SIZE);
+
+		// blocks that do not shrink are stored, their full size tells the reader to copy them
+		size_t storedSize = Lz4Compress(source, sourceSize, block.data(), block.size());
+		const uint8_t* stored = block.data();
+		if (storedSize == 0 || storedSize >= sourceSize)
+		{
+			storedSize = sourceSize;
+			stored = source;
+		}
+
+		const uint32_t blockSize = static_cast<uint32_t>(storedSize);
+		memcpy(compressed.data() + i * sizeof(uint32_t), &blockSize, sizeof(blockSize));
+		compressed.insert(compressed.end(), stored, stored + storedSize);
+	}
+
+	if (static_cast<double>(compressed.size()) <= static_cast<double>(size) * (1.0 - ASSETPACK_MIN_SAVING))
+	{
+		entry.compressed = std::move(compressed);
+		entry.blockCount = blockCount;
+	}
+}
+
+bool AssetPackWriter::Write(const std::string& path, AssetPackStats* outStats)
+{
+	PROFILE_FUNCTION();
+	ParallelFor(static_cast<uint32_t>(m_Entries.size()), [&](uint32_t i)
+		{
+			if (m_Entries[i].compress && !m_Entries[i].data.empty())
+			{
+				Compress(m_Entries[i]);
+			}
+		});
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cout << "failed to open " << path << std::endl;
+		return false;
+	}
+
+	// zeroed until everything else is written, a pack cut short on the way never looks valid
+	AssetPackHeader header{};
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	AssetPackStats stats;
+	std::vector<AssetPackEntry> entries;
+	std::string names;
+	uint64_t offset = sizeof(header);
+	const char padding[ASSETPACK_PAGE_ALIGNMENT] = {};
+	for (const PendingEntry& pending : m_Entries)
+	{
+		const bool compressed = !pending.compressed.empty();
+		const std::vector<uint8_t>& stored = compressed ? pending.compressed : pending.data;
+
+		const uint64_t alignment = compressed ? ASSETPACK_ENTRY_ALIGNMENT : ASSETPACK_PAGE_ALIGNMENT;
+		const uint64_t aligned = (offset + alignment - 1) & ~(alignment - 1);
+		file.write(padding, static_cast<std::streamsize>(aligned - offset));
+		file.write(reinterpret_cast<const char*>(stored.data()), static_cast<std::streamsize>(stored.size()));
+
+		AssetPackEntry entry{};
+		entry.offset = aligned;
+		entry.size = pending.data.size();
+		entry.storedSize = stored.size();
+		entry.nameOffset = static_cast<uint32_t>(names.size());
+		entry.nameLength = static_cast<uint32_t>(pending.name.size());
+		entry.compression = compressed ? PackCompression::Lz4 : PackCompression::None;
+		entry.blockCount = compressed ? pending.blockCount : 0;
+		entries.push_back(entry);
+		names += pending.name;
+		offset = aligned + stored.size();
+
+		stats.entries++;
+		stats.compressedEntries += compressed ? 1 : 0;
+		stats.rawBytes += entry.size;
+		stats.storedBytes += entry.storedSize;
+	}
+
+	header.tocOffset = (offset + ASSETPACK_ENTRY_ALIGNMENT - 1) & ~static_cast<uint64_t>(ASSETPACK_ENTRY_ALIGNMENT - 1);
+	header.namesOffset = header.tocOffset + entries.size() * sizeof(AssetPackEntry);
+	header.namesSize = names.size();
+	file.write(padding, static_cast<std::streamsize>(header.tocOffset - offset));
+	file.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(AssetPackEntry)));
+	file.write(names.data(), static_cast<std::streamsize>(names.size()));
+
+	header.magic = ASSETPACK_MAGIC;
+	header.version = ASSETPACK_VERSION;
+	header.entryCount = static_cast<uint32_t>(entries.size());
+	header.blockSize = ASSETPACK_BLOCK_SIZE;
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (!file)
+	{
+		std::cout << "failed to write " << path << std::endl;
+		return false;
+	}
+
+	if (outStats)
+	{
+		*outStats = stats;
+	}
+	return true;
+}
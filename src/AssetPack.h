@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// "IPAK"
+#define ASSETPACK_MAGIC 0x4B415049u
+#define ASSETPACK_VERSION 1
+// entries are compressed in independent blocks, they decompress in parallel and a range only needs its own blocks
+#define ASSETPACK_BLOCK_SIZE (64 * 1024)
+// uncompressed entries start on a page so they can be used straight from the mapping
+#define ASSETPACK_PAGE_ALIGNMENT 4096
+#define ASSETPACK_ENTRY_ALIGNMENT 16
+// compression is dropped for entries it shrinks by less than this
+#define ASSETPACK_MIN_SAVING 0.05
+
+enum class PackCompression : uint32_t
+{
+	None = 0,
+	// LZ4 block format, one block per ASSETPACK_BLOCK_SIZE bytes
+	Lz4 = 1
+};
+
+// The pack starts with the header and the entry data, the entry table and the names follow at tocOffset.
+struct AssetPackHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t blockSize;
+	uint64_t tocOffset;
+	uint64_t namesOffset;
+	uint64_t namesSize;
+};
+
+// A compressed entry starts with the stored size of each of its blocks, the blocks follow back to back.
+// A block stored at its full size was not worth compressing and is copied as is.
+struct AssetPackEntry
+{
+	uint64_t offset;
+	uint64_t size;
+	uint64_t storedSize;
+	uint32_t nameOffset;
+	uint32_t nameLength;
+	PackCompression compression;
+	uint32_t blockCount;
+};
+
+struct AssetPackStats
+{
+	uint32_t entries = 0;
+	uint32_t compressedEntries = 0;
+	uint64_t rawBytes = 0;
+	uint64_t storedBytes = 0;
+};
+
+// LZ4 block format: greedy matching over a 4 byte hash, no frame header, blocks up to 64KB so offsets fit 16 bits
+size_t Lz4CompressBound(size_t size);
+// bytes written, 0 when destination is too small
+size_t Lz4Compress(const uint8_t* source, size_t sourceSize, uint8_t* destination, size_t capacity);
+// false for corrupt data or when it does not decompress to exactly destinationSize bytes
+bool Lz4Decompress(const uint8_t* source, size_t sourceSize, uint8_t* destination, size_t destinationSize);
+
+// collects files, compresses them on every core and writes them as one pack
+class AssetPackWriter
+{
+public:
+	// name is the path the engine asks for relative to the pack's mount point, '/' separated
+	void AddFile(const std::string& name, std::vector<uint8_t>&& data, bool compress);
+	bool Write(const std::string& path, AssetPackStats* outStats = nullptr);
+
+private:
+	struct PendingEntry
+	{
+		std::string name;
+		std::vector<uint8_t> data;
+		bool compress;
+		// block size table and blocks, empty when the entry is stored as is
+		std::vector<uint8_t> compressed;
+		uint32_t blockCount;
+	};
+
+	static void Compress(PendingEntry& entry);
+
+	std::vector<PendingEntry> m_Entries;
+};
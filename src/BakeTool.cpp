@@ -0,0 +1,115 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AssetCache.h"
+#include "ParallelFor.h"
+#include "ShaderCompiler.h"
+#include "TextureStreamer.h"
+
+// Bakes every asset under the given directories next to its source: images into the streamer's .itex
+// and glsl into .spv with glslangValidator. Outputs come from the content addressed cache when the source
+// and the bake parameters hashed the same before, the rest bake in parallel. Ends with the cache report.
+// The build runs it over the shaders folder instead of compiling each shader on its timestamp.
+//
+// inferno_bake [--cache <dir>] [--glslang <path>] [--jobs <n>] <directory>...
+
+namespace
+{
+	struct BakeJob
+	{
+		std::string source;
+		std::string output;
+		bool shader;
+	};
+
+	bool IsImage(const std::filesystem::path& path)
+	{
+		const std::string extension = path.extension().string();
+		return extension == ".png" || extension == ".jpg" || extension == ".jpeg" || extension == ".tga" || extension == ".bmp";
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::string cacheDirectory = "../../.assetcache";
+	std::string glslang = "glslangValidator";
+	uint32_t jobs = 0;
+	std::vector<std::string> directories;
+	for (int i = 1; i < argc; ++i)
+	{
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--cache") == 0 && hasValue)
+		{
+			cacheDirectory = argv[++i];
+		}
+		else if (strcmp(argv[i], "--glslang") == 0 && hasValue)
+		{
+			glslang = argv[++i];
+		}
+		else if (strcmp(argv[i], "--jobs") == 0 && hasValue)
+		{
+			jobs = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else
+		{
+			directories.push_back(argv[i]);
+		}
+	}
+	if (directories.empty())
+	{
+		std::cout << "usage: inferno_bake [--cache <dir>] [--glslang <path>] [--jobs <n>] <directory>..." << std::endl;
+		return 1;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	std::vector<BakeJob> bakeJobs;
+	for (const std::string& directory : directories)
+	{
+		std::error_code error;
+		for (auto it = std::filesystem::recursive_directory_iterator(directory, error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+		{
+			const std::filesystem::path& path = it->path();
+			const bool shader = IsShaderSource(path.string());
+			if (!it->is_regular_file() || !(IsImage(path) || shader))
+			{
+				continue;
+			}
+			bakeJobs.push_back({ path.string(), path.string() + (shader ? ".spv" : ".itex"), shader });
+		}
+		if (error)
+		{
+			std::cout << "failed to walk " << directory << ": " << error.message() << std::endl;
+			return 1;
+		}
+	}
+
+	AssetCache cache;
+	cache.Open(cacheDirectory);
+	std::atomic<bool> failed{ false };
+	ParallelFor(static_cast<uint32_t>(bakeJobs.size()), [&](uint32_t i)
+		{
+			const BakeJob& job = bakeJobs[i];
+			const bool baked = job.shader
+				? CompileShader(cache, glslang, job.source, job.output)
+				: TextureStreamer::EnsureBaked(cache, job.source, job.output);
+			if (!baked)
+			{
+				failed = true;
+			}
+		}, jobs);
+
+	cache.PrintReport("asset build");
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	char line[100];
+	snprintf(line, sizeof(line), "asset build took %.2f s on %u jobs", seconds, jobs ? jobs : std::thread::hardware_concurrency());
+	std::cout << line << std::endl;
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,468 @@
+#include <vk_engine.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "ObjParser.h"
+#include "Bvh.h"
+
+// Renders a fixed number of headless frames along a camera path and reports frame time percentiles,
+// draw statistics and memory as json. With --baseline the results are compared against an earlier
+// report and the process exits with 1 when a metric got worse by more than the threshold.
+// Before rendering, the scene is parsed with tinyobjloader and with ParseObjFast to compare their throughput,
+// and a BVH is built over it to measure CPU ray throughput with single rays and packets of four.
+//
+// inferno_benchmark [--scene <obj>] [--camera <path>] [--warmup <n>] [--frames <n>]
+//                   [--output <report.json>] [--baseline <report.json>] [--threshold <percent>]
+//                   [--import-runs <n>] [--bvh-rays <n>]
+
+namespace
+{
+	struct Distribution
+	{
+		double min = 0.0;
+		double avg = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+	};
+
+	struct Metric
+	{
+		std::string name;
+		double value;
+		// only metrics that mean "slower" or "heavier" when they grow are checked against the baseline
+		bool compared;
+	};
+
+	Distribution Summarize(std::vector<double> values)
+	{
+		Distribution result;
+		if (values.empty())
+		{
+			return result;
+		}
+
+		std::sort(values.begin(), values.end());
+		// nearest rank, so p99 of 100 frames is the 99th slowest rather than an interpolated value
+		auto percentile = [&](double p)
+		{
+			const size_t rank = static_cast<size_t>(std::ceil(p * values.size()));
+			return values[std::min(std::max<size_t>(rank, 1), values.size()) - 1];
+		};
+
+		double sum = 0.0;
+		for (double value : values)
+		{
+			sum += value;
+		}
+
+		result.min = values.front();
+		result.avg = sum / values.size();
+		result.p95 = percentile(0.95);
+		result.p99 = percentile(0.99);
+		result.max = values.back();
+		return result;
+	}
+
+	void AddDistribution(std::vector<Metric>& metrics, const std::string& prefix, const Distribution& distribution)
+	{
+		metrics.push_back({ prefix + "_min_ms", distribution.min, false });
+		metrics.push_back({ prefix + "_avg_ms", distribution.avg, true });
+		metrics.push_back({ prefix + "_p95_ms", distribution.p95, true });
+		metrics.push_back({ prefix + "_p99_ms", distribution.p99, true });
+		metrics.push_back({ prefix + "_max_ms", distribution.max, false });
+	}
+
+	// the reports are flat, so finding "name": is enough to read a metric back
+	bool ReadJsonNumber(const std::string& json, const std::string& name, double& outValue)
+	{
+		const std::string key = "\"" + name + "\":";
+		const size_t position = json.find(key);
+		if (position == std::string::npos)
+		{
+			return false;
+		}
+
+		const char* begin = json.c_str() + position + key.size();
+		char* end = nullptr;
+		outValue = strtod(begin, &end);
+		return end != begin;
+	}
+
+	bool WriteReport(const std::string& path, const EngineConfig& config, uint32_t warmupFrames, const std::vector<Metric>& metrics, const std::vector<FrameTiming>& frames)
+	{
+		std::ofstream file(path);
+		if (!file.is_open())
+		{
+			std::cout << "failed to open " << path << std::endl;
+			return false;
+		}
+
+		file << "{\n";
+		file << "\t\"scene\": \"" << config.meshPath << "\",\n";
+		file << "\t\"camera\": \"" << (config.cameraPath.empty() ? "orbit" : config.cameraPath) << "\",\n";
+		file << "\t\"timestep\": " << config.timestep << ",\n";
+		file << "\t\"warmup_frames\": " << warmupFrames << ",\n";
+		for (const Metric& metric : metrics)
+		{
+			file << "\t\"" << metric.name << "\": " << metric.value << ",\n";
+		}
+
+		file << "\t\"frames\": [\n";
+		for (size_t i = warmupFrames; i < frames.size(); ++i)
+		{
+			file << "\t\t[" << frames[i].cpuMs << ", " << frames[i].gpuMs << "]" << (i + 1 < frames.size() ? ",\n" : "\n");
+		}
+		file << "\t]\n}\n";
+		return true;
+	}
+
+	bool SameMesh(const Mesh& a, const Mesh& b)
+	{
+		if (a.vertices.size() != b.vertices.size() || a.indices != b.indices || a.sections.size() != b.sections.size() || a.materials.size() != b.materials.size())
+		{
+			return false;
+		}
+		// bitwise, the fast path promises the same floats
+		if (memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(Vertex)) != 0)
+		{
+			return false;
+		}
+		for (size_t i = 0; i < a.sections.size(); ++i)
+		{
+			if (a.sections[i].material != b.sections[i].material || a.sections[i].firstIndex != b.sections[i].firstIndex || a.sections[i].indexCount != b.sections[i].indexCount)
+			{
+				return false;
+			}
+		}
+		for (size_t i = 0; i < a.materials.size(); ++i)
+		{
+			if (a.materials[i].name != b.materials[i].name)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// best of runs, a cold page cache only slows down the first one, false when the two importers built different meshes
+	bool MeasureObjImport(const std::string& path, uint32_t runs, std::vector<Metric>& metrics)
+	{
+		std::string baseDir(path);
+		const size_t slash = baseDir.find_last_of("/\\");
+		baseDir = slash == std::string::npos ? std::string() : baseDir.substr(0, slash + 1);
+
+		// loose files only, the numbers stay comparable whether or not a pack is around
+		VirtualFileSystem fileSystem;
+		ObjMaterialReader materialReader(fileSystem, baseDir);
+
+		double tinyObjSeconds = 1e30;
+		double fastSeconds = 1e30;
+		ObjParseStats stats;
+		bool supported = true;
+		for (uint32_t run = 0; run < runs; ++run)
+		{
+			tinyobj::attrib_t attrib;
+			std::vector<tinyobj::shape_t> shapes;
+			std::vector<tinyobj::material_t> materials;
+			std::string warn;
+			std::string err;
+
+			const auto start = std::chrono::steady_clock::now();
+			tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str(), baseDir.c_str());
+			const auto middle = std::chrono::steady_clock::now();
+			materials.clear();
+			const FileData file = fileSystem.Open(path);
+			supported &= file.IsValid() && ParseObjFast(reinterpret_cast<const char*>(file.GetData()), file.GetSize(), materialReader,
+				attrib, shapes, materials, warn, err, 0, &stats) == ObjParseResult::Ok;
+			const auto end = std::chrono::steady_clock::now();
+
+			tinyObjSeconds = std::min(tinyObjSeconds, std::chrono::duration<double>(middle - start).count());
+			fastSeconds = std::min(fastSeconds, std::chrono::duration<double>(end - middle).count());
+		}
+
+		if (!supported || stats.bytes == 0)
+		{
+			std::cout << path << " is not handled by the fast obj parser, import throughput not measured" << std::endl;
+			return true;
+		}
+
+		const double megabytes = static_cast<double>(stats.bytes) / (1024.0 * 1024.0);
+		metrics.push_back({ "obj_tinyobj_mb_s", megabytes / tinyObjSeconds, false });
+		metrics.push_back({ "obj_fast_mb_s", megabytes / fastSeconds, false });
+		metrics.push_back({ "obj_fast_parse_ms", fastSeconds * 1000.0, true });
+
+		Mesh tinyObjMesh;
+		Mesh fastMesh;
+		tinyObjMesh.LoadFromObj(fileSystem, path.c_str(), ObjImporter::TinyObj);
+		fastMesh.LoadFromObj(fileSystem, path.c_str(), ObjImporter::Fast);
+		const bool same = SameMesh(tinyObjMesh, fastMesh);
+
+		char line[200];
+		snprintf(line, sizeof(line), "obj import %.1f MB: tinyobjloader %.1f MB/s, fast %.1f MB/s (%u chunks on %u threads, %.2fx)%s",
+			megabytes, megabytes / tinyObjSeconds, megabytes / fastSeconds, stats.chunks, stats.threads, tinyObjSeconds / fastSeconds, same ? "" : ", MESHES DIFFER");
+		std::cout << line << std::endl;
+		return same;
+	}
+
+	// pinhole camera over the middle of the scene looking across it, a square image of primary rays
+	Ray PrimaryRay(const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint32_t x, uint32_t y, uint32_t size)
+	{
+		const glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+		const glm::vec3 extent = boundsMax - boundsMin;
+		const glm::vec3 eye = center + glm::vec3(0.f, extent.y * 0.25f, extent.z * 0.5f);
+		const glm::vec3 forward = glm::normalize(center - eye);
+		const glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.f, 1.f, 0.f)));
+		const glm::vec3 up = glm::cross(right, forward);
+		const float u = (x + 0.5f) / size * 2.f - 1.f;
+		const float v = 1.f - (y + 0.5f) / size * 2.f;
+		return { eye, FLT_MAX, forward + right * u + up * v };
+	}
+
+	// single threaded Mrays/s of closest hit queries, false when packets and single rays disagree
+	bool MeasureBvh(const std::string& path, uint32_t rayCount, std::vector<Metric>& metrics)
+	{
+		VirtualFileSystem fileSystem;
+		Mesh mesh;
+		if (!mesh.LoadFromObj(fileSystem, path.c_str()) || mesh.indices.empty())
+		{
+			std::cout << "failed to load " << path << ", bvh not measured" << std::endl;
+			return true;
+		}
+
+		Bvh bvh;
+		bvh.Build(mesh, 1);
+		const float singleThreadMs = bvh.GetStats().buildMs;
+		bvh.Build(mesh);
+		const BvhStats& stats = bvh.GetStats();
+
+		glm::vec3 boundsMin(FLT_MAX);
+		glm::vec3 boundsMax(-FLT_MAX);
+		for (const Vertex& vertex : mesh.vertices)
+		{
+			boundsMin = glm::min(boundsMin, vertex.position);
+			boundsMax = glm::max(boundsMax, vertex.position);
+		}
+
+		// the same image traced pixel by pixel and as 2x2 packets, both in rows of packets
+		const uint32_t size = std::max(2u, static_cast<uint32_t>(std::sqrt(static_cast<double>(rayCount))) & ~1u);
+		std::vector<RayHit> singleHits(size * size);
+		const auto singleStart = std::chrono::steady_clock::now();
+		for (uint32_t y = 0; y < size; ++y)
+		{
+			for (uint32_t x = 0; x < size; ++x)
+			{
+				bvh.Intersect(PrimaryRay(boundsMin, boundsMax, x, y, size), singleHits[y * size + x]);
+			}
+		}
+		const double singleSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - singleStart).count();
+
+		uint32_t mismatches = 0;
+		uint32_t hits = 0;
+		const auto packetStart = std::chrono::steady_clock::now();
+		for (uint32_t y = 0; y < size; y += 2)
+		{
+			for (uint32_t x = 0; x < size; x += 2)
+			{
+				RayPacket packet;
+				for (uint32_t lane = 0; lane < 4; ++lane)
+				{
+					packet.Set(lane, PrimaryRay(boundsMin, boundsMax, x + (lane & 1), y + (lane >> 1), size));
+				}
+				RayPacketHit packetHit;
+				bvh.IntersectPacket(packet, packetHit);
+				for (uint32_t lane = 0; lane < 4; ++lane)
+				{
+					// equally close triangles may be reported in either order, the distance has to match
+					const RayHit& single = singleHits[(y + (lane >> 1)) * size + x + (lane & 1)];
+					mismatches += single.IsHit() != (packetHit.triangle[lane] != BVH_INVALID) || (single.IsHit() && single.t != packetHit.t[lane]);
+					hits += single.IsHit();
+				}
+			}
+		}
+		const double packetSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - packetStart).count();
+
+		const double rays = static_cast<double>(size) * size;
+		metrics.push_back({ "bvh_build_ms", stats.buildMs, true });
+		metrics.push_back({ "bvh_build_single_thread_ms", singleThreadMs, false });
+		metrics.push_back({ "bvh_nodes", static_cast<double>(stats.nodes), false });
+		metrics.push_back({ "bvh_sah_cost", stats.sahCost, true });
+		metrics.push_back({ "bvh_single_mrays_s", rays / singleSeconds / 1e6, false });
+		metrics.push_back({ "bvh_packet_mrays_s", rays / packetSeconds / 1e6, false });
+
+		char line[240];
+		snprintf(line, sizeof(line), "bvh %u triangles: %u nodes, depth %u, built in %.1f ms on %u threads (%.1f ms on one), %ux%u primary rays %.1f%% hit: single %.2f Mrays/s, packets %.2f Mrays/s%s",
+			stats.triangles, stats.nodes, stats.maxDepth, stats.buildMs, stats.threads, singleThreadMs, size, size, hits * 100.0 / rays,
+			rays / singleSeconds / 1e6, rays / packetSeconds / 1e6, mismatches ? ", PACKETS DIFFER" : "");
+		std::cout << line << std::endl;
+		return mismatches == 0;
+	}
+
+	bool CompareWithBaseline(const std::string& path, const std::vector<Metric>& metrics, double thresholdPercent)
+	{
+		std::ifstream file(path);
+		if (!file.is_open())
+		{
+			std::cout << "failed to open baseline " << path << std::endl;
+			return false;
+		}
+		std::stringstream buffer;
+		buffer << file.rdbuf();
+		const std::string json = buffer.str();
+
+		bool regressed = false;
+		std::cout << "metric                     baseline      current    change" << std::endl;
+		for (const Metric& metric : metrics)
+		{
+			double baseline;
+			if (!metric.compared || !ReadJsonNumber(json, metric.name, baseline))
+			{
+				continue;
+			}
+
+			const double change = baseline != 0.0 ? (metric.value - baseline) / baseline * 100.0 : 0.0;
+			const bool worse = change > thresholdPercent;
+			regressed |= worse;
+
+			char line[160];
+			snprintf(line, sizeof(line), "%-24s %12.4f %12.4f %+8.2f%%%s", metric.name.c_str(), baseline, metric.value, change, worse ? "  REGRESSION" : "");
+			std::cout << line << std::endl;
+		}
+		return !regressed;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	EngineConfig config;
+	config.headless = true;
+
+	uint32_t warmupFrames = 60;
+	uint32_t measuredFrames = 600;
+	std::string outputPath = "benchmark.json";
+	std::string baselinePath;
+	double threshold = 5.0;
+	uint32_t importRuns = 3;
+	uint32_t bvhRays = 1 << 20;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--scene") == 0 && hasValue)
+		{
+			config.meshPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--camera") == 0 && hasValue)
+		{
+			config.cameraPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--warmup") == 0 && hasValue)
+		{
+			warmupFrames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+		{
+			measuredFrames = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--output") == 0 && hasValue)
+		{
+			outputPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--baseline") == 0 && hasValue)
+		{
+			baselinePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--threshold") == 0 && hasValue)
+		{
+			threshold = strtod(argv[++i], nullptr);
+		}
+		else if (strcmp(argv[i], "--import-runs") == 0 && hasValue)
+		{
+			importRuns = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--bvh-rays") == 0 && hasValue)
+		{
+			bvhRays = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else
+		{
+			std::cout << "unknown argument " << argv[i] << std::endl;
+			return 2;
+		}
+	}
+
+	config.frameCount = warmupFrames + measuredFrames;
+
+	std::vector<Metric> metrics;
+	const bool importMatches = importRuns == 0 || MeasureObjImport(config.meshPath, importRuns, metrics);
+	const bool packetsMatch = bvhRays == 0 || MeasureBvh(config.meshPath, bvhRays, metrics);
+
+	VulkanEngine engine;
+	engine.Init(config);
+	engine.run();
+
+	const std::vector<FrameTiming>& frames = engine.GetFrameTimings();
+	std::vector<double> cpuTimes;
+	std::vector<double> gpuTimes;
+	double drawCalls = 0.0;
+	double drawCommands = 0.0;
+	double triangles = 0.0;
+	double heapAllocations = 0.0;
+	for (size_t i = warmupFrames; i < frames.size(); ++i)
+	{
+		cpuTimes.push_back(frames[i].cpuMs);
+		if (frames[i].gpuMs >= 0.f)
+		{
+			gpuTimes.push_back(frames[i].gpuMs);
+		}
+		drawCalls += frames[i].stats.drawCalls;
+		drawCommands += frames[i].stats.drawCommands;
+		triangles += static_cast<double>(frames[i].stats.triangles);
+		heapAllocations += frames[i].stats.heapAllocations;
+	}
+	const double measured = std::max<size_t>(cpuTimes.size(), 1);
+
+	metrics.push_back({ "measured_frames", static_cast<double>(cpuTimes.size()), false });
+	AddDistribution(metrics, "cpu", Summarize(cpuTimes));
+	AddDistribution(metrics, "gpu", Summarize(gpuTimes));
+	metrics.push_back({ "draw_calls", drawCalls / measured, true });
+	metrics.push_back({ "draw_commands", drawCommands / measured, true });
+	metrics.push_back({ "triangles", triangles / measured, true });
+	metrics.push_back({ "gpu_memory_bytes", static_cast<double>(engine.CalculateGpuMemoryUsage()), true });
+	metrics.push_back({ "heap_allocations", heapAllocations / measured, true });
+
+	WriteReport(outputPath, config, warmupFrames, metrics, frames);
+	std::cout << "wrote " << outputPath << std::endl;
+	// a baseline of 0 cannot regress by a percentage, so steady state allocations are reported on their own
+	if (heapAllocations > 0.0)
+	{
+		std::cout << "measured frames made " << heapAllocations << " heap allocations, expected none after warmup" << std::endl;
+	}
+
+	engine.Cleanup();
+
+	if (!baselinePath.empty() && !CompareWithBaseline(baselinePath, metrics, threshold))
+	{
+		return 1;
+	}
+	// the fast obj parser must build exactly what tinyobjloader builds
+	if (!importMatches)
+	{
+		return 1;
+	}
+	// packet traversal must find the same hits as single rays
+	if (!packetsMatch)
+	{
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,638 @@
+#include "Bvh.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+#include "vk_Mesh.h"
+#include "CpuProfiler.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define INFERNO_BVH_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	struct Bin
+	{
+		glm::vec3 boundsMin{ FLT_MAX };
+		glm::vec3 boundsMax{ -FLT_MAX };
+		uint32_t count = 0;
+	};
+
+	// half the surface area, the SAH only compares areas with each other
+	float HalfArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+	{
+		const glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(0.f));
+		return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+	}
+
+	// entry distance of the ray into the box, FLT_MAX when it misses or only enters after tMax
+	float IntersectBox(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float tMax)
+	{
+		const glm::vec3 t1 = (node.boundsMin - origin) * inverseDirection;
+		const glm::vec3 t2 = (node.boundsMax - origin) * inverseDirection;
+		const glm::vec3 tNear = glm::min(t1, t2);
+		const glm::vec3 tFar = glm::max(t1, t2);
+		const float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+		const float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+		return entry <= exit ? entry : FLT_MAX;
+	}
+
+	// Moller-Trumbore, written in the same operation order as the packet version so both find the same hits
+	bool IntersectTriangle(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& v0, const glm::vec3& edge1, const glm::vec3& edge2,
+		float tMax, float& outT, float& outU, float& outV)
+	{
+		const glm::vec3 p = glm::cross(direction, edge2);
+		const float determinant = glm::dot(edge1, p);
+		if (std::abs(determinant) <= 1e-12f)
+		{
+			return false;
+		}
+		const float inverse = 1.f / determinant;
+		const glm::vec3 s = origin - v0;
+		const float u = glm::dot(s, p) * inverse;
+		const glm::vec3 q = glm::cross(s, edge1);
+		const float v = glm::dot(direction, q) * inverse;
+		const float t = glm::dot(edge2, q) * inverse;
+		if (u < 0.f || v < 0.f || u + v > 1.f || t <= 0.f || t >= tMax)
+		{
+			return false;
+		}
+		outT = t;
+		outU = u;
+		outV = v;
+		return true;
+	}
+
+	void AtomicMax(std::atomic<uint32_t>& target, uint32_t value)
+	{
+		uint32_t current = target.load(std::memory_order_relaxed);
+		while (current < value && !target.compare_exchange_weak(current, value, std::memory_order_relaxed))
+		{
+		}
+	}
+}
+
+struct Bvh::BuildContext
+{
+	std::vector<glm::vec3> boundsMin;
+	std::vector<glm::vec3> boundsMax;
+	std::vector<glm::vec3> centroids;
+	// original triangle indices, partitioned in place while the tree is built
+	std::vector<uint32_t> order;
+	std::atomic<uint32_t> nodeCount{ 1 };
+	std::atomic<uint32_t> leafCount{ 0 };
+	std::atomic<uint32_t> maxDepth{ 0 };
+	std::atomic<uint32_t> threads{ 1 };
+};
+
+void RayPacket::Set(uint32_t lane, const Ray& ray)
+{
+	originX[lane] = ray.origin.x;
+	originY[lane] = ray.origin.y;
+	originZ[lane] = ray.origin.z;
+	directionX[lane] = ray.direction.x;
+	directionY[lane] = ray.direction.y;
+	directionZ[lane] = ray.direction.z;
+	tMax[lane] = ray.tMax;
+}
+
+void Bvh::Build(const Mesh& mesh, uint32_t threadCount)
+{
+	Build(mesh.vertices.data(), mesh.indices.data(), static_cast<uint32_t>(mesh.indices.size() / 3), threadCount);
+}
+
+void Bvh::Build(const Vertex* vertices, const uint32_t* indices, uint32_t triangleCount, uint32_t threadCount)
+{
+	PROFILE_FUNCTION();
+	const auto start = std::chrono::steady_clock::now();
+	Clear();
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	BuildContext context;
+	context.boundsMin.resize(triangleCount);
+	context.boundsMax.resize(triangleCount);
+	context.centroids.resize(triangleCount);
+	context.order.resize(triangleCount);
+	for (uint32_t i = 0; i < triangleCount; ++i)
+	{
+		const glm::vec3& p0 = vertices[indices[i * 3 + 0]].position;
+		const glm::vec3& p1 = vertices[indices[i * 3 + 1]].position;
+		const glm::vec3& p2 = vertices[indices[i * 3 + 2]].position;
+		context.boundsMin[i] = glm::min(p0, glm::min(p1, p2));
+		context.boundsMax[i] = glm::max(p0, glm::max(p1, p2));
+		context.centroids[i] = (context.boundsMin[i] + context.boundsMax[i]) * 0.5f;
+		context.order[i] = i;
+	}
+
+	// a binary tree with at least one triangle per leaf never needs more nodes than this
+	m_Nodes.resize(triangleCount * 2 - 1);
+	const uint32_t threads = threadCount ? threadCount : std::max(std::thread::hardware_concurrency(), 1u);
+	BuildNode(context, 0, 0, triangleCount, 0, threads);
+	m_Nodes.resize(context.nodeCount.load());
+	m_Nodes.shrink_to_fit();
+
+	// the triangles in the order the leaves reference them
+	m_Triangles.resize(triangleCount);
+	m_TriangleIds.resize(triangleCount);
+	m_Corners.resize(triangleCount * 3);
+	for (uint32_t i = 0; i < triangleCount; ++i)
+	{
+		const uint32_t id = context.order[i];
+		m_TriangleIds[i] = id;
+		for (uint32_t corner = 0; corner < 3; ++corner)
+		{
+			m_Corners[i * 3 + corner] = indices[id * 3 + corner];
+		}
+		const glm::vec3& p0 = vertices[m_Corners[i * 3 + 0]].position;
+		m_Triangles[i] = { p0, vertices[m_Corners[i * 3 + 1]].position - p0, vertices[m_Corners[i * 3 + 2]].position - p0 };
+	}
+
+	m_Stats.triangles = triangleCount;
+	m_Stats.nodes = static_cast<uint32_t>(m_Nodes.size());
+	m_Stats.leaves = context.leafCount.load();
+	m_Stats.maxDepth = context.maxDepth.load();
+	m_Stats.threads = context.threads.load();
+	m_Stats.buildMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	m_Stats.sahCost = ComputeSahCost();
+}
+
+void Bvh::BuildNode(BuildContext& context, uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth, uint32_t threadBudget)
+{
+	BvhNode& node = m_Nodes[nodeIndex];
+	glm::vec3 boundsMin(FLT_MAX);
+	glm::vec3 boundsMax(-FLT_MAX);
+	glm::vec3 centroidMin(FLT_MAX);
+	glm::vec3 centroidMax(-FLT_MAX);
+	for (uint32_t i = first; i < first + count; ++i)
+	{
+		const uint32_t id = context.order[i];
+		boundsMin = glm::min(boundsMin, context.boundsMin[id]);
+		boundsMax = glm::max(boundsMax, context.boundsMax[id]);
+		centroidMin = glm::min(centroidMin, context.centroids[id]);
+		centroidMax = glm::max(centroidMax, context.centroids[id]);
+	}
+	node.boundsMin = boundsMin;
+	node.boundsMax = boundsMax;
+	AtomicMax(context.maxDepth, depth);
+
+	const auto makeLeaf = [&]()
+	{
+		node.offset = first;
+		node.triangleCount = static_cast<uint16_t>(count);
+		node.axis = 0;
+		context.leafCount++;
+	};
+	// the traversal stack holds one entry per level
+	if (count == 1 || (depth + 1 >= BVH_STACK_SIZE && count <= UINT16_MAX))
+	{
+		makeLeaf();
+		return;
+	}
+
+	// every triangle goes into a bin by its centroid on each axis, the SAH is evaluated at the planes between the bins
+	int bestAxis = -1;
+	uint32_t bestPlane = 0;
+	float bestCost = FLT_MAX;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float extent = centroidMax[axis] - centroidMin[axis];
+		if (extent <= 0.f)
+		{
+			continue;
+		}
+		const float scale = BVH_BINS / extent;
+
+		Bin bins[BVH_BINS];
+		for (uint32_t i = first; i < first + count; ++i)
+		{
+			const uint32_t id = context.order[i];
+			Bin& bin = bins[std::min<uint32_t>(BVH_BINS - 1, static_cast<uint32_t>((context.centroids[id][axis] - centroidMin[axis]) * scale))];
+			bin.boundsMin = glm::min(bin.boundsMin, context.boundsMin[id]);
+			bin.boundsMax = glm::max(bin.boundsMax, context.boundsMax[id]);
+			bin.count++;
+		}
+
+		float rightArea[BVH_BINS - 1];
+		uint32_t rightCount[BVH_BINS - 1];
+		Bin right;
+		for (uint32_t plane = BVH_BINS - 1; plane > 0; --plane)
+		{
+			right.boundsMin = glm::min(right.boundsMin, bins[plane].boundsMin);
+			right.boundsMax = glm::max(right.boundsMax, bins[plane].boundsMax);
+			right.count += bins[plane].count;
+			rightArea[plane - 1] = right.count ? HalfArea(right.boundsMin, right.boundsMax) : 0.f;
+			rightCount[plane - 1] = right.count;
+		}
+
+		Bin left;
+		for (uint32_t plane = 0; plane < BVH_BINS - 1; ++plane)
+		{
+			left.boundsMin = glm::min(left.boundsMin, bins[plane].boundsMin);
+			left.boundsMax = glm::max(left.boundsMax, bins[plane].boundsMax);
+			left.count += bins[plane].count;
+			if (left.count == 0 || rightCount[plane] == 0)
+			{
+				continue;
+			}
+			const float cost = left.count * HalfArea(left.boundsMin, left.boundsMax) + rightCount[plane] * rightArea[plane];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestPlane = plane;
+			}
+		}
+	}
+
+	uint32_t leftCount = count / 2;
+	if (bestAxis >= 0)
+	{
+		// both in units of triangle tests
+		const float splitCost = BVH_TRAVERSAL_COST + bestCost / std::max(HalfArea(boundsMin, boundsMax), FLT_MIN);
+		if (count <= BVH_MAX_LEAF_TRIANGLES && static_cast<float>(count) <= splitCost)
+		{
+			makeLeaf();
+			return;
+		}
+
+		const float scale = BVH_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+		const auto middle = std::partition(context.order.begin() + first, context.order.begin() + first + count, [&](uint32_t id)
+			{
+				return std::min<uint32_t>(BVH_BINS - 1, static_cast<uint32_t>((context.centroids[id][bestAxis] - centroidMin[bestAxis]) * scale)) <= bestPlane;
+			});
+		leftCount = static_cast<uint32_t>(middle - (context.order.begin() + first));
+	}
+	else if (count <= BVH_MAX_LEAF_TRIANGLES)
+	{
+		makeLeaf();
+		return;
+	}
+	// every centroid in one spot, no plane separates them, the range is halved as it is
+	if (leftCount == 0 || leftCount == count)
+	{
+		leftCount = count / 2;
+	}
+
+	const uint32_t children = context.nodeCount.fetch_add(2);
+	node.offset = children;
+	node.triangleCount = 0;
+	node.axis = static_cast<uint16_t>(std::max(bestAxis, 0));
+
+	if (count > BVH_PARALLEL_THRESHOLD && threadBudget > 1)
+	{
+		context.threads++;
+		std::thread worker([&, children, first, leftCount, depth, threadBudget]()
+			{
+				PROFILE_THREAD("bvh build");
+				BuildNode(context, children, first, leftCount, depth + 1, threadBudget / 2);
+			});
+		BuildNode(context, children + 1, first + leftCount, count - leftCount, depth + 1, threadBudget - threadBudget / 2);
+		worker.join();
+	}
+	else
+	{
+		BuildNode(context, children, first, leftCount, depth + 1, 1);
+		BuildNode(context, children + 1, first + leftCount, count - leftCount, depth + 1, 1);
+	}
+}
+
+float Bvh::ComputeSahCost() const
+{
+	if (m_Nodes.empty())
+	{
+		return 0.f;
+	}
+	const float rootArea = std::max(HalfArea(m_Nodes[0].boundsMin, m_Nodes[0].boundsMax), FLT_MIN);
+	float cost = 0.f;
+	for (const BvhNode& node : m_Nodes)
+	{
+		const float area = HalfArea(node.boundsMin, node.boundsMax) / rootArea;
+		cost += node.IsLeaf() ? area * node.triangleCount : area * BVH_TRAVERSAL_COST;
+	}
+	return cost;
+}
+
+void Bvh::Refit(const Vertex* vertices)
+{
+	PROFILE_FUNCTION();
+	for (size_t i = 0; i < m_Triangles.size(); ++i)
+	{
+		const glm::vec3& p0 = vertices[m_Corners[i * 3 + 0]].position;
+		m_Triangles[i] = { p0, vertices[m_Corners[i * 3 + 1]].position - p0, vertices[m_Corners[i * 3 + 2]].position - p0 };
+	}
+
+	// children are always stored after their parent, walking backwards finishes them first
+	for (size_t i = m_Nodes.size(); i-- > 0;)
+	{
+		BvhNode& node = m_Nodes[i];
+		if (node.IsLeaf())
+		{
+			node.boundsMin = glm::vec3(FLT_MAX);
+			node.boundsMax = glm::vec3(-FLT_MAX);
+			for (uint32_t t = node.offset; t < node.offset + node.triangleCount; ++t)
+			{
+				const Triangle& triangle = m_Triangles[t];
+				const glm::vec3 p1 = triangle.v0 + triangle.edge1;
+				const glm::vec3 p2 = triangle.v0 + triangle.edge2;
+				node.boundsMin = glm::min(node.boundsMin, glm::min(triangle.v0, glm::min(p1, p2)));
+				node.boundsMax = glm::max(node.boundsMax, glm::max(triangle.v0, glm::max(p1, p2)));
+			}
+		}
+		else
+		{
+			const BvhNode& first = m_Nodes[node.offset];
+			const BvhNode& second = m_Nodes[node.offset + 1];
+			node.boundsMin = glm::min(first.boundsMin, second.boundsMin);
+			node.boundsMax = glm::max(first.boundsMax, second.boundsMax);
+		}
+	}
+	m_Stats.sahCost = ComputeSahCost();
+}
+
+void Bvh::Clear()
+{
+	m_Nodes.clear();
+	m_Triangles.clear();
+	m_TriangleIds.clear();
+	m_Corners.clear();
+	m_Stats = BvhStats{};
+}
+
+bool Bvh::Intersect(const Ray& ray, RayHit& outHit) const
+{
+	outHit.t = ray.tMax;
+	outHit.triangle = BVH_INVALID;
+	if (m_Nodes.empty())
+	{
+		return false;
+	}
+
+	const glm::vec3 inverseDirection = 1.f / ray.direction;
+	if (IntersectBox(m_Nodes[0], ray.origin, inverseDirection, outHit.t) == FLT_MAX)
+	{
+		return false;
+	}
+
+	// far children with the distance the ray enters them at
+	struct StackEntry
+	{
+		uint32_t node;
+		float entry;
+	};
+	StackEntry stack[BVH_STACK_SIZE];
+	uint32_t stackSize = 0;
+	uint32_t nodeIndex = 0;
+	for (;;)
+	{
+		const BvhNode& node = m_Nodes[nodeIndex];
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = node.offset; i < node.offset + node.triangleCount; ++i)
+			{
+				const Triangle& triangle = m_Triangles[i];
+				if (IntersectTriangle(ray.origin, ray.direction, triangle.v0, triangle.edge1, triangle.edge2, outHit.t, outHit.t, outHit.u, outHit.v))
+				{
+					outHit.triangle = m_TriangleIds[i];
+				}
+			}
+		}
+		else
+		{
+			// nearer child first, the farther one is skipped later when a hit closer than its entry was found
+			uint32_t nearChild = node.offset;
+			uint32_t farChild = node.offset + 1;
+			float nearDistance = IntersectBox(m_Nodes[nearChild], ray.origin, inverseDirection, outHit.t);
+			float farDistance = IntersectBox(m_Nodes[farChild], ray.origin, inverseDirection, outHit.t);
+			if (farDistance < nearDistance)
+			{
+				std::swap(nearChild, farChild);
+				std::swap(nearDistance, farDistance);
+			}
+			if (nearDistance != FLT_MAX)
+			{
+				if (farDistance != FLT_MAX)
+				{
+					stack[stackSize++] = { farChild, farDistance };
+				}
+				nodeIndex = nearChild;
+				continue;
+			}
+		}
+
+		// the near subtree may have hit something in front of a pushed child, then nothing in that child can be closer
+		bool found = false;
+		while (stackSize > 0 && !found)
+		{
+			const StackEntry& entry = stack[--stackSize];
+			nodeIndex = entry.node;
+			found = entry.entry <= outHit.t;
+		}
+		if (!found)
+		{
+			break;
+		}
+	}
+	return outHit.IsHit();
+}
+
+bool Bvh::IsOccluded(const Ray& ray) const
+{
+	if (m_Nodes.empty())
+	{
+		return false;
+	}
+
+	const glm::vec3 inverseDirection = 1.f / ray.direction;
+	uint32_t stack[BVH_STACK_SIZE];
+	uint32_t stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const BvhNode& node = m_Nodes[stack[--stackSize]];
+		if (IntersectBox(node, ray.origin, inverseDirection, ray.tMax) == FLT_MAX)
+		{
+			continue;
+		}
+		if (!node.IsLeaf())
+		{
+			stack[stackSize++] = node.offset + 1;
+			stack[stackSize++] = node.offset;
+			continue;
+		}
+		for (uint32_t i = node.offset; i < node.offset + node.triangleCount; ++i)
+		{
+			const Triangle& triangle = m_Triangles[i];
+			float t;
+			float u;
+			float v;
+			if (IntersectTriangle(ray.origin, ray.direction, triangle.v0, triangle.edge1, triangle.edge2, ray.tMax, t, u, v))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+void Bvh::IntersectPacket(const RayPacket& packet, RayPacketHit& outHit) const
+{
+	for (uint32_t lane = 0; lane < 4; ++lane)
+	{
+		outHit.t[lane] = packet.tMax[lane];
+		outHit.triangle[lane] = BVH_INVALID;
+		outHit.u[lane] = 0.f;
+		outHit.v[lane] = 0.f;
+	}
+	if (m_Nodes.empty())
+	{
+		return;
+	}
+
+#ifdef INFERNO_BVH_SSE2
+	const __m128 originX = _mm_loadu_ps(packet.originX);
+	const __m128 originY = _mm_loadu_ps(packet.originY);
+	const __m128 originZ = _mm_loadu_ps(packet.originZ);
+	const __m128 directionX = _mm_loadu_ps(packet.directionX);
+	const __m128 directionY = _mm_loadu_ps(packet.directionY);
+	const __m128 directionZ = _mm_loadu_ps(packet.directionZ);
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 inverseX = _mm_div_ps(one, directionX);
+	const __m128 inverseY = _mm_div_ps(one, directionY);
+	const __m128 inverseZ = _mm_div_ps(one, directionZ);
+	const __m128 signMask = _mm_set1_ps(-0.f);
+	const __m128 epsilon = _mm_set1_ps(1e-12f);
+
+	__m128 bestT = _mm_loadu_ps(packet.tMax);
+	__m128 bestU = zero;
+	__m128 bestV = zero;
+	__m128i bestTriangle = _mm_set1_epi32(static_cast<int>(BVH_INVALID));
+
+	// which lanes enter the node before their closest hit so far
+	const auto boxMask = [&](const BvhNode& node)
+	{
+		const __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.x), originX), inverseX);
+		const __m128 t2x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.x), originX), inverseX);
+		const __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.y), originY), inverseY);
+		const __m128 t2y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.y), originY), inverseY);
+		const __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMin.z), originZ), inverseZ);
+		const __m128 t2z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundsMax.z), originZ), inverseZ);
+		const __m128 entry = _mm_max_ps(_mm_max_ps(_mm_min_ps(t1x, t2x), _mm_min_ps(t1y, t2y)), _mm_max_ps(_mm_min_ps(t1z, t2z), zero));
+		const __m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(t1x, t2x), _mm_max_ps(t1y, t2y)), _mm_min_ps(_mm_max_ps(t1z, t2z), bestT));
+		return _mm_movemask_ps(_mm_cmple_ps(entry, exit));
+	};
+
+	if (boxMask(m_Nodes[0]) == 0)
+	{
+		return;
+	}
+
+	// the packet's first ray picks the child order, the rays of a coherent packet agree on it
+	const float firstDirection[3] = { packet.directionX[0], packet.directionY[0], packet.directionZ[0] };
+	uint32_t stack[BVH_STACK_SIZE];
+	uint32_t stackSize = 0;
+	uint32_t nodeIndex = 0;
+	for (;;)
+	{
+		const BvhNode& node = m_Nodes[nodeIndex];
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = node.offset; i < node.offset + node.triangleCount; ++i)
+			{
+				const Triangle& triangle = m_Triangles[i];
+				const __m128 edge1X = _mm_set1_ps(triangle.edge1.x);
+				const __m128 edge1Y = _mm_set1_ps(triangle.edge1.y);
+				const __m128 edge1Z = _mm_set1_ps(triangle.edge1.z);
+				const __m128 edge2X = _mm_set1_ps(triangle.edge2.x);
+				const __m128 edge2Y = _mm_set1_ps(triangle.edge2.y);
+				const __m128 edge2Z = _mm_set1_ps(triangle.edge2.z);
+
+				const __m128 pX = _mm_sub_ps(_mm_mul_ps(directionY, edge2Z), _mm_mul_ps(edge2Y, directionZ));
+				const __m128 pY = _mm_sub_ps(_mm_mul_ps(directionZ, edge2X), _mm_mul_ps(edge2Z, directionX));
+				const __m128 pZ = _mm_sub_ps(_mm_mul_ps(directionX, edge2Y), _mm_mul_ps(edge2X, directionY));
+				const __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge1X, pX), _mm_mul_ps(edge1Y, pY)), _mm_mul_ps(edge1Z, pZ));
+				const __m128 inverse = _mm_div_ps(one, determinant);
+
+				const __m128 sX = _mm_sub_ps(originX, _mm_set1_ps(triangle.v0.x));
+				const __m128 sY = _mm_sub_ps(originY, _mm_set1_ps(triangle.v0.y));
+				const __m128 sZ = _mm_sub_ps(originZ, _mm_set1_ps(triangle.v0.z));
+				const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sX, pX), _mm_mul_ps(sY, pY)), _mm_mul_ps(sZ, pZ)), inverse);
+				const __m128 qX = _mm_sub_ps(_mm_mul_ps(sY, edge1Z), _mm_mul_ps(edge1Y, sZ));
+				const __m128 qY = _mm_sub_ps(_mm_mul_ps(sZ, edge1X), _mm_mul_ps(edge1Z, sX));
+				const __m128 qZ = _mm_sub_ps(_mm_mul_ps(sX, edge1Y), _mm_mul_ps(edge1X, sY));
+				const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(directionX, qX), _mm_mul_ps(directionY, qY)), _mm_mul_ps(directionZ, qZ)), inverse);
+				const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edge2X, qX), _mm_mul_ps(edge2Y, qY)), _mm_mul_ps(edge2Z, qZ)), inverse);
+
+				__m128 hit = _mm_cmpgt_ps(_mm_andnot_ps(signMask, determinant), epsilon);
+				hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)));
+				hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+				hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmplt_ps(t, bestT)));
+				if (_mm_movemask_ps(hit) == 0)
+				{
+					continue;
+				}
+				bestT = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, bestT));
+				bestU = _mm_or_ps(_mm_and_ps(hit, u), _mm_andnot_ps(hit, bestU));
+				bestV = _mm_or_ps(_mm_and_ps(hit, v), _mm_andnot_ps(hit, bestV));
+				const __m128i hitInt = _mm_castps_si128(hit);
+				bestTriangle = _mm_or_si128(_mm_and_si128(hitInt, _mm_set1_epi32(static_cast<int>(m_TriangleIds[i]))), _mm_andnot_si128(hitInt, bestTriangle));
+			}
+		}
+		else
+		{
+			const bool secondFirst = firstDirection[node.axis] < 0.f;
+			const uint32_t nearChild = node.offset + (secondFirst ? 1 : 0);
+			const uint32_t farChild = node.offset + (secondFirst ? 0 : 1);
+			const bool nearHit = boxMask(m_Nodes[nearChild]) != 0;
+			const bool farHit = boxMask(m_Nodes[farChild]) != 0;
+			if (nearHit || farHit)
+			{
+				if (nearHit && farHit)
+				{
+					stack[stackSize++] = farChild;
+				}
+				nodeIndex = nearHit ? nearChild : farChild;
+				continue;
+			}
+		}
+
+		// popped nodes are tested again, every lane may have found a closer hit since they were pushed
+		bool found = false;
+		while (stackSize > 0 && !found)
+		{
+			nodeIndex = stack[--stackSize];
+			found = boxMask(m_Nodes[nodeIndex]) != 0;
+		}
+		if (!found)
+		{
+			break;
+		}
+	}
+
+	_mm_storeu_ps(outHit.t, bestT);
+	_mm_storeu_ps(outHit.u, bestU);
+	_mm_storeu_ps(outHit.v, bestV);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(outHit.triangle), bestTriangle);
+#else
+	for (uint32_t lane = 0; lane < 4; ++lane)
+	{
+		const Ray ray{ { packet.originX[lane], packet.originY[lane], packet.originZ[lane] }, packet.tMax[lane],
+			{ packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane] } };
+		RayHit hit;
+		Intersect(ray, hit);
+		outHit.t[lane] = hit.t;
+		outHit.triangle[lane] = hit.triangle;
+		outHit.u[lane] = hit.u;
+		outHit.v[lane] = hit.v;
+	}
+#endif
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+struct Mesh;
+struct Vertex;
+
+// centroid bins per axis the SAH split is searched over
+#define BVH_BINS 16
+// a node with this few triangles becomes a leaf when no split is cheaper, larger ones are always split
+#define BVH_MAX_LEAF_TRIANGLES 8
+// cost of a node visit relative to a triangle test in the SAH
+#define BVH_TRAVERSAL_COST 1.f
+// subtrees with more triangles than this build their first child on another thread
+#define BVH_PARALLEL_THRESHOLD 8192
+#define BVH_STACK_SIZE 64
+#define BVH_INVALID 0xffffffffu
+
+struct Ray
+{
+	glm::vec3 origin;
+	float tMax;
+	// does not need to be normalized, t is measured in its length
+	glm::vec3 direction;
+};
+
+struct RayHit
+{
+	float t;
+	// index of the triangle's first corner in the built index list divided by 3, BVH_INVALID on a miss
+	uint32_t triangle = BVH_INVALID;
+	// barycentrics of corners 1 and 2
+	float u;
+	float v;
+
+	bool IsHit() const { return triangle != BVH_INVALID; }
+};
+
+// four rays in SoA layout, traced together by IntersectPacket
+struct RayPacket
+{
+	float originX[4], originY[4], originZ[4];
+	float directionX[4], directionY[4], directionZ[4];
+	float tMax[4];
+
+	void Set(uint32_t lane, const Ray& ray);
+};
+
+struct RayPacketHit
+{
+	float t[4];
+	uint32_t triangle[4];
+	float u[4];
+	float v[4];
+
+	RayHit Get(uint32_t lane) const { return { t[lane], triangle[lane], u[lane], v[lane] }; }
+};
+
+// 32 bytes, two to a cache line. siblings are stored next to each other
+struct BvhNode
+{
+	glm::vec3 boundsMin;
+	// leaf: first triangle in the Bvh's order, inner node: index of the first child, the second one follows it
+	uint32_t offset;
+	glm::vec3 boundsMax;
+	// 0 for inner nodes
+	uint16_t triangleCount;
+	// inner nodes: the axis the children were split on, traversal visits the child nearer the ray first
+	uint16_t axis;
+
+	bool IsLeaf() const { return triangleCount > 0; }
+};
+
+struct BvhStats
+{
+	uint32_t triangles = 0;
+	uint32_t nodes = 0;
+	uint32_t leaves = 0;
+	uint32_t maxDepth = 0;
+	uint32_t threads = 0;
+	float buildMs = 0.f;
+	// SAH cost of the whole tree, lower traces faster
+	float sahCost = 0.f;
+};
+
+// Bounding volume hierarchy over a triangle list for CPU ray queries: picking, line of sight and collision probes.
+// Built top down with binned SAH, subtrees above BVH_PARALLEL_THRESHOLD triangles are built on their own threads.
+// Nodes are allocated in sibling pairs from one flat array, children always come after their parent,
+// which lets Refit update the bounds of deformed geometry in one backwards sweep without rebuilding.
+// Triangles are copied in tree order as a corner and two edges, so a leaf's triangles are read back to back.
+class Bvh
+{
+public:
+	// positions are read from vertices through indices, three per triangle. threadCount 0 uses every hardware thread
+	void Build(const Vertex* vertices, const uint32_t* indices, uint32_t triangleCount, uint32_t threadCount = 0);
+	void Build(const Mesh& mesh, uint32_t threadCount = 0);
+	// the vertices moved but the triangles are the same ones Build saw, bounds are updated, the tree shape is kept.
+	// traversal gets slower the further the geometry moved from the shape it was built for, rebuild then
+	void Refit(const Vertex* vertices);
+	void Clear();
+	bool IsEmpty() const { return m_Nodes.empty(); }
+
+	// closest hit along the ray, false on a miss
+	bool Intersect(const Ray& ray, RayHit& outHit) const;
+	// whether anything is hit before ray.tMax, stops at the first hit
+	bool IsOccluded(const Ray& ray) const;
+	// four rays at once, SSE where available, coherent rays (neighbouring pixels) share most node visits
+	void IntersectPacket(const RayPacket& packet, RayPacketHit& outHit) const;
+
+	const std::vector<BvhNode>& GetNodes() const { return m_Nodes; }
+	const BvhStats& GetStats() const { return m_Stats; }
+
+private:
+	struct Triangle
+	{
+		glm::vec3 v0;
+		glm::vec3 edge1;
+		glm::vec3 edge2;
+	};
+
+	struct BuildContext;
+
+	void BuildNode(BuildContext& context, uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth, uint32_t threadBudget);
+	float ComputeSahCost() const;
+
+	std::vector<BvhNode> m_Nodes;
+	std::vector<Triangle> m_Triangles;
+	// original triangle index of every triangle in tree order
+	std::vector<uint32_t> m_TriangleIds;
+	// the three corners of every triangle in tree order, for Refit
+	std::vector<uint32_t> m_Corners;
+	BvhStats m_Stats;
+};
@@ -0,0 +1,145 @@
+#include "CameraPath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+	glm::vec3 CatmullRom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t)
+	{
+		const float t2 = t * t;
+		const float t3 = t2 * t;
+		return 0.5f * ((2.f * p1) + (-p0 + p2) * t + (2.f * p0 - 5.f * p1 + 4.f * p2 - p3) * t2 + (-p0 + 3.f * p1 - 3.f * p2 + p3) * t3);
+	}
+}
+
+void CameraPath::AddKey(const CameraKey& key)
+{
+	// keys stay sorted so Evaluate can binary search
+	auto it = std::upper_bound(m_Keys.begin(), m_Keys.end(), key.time, [](float time, const CameraKey& other)
+		{
+			return time < other.time;
+		});
+	m_Keys.insert(it, key);
+}
+
+void CameraPath::Evaluate(float time, glm::vec3& outPosition, glm::vec3& outTarget) const
+{
+	if (m_Keys.empty())
+	{
+		return;
+	}
+	if (m_Keys.size() == 1)
+	{
+		outPosition = m_Keys[0].position;
+		outTarget = m_Keys[0].target;
+		return;
+	}
+
+	const float duration = GetDuration();
+	if (m_Loop && duration > 0.f)
+	{
+		time = std::fmod(time, duration);
+		if (time < 0.f)
+		{
+			time += duration;
+		}
+	}
+	time = std::clamp(time, m_Keys.front().time, duration);
+
+	auto it = std::upper_bound(m_Keys.begin(), m_Keys.end(), time, [](float t, const CameraKey& key)
+		{
+			return t < key.time;
+		});
+	const size_t last = m_Keys.size() - 1;
+	const size_t i1 = std::min(static_cast<size_t>(std::max<ptrdiff_t>(it - m_Keys.begin() - 1, 0)), last - 1);
+	const size_t i2 = i1 + 1;
+
+	// the neighbours wrap on looping paths, otherwise the end keys are repeated
+	size_t i0 = i1 > 0 ? i1 - 1 : (m_Loop ? last - 1 : 0);
+	size_t i3 = i2 < last ? i2 + 1 : (m_Loop ? 1 : last);
+	i0 = std::min(i0, last);
+	i3 = std::min(i3, last);
+
+	const float span = m_Keys[i2].time - m_Keys[i1].time;
+	const float t = span > 0.f ? (time - m_Keys[i1].time) / span : 0.f;
+
+	outPosition = CatmullRom(m_Keys[i0].position, m_Keys[i1].position, m_Keys[i2].position, m_Keys[i3].position, t);
+	outTarget = CatmullRom(m_Keys[i0].target, m_Keys[i1].target, m_Keys[i2].target, m_Keys[i3].target, t);
+}
+
+bool CameraPath::LoadFromFile(const std::string& path)
+{
+	std::ifstream file(path);
+	if (!file.is_open())
+	{
+		std::cout << "failed to open camera path " << path << std::endl;
+		return false;
+	}
+
+	m_Keys.clear();
+	m_Loop = false;
+
+	std::string line;
+	uint32_t lineNumber = 0;
+	while (std::getline(file, line))
+	{
+		lineNumber++;
+		const size_t comment = line.find('#');
+		if (comment != std::string::npos)
+		{
+			line.resize(comment);
+		}
+
+		std::istringstream stream(line);
+		std::string first;
+		if (!(stream >> first))
+		{
+			continue;
+		}
+		if (first == "loop")
+		{
+			m_Loop = true;
+			continue;
+		}
+
+		CameraKey key;
+		stream.str(line);
+		stream.clear();
+		if (!(stream >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.target.x >> key.target.y >> key.target.z))
+		{
+			std::cout << path << ":" << lineNumber << ": expected time px py pz tx ty tz" << std::endl;
+			return false;
+		}
+		AddKey(key);
+	}
+
+	if (m_Keys.empty())
+	{
+		std::cout << "camera path " << path << " has no keys" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+CameraPath CameraPath::Orbit(const glm::vec3& center, float radius, float height, float duration, uint32_t keyCount)
+{
+	CameraPath path;
+	keyCount = std::max(keyCount, 3u);
+	for (uint32_t i = 0; i <= keyCount; ++i)
+	{
+		const float fraction = static_cast<float>(i) / keyCount;
+		const float angle = fraction * 6.2831853f;
+
+		CameraKey key;
+		key.time = fraction * duration;
+		key.position = center + glm::vec3(std::sin(angle) * radius, height, std::cos(angle) * radius);
+		key.target = center;
+		path.AddKey(key);
+	}
+	path.SetLooping(true);
+	return path;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+struct CameraKey
+{
+	float time;
+	glm::vec3 position;
+	glm::vec3 target;
+};
+
+// Keyframed camera, positions and targets are interpolated with a Catmull-Rom spline so
+// scripted runs see the same views regardless of frame rate.
+class CameraPath
+{
+public:
+	void AddKey(const CameraKey& key);
+	void Clear() { m_Keys.clear(); }
+	bool IsEmpty() const { return m_Keys.empty(); }
+	float GetDuration() const { return m_Keys.empty() ? 0.f : m_Keys.back().time; }
+	void SetLooping(bool loop) { m_Loop = loop; }
+
+	void Evaluate(float time, glm::vec3& outPosition, glm::vec3& outTarget) const;
+
+	// one key per line: "time px py pz tx ty tz", a line reading "loop" closes the path, # starts a comment
+	bool LoadFromFile(const std::string& path);
+
+	// evenly spaced keys on a circle around center, one revolution per duration
+	static CameraPath Orbit(const glm::vec3& center, float radius, float height, float duration, uint32_t keyCount = 16);
+
+private:
+	std::vector<CameraKey> m_Keys;
+	bool m_Loop{ false };
+};
@@ -0,0 +1,205 @@
+#include "CpuProfiler.h"
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+std::atomic<bool> CpuProfiler::s_Recording{ false };
+
+namespace
+{
+	thread_local void* t_ThreadBuffer = nullptr;
+
+	void WriteEscaped(std::ofstream& file, const char* text)
+	{
+		for (const char* c = text; *c; ++c)
+		{
+			if (*c == '"' || *c == '\\')
+			{
+				file << '\\';
+			}
+			file << *c;
+		}
+	}
+}
+
+CpuProfiler& CpuProfiler::Get()
+{
+	static CpuProfiler profiler;
+	return profiler;
+}
+
+void CpuProfiler::RequestStartupCapture(const std::string& path)
+{
+#ifndef INFERNO_PROFILE
+	std::cout << "built without INFERNO_PROFILE, the startup trace will be empty" << std::endl;
+#endif
+	m_StartupPath = path;
+}
+
+void CpuProfiler::RequestFrameCapture(uint64_t firstFrame, uint32_t frameCount, const std::string& path)
+{
+#ifndef INFERNO_PROFILE
+	std::cout << "built without INFERNO_PROFILE, the frame trace will be empty" << std::endl;
+#endif
+	m_FirstFrame = firstFrame;
+	m_FrameCount = frameCount;
+	m_FramePath = path;
+}
+
+void CpuProfiler::BeginStartup()
+{
+	if (!m_StartupPath.empty())
+	{
+		StartCapture();
+	}
+}
+
+void CpuProfiler::EndStartup()
+{
+	if (m_StartupPath.empty())
+	{
+		return;
+	}
+
+	StopCapture();
+	WriteTrace(m_StartupPath, m_CaptureBegin, Now());
+	m_StartupPath.clear();
+}
+
+void CpuProfiler::OnFrame(uint64_t frame)
+{
+	if (m_FramePath.empty())
+	{
+		return;
+	}
+
+	if (frame == m_FirstFrame)
+	{
+		StartCapture();
+	}
+	else if (frame == m_FirstFrame + m_FrameCount)
+	{
+		Finish();
+	}
+}
+
+void CpuProfiler::Finish()
+{
+	if (m_FramePath.empty() || !IsRecording())
+	{
+		return;
+	}
+
+	StopCapture();
+	WriteTrace(m_FramePath, m_CaptureBegin, Now());
+	m_FramePath.clear();
+}
+
+void CpuProfiler::SetThreadName(const char* name)
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+	std::lock_guard<std::mutex> lock(m_ThreadsMutex);
+	buffer.name = name;
+}
+
+int64_t CpuProfiler::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void CpuProfiler::Record(const char* name, int64_t begin, int64_t end)
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+
+	// single writer per buffer, the release store publishes the event to WriteTrace
+	const uint64_t index = buffer.written.load(std::memory_order_relaxed);
+	buffer.events[index % CPUPROFILER_EVENTS_PER_THREAD] = { name, begin, end };
+	buffer.written.store(index + 1, std::memory_order_release);
+}
+
+bool CpuProfiler::WriteTrace(const std::string& path, int64_t from, int64_t to) const
+{
+	std::ofstream file(path);
+	if (!file.is_open())
+	{
+		std::cout << "failed to open trace file " << path << std::endl;
+		return false;
+	}
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Inferno\"}}";
+
+	size_t eventCount = 0;
+	std::lock_guard<std::mutex> lock(m_ThreadsMutex);
+	for (const std::unique_ptr<ThreadBuffer>& buffer : m_Threads)
+	{
+		file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId << ",\"args\":{\"name\":\"";
+		WriteEscaped(file, buffer->name.c_str());
+		file << "\"}}";
+
+		const uint64_t written = buffer->written.load(std::memory_order_acquire);
+		const uint64_t first = written > CPUPROFILER_EVENTS_PER_THREAD ? written - CPUPROFILER_EVENTS_PER_THREAD : 0;
+
+		std::vector<CpuProfileEvent> events;
+		events.reserve(written - first);
+		for (uint64_t i = first; i < written; ++i)
+		{
+			events.push_back(buffer->events[i % CPUPROFILER_EVENTS_PER_THREAD]);
+		}
+
+		// drop whatever the owning thread wrapped over while we were copying
+		const uint64_t overwritten = buffer->written.load(std::memory_order_acquire) - first;
+		const size_t skip = overwritten > CPUPROFILER_EVENTS_PER_THREAD ? static_cast<size_t>(overwritten - CPUPROFILER_EVENTS_PER_THREAD) : 0;
+
+		for (size_t i = skip; i < events.size(); ++i)
+		{
+			const CpuProfileEvent& event = events[i];
+			if (event.begin < from || event.begin > to)
+			{
+				continue;
+			}
+
+			file << ",\n{\"name\":\"";
+			WriteEscaped(file, event.name);
+			file << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+				<< ",\"ts\":" << (event.begin - from) / 1000.0
+				<< ",\"dur\":" << (event.end - event.begin) / 1000.0 << "}";
+			eventCount++;
+		}
+	}
+
+	file << "\n]}\n";
+	std::cout << "wrote " << eventCount << " cpu zones to " << path << std::endl;
+	return true;
+}
+
+CpuProfiler::ThreadBuffer& CpuProfiler::GetThreadBuffer()
+{
+	if (t_ThreadBuffer)
+	{
+		return *static_cast<ThreadBuffer*>(t_ThreadBuffer);
+	}
+
+	// first zone on this thread, buffers stay owned by the profiler so traces can include finished threads
+	std::unique_ptr<ThreadBuffer> buffer = std::make_unique<ThreadBuffer>();
+	buffer->events = std::make_unique<CpuProfileEvent[]>(CPUPROFILER_EVENTS_PER_THREAD);
+
+	std::lock_guard<std::mutex> lock(m_ThreadsMutex);
+	buffer->threadId = static_cast<uint32_t>(m_Threads.size()) + 1;
+	buffer->name = "thread " + std::to_string(buffer->threadId);
+	t_ThreadBuffer = buffer.get();
+	m_Threads.push_back(std::move(buffer));
+	return *m_Threads.back();
+}
+
+void CpuProfiler::StartCapture()
+{
+	m_CaptureBegin = Now();
+	s_Recording.store(true, std::memory_order_relaxed);
+}
+
+void CpuProfiler::StopCapture()
+{
+	s_Recording.store(false, std::memory_order_relaxed);
+}
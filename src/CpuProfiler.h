@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define CPUPROFILER_EVENTS_PER_THREAD (1 << 16)
+
+struct CpuProfileEvent
+{
+	const char* name;
+	int64_t begin;
+	int64_t end;
+};
+
+// Scoped CPU zones for Chrome's about:tracing / Perfetto.
+// Every thread appends to its own ring of events, only that thread writes it so recording takes no lock.
+// Zones are only stored while a capture is running, a capture covers either the startup sequence
+// or a range of frames and is written out as trace json when it ends.
+class CpuProfiler
+{
+public:
+	static CpuProfiler& Get();
+
+	void RequestStartupCapture(const std::string& path);
+	void RequestFrameCapture(uint64_t firstFrame, uint32_t frameCount, const std::string& path);
+
+	// called by the engine around InitVulkan..LoadMeshes and at the top of every frame
+	void BeginStartup();
+	void EndStartup();
+	void OnFrame(uint64_t frame);
+	// writes a frame capture that was still running when the engine shut down
+	void Finish();
+
+	void SetThreadName(const char* name);
+
+	static bool IsRecording() { return s_Recording.load(std::memory_order_relaxed); }
+	static int64_t Now();
+	void Record(const char* name, int64_t begin, int64_t end);
+
+	bool WriteTrace(const std::string& path, int64_t from, int64_t to) const;
+
+private:
+	struct ThreadBuffer
+	{
+		uint32_t threadId;
+		std::string name;
+		// total events ever written, the ring holds the last CPUPROFILER_EVENTS_PER_THREAD of them
+		std::atomic<uint64_t> written{ 0 };
+		std::unique_ptr<CpuProfileEvent[]> events;
+	};
+
+	ThreadBuffer& GetThreadBuffer();
+	void StartCapture();
+	void StopCapture();
+
+	static std::atomic<bool> s_Recording;
+
+	mutable std::mutex m_ThreadsMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> m_Threads;
+
+	std::string m_StartupPath;
+	std::string m_FramePath;
+	uint64_t m_FirstFrame{ 0 };
+	uint32_t m_FrameCount{ 0 };
+
+	int64_t m_CaptureBegin{ 0 };
+};
+
+class CpuProfileScope
+{
+public:
+	CpuProfileScope(const char* name) : m_Name(name)
+	{
+		m_Begin = CpuProfiler::IsRecording() ? CpuProfiler::Now() : -1;
+	}
+	~CpuProfileScope()
+	{
+		if (m_Begin >= 0)
+		{
+			CpuProfiler::Get().Record(m_Name, m_Begin, CpuProfiler::Now());
+		}
+	}
+
+private:
+	const char* m_Name;
+	int64_t m_Begin;
+};
+
+// zones compile out unless the build defines INFERNO_PROFILE, names must outlive the capture (literals)
+#ifdef INFERNO_PROFILE
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) CpuProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__FUNCTION__)
+#define PROFILE_THREAD(name) CpuProfiler::Get().SetThreadName(name)
+#else
+#define PROFILE_SCOPE(name) do {} while(0)
+#define PROFILE_FUNCTION() do {} while(0)
+#define PROFILE_THREAD(name) do {} while(0)
+#endif
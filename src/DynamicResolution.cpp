@@ -0,0 +1,58 @@
+#include "DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+void DynamicResolution::Init(float budgetMs, float minScale)
+{
+	m_BudgetMs = std::max(budgetMs, 0.f);
+	m_MinScale = std::clamp(minScale, 0.1f, 1.f);
+	m_LastTimedFrame = UINT64_MAX;
+	m_Stats = DynamicResolutionStats{};
+	for (uint32_t i = 0; i < DYNAMICRESOLUTION_HISTORY; ++i)
+	{
+		m_FrameNumbers[i] = UINT64_MAX;
+		m_FrameScales[i] = 1.f;
+	}
+}
+
+void DynamicResolution::AddGpuTime(uint64_t frameNumber, float gpuMs)
+{
+	const uint32_t slot = frameNumber % DYNAMICRESOLUTION_HISTORY;
+	// the same timing is handed in every frame until the next one resolves
+	if (!IsEnabled() || gpuMs <= 0.f || frameNumber == m_LastTimedFrame || m_FrameNumbers[slot] != frameNumber)
+	{
+		return;
+	}
+	m_LastTimedFrame = frameNumber;
+	m_Stats.gpuMs = gpuMs;
+
+	const float targetMs = m_BudgetMs * DYNAMICRESOLUTION_TARGET;
+	const float error = gpuMs / targetMs - 1.f;
+	if (std::abs(error) <= DYNAMICRESOLUTION_DEADBAND)
+	{
+		return;
+	}
+
+	// pixels go with the square of the scale. the scale may have moved since the timed frame,
+	// then it only follows the timing further in the direction the timing asks for
+	const float ideal = std::clamp(m_FrameScales[slot] * std::sqrt(targetMs / gpuMs), m_MinScale, 1.f);
+	if (error > 0.f && ideal < m_Stats.scale)
+	{
+		m_Stats.scale = ideal;
+		m_Stats.drops++;
+	}
+	else if (error < 0.f && ideal > m_Stats.scale)
+	{
+		m_Stats.scale += (ideal - m_Stats.scale) * DYNAMICRESOLUTION_RAISE_RATE;
+		m_Stats.raises++;
+	}
+}
+
+float DynamicResolution::BeginFrame(uint64_t frameNumber)
+{
+	const uint32_t slot = frameNumber % DYNAMICRESOLUTION_HISTORY;
+	m_FrameNumbers[slot] = frameNumber;
+	m_FrameScales[slot] = m_Stats.scale;
+	return m_Stats.scale;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+// frames remembered with the scale they were rendered at, more than frames in flight ever lag behind
+#define DYNAMICRESOLUTION_HISTORY 8
+// the scale aims for this fraction of the budget, leaving room for spikes before frames run late
+#define DYNAMICRESOLUTION_TARGET 0.9f
+// gpu times within this fraction of the target leave the scale alone, so it does not wobble around the target
+#define DYNAMICRESOLUTION_DEADBAND 0.05f
+// fraction of the way to the ideal scale taken per timing when scaling back up, drops are taken at once
+#define DYNAMICRESOLUTION_RAISE_RATE 0.2f
+
+struct DynamicResolutionStats
+{
+	float scale = 1.f;
+	// last gpu frame time the scale reacted to
+	float gpuMs = 0.f;
+	uint32_t drops = 0;
+	uint32_t raises = 0;
+};
+
+// Picks the fraction of the output resolution the scene is rendered at, from measured GPU frame times.
+// GPU time is taken to grow with the pixel count, so every timing suggests the scale that would have met the target
+// at the resolution its frame was rendered with. Over budget the scale drops right away, under budget it climbs back slowly.
+class DynamicResolution
+{
+public:
+	void Init(float budgetMs, float minScale);
+	bool IsEnabled() const { return m_BudgetMs > 0.f; }
+
+	// the gpu time of a finished frame, frames resolve late so the scale it was rendered at is looked up
+	void AddGpuTime(uint64_t frameNumber, float gpuMs);
+	// scale of the frame about to be recorded
+	float BeginFrame(uint64_t frameNumber);
+
+	float GetScale() const { return m_Stats.scale; }
+	float GetBudgetMs() const { return m_BudgetMs; }
+	const DynamicResolutionStats& GetStats() const { return m_Stats; }
+
+private:
+	float m_BudgetMs{ 0.f };
+	float m_MinScale{ 1.f };
+	uint64_t m_LastTimedFrame{ UINT64_MAX };
+	uint64_t m_FrameNumbers[DYNAMICRESOLUTION_HISTORY] = {};
+	float m_FrameScales[DYNAMICRESOLUTION_HISTORY] = {};
+	DynamicResolutionStats m_Stats;
+};
@@ -0,0 +1,149 @@
+#include "FileWatcher.h"
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "CpuProfiler.h"
+
+namespace
+{
+	std::string JoinPath(const std::string& directory, const std::string& name)
+	{
+		return (std::filesystem::path(directory) / name).lexically_normal().generic_string();
+	}
+}
+
+#ifdef __linux__
+
+FileWatcher::~FileWatcher()
+{
+	if (m_Fd >= 0)
+	{
+		close(m_Fd);
+	}
+}
+
+bool FileWatcher::AddDirectory(const std::string& directory)
+{
+	if (m_Fd < 0)
+	{
+		m_Fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (m_Fd < 0)
+		{
+			std::cout << "inotify_init1 failed: " << strerror(errno) << std::endl;
+			return false;
+		}
+	}
+
+	// close after writing covers in place saves, moved to covers editors that write a temporary and rename it
+	const int watch = inotify_add_watch(m_Fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if (watch < 0)
+	{
+		std::cout << "cannot watch " << directory << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+	m_Directories[watch] = directory;
+	return true;
+}
+
+void FileWatcher::Poll(std::vector<std::string>& outChanged)
+{
+	PROFILE_FUNCTION();
+	outChanged.clear();
+	if (m_Fd < 0)
+	{
+		return;
+	}
+
+	alignas(inotify_event) char buffer[4096];
+	for (;;)
+	{
+		const ssize_t length = read(m_Fd, buffer, sizeof(buffer));
+		if (length <= 0)
+		{
+			// EAGAIN once the queue is empty
+			break;
+		}
+		for (ssize_t offset = 0; offset < length;)
+		{
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+			offset += sizeof(inotify_event) + event->len;
+
+			const auto directory = m_Directories.find(event->wd);
+			if (directory == m_Directories.end() || event->len == 0 || (event->mask & IN_ISDIR))
+			{
+				continue;
+			}
+			const std::string path = JoinPath(directory->second, event->name);
+			if (std::find(outChanged.begin(), outChanged.end(), path) == outChanged.end())
+			{
+				outChanged.push_back(path);
+			}
+		}
+	}
+}
+
+#else
+
+FileWatcher::~FileWatcher() = default;
+
+bool FileWatcher::AddDirectory(const std::string& directory)
+{
+	std::error_code error;
+	if (!std::filesystem::is_directory(directory, error))
+	{
+		std::cout << "cannot watch " << directory << ": not a directory" << std::endl;
+		return false;
+	}
+	// files already there are only reported once they change
+	for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+	{
+		if (entry.is_regular_file(error))
+		{
+			m_Times[JoinPath(directory, entry.path().filename().string())] = entry.last_write_time(error);
+		}
+	}
+	m_Directories.push_back(directory);
+	return true;
+}
+
+void FileWatcher::Poll(std::vector<std::string>& outChanged)
+{
+	PROFILE_FUNCTION();
+	outChanged.clear();
+	const auto now = std::chrono::steady_clock::now();
+	if (now - m_LastScan < std::chrono::milliseconds(FILEWATCHER_POLL_MS))
+	{
+		return;
+	}
+	m_LastScan = now;
+
+	for (const std::string& directory : m_Directories)
+	{
+		std::error_code error;
+		for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+		{
+			if (!entry.is_regular_file(error))
+			{
+				continue;
+			}
+			const std::string path = JoinPath(directory, entry.path().filename().string());
+			const std::filesystem::file_time_type time = entry.last_write_time(error);
+			auto known = m_Times.find(path);
+			if (known == m_Times.end() || known->second != time)
+			{
+				m_Times[path] = time;
+				outChanged.push_back(path);
+			}
+		}
+	}
+}
+
+#endif
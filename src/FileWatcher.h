@@ -0,0 +1,36 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// without inotify the watched directories are scanned for newer timestamps this often
+#define FILEWATCHER_POLL_MS 250
+
+// Reports files in watched directories that were written or replaced, subdirectories are not watched.
+// Uses inotify on Linux, so a change is seen once the writer closed the file or renamed it into place,
+// which is how editors save. Other platforms compare modification times.
+class FileWatcher
+{
+public:
+	FileWatcher() = default;
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+	~FileWatcher();
+
+	bool AddDirectory(const std::string& directory);
+	// paths are the watched directory joined with the file name, normalized, each reported once per poll
+	void Poll(std::vector<std::string>& outChanged);
+
+private:
+#ifdef __linux__
+	int m_Fd{ -1 };
+	std::unordered_map<int, std::string> m_Directories;
+#else
+	std::vector<std::string> m_Directories;
+	std::unordered_map<std::string, std::filesystem::file_time_type> m_Times;
+	std::chrono::steady_clock::time_point m_LastScan;
+#endif
+};
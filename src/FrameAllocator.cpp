@@ -0,0 +1,102 @@
+#include "FrameAllocator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#ifdef INFERNO_COUNT_ALLOCATIONS
+namespace
+{
+	// per thread so the streaming worker does not show up in the frame's count
+	thread_local uint64_t t_HeapAllocations = 0;
+}
+
+void* operator new(std::size_t size)
+{
+	t_HeapAllocations++;
+	if (void* memory = std::malloc(size ? size : 1))
+	{
+		return memory;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+uint64_t GetThreadHeapAllocations()
+{
+	return t_HeapAllocations;
+}
+#else
+uint64_t GetThreadHeapAllocations()
+{
+	return 0;
+}
+#endif
+
+FrameAllocator::FrameAllocator(size_t blockSize)
+	: m_BlockSize(blockSize)
+{
+}
+
+void* FrameAllocator::Allocate(size_t size, size_t alignment)
+{
+	for (;;)
+	{
+		if (m_Block < m_Blocks.size())
+		{
+			Block& block = m_Blocks[m_Block];
+			const uintptr_t base = reinterpret_cast<uintptr_t>(block.memory.get());
+			const uintptr_t aligned = (base + m_Offset + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+			const size_t end = static_cast<size_t>(aligned - base) + size;
+			if (end <= block.size)
+			{
+				m_Used += end - m_Offset;
+				m_Peak = std::max(m_Peak, m_Used);
+				m_Offset = end;
+				return reinterpret_cast<void*>(aligned);
+			}
+
+			// the rest of this block is skipped, a later reset makes it usable again
+			if (m_Block + 1 < m_Blocks.size())
+			{
+				m_Block++;
+				m_Offset = 0;
+				continue;
+			}
+		}
+
+		// the only heap allocation, once per block for the allocator's lifetime
+		Block block;
+		block.size = std::max(m_BlockSize, size + alignment);
+		block.memory.reset(new uint8_t[block.size]);
+		m_Blocks.push_back(std::move(block));
+		m_Block = static_cast<uint32_t>(m_Blocks.size()) - 1;
+		m_Offset = 0;
+	}
+}
+
+void FrameAllocator::Reset()
+{
+	m_Block = 0;
+	m_Offset = 0;
+	m_Used = 0;
+}
+
+size_t FrameAllocator::GetCapacity() const
+{
+	size_t capacity = 0;
+	for (const Block& block : m_Blocks)
+	{
+		capacity += block.size;
+	}
+	return capacity;
+}
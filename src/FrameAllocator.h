@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#define FRAMEALLOCATOR_BLOCK_SIZE (256 * 1024)
+
+// Linear allocator for data that only lives until the frame that built it has retired.
+// Allocate bumps an offset, there is no per allocation free, Reset hands back everything at once.
+// Blocks are kept over resets and another one is only added when a frame outgrows them,
+// so after the first frames have reached their peak a frame makes no heap allocations.
+class FrameAllocator
+{
+public:
+	explicit FrameAllocator(size_t blockSize = FRAMEALLOCATOR_BLOCK_SIZE);
+	FrameAllocator(const FrameAllocator&) = delete;
+	FrameAllocator& operator=(const FrameAllocator&) = delete;
+	FrameAllocator(FrameAllocator&&) noexcept = default;
+	FrameAllocator& operator=(FrameAllocator&&) noexcept = default;
+
+	void* Allocate(size_t size, size_t alignment);
+
+	template<typename T>
+	T* Allocate(size_t count)
+	{
+		return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+	}
+
+	// everything allocated since the last reset is invalid afterwards
+	void Reset();
+
+	size_t GetUsed() const { return m_Used; }
+	size_t GetPeak() const { return m_Peak; }
+	size_t GetCapacity() const;
+	uint32_t GetBlockCount() const { return static_cast<uint32_t>(m_Blocks.size()); }
+
+private:
+	struct Block
+	{
+		std::unique_ptr<uint8_t[]> memory;
+		size_t size = 0;
+	};
+
+	size_t m_BlockSize = 0;
+	std::vector<Block> m_Blocks;
+	uint32_t m_Block = 0;
+	size_t m_Offset = 0;
+	size_t m_Used = 0;
+	size_t m_Peak = 0;
+};
+
+// lets std containers take their storage from a FrameAllocator, deallocate is a no-op
+template<typename T>
+class FrameStlAllocator
+{
+public:
+	using value_type = T;
+
+	FrameStlAllocator(FrameAllocator& allocator) : m_Allocator(&allocator) {}
+
+	template<typename U>
+	FrameStlAllocator(const FrameStlAllocator<U>& other) : m_Allocator(other.m_Allocator) {}
+
+	T* allocate(size_t count) { return m_Allocator->Allocate<T>(count); }
+	void deallocate(T*, size_t) {}
+
+	template<typename U>
+	bool operator==(const FrameStlAllocator<U>& other) const { return m_Allocator == other.m_Allocator; }
+	template<typename U>
+	bool operator!=(const FrameStlAllocator<U>& other) const { return m_Allocator != other.m_Allocator; }
+
+	FrameAllocator* m_Allocator;
+};
+
+// growing one wastes the old storage until the reset, reserve when the size is known
+template<typename T>
+using FrameVector = std::vector<T, FrameStlAllocator<T>>;
+
+// heap allocations the calling thread made through operator new so far, always 0 without INFERNO_COUNT_ALLOCATIONS
+uint64_t GetThreadHeapAllocations();
@@ -0,0 +1,224 @@
+#include "HotReloader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+
+#include "vk_engine.h"
+#include "vk_Meshlet.h"
+#include "CpuProfiler.h"
+#include "ShaderCompiler.h"
+#include "TextureStreamer.h"
+
+namespace
+{
+	std::string NormalizePath(const std::string& path)
+	{
+		return std::filesystem::path(path).lexically_normal().generic_string();
+	}
+
+	std::string ParentDirectory(const std::string& path)
+	{
+		const std::string parent = std::filesystem::path(path).parent_path().generic_string();
+		return parent.empty() ? "." : parent;
+	}
+}
+
+void HotReloader::Init(VulkanEngine& engine)
+{
+	m_Engine = &engine;
+	m_MeshPath = NormalizePath(engine.GetConfig().meshPath);
+	m_MeshDirectory = ParentDirectory(m_MeshPath);
+
+	std::vector<std::string> directories = { NormalizePath(SHADERDIRECTORY), m_MeshDirectory };
+	for (const std::string& texture : engine.GetTextureSources())
+	{
+		directories.push_back(ParentDirectory(NormalizePath(texture)));
+	}
+	std::sort(directories.begin(), directories.end());
+	directories.erase(std::unique(directories.begin(), directories.end()), directories.end());
+
+	for (const std::string& directory : directories)
+	{
+		m_Watcher.AddDirectory(directory);
+	}
+	m_Worker = std::thread(&HotReloader::WorkerLoop, this);
+}
+
+void HotReloader::Cleanup()
+{
+	if (!m_Worker.joinable())
+	{
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Quit = true;
+	}
+	m_Condition.notify_one();
+	m_Worker.join();
+}
+
+bool HotReloader::Classify(const std::string& path, ReloadKind& outKind) const
+{
+	// baked outputs (.spv, .itex) are written by the bakes themselves and never reload anything
+	const std::string extension = std::filesystem::path(path).extension().string();
+	if (IsShaderSource(path))
+	{
+		outKind = ReloadKind::Shader;
+		return true;
+	}
+	if (path == m_MeshPath || (extension == ".mtl" && ParentDirectory(path) == m_MeshDirectory))
+	{
+		outKind = ReloadKind::Mesh;
+		return true;
+	}
+	if (m_Engine->IsTextureSource(path))
+	{
+		outKind = ReloadKind::Texture;
+		return true;
+	}
+	return false;
+}
+
+void HotReloader::Update()
+{
+	if (!m_Engine)
+	{
+		return;
+	}
+	PROFILE_FUNCTION();
+	m_Watcher.Poll(m_Changed);
+	for (const std::string& path : m_Changed)
+	{
+		ReloadKind kind;
+		if (!Classify(path, kind))
+		{
+			continue;
+		}
+		std::cout << "reloading " << path << std::endl;
+
+		// the edited file wins over a mounted pack's copy, and so do the outputs baked from it
+		VirtualFileSystem& fileSystem = m_Engine->GetFileSystem();
+		fileSystem.PreferLooseFile(path);
+		if (kind == ReloadKind::Shader)
+		{
+			fileSystem.PreferLooseFile(path + ".spv");
+		}
+		else if (kind == ReloadKind::Texture)
+		{
+			fileSystem.PreferLooseFile(path + ".itex");
+		}
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		// a file saved twice before its bake started only needs one, as does a mesh whose obj and mtl both changed
+		const bool queued = std::any_of(m_Jobs.begin(), m_Jobs.end(), [&](const Job& job)
+			{
+				return job.kind == kind && (kind == ReloadKind::Mesh || job.path == path);
+			});
+		if (!queued)
+		{
+			m_Jobs.push_back({ kind, path });
+		}
+	}
+	if (!m_Changed.empty())
+	{
+		m_Condition.notify_one();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (m_Results.empty())
+		{
+			return;
+		}
+		m_Applying.swap(m_Results);
+	}
+
+	// both stages are in the same pipelines, several edited shaders rebuild them once
+	bool pipelinesDirty = false;
+	for (Result& result : m_Applying)
+	{
+		Apply(result, pipelinesDirty);
+	}
+	m_Applying.clear();
+	if (pipelinesDirty)
+	{
+		m_Engine->ReloadPipelines();
+	}
+}
+
+void HotReloader::Apply(Result& result, bool& outPipelinesDirty)
+{
+	const std::string& path = result.job.path;
+	if (!result.baked)
+	{
+		std::cout << "keeping the previous version of " << path << std::endl;
+		return;
+	}
+
+	switch (result.job.kind)
+	{
+	case ReloadKind::Shader:
+		outPipelinesDirty = true;
+		break;
+	case ReloadKind::Texture:
+		m_Engine->ReloadTexture(path);
+		break;
+	case ReloadKind::Mesh:
+		m_Engine->ReplaceSceneMesh(std::move(result.mesh));
+		break;
+	}
+}
+
+void HotReloader::WorkerLoop()
+{
+	PROFILE_THREAD("hot reload");
+	for (;;)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Condition.wait(lock, [this] { return m_Quit || !m_Jobs.empty(); });
+			if (m_Quit)
+			{
+				return;
+			}
+			job = std::move(m_Jobs.front());
+			m_Jobs.pop_front();
+		}
+
+		Result result = Bake(job);
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Results.push_back(std::move(result));
+	}
+}
+
+HotReloader::Result HotReloader::Bake(const Job& job) const
+{
+	PROFILE_FUNCTION();
+	const auto start = std::chrono::steady_clock::now();
+	Result result;
+	result.job = job;
+	switch (job.kind)
+	{
+	case ReloadKind::Shader:
+		result.baked = CompileShader(m_Engine->GetAssetCache(), m_Engine->GetConfig().glslangPath, job.path, job.path + ".spv");
+		break;
+	case ReloadKind::Texture:
+		result.baked = TextureStreamer::EnsureBaked(m_Engine->GetAssetCache(), job.path, job.path + ".itex");
+		break;
+	case ReloadKind::Mesh:
+		result.baked = result.mesh.LoadFromObj(m_Engine->GetFileSystem(), m_MeshPath.c_str(), m_Engine->GetConfig().objImporter);
+		if (result.baked)
+		{
+			vkutil::BuildMeshlets(result.mesh);
+		}
+		break;
+	}
+
+	const float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << (result.baked ? "baked " : "failed to bake ") << job.path << " in " << ms << " ms" << std::endl;
+	return result;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "FileWatcher.h"
+#include "vk_Mesh.h"
+
+class VulkanEngine;
+
+enum class ReloadKind
+{
+	// a glsl source, compiled next to itself as .spv
+	Shader,
+	Texture,
+	// the scene obj or one of the mtl files next to it
+	Mesh
+};
+
+// Watches the directories the engine loads from and swaps edited assets in without a restart.
+// Changed files are baked (shaders compiled, textures baked, meshes parsed and split into meshlets)
+// on a worker thread through the asset cache, Update hands the results to the engine at a frame boundary,
+// which replaces pipelines, textures and meshes and retires the old ones through the deferred destruction path.
+class HotReloader
+{
+public:
+	void Init(VulkanEngine& engine);
+	void Cleanup();
+
+	// call once per frame after the frame slot's timeline wait, before anything is recorded
+	void Update();
+
+private:
+	struct Job
+	{
+		ReloadKind kind;
+		std::string path;
+	};
+
+	struct Result
+	{
+		Job job;
+		bool baked;
+		Mesh mesh;
+	};
+
+	bool Classify(const std::string& path, ReloadKind& outKind) const;
+	void WorkerLoop();
+	Result Bake(const Job& job) const;
+	void Apply(Result& result, bool& outPipelinesDirty);
+
+	VulkanEngine* m_Engine{ nullptr };
+	FileWatcher m_Watcher;
+	std::vector<std::string> m_Changed;
+	// normalized, what a changed path is compared against
+	std::string m_MeshPath;
+	std::string m_MeshDirectory;
+
+	std::thread m_Worker;
+	std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+	std::deque<Job> m_Jobs;
+	std::deque<Result> m_Results;
+	// swapped with m_Results each update so the main thread never allocates a queue of its own
+	std::deque<Result> m_Applying;
+	bool m_Quit{ false };
+};
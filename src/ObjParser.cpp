@@ -0,0 +1,751 @@
+#include "ObjParser.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define INFERNO_OBJPARSER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "CpuProfiler.h"
+
+namespace
+{
+	// a usemtl or mtllib line, they are resolved in file order after the chunks are parsed
+	struct MaterialStatement
+	{
+		// faces of the chunk before the statement
+		uint32_t face;
+		bool library;
+		std::string value;
+	};
+
+	struct ObjChunk
+	{
+		const char* begin = nullptr;
+		const char* end = nullptr;
+
+		std::vector<tinyobj::real_t> vertices;
+		std::vector<tinyobj::real_t> normals;
+		std::vector<tinyobj::real_t> texcoords;
+		// three corners per triangle
+		std::vector<tinyobj::index_t> indices;
+		// corners with a negative (relative) index per attribute, they are relative to the chunk's
+		// first element until the elements of the chunks before it are counted
+		std::vector<uint32_t> relativeCorners[3];
+		std::vector<MaterialStatement> statements;
+		// the first face of every run of faces with the same material, starting at face 0
+		std::vector<std::pair<uint32_t, int>> materialRuns;
+
+		// where the chunk's data starts in the merged arrays
+		size_t vertexOffset = 0;
+		size_t normalOffset = 0;
+		size_t texcoordOffset = 0;
+		size_t indexOffset = 0;
+
+		bool unsupported = false;
+	};
+
+	inline uint32_t CountTrailingZeros(uint32_t mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return index;
+#else
+		return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+	}
+
+	inline bool IsDigit(char c) { return static_cast<unsigned int>(c - '0') < 10u; }
+	inline bool IsSpace(char c) { return c == ' ' || c == '\t'; }
+	// what strcspn(" \t\r") stops at in tinyobjloader's null terminated lines
+	inline bool IsTokenEnd(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\0'; }
+
+	const uint64_t c_PowersOf10[] = { 1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull, 100000000ull };
+
+	// the first '\n' or '\r' at or after p, end when there is none
+	const char* FindLineEnd(const char* p, const char* end)
+	{
+#ifdef INFERNO_OBJPARSER_SSE2
+		const __m128i newline = _mm_set1_epi8('\n');
+		const __m128i carriageReturn = _mm_set1_epi8('\r');
+		while (end - p >= 16)
+		{
+			const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+			const uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(bytes, newline), _mm_cmpeq_epi8(bytes, carriageReturn))));
+			if (mask != 0)
+			{
+				return p + CountTrailingZeros(mask);
+			}
+			p += 16;
+		}
+#endif
+		while (p < end && *p != '\n' && *p != '\r')
+		{
+			++p;
+		}
+		return p;
+	}
+
+	// length of the run of digits at p, never reads at or past end
+	size_t CountDigits(const char* p, const char* end)
+	{
+		const char* start = p;
+#ifdef INFERNO_OBJPARSER_SSE2
+		// c - '0' < 10 unsigned, the bias turns it into the signed compare SSE2 has
+		const __m128i zero = _mm_set1_epi8('0');
+		const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+		const __m128i limit = _mm_set1_epi8(static_cast<char>(10 ^ 0x80));
+		while (end - p >= 16)
+		{
+			const __m128i bytes = _mm_xor_si128(_mm_sub_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), zero), bias);
+			const uint32_t digits = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmplt_epi8(bytes, limit)));
+			if (digits != 0xFFFF)
+			{
+				return static_cast<size_t>(p - start) + CountTrailingZeros(~digits);
+			}
+			p += 16;
+		}
+#endif
+		while (p < end && IsDigit(*p))
+		{
+			++p;
+		}
+		return static_cast<size_t>(p - start);
+	}
+
+	// value of 1 to 8 digits at p
+	uint32_t ParseDigits8(const char* p, size_t count, const char* end)
+	{
+#ifdef INFERNO_OBJPARSER_SSE2
+		if (end - p >= 8)
+		{
+			// the digits are shifted to the top of the lane, what followed them falls out and zeros lead
+			__m128i digits = _mm_sub_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_set1_epi8('0'));
+			digits = _mm_sll_epi64(digits, _mm_cvtsi32_si128(static_cast<int>(8 - count) * 8));
+			const __m128i wide = _mm_unpacklo_epi8(digits, _mm_setzero_si128());
+			// pairs of digits, then pairs of pairs, leaves the two 4 digit halves
+			const __m128i pairs = _mm_madd_epi16(wide, _mm_setr_epi16(10, 1, 10, 1, 10, 1, 10, 1));
+			const __m128i halves = _mm_madd_epi16(_mm_packs_epi32(pairs, pairs), _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+			return static_cast<uint32_t>(_mm_cvtsi128_si32(halves)) * 10000u + static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(halves, 4)));
+		}
+#endif
+		uint32_t value = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			value = value * 10 + static_cast<uint32_t>(p[i] - '0');
+		}
+		return value;
+	}
+
+	// value of 1 to 16 digits at p
+	uint64_t ParseDigits(const char* p, size_t count, const char* end)
+	{
+		if (count <= 8)
+		{
+			return ParseDigits8(p, count, end);
+		}
+		return ParseDigits8(p, 8, end) * c_PowersOf10[count - 8] + ParseDigits8(p + 8, count - 8, end);
+	}
+
+	// tinyobjloader's tryParseDouble step by step, only the integer part is read in one go,
+	// below 10^15 the double it accumulates digit by digit is exact and equals the converted integer.
+	// The fraction is summed digit by digit like there, anything else would round differently.
+	bool ParseDouble(const char* s, const char* end, const char* fileEnd, double& outValue)
+	{
+		if (s >= end)
+		{
+			return false;
+		}
+
+		const char* current = s;
+		double mantissa = 0.0;
+		int exponent = 0;
+		bool negative = false;
+		bool leadingDot = false;
+
+		if (*current == '+' || *current == '-')
+		{
+			negative = *current == '-';
+			current++;
+			leadingDot = current != end && *current == '.';
+		}
+		else if (*current == '.')
+		{
+			leadingDot = true;
+		}
+		else if (!IsDigit(*current))
+		{
+			return false;
+		}
+
+		if (!leadingDot)
+		{
+			const size_t count = std::min<size_t>(CountDigits(current, fileEnd), static_cast<size_t>(end - current));
+			if (count == 0)
+			{
+				return false;
+			}
+			if (count <= 15)
+			{
+				mantissa = static_cast<double>(ParseDigits(current, count, fileEnd));
+			}
+			else
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					mantissa *= 10;
+					mantissa += static_cast<int>(current[i] - '0');
+				}
+			}
+			current += count;
+		}
+
+		if (current != end)
+		{
+			if (*current == '.')
+			{
+				static const double powers[] = { 1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001 };
+				current++;
+				for (int read = 1; current != end && IsDigit(*current); ++read, ++current)
+				{
+					mantissa += static_cast<int>(*current - '0') * (read < 8 ? powers[read] : std::pow(10.0, -read));
+				}
+			}
+
+			if (current != end && (*current == 'e' || *current == 'E'))
+			{
+				current++;
+				bool negativeExponent = false;
+				if (current != end && (*current == '+' || *current == '-'))
+				{
+					negativeExponent = *current == '-';
+					current++;
+				}
+				else if (current == end || !IsDigit(*current))
+				{
+					return false;
+				}
+
+				int read = 0;
+				for (; current != end && IsDigit(*current); ++read, ++current)
+				{
+					exponent = exponent * 10 + static_cast<int>(*current - '0');
+				}
+				if (read == 0)
+				{
+					return false;
+				}
+				exponent = negativeExponent ? -exponent : exponent;
+			}
+		}
+
+		outValue = (negative ? -1 : 1) * (exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent) : mantissa);
+		return true;
+	}
+
+	tinyobj::real_t ParseReal(const char*& token, const char* lineEnd, const char* fileEnd)
+	{
+		while (token < lineEnd && IsSpace(*token))
+		{
+			++token;
+		}
+		const char* tokenEnd = token;
+		while (tokenEnd < lineEnd && !IsTokenEnd(*tokenEnd))
+		{
+			++tokenEnd;
+		}
+
+		// a token that is not a number reads as 0
+		double value = 0.0;
+		ParseDouble(token, tokenEnd, fileEnd, value);
+		token = tokenEnd;
+		return static_cast<tinyobj::real_t>(value);
+	}
+
+	std::string ParseString(const char*& token, const char* lineEnd)
+	{
+		while (token < lineEnd && IsSpace(*token))
+		{
+			++token;
+		}
+		const char* start = token;
+		while (token < lineEnd && !IsTokenEnd(*token))
+		{
+			++token;
+		}
+		return std::string(start, token);
+	}
+
+	// atoi like parseTriple uses it, false for more digits than an index can have
+	bool ParseIndex(const char* p, const char* lineEnd, const char* fileEnd, int& outValue)
+	{
+		while (p < lineEnd && (*p == ' ' || *p == '\t' || *p == '\v' || *p == '\f'))
+		{
+			++p;
+		}
+		bool negative = false;
+		if (p < lineEnd && (*p == '+' || *p == '-'))
+		{
+			negative = *p == '-';
+			++p;
+		}
+		const size_t count = std::min<size_t>(CountDigits(p, fileEnd), static_cast<size_t>(lineEnd - p));
+		if (count > 9)
+		{
+			return false;
+		}
+		const int value = count > 0 ? static_cast<int>(ParseDigits(p, count, fileEnd)) : 0;
+		outValue = negative ? -value : value;
+		return true;
+	}
+
+	// 1 based to 0 based, negative indices count back from the elements read so far, 0 is invalid
+	bool FixIndex(int index, int count, int& outIndex, bool& outRelative)
+	{
+		if (index == 0)
+		{
+			return false;
+		}
+		outRelative = index < 0;
+		outIndex = index > 0 ? index - 1 : count + index;
+		return true;
+	}
+
+	// the index of one attribute, the token moves on to the next '/' or separator
+	bool ParseCornerIndex(const char*& token, const char* lineEnd, const char* fileEnd, int count, int& outIndex, bool& outRelative)
+	{
+		int value;
+		if (!ParseIndex(token, lineEnd, fileEnd, value) || !FixIndex(value, count, outIndex, outRelative))
+		{
+			return false;
+		}
+		while (token < lineEnd && *token != '/' && !IsTokenEnd(*token))
+		{
+			++token;
+		}
+		return true;
+	}
+
+	// i, i/j, i//k or i/j/k, counts are the chunk's positions, normals and uvs read so far
+	bool ParseCorner(const char*& token, const char* lineEnd, const char* fileEnd, const int counts[3], tinyobj::index_t& outIndex, bool outRelative[3])
+	{
+		outIndex.vertex_index = -1;
+		outIndex.normal_index = -1;
+		outIndex.texcoord_index = -1;
+
+		if (!ParseCornerIndex(token, lineEnd, fileEnd, counts[0], outIndex.vertex_index, outRelative[0]))
+		{
+			return false;
+		}
+		if (token == lineEnd || *token != '/')
+		{
+			return true;
+		}
+		token++;
+
+		if (token < lineEnd && *token == '/')
+		{
+			token++;
+			return ParseCornerIndex(token, lineEnd, fileEnd, counts[1], outIndex.normal_index, outRelative[1]);
+		}
+
+		if (!ParseCornerIndex(token, lineEnd, fileEnd, counts[2], outIndex.texcoord_index, outRelative[2]))
+		{
+			return false;
+		}
+		if (token == lineEnd || *token != '/')
+		{
+			return true;
+		}
+		token++;
+		return ParseCornerIndex(token, lineEnd, fileEnd, counts[1], outIndex.normal_index, outRelative[1]);
+	}
+
+	void ParseFace(ObjChunk& chunk, const char* token, const char* lineEnd, const char* fileEnd)
+	{
+		while (token < lineEnd && IsSpace(*token))
+		{
+			++token;
+		}
+
+		const int counts[3] = {
+			static_cast<int>(chunk.vertices.size() / 3),
+			static_cast<int>(chunk.normals.size() / 3),
+			static_cast<int>(chunk.texcoords.size() / 2) };
+
+		tinyobj::index_t corners[3];
+		bool relative[3][3] = {};
+		uint32_t cornerCount = 0;
+		while (token < lineEnd && *token != '\0')
+		{
+			// polygons are triangulated by tinyobjloader's ear clipping, leave them to it
+			if (cornerCount == 3 || !ParseCorner(token, lineEnd, fileEnd, counts, corners[cornerCount], relative[cornerCount]))
+			{
+				chunk.unsupported = true;
+				return;
+			}
+			cornerCount++;
+			while (token < lineEnd && IsTokenEnd(*token) && *token != '\0')
+			{
+				++token;
+			}
+		}
+
+		// faces with fewer corners are dropped like tinyobjloader drops them
+		if (cornerCount < 3)
+		{
+			return;
+		}
+
+		for (uint32_t corner = 0; corner < 3; ++corner)
+		{
+			for (uint32_t attribute = 0; attribute < 3; ++attribute)
+			{
+				if (relative[corner][attribute])
+				{
+					chunk.relativeCorners[attribute].push_back(static_cast<uint32_t>(chunk.indices.size()));
+				}
+			}
+			chunk.indices.push_back(corners[corner]);
+		}
+	}
+
+	// dispatches on the same prefixes in the same order as tinyobj::LoadObj
+	void ParseLine(ObjChunk& chunk, const char* token, const char* lineEnd, const char* fileEnd)
+	{
+		while (token < lineEnd && IsSpace(*token))
+		{
+			++token;
+		}
+		// the lines tinyobjloader reads are null terminated, past the end reads as '\0'
+		auto at = [&](size_t i) { return token + i < lineEnd ? token[i] : '\0'; };
+
+		const char c0 = at(0);
+		if (c0 == '\0' || c0 == '#')
+		{
+			return;
+		}
+
+		const char c1 = at(1);
+		if (c0 == 'v' && IsSpace(c1))
+		{
+			token += 2;
+			for (int i = 0; i < 3; ++i)
+			{
+				chunk.vertices.push_back(ParseReal(token, lineEnd, fileEnd));
+			}
+			return;
+		}
+		if (c0 == 'v' && c1 == 'n' && IsSpace(at(2)))
+		{
+			token += 3;
+			for (int i = 0; i < 3; ++i)
+			{
+				chunk.normals.push_back(ParseReal(token, lineEnd, fileEnd));
+			}
+			return;
+		}
+		if (c0 == 'v' && c1 == 't' && IsSpace(at(2)))
+		{
+			token += 3;
+			for (int i = 0; i < 2; ++i)
+			{
+				chunk.texcoords.push_back(ParseReal(token, lineEnd, fileEnd));
+			}
+			return;
+		}
+		// lines and points can fail the whole load in tinyobjloader, so they go through it
+		if ((c0 == 'l' || c0 == 'p') && IsSpace(c1))
+		{
+			chunk.unsupported = true;
+			return;
+		}
+		if (c0 == 'f' && IsSpace(c1))
+		{
+			ParseFace(chunk, token + 2, lineEnd, fileEnd);
+			return;
+		}
+
+		const uint32_t face = static_cast<uint32_t>(chunk.indices.size() / 3);
+		if (lineEnd - token >= 6 && memcmp(token, "usemtl", 6) == 0)
+		{
+			token += 6;
+			chunk.statements.push_back({ face, false, ParseString(token, lineEnd) });
+			return;
+		}
+		if (lineEnd - token >= 7 && memcmp(token, "mtllib", 6) == 0 && IsSpace(token[6]))
+		{
+			const char* end = static_cast<const char*>(memchr(token, '\0', static_cast<size_t>(lineEnd - token)));
+			chunk.statements.push_back({ face, true, std::string(token + 7, end ? end : lineEnd) });
+		}
+
+		// groups, objects, smoothing groups and tags do not change what a Mesh is built from
+	}
+
+	void ParseChunk(ObjChunk& chunk, const char* fileEnd)
+	{
+		PROFILE_SCOPE("ParseObjChunk");
+		// an obj line is usually 20 to 40 bytes, most of them vertices
+		const size_t size = static_cast<size_t>(chunk.end - chunk.begin);
+		chunk.vertices.reserve(size / 32);
+		chunk.indices.reserve(size / 32);
+
+		const char* p = chunk.begin;
+		while (p < chunk.end && !chunk.unsupported)
+		{
+			const char* lineEnd = FindLineEnd(p, chunk.end);
+			ParseLine(chunk, p, lineEnd, fileEnd);
+
+			// "\r\n", "\n" and "\r" each end one line, like safeGetline reads them
+			p = lineEnd;
+			if (p < chunk.end && *p == '\r')
+			{
+				++p;
+			}
+			if (p < chunk.end && *p == '\n')
+			{
+				++p;
+			}
+		}
+	}
+
+	// runs work on every chunk, the calling thread is one of the workers
+	template<typename Function>
+	void ForEachChunk(std::vector<ObjChunk>& chunks, uint32_t workerCount, const Function& work)
+	{
+		std::atomic<uint32_t> next{ 0 };
+		auto worker = [&]()
+		{
+			for (uint32_t chunk = next++; chunk < chunks.size(); chunk = next++)
+			{
+				work(chunks[chunk]);
+			}
+		};
+
+		std::vector<std::thread> workers;
+		for (uint32_t i = 1; i < workerCount; ++i)
+		{
+			workers.emplace_back(worker);
+		}
+		worker();
+		for (std::thread& thread : workers)
+		{
+			thread.join();
+		}
+	}
+
+	// mtllib as tinyobj::LoadObj handles it, the first of its files that loads wins
+	void LoadMaterialLibrary(const std::string& value, tinyobj::MaterialReader& reader, std::vector<tinyobj::material_t>& materials,
+		std::map<std::string, int>& materialMap, std::string& warn, std::string& err)
+	{
+		std::vector<std::string> filenames;
+		std::stringstream stream(value);
+		std::string item;
+		while (std::getline(stream, item, ' '))
+		{
+			filenames.push_back(item);
+		}
+
+		if (filenames.empty())
+		{
+			warn += "Looks like empty filename for mtllib. Use default material.\n";
+			return;
+		}
+
+		for (const std::string& filename : filenames)
+		{
+			std::string warnMtl;
+			std::string errMtl;
+			const bool loaded = reader(filename, &materials, &materialMap, &warnMtl, &errMtl);
+			warn += warnMtl;
+			err += errMtl;
+			if (loaded)
+			{
+				return;
+			}
+		}
+		warn += "Failed to load material file(s). Use default material.\n";
+	}
+}
+
+ObjMaterialReader::ObjMaterialReader(const VirtualFileSystem& fileSystem, const std::string& baseDir)
+	: m_FileSystem(fileSystem)
+	, m_BaseDir(baseDir)
+{
+	if (!m_BaseDir.empty() && m_BaseDir.back() != '/' && m_BaseDir.back() != '\\')
+	{
+		m_BaseDir += '/';
+	}
+}
+
+bool ObjMaterialReader::operator()(const std::string& matId, std::vector<tinyobj::material_t>* materials, std::map<std::string, int>* matMap,
+	std::string* warn, std::string* err)
+{
+	const FileData file = m_FileSystem.Open(m_BaseDir + matId);
+	if (!file.IsValid())
+	{
+		if (warn)
+		{
+			*warn += "Material file [ " + matId + " ] not found in a path : " + m_BaseDir + "\n";
+		}
+		return false;
+	}
+
+	MemoryStreamBuffer buffer(file.GetData(), file.GetSize());
+	std::istream stream(&buffer);
+	tinyobj::LoadMtl(matMap, materials, &stream, warn, err);
+	return true;
+}
+
+ObjParseResult ParseObjFast(const char* data, size_t size, tinyobj::MaterialReader& materialReader, tinyobj::attrib_t& attrib,
+	std::vector<tinyobj::shape_t>& shapes, std::vector<tinyobj::material_t>& materials, std::string& warn, std::string& err, uint32_t threadCount, ObjParseStats* outStats)
+{
+	PROFILE_FUNCTION();
+	attrib.vertices.clear();
+	attrib.normals.clear();
+	attrib.texcoords.clear();
+	attrib.colors.clear();
+	shapes.clear();
+
+	const char* fileEnd = data + size;
+
+	const uint32_t threads = threadCount ? threadCount : std::max(std::thread::hardware_concurrency(), 1u);
+	const size_t chunkCount = std::clamp<size_t>(size / OBJPARSER_MIN_CHUNK_SIZE, 1, static_cast<size_t>(threads) * OBJPARSER_CHUNKS_PER_THREAD);
+	const uint32_t workerCount = static_cast<uint32_t>(std::min<size_t>(threads, chunkCount));
+
+	// every chunk ends after a '\n', so no line and no "\r\n" is split
+	std::vector<ObjChunk> chunks(chunkCount);
+	const char* begin = data;
+	for (size_t i = 0; i < chunkCount; ++i)
+	{
+		const char* end = fileEnd;
+		if (i + 1 < chunkCount)
+		{
+			end = std::max(data + size * (i + 1) / chunkCount, begin);
+			const char* newline = static_cast<const char*>(memchr(end, '\n', static_cast<size_t>(fileEnd - end)));
+			end = newline ? newline + 1 : fileEnd;
+		}
+		chunks[i].begin = begin;
+		chunks[i].end = end;
+		begin = end;
+	}
+
+	ForEachChunk(chunks, workerCount, [&](ObjChunk& chunk)
+		{
+			ParseChunk(chunk, fileEnd);
+		});
+
+	for (const ObjChunk& chunk : chunks)
+	{
+		if (chunk.unsupported)
+		{
+			return ObjParseResult::Unsupported;
+		}
+	}
+
+	// statements in file order, a face has the material of the last usemtl before it
+	std::map<std::string, int> materialMap;
+	int material = -1;
+	size_t vertexCount = 0;
+	size_t normalCount = 0;
+	size_t texcoordCount = 0;
+	size_t indexCount = 0;
+	for (ObjChunk& chunk : chunks)
+	{
+		chunk.vertexOffset = vertexCount;
+		chunk.normalOffset = normalCount;
+		chunk.texcoordOffset = texcoordCount;
+		chunk.indexOffset = indexCount;
+		vertexCount += chunk.vertices.size();
+		normalCount += chunk.normals.size();
+		texcoordCount += chunk.texcoords.size();
+		indexCount += chunk.indices.size();
+
+		chunk.materialRuns.push_back({ 0, material });
+		for (const MaterialStatement& statement : chunk.statements)
+		{
+			if (statement.library)
+			{
+				LoadMaterialLibrary(statement.value, materialReader, materials, materialMap, warn, err);
+				continue;
+			}
+
+			const auto found = materialMap.find(statement.value);
+			if (found == materialMap.end())
+			{
+				warn += "material [ '" + statement.value + "' ] not found in .mtl\n";
+			}
+			material = found != materialMap.end() ? found->second : -1;
+			chunk.materialRuns.push_back({ statement.face, material });
+		}
+	}
+
+	attrib.vertices.resize(vertexCount);
+	attrib.normals.resize(normalCount);
+	attrib.texcoords.resize(texcoordCount);
+
+	// like LoadObj, a file without faces has no shape
+	tinyobj::mesh_t* mesh = nullptr;
+	if (indexCount > 0)
+	{
+		shapes.emplace_back();
+		mesh = &shapes.back().mesh;
+		mesh->indices.resize(indexCount);
+		mesh->num_face_vertices.resize(indexCount / 3, 3);
+		mesh->material_ids.resize(indexCount / 3);
+	}
+
+	ForEachChunk(chunks, workerCount, [&](ObjChunk& chunk)
+		{
+			PROFILE_SCOPE("MergeObjChunk");
+			std::copy(chunk.vertices.begin(), chunk.vertices.end(), attrib.vertices.begin() + chunk.vertexOffset);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), attrib.normals.begin() + chunk.normalOffset);
+			std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), attrib.texcoords.begin() + chunk.texcoordOffset);
+			if (chunk.indices.empty())
+			{
+				return;
+			}
+
+			for (uint32_t corner : chunk.relativeCorners[0])
+			{
+				chunk.indices[corner].vertex_index += static_cast<int>(chunk.vertexOffset / 3);
+			}
+			for (uint32_t corner : chunk.relativeCorners[1])
+			{
+				chunk.indices[corner].normal_index += static_cast<int>(chunk.normalOffset / 3);
+			}
+			for (uint32_t corner : chunk.relativeCorners[2])
+			{
+				chunk.indices[corner].texcoord_index += static_cast<int>(chunk.texcoordOffset / 2);
+			}
+			std::copy(chunk.indices.begin(), chunk.indices.end(), mesh->indices.begin() + chunk.indexOffset);
+
+			const size_t firstFace = chunk.indexOffset / 3;
+			const uint32_t faceCount = static_cast<uint32_t>(chunk.indices.size() / 3);
+			for (size_t run = 0; run < chunk.materialRuns.size(); ++run)
+			{
+				const uint32_t runEnd = run + 1 < chunk.materialRuns.size() ? chunk.materialRuns[run + 1].first : faceCount;
+				std::fill(mesh->material_ids.begin() + firstFace + chunk.materialRuns[run].first, mesh->material_ids.begin() + firstFace + runEnd, chunk.materialRuns[run].second);
+			}
+		});
+
+	if (outStats)
+	{
+		outStats->bytes = size;
+		outStats->chunks = static_cast<uint32_t>(chunkCount);
+		outStats->threads = workerCount;
+	}
+	return ObjParseResult::Ok;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "tiny_obj_loader.h"
+#include "VirtualFileSystem.h"
+
+// chunks are at least this big, smaller files are parsed by one thread
+#define OBJPARSER_MIN_CHUNK_SIZE (1024 * 1024)
+// chunks per worker, more than one so a worker that drew a light chunk picks up another
+#define OBJPARSER_CHUNKS_PER_THREAD 4
+
+enum class ObjParseResult
+{
+	Ok,
+	// the file uses something only tinyobjloader handles (polygons, lines, points, broken faces), parse it with LoadObj instead
+	Unsupported
+};
+
+struct ObjParseStats
+{
+	size_t bytes = 0;
+	uint32_t chunks = 0;
+	uint32_t threads = 0;
+};
+
+// tinyobj::MaterialFileReader for mtl files behind a VirtualFileSystem, used by both obj parsers
+class ObjMaterialReader : public tinyobj::MaterialReader
+{
+public:
+	ObjMaterialReader(const VirtualFileSystem& fileSystem, const std::string& baseDir);
+
+	bool operator()(const std::string& matId, std::vector<tinyobj::material_t>* materials, std::map<std::string, int>* matMap,
+		std::string* warn, std::string* err) override;
+
+private:
+	const VirtualFileSystem& m_FileSystem;
+	std::string m_BaseDir;
+};
+
+// Parses an obj into the same attrib, shapes and materials tinyobj::LoadObj would fill for it,
+// as far as Mesh::LoadFromObj reads them: positions, normals, uvs, triangle corners and their materials.
+// The file's contents are split into line aligned chunks that worker threads parse on their own,
+// relative indices and usemtl/mtllib statements are resolved once every chunk is done.
+// Numbers are read the way tinyobjloader reads them, so the floats come out bit for bit the same.
+// All faces end up in one shape, in file order. threadCount 0 uses every hardware thread.
+// data is the whole file, usually a VirtualFileSystem mapping, mtllib files are read through materialReader.
+ObjParseResult ParseObjFast(const char* data, size_t size, tinyobj::MaterialReader& materialReader, tinyobj::attrib_t& attrib,
+	std::vector<tinyobj::shape_t>& shapes, std::vector<tinyobj::material_t>& materials, std::string& warn, std::string& err, uint32_t threadCount = 0, ObjParseStats* outStats = nullptr);
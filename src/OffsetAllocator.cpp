@@ -0,0 +1,360 @@
+#include "OffsetAllocator.h"
+
+#include <cassert>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+	constexpr uint32_t MANTISSA_BITS = 3;
+	constexpr uint32_t MANTISSA_VALUE = 1 << MANTISSA_BITS;
+	constexpr uint32_t MANTISSA_MASK = MANTISSA_VALUE - 1;
+
+	uint32_t LeadingZeros(uint32_t v)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		return _BitScanReverse(&index, v) ? 31 - index : 32;
+#else
+		return v ? __builtin_clz(v) : 32;
+#endif
+	}
+
+	uint32_t TrailingZeros(uint32_t v)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		return _BitScanForward(&index, v) ? index : 32;
+#else
+		return v ? __builtin_ctz(v) : 32;
+#endif
+	}
+
+	uint32_t FindLowestSetBitAfter(uint32_t bitMask, uint32_t startBitIndex)
+	{
+		if (startBitIndex >= 32)
+		{
+			return 0xffffffff;
+		}
+		const uint32_t maskBeforeStartIndex = (1u << startBitIndex) - 1;
+		const uint32_t bitsAfter = bitMask & ~maskBeforeStartIndex;
+		return bitsAfter ? TrailingZeros(bitsAfter) : 0xffffffff;
+	}
+
+	// sizes are binned as tiny floats with a 3 bit mantissa, rounding up finds a bin where every region fits
+	uint32_t UintToFloatRoundUp(uint32_t size)
+	{
+		uint32_t exponent = 0;
+		uint32_t mantissa = 0;
+
+		if (size < MANTISSA_VALUE)
+		{
+			mantissa = size;
+		}
+		else
+		{
+			const uint32_t highestSetBit = 31 - LeadingZeros(size);
+			const uint32_t mantissaStartBit = highestSetBit - MANTISSA_BITS;
+			exponent = mantissaStartBit + 1;
+			mantissa = (size >> mantissaStartBit) & MANTISSA_MASK;
+
+			const uint32_t lowBitsMask = (1u << mantissaStartBit) - 1;
+			if ((size & lowBitsMask) != 0)
+			{
+				mantissa++;
+			}
+		}
+
+		// a mantissa overflow carries into the exponent on purpose
+		return (exponent << MANTISSA_BITS) + mantissa;
+	}
+
+	uint32_t UintToFloatRoundDown(uint32_t size)
+	{
+		uint32_t exponent = 0;
+		uint32_t mantissa = 0;
+
+		if (size < MANTISSA_VALUE)
+		{
+			mantissa = size;
+		}
+		else
+		{
+			const uint32_t highestSetBit = 31 - LeadingZeros(size);
+			const uint32_t mantissaStartBit = highestSetBit - MANTISSA_BITS;
+			exponent = mantissaStartBit + 1;
+			mantissa = (size >> mantissaStartBit) & MANTISSA_MASK;
+		}
+
+		return (exponent << MANTISSA_BITS) | mantissa;
+	}
+
+	uint32_t FloatToUint(uint32_t floatValue)
+	{
+		const uint32_t exponent = floatValue >> MANTISSA_BITS;
+		const uint32_t mantissa = floatValue & MANTISSA_MASK;
+		if (exponent == 0)
+		{
+			return mantissa;
+		}
+		return (mantissa | MANTISSA_VALUE) << (exponent - 1);
+	}
+}
+
+OffsetAllocator::OffsetAllocator(uint32_t size, uint32_t maxAllocations)
+{
+	Reset(size, maxAllocations);
+}
+
+void OffsetAllocator::Reset(uint32_t size, uint32_t maxAllocations)
+{
+	m_Size = size;
+	m_FreeStorage = 0;
+	m_UsedBinsTop = 0;
+
+	for (uint32_t i = 0; i < NUM_TOP_BINS; ++i)
+	{
+		m_UsedBins[i] = 0;
+	}
+	for (uint32_t i = 0; i < NUM_LEAF_BINS; ++i)
+	{
+		m_BinIndices[i] = UNUSED;
+	}
+
+	m_Nodes.assign(maxAllocations, Node{});
+	m_FreeNodes.resize(maxAllocations);
+
+	// pop order starts from node zero
+	m_FreeNodeCount = maxAllocations;
+	for (uint32_t i = 0; i < maxAllocations; ++i)
+	{
+		m_FreeNodes[i] = maxAllocations - i - 1;
+	}
+
+	if (size > 0)
+	{
+		InsertNodeIntoBin(size, 0);
+	}
+}
+
+OffsetAllocation OffsetAllocator::Allocate(uint32_t size)
+{
+	// one node for the allocation and one for a possible remainder
+	if (size == 0 || m_FreeNodeCount < 2)
+	{
+		return {};
+	}
+
+	const uint32_t minBinIndex = UintToFloatRoundUp(size);
+	const uint32_t minTopBinIndex = minBinIndex >> MANTISSA_BITS;
+	const uint32_t minLeafBinIndex = minBinIndex & MANTISSA_MASK;
+
+	uint32_t topBinIndex = minTopBinIndex;
+	uint32_t leafBinIndex = UNUSED;
+
+	if (topBinIndex < NUM_TOP_BINS && (m_UsedBinsTop & (1u << topBinIndex)))
+	{
+		leafBinIndex = FindLowestSetBitAfter(m_UsedBins[topBinIndex], minLeafBinIndex);
+	}
+
+	if (leafBinIndex == UNUSED)
+	{
+		topBinIndex = FindLowestSetBitAfter(m_UsedBinsTop, minTopBinIndex + 1);
+		if (topBinIndex == UNUSED)
+		{
+			return {};
+		}
+		leafBinIndex = TrailingZeros(m_UsedBins[topBinIndex]);
+	}
+
+	const uint32_t binIndex = (topBinIndex << MANTISSA_BITS) | leafBinIndex;
+
+	const uint32_t nodeIndex = m_BinIndices[binIndex];
+	Node& node = m_Nodes[nodeIndex];
+	const uint32_t nodeTotalSize = node.dataSize;
+	node.dataSize = size;
+	node.used = true;
+
+	m_BinIndices[binIndex] = node.binListNext;
+	if (node.binListNext != UNUSED)
+	{
+		m_Nodes[node.binListNext].binListPrev = UNUSED;
+	}
+	m_FreeStorage -= nodeTotalSize;
+
+	if (m_BinIndices[binIndex] == UNUSED)
+	{
+		m_UsedBins[topBinIndex] &= ~(1u << leafBinIndex);
+		if (m_UsedBins[topBinIndex] == 0)
+		{
+			m_UsedBinsTop &= ~(1u << topBinIndex);
+		}
+	}
+
+	const uint32_t remainder = nodeTotalSize - size;
+	if (remainder > 0)
+	{
+		const uint32_t newNodeIndex = InsertNodeIntoBin(remainder, m_Nodes[nodeIndex].dataOffset + size);
+
+		Node& allocated = m_Nodes[nodeIndex];
+		if (allocated.neighborNext != UNUSED)
+		{
+			m_Nodes[allocated.neighborNext].neighborPrev = newNodeIndex;
+		}
+		m_Nodes[newNodeIndex].neighborPrev = nodeIndex;
+		m_Nodes[newNodeIndex].neighborNext = allocated.neighborNext;
+		allocated.neighborNext = newNodeIndex;
+	}
+
+	OffsetAllocation allocation;
+	allocation.offset = m_Nodes[nodeIndex].dataOffset;
+	allocation.metadata = nodeIndex;
+	return allocation;
+}
+
+void OffsetAllocator::Free(OffsetAllocation allocation)
+{
+	if (!allocation.IsValid())
+	{
+		return;
+	}
+
+	const uint32_t nodeIndex = allocation.metadata;
+	Node& node = m_Nodes[nodeIndex];
+	assert(node.used && "double free of offset allocation");
+
+	uint32_t offset = node.dataOffset;
+	uint32_t size = node.dataSize;
+
+	if (node.neighborPrev != UNUSED && !m_Nodes[node.neighborPrev].used)
+	{
+		const uint32_t prevIndex = node.neighborPrev;
+		const Node& prevNode = m_Nodes[prevIndex];
+		offset = prevNode.dataOffset;
+		size += prevNode.dataSize;
+		node.neighborPrev = prevNode.neighborPrev;
+		RemoveNodeFromBin(prevIndex);
+	}
+
+	if (node.neighborNext != UNUSED && !m_Nodes[node.neighborNext].used)
+	{
+		const uint32_t nextIndex = node.neighborNext;
+		const Node& nextNode = m_Nodes[nextIndex];
+		size += nextNode.dataSize;
+		node.neighborNext = nextNode.neighborNext;
+		RemoveNodeFromBin(nextIndex);
+	}
+
+	const uint32_t neighborNext = node.neighborNext;
+	const uint32_t neighborPrev = node.neighborPrev;
+
+	node = Node{};
+	m_FreeNodes[m_FreeNodeCount++] = nodeIndex;
+
+	const uint32_t combinedNodeIndex = InsertNodeIntoBin(size, offset);
+	if (neighborNext != UNUSED)
+	{
+		m_Nodes[combinedNodeIndex].neighborNext = neighborNext;
+		m_Nodes[neighborNext].neighborPrev = combinedNodeIndex;
+	}
+	if (neighborPrev != UNUSED)
+	{
+		m_Nodes[combinedNodeIndex].neighborPrev = neighborPrev;
+		m_Nodes[neighborPrev].neighborNext = combinedNodeIndex;
+	}
+}
+
+uint32_t OffsetAllocator::AllocationSize(OffsetAllocation allocation) const
+{
+	if (!allocation.IsValid())
+	{
+		return 0;
+	}
+	return m_Nodes[allocation.metadata].dataSize;
+}
+
+OffsetAllocatorReport OffsetAllocator::GetReport() const
+{
+	OffsetAllocatorReport report{};
+	report.totalFreeSpace = m_FreeStorage;
+
+	if (m_UsedBinsTop)
+	{
+		const uint32_t topBinIndex = 31 - LeadingZeros(m_UsedBinsTop);
+		const uint32_t leafBinIndex = 31 - LeadingZeros(m_UsedBins[topBinIndex]);
+		report.largestFreeRegion = FloatToUint((topBinIndex << MANTISSA_BITS) | leafBinIndex);
+	}
+	return report;
+}
+
+uint32_t OffsetAllocator::InsertNodeIntoBin(uint32_t size, uint32_t dataOffset)
+{
+	const uint32_t binIndex = UintToFloatRoundDown(size);
+	const uint32_t topBinIndex = binIndex >> MANTISSA_BITS;
+	const uint32_t leafBinIndex = binIndex & MANTISSA_MASK;
+
+	if (m_BinIndices[binIndex] == UNUSED)
+	{
+		m_UsedBins[topBinIndex] |= 1u << leafBinIndex;
+		m_UsedBinsTop |= 1u << topBinIndex;
+	}
+
+	const uint32_t topNodeIndex = m_BinIndices[binIndex];
+	const uint32_t nodeIndex = m_FreeNodes[--m_FreeNodeCount];
+
+	Node& node = m_Nodes[nodeIndex];
+	node = Node{};
+	node.dataOffset = dataOffset;
+	node.dataSize = size;
+	node.binListNext = topNodeIndex;
+	if (topNodeIndex != UNUSED)
+	{
+		m_Nodes[topNodeIndex].binListPrev = nodeIndex;
+	}
+	m_BinIndices[binIndex] = nodeIndex;
+
+	m_FreeStorage += size;
+	return nodeIndex;
+}
+
+void OffsetAllocator::RemoveNodeFromBin(uint32_t nodeIndex)
+{
+	Node& node = m_Nodes[nodeIndex];
+
+	if (node.binListPrev != UNUSED)
+	{
+		m_Nodes[node.binListPrev].binListNext = node.binListNext;
+		if (node.binListNext != UNUSED)
+		{
+			m_Nodes[node.binListNext].binListPrev = node.binListPrev;
+		}
+	}
+	else
+	{
+		// head of its bin list
+		const uint32_t binIndex = UintToFloatRoundDown(node.dataSize);
+		const uint32_t topBinIndex = binIndex >> MANTISSA_BITS;
+		const uint32_t leafBinIndex = binIndex & MANTISSA_MASK;
+
+		m_BinIndices[binIndex] = node.binListNext;
+		if (node.binListNext != UNUSED)
+		{
+			m_Nodes[node.binListNext].binListPrev = UNUSED;
+		}
+
+		if (m_BinIndices[binIndex] == UNUSED)
+		{
+			m_UsedBins[topBinIndex] &= ~(1u << leafBinIndex);
+			if (m_UsedBins[topBinIndex] == 0)
+			{
+				m_UsedBinsTop &= ~(1u << topBinIndex);
+			}
+		}
+	}
+
+	m_FreeStorage -= node.dataSize;
+	node = Node{};
+	m_FreeNodes[m_FreeNodeCount++] = nodeIndex;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Two level segregated fit allocator handing out ranges of an external resource (buffer elements, not bytes).
+// Allocate and Free are O(1): free regions live in 256 size bins found through two bitmasks,
+// and neighbouring free regions are merged when a range is released.
+struct OffsetAllocation
+{
+	static constexpr uint32_t NO_SPACE = 0xffffffff;
+
+	uint32_t offset = NO_SPACE;
+	uint32_t metadata = NO_SPACE;
+
+	bool IsValid() const { return offset != NO_SPACE; }
+};
+
+struct OffsetAllocatorReport
+{
+	uint32_t totalFreeSpace;
+	uint32_t largestFreeRegion;
+};
+
+class OffsetAllocator
+{
+public:
+	explicit OffsetAllocator(uint32_t size = 0, uint32_t maxAllocations = 128 * 1024);
+
+	void Reset(uint32_t size, uint32_t maxAllocations = 128 * 1024);
+
+	OffsetAllocation Allocate(uint32_t size);
+	void Free(OffsetAllocation allocation);
+
+	uint32_t AllocationSize(OffsetAllocation allocation) const;
+	OffsetAllocatorReport GetReport() const;
+	uint32_t GetSize() const { return m_Size; }
+
+private:
+	static constexpr uint32_t NUM_TOP_BINS = 32;
+	static constexpr uint32_t BINS_PER_LEAF = 8;
+	static constexpr uint32_t NUM_LEAF_BINS = NUM_TOP_BINS * BINS_PER_LEAF;
+	static constexpr uint32_t UNUSED = 0xffffffff;
+
+	struct Node
+	{
+		uint32_t dataOffset = 0;
+		uint32_t dataSize = 0;
+		uint32_t binListPrev = UNUSED;
+		uint32_t binListNext = UNUSED;
+		uint32_t neighborPrev = UNUSED;
+		uint32_t neighborNext = UNUSED;
+		bool used = false;
+	};
+
+	uint32_t InsertNodeIntoBin(uint32_t size, uint32_t dataOffset);
+	void RemoveNodeFromBin(uint32_t nodeIndex);
+
+	uint32_t m_Size = 0;
+	uint32_t m_FreeStorage = 0;
+
+	uint32_t m_UsedBinsTop = 0;
+	uint8_t m_UsedBins[NUM_TOP_BINS] = {};
+	uint32_t m_BinIndices[NUM_LEAF_BINS] = {};
+
+	std::vector<Node> m_Nodes;
+	std::vector<uint32_t> m_FreeNodes;
+	uint32_t m_FreeNodeCount = 0;
+};
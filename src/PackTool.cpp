@@ -0,0 +1,174 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "AssetCache.h"
+#include "AssetPack.h"
+#include "TextureStreamer.h"
+
+// Packs asset directories into one file for VirtualFileSystem::Mount. Entry names are relative to root,
+// so a pack built from the repository root and mounted at "../../" serves the paths the engine already uses.
+// Images are baked into their streamed form and stored uncompressed, the streamer reads their mips straight
+// from the mapping. Sources that only the build reads (images, glsl) are left out unless --keep-sources.
+// Bakes go through the asset cache in <root>/.assetcache unless --cache names another one.
+//
+// inferno_pack <output.ipak> <root> <directory>... [--keep-sources] [--no-compress] [--cache <dir>]
+// from the bin directory: inferno_pack ../../inferno.ipak ../../ ../../assets ../../shaders
+
+namespace
+{
+	bool HasExtension(const std::filesystem::path& path, std::initializer_list<const char*> extensions)
+	{
+		const std::string extension = path.extension().string();
+		for (const char* candidate : extensions)
+		{
+			if (extension == candidate)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool IsImage(const std::filesystem::path& path)
+	{
+		return HasExtension(path, { ".png", ".jpg", ".jpeg", ".tga", ".bmp" });
+	}
+
+	bool IsShaderSource(const std::filesystem::path& path)
+	{
+		return HasExtension(path, { ".vert", ".frag", ".comp", ".mesh", ".task", ".glsl" });
+	}
+
+	bool ReadWholeFile(const std::filesystem::path& path, std::vector<uint8_t>& outData)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file.is_open())
+		{
+			return false;
+		}
+		outData.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(reinterpret_cast<char*>(outData.data()), static_cast<std::streamsize>(outData.size()));
+		return static_cast<bool>(file);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<std::string> positional;
+	bool keepSources = false;
+	bool compress = true;
+	std::string cacheDirectory;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--keep-sources") == 0)
+		{
+			keepSources = true;
+		}
+		else if (strcmp(argv[i], "--no-compress") == 0)
+		{
+			compress = false;
+		}
+		else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc)
+		{
+			cacheDirectory = argv[++i];
+		}
+		else
+		{
+			positional.push_back(argv[i]);
+		}
+	}
+	if (positional.size() < 3)
+	{
+		std::cout << "usage: inferno_pack <output.ipak> <root> <directory>... [--keep-sources] [--no-compress] [--cache <dir>]" << std::endl;
+		return 1;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	const std::filesystem::path root = std::filesystem::path(positional[1]).lexically_normal();
+	AssetCache cache;
+	cache.Open(cacheDirectory.empty() ? (root / ".assetcache").string() : cacheDirectory);
+	AssetPackWriter writer;
+	auto add = [&](const std::filesystem::path& path, bool compressEntry)
+	{
+		std::vector<uint8_t> data;
+		if (!ReadWholeFile(path, data))
+		{
+			std::cout << "failed to read " << path.string() << std::endl;
+			return false;
+		}
+		writer.AddFile(path.lexically_normal().lexically_relative(root).generic_string(), std::move(data), compressEntry);
+		return true;
+	};
+
+	for (size_t i = 2; i < positional.size(); ++i)
+	{
+		std::error_code error;
+		for (auto it = std::filesystem::recursive_directory_iterator(positional[i], error); !error && it != std::filesystem::recursive_directory_iterator(); it.increment(error))
+		{
+			if (!it->is_regular_file())
+			{
+				continue;
+			}
+			const std::filesystem::path& path = it->path();
+
+			// a baked texture is added with its source, one without a source is packed like any other file
+			if (path.extension() == ".itex")
+			{
+				std::filesystem::path source = path;
+				source.replace_extension();
+				if (IsImage(source) && std::filesystem::exists(source, error))
+				{
+					continue;
+				}
+			}
+			if (IsImage(path))
+			{
+				const std::string bakedPath = path.string() + ".itex";
+				if (!TextureStreamer::EnsureBaked(cache, path.string(), bakedPath) || !add(bakedPath, false))
+				{
+					return 1;
+				}
+				if (!keepSources)
+				{
+					continue;
+				}
+			}
+			if (IsShaderSource(path) && !keepSources)
+			{
+				continue;
+			}
+			if (!add(path, compress))
+			{
+				return 1;
+			}
+		}
+		if (error)
+		{
+			std::cout << "failed to walk " << positional[i] << ": " << error.message() << std::endl;
+			return 1;
+		}
+	}
+
+	cache.PrintReport("texture bakes");
+
+	AssetPackStats stats;
+	if (!writer.Write(positional[0], &stats))
+	{
+		return 1;
+	}
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	char line[200];
+	snprintf(line, sizeof(line), "packed %u entries (%u compressed): %.1f MB -> %.1f MB (%.1f%%) in %.2f s",
+		stats.entries, stats.compressedEntries, stats.rawBytes / (1024.0 * 1024.0), stats.storedBytes / (1024.0 * 1024.0),
+		stats.rawBytes ? 100.0 * stats.storedBytes / stats.rawBytes : 100.0, seconds);
+	std::cout << line << std::endl;
+	return 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Runs work(i) for every i below count on short lived threads, the calling thread is one of them.
+// Items are handed out one at a time, so uneven items still spread over all workers.
+// threadCount 0 uses every hardware thread.
+template<typename Function>
+void ParallelFor(uint32_t count, const Function& work, uint32_t threadCount = 0)
+{
+	const uint32_t threads = threadCount ? threadCount : std::max(std::thread::hardware_concurrency(), 1u);
+	const uint32_t workerCount = std::min(threads, count);
+
+	std::atomic<uint32_t> next{ 0 };
+	auto worker = [&]()
+	{
+		for (uint32_t i = next++; i < count; i = next++)
+		{
+			work(i);
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (uint32_t i = 1; i < workerCount; ++i)
+	{
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : workers)
+	{
+		thread.join();
+	}
+}
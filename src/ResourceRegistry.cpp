@@ -0,0 +1,52 @@
+#include "ResourceRegistry.h"
+
+#include "vk_engine.h"
+
+void ResourceRegistry::Init(VulkanEngine& engine)
+{
+	m_Engine = &engine;
+
+	m_Meshes.SetDestroyer([this](Mesh& mesh)
+		{
+			m_Engine->UnloadMesh(mesh);
+		});
+
+	// a material holds a reference to its texture
+	m_Materials.SetDestroyer([this](Material& material)
+		{
+			m_Textures.Release(material.texture);
+		});
+
+	m_Textures.SetDestroyer([this](TextureResource& texture)
+		{
+			m_Engine->GetTextureStreamer().RemoveTexture(texture.streamerSlot);
+		});
+
+	m_Buffers.SetDestroyer([this](AllocatedBuffer& buffer)
+		{
+			const AllocatedBuffer retired = buffer;
+			m_Engine->GetFrameDeletionQueue().PushFunction([=]
+				{
+					vmaDestroyBuffer(m_Engine->GetAllocator(), retired.buffer, retired.allocation);
+				});
+		});
+}
+
+void ResourceRegistry::Cleanup()
+{
+	// materials first so the textures they reference are released by them
+	m_Materials.Clear();
+	m_Meshes.Clear();
+	m_Textures.Clear();
+	m_Buffers.Clear();
+}
+
+ResourceRegistryStats ResourceRegistry::GetStats() const
+{
+	ResourceRegistryStats stats;
+	stats.meshes = m_Meshes.GetAliveCount();
+	stats.materials = m_Materials.GetAliveCount();
+	stats.textures = m_Textures.GetAliveCount();
+	stats.buffers = m_Buffers.GetAliveCount();
+	return stats;
+}
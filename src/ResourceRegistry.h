@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "vk_types.h"
+#include "vk_Mesh.h"
+
+class VulkanEngine;
+
+// a handle is the slot index in the low bits and the slot's generation in the high bits
+#define RESOURCE_INDEX_BITS 20
+#define RESOURCE_GENERATION_BITS 12
+#define RESOURCE_MAX_SLOTS (1u << RESOURCE_INDEX_BITS)
+
+template<typename T>
+struct Handle
+{
+	// 0 is never handed out, generations start at 1
+	uint32_t value{ 0 };
+
+	bool IsValid() const { return value != 0; }
+	uint32_t GetIndex() const { return value & (RESOURCE_MAX_SLOTS - 1); }
+	uint32_t GetGeneration() const { return value >> RESOURCE_INDEX_BITS; }
+
+	bool operator==(const Handle& other) const { return value == other.value; }
+	bool operator!=(const Handle& other) const { return value != other.value; }
+	bool operator<(const Handle& other) const { return value < other.value; }
+};
+
+// Dense storage for one kind of resource, addressed by generational handles.
+// Every slot keeps a generation that is bumped when its resource is destroyed, so handles to it
+// go stale and Get returns nullptr instead of a resource that took the slot over.
+// Slots are reference counted, the destroyer runs when the last reference is released.
+template<typename T>
+class ResourcePool
+{
+public:
+	// releases the resource's GPU objects, anything the GPU may still read goes through the frame deletion queue
+	using Destroyer = std::function<void(T& resource)>;
+
+	void SetDestroyer(Destroyer&& destroyer) { m_Destroyer = std::move(destroyer); }
+
+	// the new resource holds one reference
+	Handle<T> Create(T&& resource)
+	{
+		uint32_t index;
+		if (!m_FreeSlots.empty())
+		{
+			index = m_FreeSlots.back();
+			m_FreeSlots.pop_back();
+			m_Resources[index] = std::move(resource);
+		}
+		else
+		{
+			if (m_Slots.size() >= RESOURCE_MAX_SLOTS)
+			{
+				return {};
+			}
+			index = static_cast<uint32_t>(m_Slots.size());
+			m_Slots.push_back({ 1, 0 });
+			m_Resources.push_back(std::move(resource));
+		}
+
+		m_Slots[index].refCount = 1;
+		m_AliveCount++;
+		return { (m_Slots[index].generation << RESOURCE_INDEX_BITS) | index };
+	}
+
+	T* Get(Handle<T> handle)
+	{
+		return IsAlive(handle) ? &m_Resources[handle.GetIndex()] : nullptr;
+	}
+
+	const T* Get(Handle<T> handle) const
+	{
+		return IsAlive(handle) ? &m_Resources[handle.GetIndex()] : nullptr;
+	}
+
+	bool IsAlive(Handle<T> handle) const
+	{
+		const uint32_t index = handle.GetIndex();
+		return handle.IsValid() && index < m_Slots.size() && m_Slots[index].refCount > 0 && m_Slots[index].generation == handle.GetGeneration();
+	}
+
+	void AddRef(Handle<T> handle)
+	{
+		if (IsAlive(handle))
+		{
+			m_Slots[handle.GetIndex()].refCount++;
+		}
+	}
+
+	// stale handles are ignored, so releasing twice through a copied handle is harmless once the slot is reused
+	void Release(Handle<T> handle)
+	{
+		if (!IsAlive(handle))
+		{
+			return;
+		}
+		Slot& slot = m_Slots[handle.GetIndex()];
+		if (--slot.refCount == 0)
+		{
+			Destroy(handle.GetIndex());
+		}
+	}
+
+	// destroys every live resource no matter how many references are left
+	void Clear()
+	{
+		for (uint32_t index = 0; index < m_Slots.size(); ++index)
+		{
+			if (m_Slots[index].refCount > 0)
+			{
+				m_Slots[index].refCount = 0;
+				Destroy(index);
+			}
+		}
+	}
+
+	uint32_t GetAliveCount() const { return m_AliveCount; }
+	uint32_t GetSlotCount() const { return static_cast<uint32_t>(m_Slots.size()); }
+
+private:
+	struct Slot
+	{
+		uint32_t generation;
+		uint32_t refCount;
+	};
+
+	void Destroy(uint32_t index)
+	{
+		if (m_Destroyer)
+		{
+			m_Destroyer(m_Resources[index]);
+		}
+		m_Resources[index] = T{};
+
+		// 0 stays reserved for the invalid handle
+		Slot& slot = m_Slots[index];
+		slot.generation = (slot.generation + 1) & ((1u << RESOURCE_GENERATION_BITS) - 1);
+		if (slot.generation == 0)
+		{
+			slot.generation = 1;
+		}
+		m_FreeSlots.push_back(index);
+		m_AliveCount--;
+	}
+
+	// a deque never moves its elements, the geometry pool keeps pointers to the meshes
+	std::deque<T> m_Resources;
+	std::vector<Slot> m_Slots;
+	std::vector<uint32_t> m_FreeSlots;
+	Destroyer m_Destroyer;
+	uint32_t m_AliveCount{ 0 };
+};
+
+// a streamed texture, the slot indexes the streamer's images and feedback
+struct TextureResource
+{
+	uint32_t streamerSlot{ 0 };
+	// what the texture was baked from, hot reload finds it by this
+	std::string sourcePath;
+};
+
+using TextureHandle = Handle<TextureResource>;
+
+struct Material
+{
+	VkPipeline pipeline{ VK_NULL_HANDLE };
+	VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
+	TextureHandle texture;
+};
+
+using MeshHandle = Handle<Mesh>;
+using MaterialHandle = Handle<Material>;
+using BufferHandle = Handle<AllocatedBuffer>;
+
+struct ResourceRegistryStats
+{
+	uint32_t meshes = 0;
+	uint32_t materials = 0;
+	uint32_t textures = 0;
+	uint32_t buffers = 0;
+};
+
+// One pool per resource type. The destroyers hand meshes back to the geometry pool, textures to the
+// streamer and buffers to the frame deletion queue, so a resource released mid-frame stays valid
+// for the frames still in flight while its handle is already stale.
+class ResourceRegistry
+{
+public:
+	void Init(VulkanEngine& engine);
+	// destroys everything still registered, call while the frame deletion queues can still be flushed
+	void Cleanup();
+
+	ResourcePool<Mesh>& GetMeshes() { return m_Meshes; }
+	ResourcePool<Material>& GetMaterials() { return m_Materials; }
+	ResourcePool<TextureResource>& GetTextures() { return m_Textures; }
+	ResourcePool<AllocatedBuffer>& GetBuffers() { return m_Buffers; }
+
+	Mesh* Get(MeshHandle handle) { return m_Meshes.Get(handle); }
+	Material* Get(MaterialHandle handle) { return m_Materials.Get(handle); }
+	TextureResource* Get(TextureHandle handle) { return m_Textures.Get(handle); }
+	AllocatedBuffer* Get(BufferHandle handle) { return m_Buffers.Get(handle); }
+	const Mesh* Get(MeshHandle handle) const { return m_Meshes.Get(handle); }
+	const Material* Get(MaterialHandle handle) const { return m_Materials.Get(handle); }
+	const TextureResource* Get(TextureHandle handle) const { return m_Textures.Get(handle); }
+	const AllocatedBuffer* Get(BufferHandle handle) const { return m_Buffers.Get(handle); }
+
+	ResourceRegistryStats GetStats() const;
+
+private:
+	VulkanEngine* m_Engine{ nullptr };
+
+	ResourcePool<Mesh> m_Meshes;
+	ResourcePool<Material> m_Materials;
+	ResourcePool<TextureResource> m_Textures;
+	ResourcePool<AllocatedBuffer> m_Buffers;
+};
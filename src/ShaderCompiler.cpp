@@ -0,0 +1,74 @@
+#include "ShaderCompiler.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <unordered_map>
+
+#include "AssetCache.h"
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+namespace
+{
+	// what the compiler prints for --version, run once per path. bake jobs compile on several threads
+	std::string GetCompilerVersion(const std::string& glslang)
+	{
+		static std::mutex mutex;
+		static std::unordered_map<std::string, std::string> versions;
+		std::lock_guard<std::mutex> lock(mutex);
+		auto found = versions.find(glslang);
+		if (found != versions.end())
+		{
+			return found->second;
+		}
+
+		std::string command = "\"" + glslang + "\" --version";
+#ifdef _WIN32
+		command = "\"" + command + "\"";
+#endif
+		// a compiler that cannot be run leaves the version empty, its compile fails right after anyway
+		std::string version;
+		if (FILE* pipe = popen(command.c_str(), "r"))
+		{
+			char buffer[256];
+			size_t read;
+			while ((read = fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+			{
+				version.append(buffer, read);
+			}
+			pclose(pipe);
+		}
+		versions[glslang] = version;
+		return version;
+	}
+}
+
+bool CompileShader(AssetCache& cache, const std::string& glslang, const std::string& sourcePath, const std::string& outputPath)
+{
+	return cache.Build(sourcePath, "glslang -V " + glslang + "\n" + GetCompilerVersion(glslang), outputPath, [&](const std::string& source, const std::string& output)
+		{
+			std::string command = "\"" + glslang + "\" -V \"" + source + "\" -o \"" + output + "\"";
+#ifdef _WIN32
+			// cmd strips the outer quotes of the whole line
+			command = "\"" + command + "\"";
+#endif
+			if (std::system(command.c_str()) != 0)
+			{
+				std::cout << "failed to compile " << source << std::endl;
+				return false;
+			}
+			return true;
+		});
+}
+
+bool IsShaderSource(const std::string& path)
+{
+	const std::string extension = std::filesystem::path(path).extension().string();
+	return extension == ".vert" || extension == ".frag" || extension == ".comp";
+}
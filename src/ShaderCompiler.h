@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+class AssetCache;
+
+// compiles glsl to SPIR-V with glslangValidator through the cache, the compiler's path and --version output are part
+// of the key since another version may produce different code. #include'd files are not hashed, the shaders do not use any yet
+bool CompileShader(AssetCache& cache, const std::string& glslang, const std::string& sourcePath, const std::string& outputPath);
+bool IsShaderSource(const std::string& path);
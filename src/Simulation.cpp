@@ -0,0 +1,151 @@
+#include "Simulation.h"
+
+#include <algorithm>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "CpuProfiler.h"
+
+void Simulation::Init(const CameraPath& cameraPath, const std::vector<glm::mat4>& bodies, float tickRate)
+{
+	m_CameraPath = cameraPath;
+	m_Bodies = bodies;
+	m_TickRate = std::max(tickRate, 1.f);
+	m_TickLength = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / m_TickRate));
+
+	// every body spins about its up axis, neighbours at different rates and directions
+	m_SpinRates.resize(m_Bodies.size());
+	for (size_t i = 0; i < m_Bodies.size(); ++i)
+	{
+		m_SpinRates[i] = (i % 2 ? -1.f : 1.f) * (0.5f + 0.25f * static_cast<float>(i % 7));
+	}
+
+	// sized once, ticks only copy into them
+	m_State.transforms.resize(m_Bodies.size());
+	for (uint32_t i = 0; i < 3; ++i)
+	{
+		m_Snapshots.GetSlot(i).previous.transforms.resize(m_Bodies.size());
+		m_Snapshots.GetSlot(i).current.transforms.resize(m_Bodies.size());
+	}
+
+	// tick 0 rests at time 0, there is always a snapshot to render from
+	m_Tick = 0;
+	Evaluate(0.0, m_State);
+	Publish(std::chrono::steady_clock::now());
+	m_Tick = 1;
+}
+
+void Simulation::Start()
+{
+	m_Quit = false;
+	m_Thread = std::thread(&Simulation::ThreadLoop, this);
+}
+
+void Simulation::Stop()
+{
+	if (!m_Thread.joinable())
+	{
+		return;
+	}
+	m_Quit = true;
+	m_Thread.join();
+}
+
+void Simulation::Tick()
+{
+	PROFILE_FUNCTION();
+	Publish(std::chrono::steady_clock::now());
+	m_Tick++;
+	m_Ticks++;
+}
+
+const FrameSnapshot& Simulation::AcquireLatest()
+{
+	m_Snapshots.Acquire();
+	return m_Snapshots.GetReadSlot();
+}
+
+float Simulation::GetAlpha(const FrameSnapshot& snapshot, std::chrono::steady_clock::time_point now) const
+{
+	const float alpha = std::chrono::duration<float>(now - snapshot.due) / std::chrono::duration<float>(m_TickLength);
+	return std::clamp(alpha, 0.f, 1.f);
+}
+
+void Simulation::Interpolate(const FrameSnapshot& snapshot, float alpha, SimulationState& outState)
+{
+	const SimulationState& from = snapshot.previous;
+	const SimulationState& to = snapshot.current;
+	outState.time = from.time + (to.time - from.time) * alpha;
+	outState.eye = glm::mix(from.eye, to.eye, alpha);
+	outState.target = glm::mix(from.target, to.target, alpha);
+
+	// a tick turns a body by a few degrees at most, blending the matrices does not visibly shrink it
+	outState.transforms.resize(to.transforms.size());
+	for (size_t i = 0; i < to.transforms.size(); ++i)
+	{
+		outState.transforms[i] = from.transforms[i] + (to.transforms[i] - from.transforms[i]) * alpha;
+	}
+}
+
+SimulationStats Simulation::GetStats() const
+{
+	SimulationStats stats;
+	stats.ticks = m_Ticks.load(std::memory_order_relaxed);
+	stats.tickMs = m_TickMs.load(std::memory_order_relaxed);
+	stats.droppedTicks = m_DroppedTicks.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void Simulation::ThreadLoop()
+{
+	PROFILE_THREAD("simulation");
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now() + m_TickLength;
+	while (!m_Quit.load(std::memory_order_relaxed))
+	{
+		std::this_thread::sleep_until(next);
+
+		// a stalled thread skips the ticks it cannot catch up on, simulated time jumps ahead with the wall clock
+		const std::chrono::steady_clock::duration behind = std::chrono::steady_clock::now() - next;
+		if (behind > m_TickLength * SIMULATION_MAX_CATCHUP)
+		{
+			const uint64_t dropped = static_cast<uint64_t>(behind / m_TickLength);
+			m_Tick += dropped;
+			next += m_TickLength * dropped;
+			m_DroppedTicks += static_cast<uint32_t>(dropped);
+		}
+
+		{
+			PROFILE_SCOPE("tick");
+			const auto begin = std::chrono::steady_clock::now();
+			Publish(next);
+			m_Tick++;
+			m_Ticks++;
+			m_TickMs.store(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - begin).count(), std::memory_order_relaxed);
+		}
+		next += m_TickLength;
+	}
+}
+
+void Simulation::Evaluate(double time, SimulationState& outState) const
+{
+	outState.time = time;
+	if (!m_CameraPath.IsEmpty())
+	{
+		m_CameraPath.Evaluate(static_cast<float>(time), outState.eye, outState.target);
+	}
+	for (size_t i = 0; i < m_Bodies.size(); ++i)
+	{
+		outState.transforms[i] = glm::rotate(m_Bodies[i], static_cast<float>(time) * m_SpinRates[i], glm::vec3(0.f, 1.f, 0.f));
+	}
+}
+
+void Simulation::Publish(std::chrono::steady_clock::time_point due)
+{
+	FrameSnapshot& snapshot = m_Snapshots.GetWriteSlot();
+	snapshot.tick = m_Tick;
+	snapshot.due = due;
+	snapshot.previous = m_State;
+	Evaluate(static_cast<double>(m_Tick) / m_TickRate, m_State);
+	snapshot.current = m_State;
+	m_Snapshots.Publish();
+}
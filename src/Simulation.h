@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "CameraPath.h"
+#include "TripleBuffer.h"
+#include "glm/glm.hpp"
+
+// a simulation thread that fell further behind than this many ticks drops them instead of catching up
+#define SIMULATION_MAX_CATCHUP 5
+// degrees per simulated second the scene mesh turns about the up axis, 0.2 a frame at 60 ticks
+#define SIMULATION_SCENE_SPIN 12.f
+
+struct SimulationState
+{
+	// simulated seconds since the start
+	double time = 0.0;
+	glm::vec3 eye{ 0.f };
+	glm::vec3 target{ 0.f };
+	// transforms of the engine's dynamic renderables, in renderable order
+	std::vector<glm::mat4> transforms;
+};
+
+// immutable once published, the renderer interpolates from previous to current
+struct FrameSnapshot
+{
+	uint64_t tick = 0;
+	// wall clock time current belongs to, previous is one tick before
+	std::chrono::steady_clock::time_point due;
+	SimulationState previous;
+	SimulationState current;
+};
+
+struct SimulationStats
+{
+	uint64_t ticks = 0;
+	float tickMs = 0.f;
+	uint32_t droppedTicks = 0;
+};
+
+// Fixed rate simulation of the scene's moving parts, the camera path and the dynamic renderables.
+// Windowed runs tick it on its own thread, which publishes every tick as a snapshot through a triple buffer.
+// The render thread takes the newest snapshot every frame and interpolates one tick behind the wall clock,
+// so neither thread waits for the other and the CPU frame costs the slower of the two instead of their sum.
+// Headless runs tick it inline once per frame, which keeps their frames deterministic.
+class Simulation
+{
+public:
+	// bodies are the dynamic renderables' transforms at rest
+	void Init(const CameraPath& cameraPath, const std::vector<glm::mat4>& bodies, float tickRate);
+	void Start();
+	void Stop();
+
+	// advances one tick and publishes it, only call it while the thread is not running
+	void Tick();
+
+	// render thread, the newest snapshot stays valid until the next call
+	const FrameSnapshot& AcquireLatest();
+	// fraction of the way from previous to current at the wall clock time now, rendering lags one tick
+	float GetAlpha(const FrameSnapshot& snapshot, std::chrono::steady_clock::time_point now) const;
+	static void Interpolate(const FrameSnapshot& snapshot, float alpha, SimulationState& outState);
+
+	float GetTickRate() const { return m_TickRate; }
+	SimulationStats GetStats() const;
+
+private:
+	void ThreadLoop();
+	void Evaluate(double time, SimulationState& outState) const;
+	void Publish(std::chrono::steady_clock::time_point due);
+
+	CameraPath m_CameraPath;
+	std::vector<glm::mat4> m_Bodies;
+	std::vector<float> m_SpinRates;
+	float m_TickRate{ 60.f };
+	std::chrono::steady_clock::duration m_TickLength{};
+
+	// owned by whichever thread ticks
+	SimulationState m_State;
+	uint64_t m_Tick{ 0 };
+	TripleBuffer<FrameSnapshot> m_Snapshots;
+
+	std::thread m_Thread;
+	std::atomic<bool> m_Quit{ false };
+	std::atomic<uint64_t> m_Ticks{ 0 };
+	std::atomic<float> m_TickMs{ 0.f };
+	std::atomic<uint32_t> m_DroppedTicks{ 0 };
+};
@@ -1,91 +1,57 @@
 #include "Texture.h"
+#include <fstream>
 #include <iostream>
 
-#include <vk_initializers.h>
+#include "CpuProfiler.h"
 
+// the texture streamer decodes through stb_image, its implementation is compiled here
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
-bool vkutil::LoadImageFromFile(VulkanEngine& engine, const char* file, AllocatedImage& outImage)
-{
-	int texWidth, texHeight, texChannels;
-	stbi_uc* pixels = stbi_load(file, &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-
-	if (!pixels)
-	{
-		std::cout << "Failed to load texture file " << file << std::endl;
-		return false;
-	}
-	void* pixelPtr = pixels;
-	VkDeviceSize imageSize = texWidth * texHeight * 4;
-
-	VkFormat imageFormat = VK_FORMAT_R8G8B8A8_SRGB;
-	AllocatedBuffer stagingBuffer = engine.CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
-
-	void* data;
-	vmaMapMemory(engine.GetAllocator(), stagingBuffer.allocation, &data);
-	memcpy(data, pixelPtr, static_cast<size_t>(imageSize));
-	vmaUnmapMemory(engine.GetAllocator(), stagingBuffer.allocation);
-
-	stbi_image_free(pixels);
-
-	VkExtent3D imageExtent;
-	imageExtent.width = static_cast<uint32_t>(texWidth);
-	imageExtent.height = static_cast<uint32_t>(texHeight);
-	imageExtent.depth = 1;
-
-	VkImageCreateInfo dimgInfo = vkinit::ImageCreateInfo(imageFormat, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, imageExtent);
 
-	AllocatedImage newImage;
-
-	VmaAllocationCreateInfo dimgAllocInfo{};
-	dimgAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+bool vkutil::SaveImageToFile(VulkanEngine& engine, VkImage image, VkExtent2D extent, const char* file)
+{
+	PROFILE_FUNCTION();
+	const VkDeviceSize imageSize = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+	AllocatedBuffer readbackBuffer = engine.CreateBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
 
-	vmaCreateImage(engine.GetAllocator(), &dimgInfo, &dimgAllocInfo, &newImage.image, &newImage.allocation, nullptr);
-	outImage = newImage;
-	
 	engine.ImmediateSubmit([&](VkCommandBuffer cmd)
 		{
-			VkImageSubresourceRange range;
-			range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			range.baseMipLevel = 0;
-			range.levelCount = 1;
-			range.baseArrayLayer = 0;
-			range.layerCount = 1;
-
-			VkImageMemoryBarrier imageBarrierToTransfer{};
-			imageBarrierToTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-			imageBarrierToTransfer.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-			imageBarrierToTransfer.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			imageBarrierToTransfer.image = newImage.image;
-			imageBarrierToTransfer.subresourceRange = range;
-			imageBarrierToTransfer.srcAccessMask = 0;
-			imageBarrierToTransfer.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrierToTransfer);
-
 			VkBufferImageCopy copyRegion{};
-			copyRegion.bufferOffset = 0;
-			copyRegion.bufferRowLength = 0;
-			copyRegion.bufferImageHeight = 0;
-
 			copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			copyRegion.imageSubresource.mipLevel = 0;
-			copyRegion.imageSubresource.baseArrayLayer = 0;
 			copyRegion.imageSubresource.layerCount = 1;
-			copyRegion.imageExtent = imageExtent;
-
-			vkCmdCopyBufferToImage(cmd, stagingBuffer.buffer, newImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-			VkImageMemoryBarrier imageBarrierToFrontTransfer{};
-			imageBarrierToFrontTransfer.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-			imageBarrierToFrontTransfer.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-			imageBarrierToFrontTransfer.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-			imageBarrierToFrontTransfer.image = newImage.image;
-			imageBarrierToFrontTransfer.subresourceRange = range;
-			imageBarrierToFrontTransfer.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-			imageBarrierToFrontTransfer.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			copyRegion.imageExtent = { extent.width, extent.height, 1 };
 
-			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrierToFrontTransfer);
+			vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer.buffer, 1, &copyRegion);
 		});
 
+	std::ofstream output(file, std::ios::binary);
+	if (!output.is_open())
+	{
+		std::cout << "Failed to open image file " << file << std::endl;
+		vmaDestroyBuffer(engine.GetAllocator(), readbackBuffer.buffer, readbackBuffer.allocation);
+		return false;
+	}
+
+	void* data;
+	vmaMapMemory(engine.GetAllocator(), readbackBuffer.allocation, &data);
+	vmaInvalidateAllocation(engine.GetAllocator(), readbackBuffer.allocation, 0, VK_WHOLE_SIZE);
+
+	output << "P6\n" << extent.width << " " << extent.height << "\n255\n";
+	const uint8_t* pixels = static_cast<const uint8_t*>(data);
+	std::vector<uint8_t> row(extent.width * 3);
+	for (uint32_t y = 0; y < extent.height; ++y)
+	{
+		for (uint32_t x = 0; x < extent.width; ++x)
+		{
+			const uint8_t* pixel = pixels + (static_cast<size_t>(y) * extent.width + x) * 4;
+			row[x * 3 + 0] = pixel[0];
+			row[x * 3 + 1] = pixel[1];
+			row[x * 3 + 2] = pixel[2];
+		}
+		output.write(reinterpret_cast<const char*>(row.data()), row.size());
+	}
+
+	vmaUnmapMemory(engine.GetAllocator(), readbackBuffer.allocation);
+	vmaDestroyBuffer(engine.GetAllocator(), readbackBuffer.buffer, readbackBuffer.allocation);
 	return true;
 }
@@ -4,5 +4,6 @@
 
 namespace vkutil
 {
-	bool LoadImageFromFile(VulkanEngine& engine, const char* file, AllocatedImage& outImage);
+	// copies an R8G8B8A8 image in TRANSFER_SRC_OPTIMAL layout back to the host and writes it as a binary ppm
+	bool SaveImageToFile(VulkanEngine& engine, VkImage image, VkExtent2D extent, const char* file);
 }
\ No newline at end of file
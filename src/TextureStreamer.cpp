@@ -0,0 +1,662 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <stb_image.h>
+
+#include "vk_engine.h"
+#include "vk_initializers.h"
+#include "CpuProfiler.h"
+
+namespace
+{
+	constexpr uint32_t BAKED_TEXTURE_MAGIC = 0x58455449; // "ITEX"
+	constexpr uint32_t BAKED_TEXTURE_VERSION = 1;
+	constexpr VkFormat STREAMED_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+void TextureStreamer::Init(VulkanEngine& engine, VkDeviceSize budgetBytes)
+{
+	m_Engine = &engine;
+	m_BudgetBytes = budgetBytes;
+	m_Stats.budgetBytes = budgetBytes;
+
+	// read back by the CPU once the frame slot comes around again, one buffer per slot
+	m_Feedback.resize(m_Engine->GetFramesInFlight());
+	for (AllocatedBuffer& feedback : m_Feedback)
+	{
+		feedback = m_Engine->CreateBuffer(GetFeedbackSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+
+		void* data;
+		vmaMapMemory(m_Engine->GetAllocator(), feedback.allocation, &data);
+		memset(data, 0xff, GetFeedbackSize());
+		vmaFlushAllocation(m_Engine->GetAllocator(), feedback.allocation, 0, VK_WHOLE_SIZE);
+		vmaUnmapMemory(m_Engine->GetAllocator(), feedback.allocation);
+	}
+
+	// mips only go away on the next update, schedule what could be dropped down to the startup levels.
+	// only textures living in the heap under pressure count, any heap when the caller does not know it
+	m_Engine->GetMemoryManager().AddEvictionCallback([this](uint32_t heap, VkDeviceSize bytesToFree)
+		{
+			const MemoryManager& memoryManager = m_Engine->GetMemoryManager();
+			VkDeviceSize evictable = 0;
+			for (const StreamedTexture& texture : m_Textures)
+			{
+				if (texture.mips.empty() || (heap != memoryManager.GetHeapCount() && memoryManager.GetHeapIndex(texture.image.allocation) != heap))
+				{
+					continue;
+				}
+				evictable += MipBytes(texture, texture.residentMip, texture.startupMip);
+			}
+			const VkDeviceSize evicted = std::min(evictable, bytesToFree);
+			m_PressureBytes += evicted;
+			return evicted;
+		});
+
+	m_Worker = std::thread(&TextureStreamer::WorkerLoop, this);
+}
+
+void TextureStreamer::Cleanup()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Quit = true;
+	}
+	m_Condition.notify_all();
+	if (m_Worker.joinable())
+	{
+		m_Worker.join();
+	}
+
+	for (StreamedTexture& texture : m_Textures)
+	{
+		vkDestroyImageView(m_Engine->m_Device, texture.view, nullptr);
+		vmaDestroyImage(m_Engine->GetAllocator(), texture.image.image, texture.image.allocation);
+	}
+	m_Textures.clear();
+
+	for (AllocatedBuffer& feedback : m_Feedback)
+	{
+		vmaDestroyBuffer(m_Engine->GetAllocator(), feedback.buffer, feedback.allocation);
+	}
+	m_Feedback.clear();
+}
+
+bool TextureStreamer::AddTexture(const std::string& sourcePath, uint32_t& outTexture)
+{
+	PROFILE_FUNCTION();
+	const uint32_t slot = FindFreeSlot();
+	if (slot >= TEXTURESTREAMER_MAX_TEXTURES)
+	{
+		std::cout << "texture streamer is full, skipping " << sourcePath << std::endl;
+		return false;
+	}
+
+	// a packed texture was baked when the pack was built, its source is usually not shipped
+	const VirtualFileSystem& fileSystem = m_Engine->GetFileSystem();
+	const std::string bakedPath = sourcePath + ".itex";
+	if (!fileSystem.IsPacked(bakedPath) && !EnsureBaked(m_Engine->GetAssetCache(), sourcePath, bakedPath))
+	{
+		return false;
+	}
+
+	std::vector<uint8_t> bytes;
+	BakedTextureHeader header{};
+	if (fileSystem.ReadRange(bakedPath, 0, sizeof(header), bytes))
+	{
+		memcpy(&header, bytes.data(), sizeof(header));
+	}
+	if (header.magic != BAKED_TEXTURE_MAGIC || header.version != BAKED_TEXTURE_VERSION || header.mipCount == 0)
+	{
+		std::cout << "invalid baked texture " << bakedPath << std::endl;
+		return false;
+	}
+
+	StreamedTexture texture{};
+	texture.bakedPath = bakedPath;
+	texture.mips.resize(header.mipCount);
+	if (!fileSystem.ReadRange(bakedPath, sizeof(header), header.mipCount * sizeof(BakedMip), bytes))
+	{
+		std::cout << "invalid baked texture " << bakedPath << std::endl;
+		return false;
+	}
+	memcpy(texture.mips.data(), bytes.data(), bytes.size());
+
+	texture.startupMip = header.mipCount - 1;
+	for (uint32_t mip = 0; mip < header.mipCount; ++mip)
+	{
+		if (std::max(texture.mips[mip].width, texture.mips[mip].height) <= TEXTURESTREAMER_STARTUP_SIZE)
+		{
+			texture.startupMip = mip;
+			break;
+		}
+	}
+	texture.residentMip = header.mipCount;
+	texture.desiredMip = texture.startupMip;
+	texture.frameMips.resize(m_Engine->GetFramesInFlight(), texture.startupMip);
+
+	std::vector<uint8_t> data;
+	if (!fileSystem.ReadRange(bakedPath, texture.mips[texture.startupMip].offset, MipBytes(texture, texture.startupMip, header.mipCount), data))
+	{
+		std::cout << "failed to read the startup mips of " << bakedPath << std::endl;
+		return false;
+	}
+
+	if (slot == m_Textures.size())
+	{
+		m_Textures.emplace_back();
+	}
+	m_Textures[slot] = std::move(texture);
+	outTexture = slot;
+
+	DeletionQueue uploadQueue;
+	bool resident = false;
+	m_Engine->ImmediateSubmit([&](VkCommandBuffer cmd)
+		{
+			resident = ChangeResidency(cmd, m_Textures[slot], m_Textures[slot].startupMip, data, uploadQueue);
+		});
+	uploadQueue.Flush();
+	if (!resident)
+	{
+		// the slot is free again
+		m_Textures[slot].mips.clear();
+		return false;
+	}
+
+	m_Stats.textureCount++;
+	return true;
+}
+
+void TextureStreamer::RemoveTexture(uint32_t texture)
+{
+	if (texture >= m_Textures.size() || m_Textures[texture].mips.empty())
+	{
+		return;
+	}
+
+	StreamedTexture& removed = m_Textures[texture];
+	m_Stats.residentBytes -= MipBytes(removed, removed.residentMip, static_cast<uint32_t>(removed.mips.size()));
+	m_Stats.textureCount--;
+
+	const AllocatedImage image = removed.image;
+	const VkImageView view = removed.view;
+	VulkanEngine* engine = m_Engine;
+	m_Engine->GetFrameDeletionQueue().PushFunction([=]
+		{
+			vkDestroyImageView(engine->m_Device, view, nullptr);
+			vmaDestroyImage(engine->GetAllocator(), image.image, image.allocation);
+		});
+
+	// with no mips left every update skips the slot, a load still in flight is dropped by ApplyLoads
+	removed.mips.clear();
+	removed.residentMip = 0;
+	removed.startupMip = 0;
+	removed.desiredMip = 0;
+	removed.image = {};
+	removed.view = VK_NULL_HANDLE;
+}
+
+uint32_t TextureStreamer::FindFreeSlot() const
+{
+	for (uint32_t i = 0; i < m_Textures.size(); ++i)
+	{
+		if (m_Textures[i].mips.empty() && !m_Textures[i].loading)
+		{
+			return i;
+		}
+	}
+	return static_cast<uint32_t>(m_Textures.size());
+}
+
+void TextureStreamer::Update(VkCommandBuffer cmd, uint64_t frameNumber, uint32_t frameIndex)
+{
+	PROFILE_FUNCTION();
+	m_Stats.frameUploadBytes = 0;
+
+	ReadFeedback(frameNumber, frameIndex);
+	ApplyLoads(cmd);
+	EnforceBudget(cmd, frameNumber);
+	QueueLoads(frameNumber);
+
+	// the engine binds the current views to this slot right after the update
+	for (StreamedTexture& texture : m_Textures)
+	{
+		texture.frameMips[frameIndex] = texture.residentMip;
+	}
+}
+
+bool TextureStreamer::EnsureBaked(AssetCache& cache, const std::string& sourcePath, const std::string& bakedPath)
+{
+	const std::string parameters = "itex " + std::to_string(BAKED_TEXTURE_VERSION) + " box filter rgba8";
+	return cache.Build(sourcePath, parameters, bakedPath, &Bake);
+}
+
+bool TextureStreamer::Bake(const std::string& sourcePath, const std::string& bakedPath)
+{
+	PROFILE_FUNCTION();
+	int width, height, channels;
+	stbi_uc* pixels = stbi_load(sourcePath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	if (!pixels)
+	{
+		std::cout << "Failed to load texture file " << sourcePath << std::endl;
+		return false;
+	}
+
+	std::vector<std::vector<uint8_t>> levels;
+	std::vector<BakedMip> mips;
+	levels.emplace_back(pixels, pixels + static_cast<size_t>(width) * height * 4);
+	mips.push_back({ 0, levels.back().size(), static_cast<uint32_t>(width), static_cast<uint32_t>(height) });
+	stbi_image_free(pixels);
+
+	// 2x2 box filter down to 1x1, odd edges repeat their last texel
+	while (mips.back().width > 1 || mips.back().height > 1)
+	{
+		const BakedMip& source = mips.back();
+		const std::vector<uint8_t>& sourceTexels = levels.back();
+		const uint32_t mipWidth = std::max(source.width / 2, 1u);
+		const uint32_t mipHeight = std::max(source.height / 2, 1u);
+
+		std::vector<uint8_t> texels(static_cast<size_t>(mipWidth) * mipHeight * 4);
+		for (uint32_t y = 0; y < mipHeight; ++y)
+		{
+			const uint32_t y0 = std::min(y * 2, source.height - 1);
+			const uint32_t y1 = std::min(y * 2 + 1, source.height - 1);
+			for (uint32_t x = 0; x < mipWidth; ++x)
+			{
+				const uint32_t x0 = std::min(x * 2, source.width - 1);
+				const uint32_t x1 = std::min(x * 2 + 1, source.width - 1);
+				for (uint32_t c = 0; c < 4; ++c)
+				{
+					const uint32_t sum = sourceTexels[(y0 * source.width + x0) * 4 + c] + sourceTexels[(y0 * source.width + x1) * 4 + c]
+						+ sourceTexels[(y1 * source.width + x0) * 4 + c] + sourceTexels[(y1 * source.width + x1) * 4 + c];
+					texels[(y * mipWidth + x) * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+				}
+			}
+		}
+
+		mips.push_back({ 0, texels.size(), mipWidth, mipHeight });
+		levels.push_back(std::move(texels));
+	}
+
+	BakedTextureHeader header{ BAKED_TEXTURE_MAGIC, BAKED_TEXTURE_VERSION, static_cast<uint32_t>(width), static_cast<uint32_t>(height), static_cast<uint32_t>(mips.size()) };
+	uint64_t offset = sizeof(header) + mips.size() * sizeof(BakedMip);
+	for (BakedMip& mip : mips)
+	{
+		mip.offset = offset;
+		offset += mip.size;
+	}
+
+	std::ofstream file(bakedPath, std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cout << "failed to write baked texture " << bakedPath << std::endl;
+		return false;
+	}
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(mips.data()), mips.size() * sizeof(BakedMip));
+	for (const std::vector<uint8_t>& texels : levels)
+	{
+		file.write(reinterpret_cast<const char*>(texels.data()), texels.size());
+	}
+
+	std::cout << "baked " << sourcePath << " with " << mips.size() << " mips" << std::endl;
+	return true;
+}
+
+void TextureStreamer::WorkerLoop()
+{
+	PROFILE_THREAD("texture streaming");
+	for (;;)
+	{
+		LoadRequest request;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Condition.wait(lock, [this] { return m_Quit || !m_Requests.empty(); });
+			if (m_Quit)
+			{
+				return;
+			}
+			request = std::move(m_Requests.front());
+			m_Requests.pop_front();
+		}
+
+		LoadResult result;
+		{
+			PROFILE_SCOPE("TextureStreamer::ReadRange");
+			if (!m_Engine->GetFileSystem().ReadRange(request.path, request.offset, request.size, result.data))
+			{
+				std::cout << "failed to stream mips from " << request.path << std::endl;
+				result.data.clear();
+			}
+		}
+		result.request = std::move(request);
+
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Results.push_back(std::move(result));
+	}
+}
+
+TextureStreamer::LoadRequest TextureStreamer::MakeRequest(uint32_t texture, uint32_t firstMip, uint32_t endMip) const
+{
+	// mips are stored finest first, so a run of levels is one contiguous range of the file
+	const StreamedTexture& streamed = m_Textures[texture];
+	LoadRequest request;
+	request.texture = texture;
+	request.firstMip = firstMip;
+	request.endMip = endMip;
+	request.path = streamed.bakedPath;
+	request.offset = streamed.mips[firstMip].offset;
+	request.size = MipBytes(streamed, firstMip, endMip);
+	return request;
+}
+
+void TextureStreamer::ReadFeedback(uint64_t frameNumber, uint32_t frameIndex)
+{
+	// written by the frame that used this slot last, it has been waited for
+	const AllocatedBuffer& feedback = m_Feedback[frameIndex];
+	void* data;
+	vmaMapMemory(m_Engine->GetAllocator(), feedback.allocation, &data);
+	vmaInvalidateAllocation(m_Engine->GetAllocator(), feedback.allocation, 0, VK_WHOLE_SIZE);
+
+	uint32_t* lods = static_cast<uint32_t*>(data);
+	for (size_t i = 0; i < m_Textures.size(); ++i)
+	{
+		if (lods[i] == TEXTURESTREAMER_FEEDBACK_NONE || m_Textures[i].mips.empty())
+		{
+			continue;
+		}
+
+		StreamedTexture& texture = m_Textures[i];
+		// the lod is relative to the finest mip the frame had bound
+		const int32_t mip = static_cast<int32_t>(texture.frameMips[frameIndex]) + static_cast<int32_t>(lods[i]) - TEXTURESTREAMER_FEEDBACK_BIAS;
+		texture.desiredMip = static_cast<uint32_t>(std::clamp(mip, 0, static_cast<int32_t>(texture.mips.size()) - 1));
+		texture.lastUsedFrame = frameNumber;
+	}
+
+	memset(data, 0xff, GetFeedbackSize());
+	vmaFlushAllocation(m_Engine->GetAllocator(), feedback.allocation, 0, VK_WHOLE_SIZE);
+	vmaUnmapMemory(m_Engine->GetAllocator(), feedback.allocation);
+}
+
+void TextureStreamer::ApplyLoads(VkCommandBuffer cmd)
+{
+	FrameVector<LoadResult> results(m_Engine->GetFrameAllocator());
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		// at least one result per frame so a single large mip chain cannot stall forever
+		while (!m_Results.empty() && (results.empty() || m_Stats.frameUploadBytes + m_Results.front().data.size() <= TEXTURESTREAMER_UPLOAD_BYTES_PER_FRAME))
+		{
+			m_Stats.frameUploadBytes += m_Results.front().data.size();
+			results.push_back(std::move(m_Results.front()));
+			m_Results.pop_front();
+		}
+	}
+
+	for (const LoadResult& result : results)
+	{
+		StreamedTexture& texture = m_Textures[result.request.texture];
+		texture.loading = false;
+		m_Stats.pendingLoads--;
+		m_InFlightBytes -= result.request.size;
+
+		// a failed read, or the texture lost mips while the load was in flight
+		if (result.data.empty() || result.request.endMip != texture.residentMip)
+		{
+			continue;
+		}
+
+		if (!ChangeResidency(cmd, texture, result.request.firstMip, result.data, m_Engine->GetFrameDeletionQueue()))
+		{
+			continue;
+		}
+		m_Stats.mipsStreamed += result.request.endMip - result.request.firstMip;
+		m_Stats.bytesStreamed += result.data.size();
+	}
+}
+
+void TextureStreamer::EnforceBudget(VkCommandBuffer cmd, uint64_t frameNumber)
+{
+	const VkDeviceSize budget = m_BudgetBytes > m_PressureBytes ? m_BudgetBytes - m_PressureBytes : 0;
+	m_PressureBytes = 0;
+
+	// over budget, the least recently sampled textures give up their finest mip, visible or not
+	while (m_Stats.residentBytes > budget)
+	{
+		StreamedTexture* victim = FindEvictionVictim(UINT64_MAX);
+		if (!victim)
+		{
+			break;
+		}
+		// the smaller image could not be allocated, the victim would be picked again forever
+		if (!ChangeResidency(cmd, *victim, victim->residentMip + 1, {}, m_Engine->GetFrameDeletionQueue()))
+		{
+			break;
+		}
+		m_Stats.mipsEvicted++;
+	}
+
+	// visible textures waiting for room only take it from textures that have been idle for a while
+	const uint64_t idleBefore = frameNumber > TEXTURESTREAMER_IDLE_FRAMES ? frameNumber - TEXTURESTREAMER_IDLE_FRAMES : 0;
+	while (m_WantedBytes > 0 && m_Stats.residentBytes + m_InFlightBytes + m_WantedBytes > budget)
+	{
+		StreamedTexture* victim = FindEvictionVictim(idleBefore);
+		if (!victim)
+		{
+			break;
+		}
+		// the smaller image could not be allocated, the victim would be picked again forever
+		if (!ChangeResidency(cmd, *victim, victim->residentMip + 1, {}, m_Engine->GetFrameDeletionQueue()))
+		{
+			break;
+		}
+		m_Stats.mipsEvicted++;
+	}
+	m_WantedBytes = 0;
+}
+
+void TextureStreamer::QueueLoads(uint64_t frameNumber)
+{
+	// most recently sampled first
+	FrameVector<uint32_t> candidates(m_Engine->GetFrameAllocator());
+	for (uint32_t i = 0; i < m_Textures.size(); ++i)
+	{
+		const StreamedTexture& texture = m_Textures[i];
+		if (!texture.loading && texture.desiredMip < texture.residentMip)
+		{
+			candidates.push_back(i);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b)
+		{
+			return m_Textures[a].lastUsedFrame > m_Textures[b].lastUsedFrame;
+		});
+
+	FrameVector<LoadRequest> requests(m_Engine->GetFrameAllocator());
+	for (uint32_t index : candidates)
+	{
+		if (m_Stats.pendingLoads >= TEXTURESTREAMER_MAX_PENDING_LOADS)
+		{
+			break;
+		}
+
+		// the finest of the wanted mips that still fits the budget
+		StreamedTexture& texture = m_Textures[index];
+		uint32_t firstMip = texture.desiredMip;
+		while (firstMip < texture.residentMip && m_Stats.residentBytes + m_InFlightBytes + MipBytes(texture, firstMip, texture.residentMip) > m_BudgetBytes)
+		{
+			firstMip++;
+		}
+
+		if (firstMip != texture.desiredMip && frameNumber == texture.lastUsedFrame)
+		{
+			m_WantedBytes += MipBytes(texture, texture.desiredMip, firstMip);
+		}
+		if (firstMip == texture.residentMip)
+		{
+			continue;
+		}
+
+		requests.push_back(MakeRequest(index, firstMip, texture.residentMip));
+		texture.loading = true;
+		m_Stats.pendingLoads++;
+		m_InFlightBytes += requests.back().size;
+	}
+
+	if (requests.empty())
+	{
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		for (LoadRequest& request : requests)
+		{
+			m_Requests.push_back(std::move(request));
+		}
+	}
+	m_Condition.notify_one();
+}
+
+TextureStreamer::StreamedTexture* TextureStreamer::FindEvictionVictim(uint64_t usedBefore)
+{
+	StreamedTexture* victim = nullptr;
+	for (StreamedTexture& texture : m_Textures)
+	{
+		if (texture.loading || texture.residentMip >= texture.startupMip || texture.lastUsedFrame >= usedBefore)
+		{
+			continue;
+		}
+		if (!victim || texture.lastUsedFrame < victim->lastUsedFrame)
+		{
+			victim = &texture;
+		}
+	}
+	return victim;
+}
+
+bool TextureStreamer::ChangeResidency(VkCommandBuffer cmd, StreamedTexture& texture, uint32_t firstMip, const std::vector<uint8_t>& data, DeletionQueue& retireQueue)
+{
+	const uint32_t mipCount = static_cast<uint32_t>(texture.mips.size());
+	const uint32_t levelCount = mipCount - firstMip;
+	const uint32_t oldMip = texture.residentMip;
+	const bool hasOldImage = texture.image.image != VK_NULL_HANDLE;
+
+	VkImageCreateInfo imageInfo = vkinit::ImageCreateInfo(STREAMED_FORMAT, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+		{ texture.mips[firstMip].width, texture.mips[firstMip].height, 1 });
+	imageInfo.mipLevels = levelCount;
+
+	AllocatedImage image;
+	if (m_Engine->GetMemoryManager().CreateImage(imageInfo, VMA_MEMORY_USAGE_GPU_ONLY, MemoryCategory::Textures, image) != VK_SUCCESS)
+	{
+		std::cout << "failed to allocate " << levelCount << " mips of " << texture.bakedPath << std::endl;
+		return false;
+	}
+
+	VkImageViewCreateInfo viewInfo = vkinit::ImageViewCreateInfo(STREAMED_FORMAT, image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+	viewInfo.subresourceRange.levelCount = levelCount;
+	VkImageView view;
+	vkCreateImageView(m_Engine->m_Device, &viewInfo, nullptr, &view);
+
+	AllocatedBuffer staging{};
+	if (!data.empty())
+	{
+		staging = m_Engine->CreateStagingBuffer(data.size());
+		void* mapped;
+		vmaMapMemory(m_Engine->GetAllocator(), staging.allocation, &mapped);
+		memcpy(mapped, data.data(), data.size());
+		vmaUnmapMemory(m_Engine->GetAllocator(), staging.allocation);
+	}
+
+	VkImageMemoryBarrier barriers[2]{};
+	barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barriers[0].image = image.image;
+	barriers[0].subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount, 0, 1 };
+	barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+	// earlier frames sampled the old image, its mips are copied over rather than read from disk again
+	barriers[1] = barriers[0];
+	barriers[1].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	barriers[1].image = texture.image.image;
+	barriers[1].subresourceRange.levelCount = mipCount - oldMip;
+	barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, hasOldImage ? 2 : 1, barriers);
+
+	if (hasOldImage)
+	{
+		std::vector<VkImageCopy> copies;
+		for (uint32_t mip = std::max(firstMip, oldMip); mip < mipCount; ++mip)
+		{
+			VkImageCopy copy{};
+			copy.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip - oldMip, 0, 1 };
+			copy.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip - firstMip, 0, 1 };
+			copy.extent = { texture.mips[mip].width, texture.mips[mip].height, 1 };
+			copies.push_back(copy);
+		}
+		vkCmdCopyImage(cmd, texture.image.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(copies.size()), copies.data());
+	}
+
+	if (!data.empty())
+	{
+		std::vector<VkBufferImageCopy> regions;
+		VkDeviceSize offset = 0;
+		for (uint32_t mip = firstMip; mip < oldMip; ++mip)
+		{
+			VkBufferImageCopy region{};
+			region.bufferOffset = offset;
+			region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, mip - firstMip, 0, 1 };
+			region.imageExtent = { texture.mips[mip].width, texture.mips[mip].height, 1 };
+			regions.push_back(region);
+			offset += texture.mips[mip].size;
+		}
+		vkCmdCopyBufferToImage(cmd, staging.buffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+	}
+
+	barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+	barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, barriers);
+
+	// frames still in flight sample the old image until their slot binds the new view
+	const AllocatedImage oldImage = texture.image;
+	const VkImageView oldView = texture.view;
+	VmaAllocator allocator = m_Engine->GetAllocator();
+	VkDevice device = m_Engine->m_Device;
+	retireQueue.PushFunction([=]
+		{
+			if (oldImage.image != VK_NULL_HANDLE)
+			{
+				vkDestroyImageView(device, oldView, nullptr);
+				vmaDestroyImage(allocator, oldImage.image, oldImage.allocation);
+			}
+			if (staging.buffer != VK_NULL_HANDLE)
+			{
+				vmaDestroyBuffer(allocator, staging.buffer, staging.allocation);
+			}
+		});
+
+	m_Stats.residentBytes += MipBytes(texture, firstMip, mipCount);
+	m_Stats.residentBytes -= MipBytes(texture, oldMip, mipCount);
+	texture.image = image;
+	texture.view = view;
+	texture.residentMip = firstMip;
+	return true;
+}
+
+VkDeviceSize TextureStreamer::MipBytes(const StreamedTexture& texture, uint32_t firstMip, uint32_t endMip) const
+{
+	VkDeviceSize bytes = 0;
+	for (uint32_t mip = firstMip; mip < endMip && mip < texture.mips.size(); ++mip)
+	{
+		bytes += texture.mips[mip].size;
+	}
+	return bytes;
+}
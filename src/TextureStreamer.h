@@ -0,0 +1,157 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vk_types.h"
+
+class VulkanEngine;
+class AssetCache;
+struct DeletionQueue;
+
+// feedback slots, one per streamed texture
+#define TEXTURESTREAMER_MAX_TEXTURES 256
+// mips whose larger edge is at most this many texels are loaded at startup and never evicted
+#define TEXTURESTREAMER_STARTUP_SIZE 64
+#define TEXTURESTREAMER_UPLOAD_BYTES_PER_FRAME (16 * 1024 * 1024)
+#define TEXTURESTREAMER_MAX_PENDING_LOADS 8
+// textures not sampled for this many frames give up mips to make room for visible ones
+#define TEXTURESTREAMER_IDLE_FRAMES 120
+// the shader adds this to the sampled lod so magnification still encodes as a positive number
+#define TEXTURESTREAMER_FEEDBACK_BIAS 16
+#define TEXTURESTREAMER_FEEDBACK_NONE 0xffffffffu
+
+// header of a baked texture, followed by the mip table and the mips themselves, finest first
+struct BakedTextureHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mipCount;
+};
+
+struct BakedMip
+{
+	uint64_t offset;
+	uint64_t size;
+	uint32_t width;
+	uint32_t height;
+};
+
+struct TextureStreamerStats
+{
+	uint32_t textureCount = 0;
+	VkDeviceSize residentBytes = 0;
+	VkDeviceSize budgetBytes = 0;
+	uint32_t pendingLoads = 0;
+	uint32_t mipsStreamed = 0;
+	uint32_t mipsEvicted = 0;
+	VkDeviceSize bytesStreamed = 0;
+	VkDeviceSize frameUploadBytes = 0;
+};
+
+// Streams mip levels of RGBA8 textures in and out under a VRAM budget.
+// Sources are baked once into a file holding the whole mip chain, at startup only the small mips are uploaded.
+// The mesh shader reports the finest lod it sampled every texture at, from that each texture gets a desired mip.
+// A worker thread reads the missing mips from the baked file, the main thread swaps in a larger image
+// that keeps the old mips and takes the new ones. Over budget the least recently seen textures lose mips.
+class TextureStreamer
+{
+public:
+	void Init(VulkanEngine& engine, VkDeviceSize budgetBytes);
+	void Cleanup();
+
+	// bakes the source unless a mounted pack has its baked file and uploads the startup mips,
+	// outTexture is the feedback slot the material passes to the shader
+	bool AddTexture(const std::string& sourcePath, uint32_t& outTexture);
+	// the image is retired through the frame deletion queue, the slot is reused once no load for it is in flight
+	void RemoveTexture(uint32_t texture);
+
+	// reads this frame slot's feedback, applies finished loads and evictions and queues new loads.
+	// call after the frame's timeline wait and vkBeginCommandBuffer, outside of any render pass
+	void Update(VkCommandBuffer cmd, uint64_t frameNumber, uint32_t frameIndex);
+
+	VkImageView GetImageView(uint32_t texture) const { return m_Textures[texture].view; }
+	VkBuffer GetFeedbackBuffer(uint32_t frameIndex) const { return m_Feedback[frameIndex].buffer; }
+	VkDeviceSize GetFeedbackSize() const { return TEXTURESTREAMER_MAX_TEXTURES * sizeof(uint32_t); }
+	const TextureStreamerStats& GetStats() const { return m_Stats; }
+
+	// bakes through the cache, so the baked file is only rebuilt when the source's contents change
+	static bool EnsureBaked(AssetCache& cache, const std::string& sourcePath, const std::string& bakedPath);
+	static bool Bake(const std::string& sourcePath, const std::string& bakedPath);
+
+private:
+	struct StreamedTexture
+	{
+		std::string bakedPath;
+		// empty for a removed texture
+		std::vector<BakedMip> mips;
+		// finest mip in the image, the image holds residentMip..mips.size()-1
+		uint32_t residentMip;
+		// coarsest level the texture may be evicted down to
+		uint32_t startupMip;
+		uint32_t desiredMip;
+		uint64_t lastUsedFrame;
+		bool loading;
+		// residentMip bound in each frame slot, the feedback lod is relative to it
+		std::vector<uint32_t> frameMips;
+		AllocatedImage image;
+		VkImageView view;
+	};
+
+	// carries its own copy of the file range, the worker never touches m_Textures
+	struct LoadRequest
+	{
+		uint32_t texture;
+		uint32_t firstMip;
+		uint32_t endMip;
+		std::string path;
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	struct LoadResult
+	{
+		LoadRequest request;
+		std::vector<uint8_t> data;
+	};
+
+	void WorkerLoop();
+	LoadRequest MakeRequest(uint32_t texture, uint32_t firstMip, uint32_t endMip) const;
+
+	void ReadFeedback(uint64_t frameNumber, uint32_t frameIndex);
+	void ApplyLoads(VkCommandBuffer cmd);
+	void EnforceBudget(VkCommandBuffer cmd, uint64_t frameNumber);
+	void QueueLoads(uint64_t frameNumber);
+	StreamedTexture* FindEvictionVictim(uint64_t usedBefore);
+	uint32_t FindFreeSlot() const;
+
+	// moves the texture to a new image holding firstMip and coarser, data has the mips the old image lacks.
+	// false if the new image could not be allocated, the texture keeps its old one
+	bool ChangeResidency(VkCommandBuffer cmd, StreamedTexture& texture, uint32_t firstMip, const std::vector<uint8_t>& data, DeletionQueue& retireQueue);
+	VkDeviceSize MipBytes(const StreamedTexture& texture, uint32_t firstMip, uint32_t endMip) const;
+
+	VulkanEngine* m_Engine{ nullptr };
+	VkDeviceSize m_BudgetBytes{ 0 };
+	// asked for by memory manager eviction, taken off the budget on the next update
+	VkDeviceSize m_PressureBytes{ 0 };
+	// mips visible textures want but that did not fit, idle textures make room for them
+	VkDeviceSize m_WantedBytes{ 0 };
+	VkDeviceSize m_InFlightBytes{ 0 };
+
+	std::vector<StreamedTexture> m_Textures;
+	std::vector<AllocatedBuffer> m_Feedback;
+	TextureStreamerStats m_Stats;
+
+	std::thread m_Worker;
+	std::mutex m_Mutex;
+	std::condition_variable m_Condition;
+	std::deque<LoadRequest> m_Requests;
+	std::deque<LoadResult> m_Results;
+	bool m_Quit{ false };
+};
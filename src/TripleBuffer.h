@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single producer, single consumer hand-off of the newest value.
+// The producer and the consumer each own one of three slots, the third is shared and swapped with an atomic exchange.
+// Neither side ever waits: the producer may publish faster than the consumer reads, the consumer then skips to the newest.
+template<typename T>
+class TripleBuffer
+{
+public:
+	// for sizing the slots before either side starts
+	T& GetSlot(uint32_t index) { return m_Slots[index]; }
+
+	// producer side, fill the write slot, then publish it
+	T& GetWriteSlot() { return m_Slots[m_Write]; }
+	void Publish()
+	{
+		// release makes the slot's contents visible to the consumer that picks it up
+		m_Write = m_Shared.exchange(static_cast<uint8_t>(m_Write | FRESH), std::memory_order_acq_rel) & INDEX;
+	}
+
+	// consumer side, swaps in the newest published slot, false keeps the one read before
+	bool Acquire()
+	{
+		if ((m_Shared.load(std::memory_order_relaxed) & FRESH) == 0)
+		{
+			return false;
+		}
+		m_Read = m_Shared.exchange(m_Read, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+	const T& GetReadSlot() const { return m_Slots[m_Read]; }
+
+private:
+	static constexpr uint8_t INDEX = 3;
+	// set while the shared slot holds a value the consumer has not taken yet
+	static constexpr uint8_t FRESH = 4;
+
+	T m_Slots[3];
+	// the two sides run on different cores, keep their indices off each other's cache lines
+	alignas(64) uint8_t m_Write{ 0 };
+	alignas(64) std::atomic<uint8_t> m_Shared{ 1 };
+	alignas(64) uint8_t m_Read{ 2 };
+};
@@ -0,0 +1,366 @@
+#include "VirtualFileSystem.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "CpuProfiler.h"
+#include "ParallelFor.h"
+
+namespace
+{
+	// '/' separated without "." and ".." where they can be resolved, so equal paths compare equal
+	std::string NormalizePath(const std::string& path)
+	{
+		std::string normalized = std::filesystem::path(path).lexically_normal().generic_string();
+		return normalized == "." ? std::string() : normalized;
+	}
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if (m_Data) UnmapViewOfFile(m_Data);
+	if (m_Mapping) CloseHandle(m_Mapping);
+	if (m_File) CloseHandle(m_File);
+#else
+	if (m_Data) munmap(const_cast<uint8_t*>(m_Data), m_Size);
+#endif
+}
+
+bool MappedFile::Open(const char* filename)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	m_File = file;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_File, &size))
+	{
+		return false;
+	}
+	m_Size = static_cast<size_t>(size.QuadPart);
+	// an empty file cannot be mapped, there is nothing to read either
+	if (m_Size == 0)
+	{
+		return true;
+	}
+	m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!m_Mapping)
+	{
+		return false;
+	}
+	m_Data = static_cast<const uint8_t*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+	return m_Data != nullptr;
+#else
+	const int file = open(filename, O_RDONLY);
+	if (file < 0)
+	{
+		return false;
+	}
+	struct stat info;
+	if (fstat(file, &info) != 0 || !S_ISREG(info.st_mode))
+	{
+		close(file);
+		return false;
+	}
+	m_Size = static_cast<size_t>(info.st_size);
+	if (m_Size == 0)
+	{
+		close(file);
+		return true;
+	}
+	void* data = mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, file, 0);
+	// the mapping keeps the file alive
+	close(file);
+	if (data == MAP_FAILED)
+	{
+		m_Size = 0;
+		return false;
+	}
+	m_Data = static_cast<const uint8_t*>(data);
+	return true;
+#endif
+}
+
+bool VirtualFileSystem::Mount(const std::string& packPath, const std::string& mountPoint)
+{
+	PROFILE_FUNCTION();
+	auto pack = std::make_unique<Pack>();
+	pack->path = packPath;
+	pack->mountPoint = NormalizePath(mountPoint);
+	if (!pack->mountPoint.empty() && pack->mountPoint.back() != '/')
+	{
+		pack->mountPoint += '/';
+	}
+
+	if (!pack->file.Open(packPath.c_str()))
+	{
+		std::cout << "failed to open asset pack " << packPath << std::endl;
+		return false;
+	}
+
+	const uint8_t* data = pack->file.GetData();
+	const size_t size = pack->file.GetSize();
+	AssetPackHeader header{};
+	if (size >= sizeof(header))
+	{
+		memcpy(&header, data, sizeof(header));
+	}
+	if (header.magic != ASSETPACK_MAGIC || header.version != ASSETPACK_VERSION || header.blockSize != ASSETPACK_BLOCK_SIZE
+		|| header.tocOffset + static_cast<uint64_t>(header.entryCount) * sizeof(AssetPackEntry) > size || header.namesOffset + header.namesSize > size)
+	{
+		std::cout << "invalid asset pack " << packPath << std::endl;
+		return false;
+	}
+
+	pack->entries.resize(header.entryCount);
+	memcpy(pack->entries.data(), data + header.tocOffset, header.entryCount * sizeof(AssetPackEntry));
+	const char* names = reinterpret_cast<const char*>(data + header.namesOffset);
+	for (uint32_t i = 0; i < header.entryCount; ++i)
+	{
+		const AssetPackEntry& entry = pack->entries[i];
+		if (entry.offset + entry.storedSize > size || static_cast<uint64_t>(entry.nameOffset) + entry.nameLength > header.namesSize)
+		{
+			std::cout << "invalid asset pack " << packPath << std::endl;
+			return false;
+		}
+		pack->lookup.emplace(std::string(names + entry.nameOffset, entry.nameLength), i);
+	}
+
+	std::cout << "mounted " << packPath << " with " << header.entryCount << " entries" << std::endl;
+	m_Packs.push_back(std::move(pack));
+	return true;
+}
+
+void VirtualFileSystem::UnmountAll()
+{
+	m_Packs.clear();
+	m_LooseFiles.clear();
+}
+
+const AssetPackEntry* VirtualFileSystem::Find(const std::string& path, const Pack*& outPack) const
+{
+	if (m_Packs.empty())
+	{
+		return nullptr;
+	}
+
+	const std::string normalized = NormalizePath(path);
+	{
+		std::lock_guard<std::mutex> lock(m_LooseMutex);
+		if (m_LooseFiles.count(normalized))
+		{
+			return nullptr;
+		}
+	}
+	for (auto pack = m_Packs.rbegin(); pack != m_Packs.rend(); ++pack)
+	{
+		const std::string& mountPoint = (*pack)->mountPoint;
+		if (normalized.compare(0, mountPoint.size(), mountPoint) != 0)
+		{
+			continue;
+		}
+		const auto found = (*pack)->lookup.find(normalized.substr(mountPoint.size()));
+		if (found != (*pack)->lookup.end())
+		{
+			outPack = pack->get();
+			return &(*pack)->entries[found->second];
+		}
+	}
+	return nullptr;
+}
+
+bool VirtualFileSystem::DecompressBlocks(const Pack& pack, const AssetPackEntry& entry, uint32_t firstBlock, uint32_t endBlock, uint8_t* destination)
+{
+	const uint8_t* base = pack.file.GetData() + entry.offset;
+	const uint64_t tableSize = static_cast<uint64_t>(entry.blockCount) * sizeof(uint32_t);
+	if (tableSize > entry.storedSize)
+	{
+		return false;
+	}
+
+	// block offsets inside the entry, the table only has sizes
+	std::vector<uint64_t> offsets(endBlock - firstBlock + 1);
+	uint64_t offset = tableSize;
+	for (uint32_t block = 0; block < endBlock; ++block)
+	{
+		uint32_t storedSize;
+		memcpy(&storedSize, base + block * sizeof(uint32_t), sizeof(storedSize));
+		if (block >= firstBlock)
+		{
+			offsets[block - firstBlock] = offset;
+		}
+		offset += storedSize;
+	}
+	offsets.back() = offset;
+	if (offset > entry.storedSize)
+	{
+		return false;
+	}
+
+	std::atomic<bool> valid{ true };
+	auto decompress = [&](uint32_t i)
+	{
+		const uint32_t block = firstBlock + i;
+		const uint64_t blockStart = static_cast<uint64_t>(block) * ASSETPACK_BLOCK_SIZE;
+		const size_t size = static_cast<size_t>(std::min<uint64_t>(ASSETPACK_BLOCK_SIZE, entry.size - blockStart));
+		const size_t storedSize = static_cast<size_t>(offsets[i + 1] - offsets[i]);
+		uint8_t* target = destination + static_cast<size_t>(i) * ASSETPACK_BLOCK_SIZE;
+		if (storedSize == size)
+		{
+			memcpy(target, base + offsets[i], size);
+		}
+		else if (!Lz4Decompress(base + offsets[i], storedSize, target, size))
+		{
+			valid = false;
+		}
+	};
+
+	const uint32_t blockCount = endBlock - firstBlock;
+	if (blockCount >= FILESYSTEM_PARALLEL_BLOCKS)
+	{
+		ParallelFor(blockCount, decompress);
+	}
+	else
+	{
+		for (uint32_t i = 0; i < blockCount; ++i)
+		{
+			decompress(i);
+		}
+	}
+	return valid;
+}
+
+FileData VirtualFileSystem::Open(const std::string& path) const
+{
+	PROFILE_FUNCTION();
+	FileData result;
+
+	const Pack* pack = nullptr;
+	const AssetPackEntry* entry = Find(path, pack);
+	if (!entry)
+	{
+		result.m_Mapping = std::make_unique<MappedFile>();
+		if (result.m_Mapping->Open(path.c_str()))
+		{
+			result.m_Data = result.m_Mapping->GetData();
+			result.m_Size = result.m_Mapping->GetSize();
+			result.m_Valid = true;
+		}
+		return result;
+	}
+
+	// stored entries are used in place, the pack stays mapped while it is mounted
+	if (entry->compression == PackCompression::None)
+	{
+		result.m_Data = pack->file.GetData() + entry->offset;
+		result.m_Size = static_cast<size_t>(entry->size);
+		result.m_Valid = true;
+		return result;
+	}
+
+	result.m_Buffer.resize(static_cast<size_t>(entry->size));
+	if (!DecompressBlocks(*pack, *entry, 0, entry->blockCount, result.m_Buffer.data()))
+	{
+		std::cout << "corrupt entry " << path << " in " << pack->path << std::endl;
+		result.m_Buffer.clear();
+		return result;
+	}
+	result.m_Data = result.m_Buffer.data();
+	result.m_Size = result.m_Buffer.size();
+	result.m_Valid = true;
+	return result;
+}
+
+bool VirtualFileSystem::Read(const std::string& path, std::vector<uint8_t>& outData) const
+{
+	const FileData file = Open(path);
+	if (!file.IsValid())
+	{
+		return false;
+	}
+	outData.assign(file.GetData(), file.GetData() + file.GetSize());
+	return true;
+}
+
+bool VirtualFileSystem::ReadRange(const std::string& path, uint64_t offset, uint64_t size, std::vector<uint8_t>& outData) const
+{
+	const Pack* pack = nullptr;
+	const AssetPackEntry* entry = Find(path, pack);
+	if (!entry)
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open())
+		{
+			return false;
+		}
+		file.seekg(static_cast<std::streamoff>(offset));
+		outData.resize(static_cast<size_t>(size));
+		file.read(reinterpret_cast<char*>(outData.data()), static_cast<std::streamsize>(size));
+		return static_cast<bool>(file);
+	}
+
+	if (offset + size > entry->size)
+	{
+		return false;
+	}
+	if (entry->compression == PackCompression::None)
+	{
+		const uint8_t* data = pack->file.GetData() + entry->offset + offset;
+		outData.assign(data, data + size);
+		return true;
+	}
+
+	const uint32_t firstBlock = static_cast<uint32_t>(offset / ASSETPACK_BLOCK_SIZE);
+	const uint32_t endBlock = static_cast<uint32_t>((offset + size + ASSETPACK_BLOCK_SIZE - 1) / ASSETPACK_BLOCK_SIZE);
+	const uint64_t blocksStart = static_cast<uint64_t>(firstBlock) * ASSETPACK_BLOCK_SIZE;
+	std::vector<uint8_t> blocks(static_cast<size_t>(std::min<uint64_t>(static_cast<uint64_t>(endBlock) * ASSETPACK_BLOCK_SIZE, entry->size) - blocksStart));
+	if (!DecompressBlocks(*pack, *entry, firstBlock, endBlock, blocks.data()))
+	{
+		std::cout << "corrupt entry " << path << " in " << pack->path << std::endl;
+		return false;
+	}
+	const size_t start = static_cast<size_t>(offset - blocksStart);
+	outData.assign(blocks.begin() + start, blocks.begin() + start + static_cast<size_t>(size));
+	return true;
+}
+
+bool VirtualFileSystem::Exists(const std::string& path) const
+{
+	std::error_code error;
+	return IsPacked(path) || std::filesystem::is_regular_file(path, error);
+}
+
+void VirtualFileSystem::PreferLooseFile(const std::string& path)
+{
+	if (m_Packs.empty())
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lock(m_LooseMutex);
+	m_LooseFiles.insert(NormalizePath(path));
+}
+
+bool VirtualFileSystem::IsPacked(const std::string& path) const
+{
+	const Pack* pack = nullptr;
+	return Find(path, pack) != nullptr;
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "AssetPack.h"
+
+#ifdef _WIN32
+typedef void* HANDLE;
+#endif
+
+// compressed reads spanning fewer blocks decompress on the calling thread
+#define FILESYSTEM_PARALLEL_BLOCKS 8
+
+// read only view of a whole file, pages are faulted in as they are read
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	bool Open(const char* filename);
+
+	const uint8_t* GetData() const { return m_Data; }
+	size_t GetSize() const { return m_Size; }
+
+private:
+	const uint8_t* m_Data = nullptr;
+	size_t m_Size = 0;
+#ifdef _WIN32
+	HANDLE m_File = nullptr;
+	HANDLE m_Mapping = nullptr;
+#endif
+};
+
+// A whole file, either a view into a mapping (loose files and uncompressed pack entries)
+// or the buffer a compressed entry was decompressed into.
+class FileData
+{
+public:
+	bool IsValid() const { return m_Valid; }
+	const uint8_t* GetData() const { return m_Data; }
+	size_t GetSize() const { return m_Size; }
+
+private:
+	friend class VirtualFileSystem;
+
+	std::unique_ptr<MappedFile> m_Mapping;
+	std::vector<uint8_t> m_Buffer;
+	const uint8_t* m_Data = nullptr;
+	size_t m_Size = 0;
+	bool m_Valid = false;
+};
+
+// lets std::istream based parsers read a FileData without copying it
+class MemoryStreamBuffer : public std::streambuf
+{
+public:
+	MemoryStreamBuffer(const uint8_t* data, size_t size)
+	{
+		char* begin = const_cast<char*>(reinterpret_cast<const char*>(data));
+		setg(begin, begin, begin + size);
+	}
+};
+
+// Resolves the paths the loaders already use to entries of mounted asset packs,
+// a path no pack has is read from disk as is, so loose files keep working next to packs.
+// Reads are safe from any thread, Mount and UnmountAll are not.
+class VirtualFileSystem
+{
+public:
+	// entries are found below mountPoint, mounted at "../../" the entry "assets/a.png" is read for "../../assets/a.png".
+	// packs mounted later are searched first
+	bool Mount(const std::string& packPath, const std::string& mountPoint);
+	void UnmountAll();
+
+	FileData Open(const std::string& path) const;
+	bool Read(const std::string& path, std::vector<uint8_t>& outData) const;
+	// a compressed entry only decompresses the blocks the range touches
+	bool ReadRange(const std::string& path, uint64_t offset, uint64_t size, std::vector<uint8_t>& outData) const;
+
+	bool Exists(const std::string& path) const;
+	bool IsPacked(const std::string& path) const;
+
+	// the loose file is read from now on even where a pack has the path, for files edited while the engine runs
+	void PreferLooseFile(const std::string& path);
+
+	uint32_t GetPackCount() const { return static_cast<uint32_t>(m_Packs.size()); }
+
+private:
+	struct Pack
+	{
+		std::string path;
+		// normalized, ends with '/' unless empty
+		std::string mountPoint;
+		MappedFile file;
+		std::vector<AssetPackEntry> entries;
+		std::unordered_map<std::string, uint32_t> lookup;
+	};
+
+	const AssetPackEntry* Find(const std::string& path, const Pack*& outPack) const;
+	// blocks [firstBlock, endBlock) of a compressed entry into destination, in parallel when there are enough of them
+	static bool DecompressBlocks(const Pack& pack, const AssetPackEntry& entry, uint32_t firstBlock, uint32_t endBlock, uint8_t* destination);
+
+	std::vector<std::unique_ptr<Pack>> m_Packs;
+	// normalized paths, the streaming worker reads while the main thread adds
+	std::unordered_set<std::string> m_LooseFiles;
+	mutable std::mutex m_LooseMutex;
+};
@@ -1,10 +1,126 @@
 #include <vk_engine.h>
 
+#include <cstdlib>
+#include <cstring>
+
+#include "CpuProfiler.h"
+
 int main(int argc, char* argv[])
 {
+	EngineConfig config;
+
+	// --headless [--frames <n>] [--stats <file.csv>] [--readback <file.ppm>] [--camera <path>]
+	// --trace-startup <file.json>, --trace-frames <first> <count> <file.json>, --texture-budget <mb>
+	// --frames-in-flight <n>, --present <fifo|mailbox|immediate>, --low-latency, --fps-limit <fps>
+	// --obj-importer <fast|tinyobj>, --pack <file.ipak> (an empty name mounts nothing)
+	// --no-hot-reload, --glslang <path>, --lights <n>, --frame-budget <ms> [--min-scale <fraction>]
+	// --sim-rate <hz>, --dump-graph <file.txt>
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--headless") == 0)
+		{
+			config.headless = true;
+		}
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+		{
+			config.frameCount = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc)
+		{
+			config.statsPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--readback") == 0 && i + 1 < argc)
+		{
+			config.readbackPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--dump-graph") == 0 && i + 1 < argc)
+		{
+			config.graphDumpPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--camera") == 0 && i + 1 < argc)
+		{
+			config.cameraPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--trace-startup") == 0 && i + 1 < argc)
+		{
+			CpuProfiler::Get().RequestStartupCapture(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--trace-frames") == 0 && i + 3 < argc)
+		{
+			const uint64_t first = strtoull(argv[i + 1], nullptr, 10);
+			const uint32_t count = static_cast<uint32_t>(strtoul(argv[i + 2], nullptr, 10));
+			CpuProfiler::Get().RequestFrameCapture(first, count, argv[i + 3]);
+			i += 3;
+		}
+		else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc)
+		{
+			config.textureBudgetMb = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc)
+		{
+			config.framesInFlight = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--present") == 0 && i + 1 < argc)
+		{
+			const char* mode = argv[++i];
+			if (strcmp(mode, "fifo") == 0)
+			{
+				config.presentMode = PresentMode::Fifo;
+			}
+			else if (strcmp(mode, "immediate") == 0)
+			{
+				config.presentMode = PresentMode::Immediate;
+			}
+			else
+			{
+				config.presentMode = PresentMode::Mailbox;
+			}
+		}
+		else if (strcmp(argv[i], "--low-latency") == 0)
+		{
+			config.lowLatency = true;
+		}
+		else if (strcmp(argv[i], "--no-hot-reload") == 0)
+		{
+			config.hotReload = false;
+		}
+		else if (strcmp(argv[i], "--glslang") == 0 && i + 1 < argc)
+		{
+			config.glslangPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+		{
+			config.lightCount = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+		}
+		else if (strcmp(argv[i], "--frame-budget") == 0 && i + 1 < argc)
+		{
+			config.frameBudgetMs = static_cast<float>(strtod(argv[++i], nullptr));
+		}
+		else if (strcmp(argv[i], "--min-scale") == 0 && i + 1 < argc)
+		{
+			config.minResolutionScale = static_cast<float>(strtod(argv[++i], nullptr));
+		}
+		else if (strcmp(argv[i], "--sim-rate") == 0 && i + 1 < argc)
+		{
+			config.simulationRate = static_cast<float>(strtod(argv[++i], nullptr));
+		}
+		else if (strcmp(argv[i], "--pack") == 0 && i + 1 < argc)
+		{
+			config.assetPack = argv[++i];
+		}
+		else if (strcmp(argv[i], "--fps-limit") == 0 && i + 1 < argc)
+		{
+			config.fpsLimit = static_cast<float>(strtod(argv[++i], nullptr));
+		}
+		else if (strcmp(argv[i], "--obj-importer") == 0 && i + 1 < argc)
+		{
+			config.objImporter = strcmp(argv[++i], "tinyobj") == 0 ? ObjImporter::TinyObj : ObjImporter::Fast;
+		}
+	}
+
 	VulkanEngine engine;
 
-	engine.Init();	
+	engine.Init(config);	
 	
 	engine.run();	
 
@@ -0,0 +1,177 @@
+#include "vk_ClusteredLights.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include "vk_engine.h"
+#include "vk_initializers.h"
+#include "CpuProfiler.h"
+
+void ClusteredLights::Init(VulkanEngine& engine, VkDescriptorSetLayout globalSetLayout)
+{
+	m_Engine = &engine;
+
+	// the previous frame in the same slot has finished before its buffers are written again
+	m_Frames.resize(m_Engine->GetFramesInFlight());
+	for (FrameBuffers& frame : m_Frames)
+	{
+		frame.lights = m_Engine->CreateBuffer(GetLightBufferSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, MemoryCategory::PerFrame);
+		frame.grid = m_Engine->CreateBuffer(GetGridBufferSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+		frame.indices = m_Engine->CreateBuffer(GetIndexBufferSize(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_ONLY);
+	}
+
+	VkPipelineLayoutCreateInfo layoutInfo = vkinit::PipelineLayoutCreateInfo();
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &globalSetLayout;
+	if (vkCreatePipelineLayout(m_Engine->m_Device, &layoutInfo, nullptr, &m_PipelineLayout) != VK_SUCCESS)
+	{
+		std::cout << "failed to create the light culling pipeline layout" << std::endl;
+		return;
+	}
+	BuildPipeline(m_Pipeline);
+}
+
+void ClusteredLights::Cleanup()
+{
+	vkDestroyPipeline(m_Engine->m_Device, m_Pipeline, nullptr);
+	vkDestroyPipelineLayout(m_Engine->m_Device, m_PipelineLayout, nullptr);
+	for (FrameBuffers& frame : m_Frames)
+	{
+		vmaDestroyBuffer(m_Engine->GetAllocator(), frame.lights.buffer, frame.lights.allocation);
+		vmaDestroyBuffer(m_Engine->GetAllocator(), frame.grid.buffer, frame.grid.allocation);
+		vmaDestroyBuffer(m_Engine->GetAllocator(), frame.indices.buffer, frame.indices.allocation);
+	}
+	m_Frames.clear();
+}
+
+bool ClusteredLights::BuildPipeline(VkPipeline& outPipeline)
+{
+	PROFILE_FUNCTION();
+	outPipeline = VK_NULL_HANDLE;
+
+	VkShaderModule cullShader;
+	if (!m_Engine->LoadShaderModule(SHADERDIRECTORY "light_cull.comp.spv", &cullShader))
+	{
+		std::cout << "Failed to load the light culling shader\n";
+		return false;
+	}
+
+	// constant_id 0 of light_cull.comp sizes the per cluster list, constant_id 1 is the index list capacity
+	const std::array<uint32_t, 2> constants = { CLUSTEREDLIGHTS_MAX_PER_CLUSTER, CLUSTEREDLIGHTS_INDEX_CAPACITY };
+	const std::array<VkSpecializationMapEntry, 2> entries = { {
+		{ 0, 0, sizeof(uint32_t) },
+		{ 1, sizeof(uint32_t), sizeof(uint32_t) } } };
+	VkSpecializationInfo specialization{ static_cast<uint32_t>(entries.size()), entries.data(), sizeof(constants), constants.data() };
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.pNext = nullptr;
+	pipelineInfo.stage = vkinit::PipelineShaderStageCreateInfo(VK_SHADER_STAGE_COMPUTE_BIT, cullShader);
+	pipelineInfo.stage.pSpecializationInfo = &specialization;
+	pipelineInfo.layout = m_PipelineLayout;
+
+	outPipeline = m_Engine->GetPipelineCache().CreateComputePipeline(pipelineInfo);
+	vkDestroyShaderModule(m_Engine->m_Device, cullShader, nullptr);
+	return outPipeline != VK_NULL_HANDLE;
+}
+
+bool ClusteredLights::ReloadPipeline(const std::function<void(std::function<void()>&&)>& retire)
+{
+	VkPipeline pipeline;
+	if (!BuildPipeline(pipeline))
+	{
+		std::cout << "keeping the current light culling pipeline" << std::endl;
+		return false;
+	}
+
+	const VkDevice device = m_Engine->m_Device;
+	const VkPipeline retired = m_Pipeline;
+	retire([=]
+		{
+			vkDestroyPipeline(device, retired, nullptr);
+		});
+	m_Pipeline = pipeline;
+	return true;
+}
+
+void ClusteredLights::Scatter(uint32_t count, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	// fixed seed, every run and every headless capture sees the same lights
+	std::mt19937 random(1337);
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+	const glm::vec3 extent = boundsMax - boundsMin;
+
+	m_Lights.resize(std::min<uint32_t>(count, CLUSTEREDLIGHTS_MAX_LIGHTS));
+	for (PointLight& light : m_Lights)
+	{
+		light.center = boundsMin + extent * glm::vec3(unit(random), unit(random), unit(random));
+		light.radius = 4.f + 8.f * unit(random);
+		// saturated colors, one channel kept bright so no light ends up black
+		light.color = glm::vec3(unit(random), unit(random), unit(random));
+		light.color /= std::max(light.color.r, std::max(light.color.g, light.color.b));
+		light.phase = 6.2831853f * unit(random);
+	}
+}
+
+void ClusteredLights::Update(uint32_t frameIndex, float time, const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar, VkExtent2D extent)
+{
+	PROFILE_FUNCTION();
+	const float depthRange = std::log(zFar / zNear);
+
+	GPULightHeader header;
+	header.inverseProjection = glm::inverse(projection);
+	header.screen = glm::vec4(static_cast<float>(extent.width), static_cast<float>(extent.height),
+		static_cast<float>(CLUSTEREDLIGHTS_GRID_X) / static_cast<float>(std::max(extent.width, 1u)),
+		static_cast<float>(CLUSTEREDLIGHTS_GRID_Y) / static_cast<float>(std::max(extent.height, 1u)));
+	header.depthSlices = glm::vec4(zNear, zFar, CLUSTEREDLIGHTS_GRID_Z / depthRange, CLUSTEREDLIGHTS_GRID_Z * std::log(zNear) / depthRange);
+	header.grid = glm::uvec4(CLUSTEREDLIGHTS_GRID_X, CLUSTEREDLIGHTS_GRID_Y, CLUSTEREDLIGHTS_GRID_Z, GetLightCount());
+
+	const VmaAllocation allocation = m_Frames[frameIndex].lights.allocation;
+	void* data;
+	vmaMapMemory(m_Engine->GetAllocator(), allocation, &data);
+	memcpy(data, &header, sizeof(header));
+
+	// every light circles its center and bobs up and down, shading happens in view space
+	GPUPointLight* lights = reinterpret_cast<GPUPointLight*>(static_cast<char*>(data) + sizeof(GPULightHeader));
+	for (size_t i = 0; i < m_Lights.size(); ++i)
+	{
+		const PointLight& light = m_Lights[i];
+		const float angle = 0.5f * time + light.phase;
+		const glm::vec3 position = light.center + glm::vec3(std::cos(angle) * light.radius, std::sin(2.f * angle), std::sin(angle) * light.radius);
+
+		lights[i].positionRadius = glm::vec4(glm::vec3(view * glm::vec4(position, 1.f)), light.radius);
+		// about full brightness at half the radius
+		lights[i].color = glm::vec4(light.color, 0.5f * light.radius * light.radius);
+	}
+	vmaUnmapMemory(m_Engine->GetAllocator(), allocation);
+}
+
+void ClusteredLights::Cull(VkCommandBuffer cmd, VkDescriptorSet globalSet, uint32_t frameIndex)
+{
+	if (m_Pipeline == VK_NULL_HANDLE)
+	{
+		return;
+	}
+	const VkBuffer indices = m_Frames[frameIndex].indices.buffer;
+
+	// clusters append their lights behind a counter at the start of the index list
+	vkCmdFillBuffer(cmd, indices, 0, sizeof(uint32_t), 0);
+	VkBufferMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = indices;
+	barrier.offset = 0;
+	barrier.size = sizeof(uint32_t);
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_Pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_PipelineLayout, 0, 1, &globalSet, 0, nullptr);
+	vkCmdDispatch(cmd, (CLUSTEREDLIGHTS_CLUSTERS + CLUSTEREDLIGHTS_GROUP_SIZE - 1) / CLUSTEREDLIGHTS_GROUP_SIZE, 1, 1);
+}
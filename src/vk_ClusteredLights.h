@@ -0,0 +1,102 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "vk_types.h"
+#include "glm/glm.hpp"
+
+class VulkanEngine;
+
+// froxel grid, screen tiles in x and y and exponential depth slices between the near and far plane
+#define CLUSTEREDLIGHTS_GRID_X 16
+#define CLUSTEREDLIGHTS_GRID_Y 9
+#define CLUSTEREDLIGHTS_GRID_Z 24
+#define CLUSTEREDLIGHTS_CLUSTERS (CLUSTEREDLIGHTS_GRID_X * CLUSTEREDLIGHTS_GRID_Y * CLUSTEREDLIGHTS_GRID_Z)
+#define CLUSTEREDLIGHTS_MAX_LIGHTS 4096
+// a cluster touched by more lights keeps the first ones it finds
+#define CLUSTEREDLIGHTS_MAX_PER_CLUSTER 64
+// the compact index list all clusters share holds this many lights per cluster on average
+#define CLUSTEREDLIGHTS_AVERAGE_PER_CLUSTER 16
+#define CLUSTEREDLIGHTS_INDEX_CAPACITY (CLUSTEREDLIGHTS_CLUSTERS * CLUSTEREDLIGHTS_AVERAGE_PER_CLUSTER)
+// local_size_x of light_cull.comp, also the number of lights a workgroup stages in shared memory at once
+#define CLUSTEREDLIGHTS_GROUP_SIZE 64
+
+struct PointLight
+{
+	// the light circles around this point
+	glm::vec3 center;
+	float radius;
+	glm::vec3 color;
+	float phase;
+};
+
+// std430 header of the light buffer, the lights follow it
+struct GPULightHeader
+{
+	glm::mat4 inverseProjection;
+	// framebuffer width and height, then cluster tiles per pixel in x and y
+	glm::vec4 screen;
+	// near and far plane, then the scale and bias turning log(view depth) into a depth slice
+	glm::vec4 depthSlices;
+	// grid size in x, y and z, then the light count
+	glm::uvec4 grid;
+};
+
+struct GPUPointLight
+{
+	// view space position and radius
+	glm::vec4 positionRadius;
+	// rgb and intensity
+	glm::vec4 color;
+};
+
+// Clustered forward shading for many dynamic point lights.
+// Every frame the lights are animated and written in view space, then a compute pass bins them into a froxel grid:
+// one invocation per cluster tests every light against the cluster's view space bounds and appends the hits
+// to a compact index list. The mesh fragment shader finds its cluster from the pixel and view depth
+// and only shades the lights listed there.
+class ClusteredLights
+{
+public:
+	// the culling pipeline binds the engine's global set, which carries the light, grid and index buffers
+	void Init(VulkanEngine& engine, VkDescriptorSetLayout globalSetLayout);
+	void Cleanup();
+	// rebuilds the culling pipeline from the current SPIR-V, the old one is handed to retire
+	bool ReloadPipeline(const std::function<void(std::function<void()>&&)>& retire);
+
+	// replaces the lights with count random ones inside the box
+	void Scatter(uint32_t count, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	// animates the lights and fills the frame slot's light buffer, the projection must be the one drawn with
+	void Update(uint32_t frameIndex, float time, const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar, VkExtent2D extent);
+	// resets the index list and dispatches the culling, recorded in a compute pass before the forward pass
+	void Cull(VkCommandBuffer cmd, VkDescriptorSet globalSet, uint32_t frameIndex);
+
+	VkBuffer GetLightBuffer(uint32_t frameIndex) const { return m_Frames[frameIndex].lights.buffer; }
+	VkBuffer GetGridBuffer(uint32_t frameIndex) const { return m_Frames[frameIndex].grid.buffer; }
+	VkBuffer GetIndexBuffer(uint32_t frameIndex) const { return m_Frames[frameIndex].indices.buffer; }
+	static constexpr VkDeviceSize GetLightBufferSize() { return sizeof(GPULightHeader) + CLUSTEREDLIGHTS_MAX_LIGHTS * sizeof(GPUPointLight); }
+	// offset and count of every cluster's range in the index list
+	static constexpr VkDeviceSize GetGridBufferSize() { return CLUSTEREDLIGHTS_CLUSTERS * 2 * sizeof(uint32_t); }
+	// the append counter, then the indices
+	static constexpr VkDeviceSize GetIndexBufferSize() { return (1 + CLUSTEREDLIGHTS_INDEX_CAPACITY) * sizeof(uint32_t); }
+	uint32_t GetLightCount() const { return static_cast<uint32_t>(m_Lights.size()); }
+
+private:
+	bool BuildPipeline(VkPipeline& outPipeline);
+
+	struct FrameBuffers
+	{
+		// host written every frame
+		AllocatedBuffer lights;
+		// written by the culling pass, read by the forward pass
+		AllocatedBuffer grid;
+		AllocatedBuffer indices;
+	};
+
+	VulkanEngine* m_Engine{ nullptr };
+	std::vector<FrameBuffers> m_Frames;
+	std::vector<PointLight> m_Lights;
+	VkPipelineLayout m_PipelineLayout{ VK_NULL_HANDLE };
+	VkPipeline m_Pipeline{ VK_NULL_HANDLE };
+};
@@ -0,0 +1,267 @@
+#include "vk_GeometryPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "CpuProfiler.h"
+#include "vk_engine.h"
+#include "vk_Mesh.h"
+
+namespace
+{
+	constexpr uint32_t MAX_POOL_ALLOCATIONS = 16 * 1024;
+}
+
+void GeometryPool::Init(VulkanEngine& engine, uint32_t maxVertices, uint32_t maxIndices)
+{
+	m_Engine = &engine;
+
+	m_VertexAllocator.Reset(maxVertices, MAX_POOL_ALLOCATIONS);
+	m_IndexAllocator.Reset(maxIndices, MAX_POOL_ALLOCATIONS);
+
+	m_VertexBuffer = CreateGeometryBuffer(static_cast<size_t>(maxVertices) * sizeof(Vertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	m_IndexBuffer = CreateGeometryBuffer(static_cast<size_t>(maxIndices) * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+	RegisterMovable();
+}
+
+void GeometryPool::Cleanup()
+{
+	m_Engine->GetMemoryManager().UnregisterMovableBuffer(m_VertexBuffer.allocation);
+	m_Engine->GetMemoryManager().UnregisterMovableBuffer(m_IndexBuffer.allocation);
+	vmaDestroyBuffer(m_Engine->GetAllocator(), m_VertexBuffer.buffer, m_VertexBuffer.allocation);
+	vmaDestroyBuffer(m_Engine->GetAllocator(), m_IndexBuffer.buffer, m_IndexBuffer.allocation);
+	m_Meshes.clear();
+}
+
+bool GeometryPool::Upload(Mesh& mesh)
+{
+	PROFILE_SCOPE("GeometryPool::Upload");
+	const uint32_t vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+	const uint32_t indexCount = static_cast<uint32_t>(mesh.indices.size());
+
+	const OffsetAllocation vertexAllocation = m_VertexAllocator.Allocate(vertexCount);
+	const OffsetAllocation indexAllocation = m_IndexAllocator.Allocate(indexCount);
+	if (!vertexAllocation.IsValid() || !indexAllocation.IsValid())
+	{
+		std::cout << "Geometry pool out of space for mesh with " << vertexCount << " vertices and " << indexCount << " indices" << std::endl;
+		m_VertexAllocator.Free(vertexAllocation);
+		m_IndexAllocator.Free(indexAllocation);
+		return false;
+	}
+
+	const size_t vertexBufferSize = vertexCount * sizeof(Vertex);
+	const size_t indexBufferSize = indexCount * sizeof(uint32_t);
+
+	AllocatedBuffer stagingBuffer = m_Engine->CreateStagingBuffer(vertexBufferSize + indexBufferSize);
+
+	void* data;
+	vmaMapMemory(m_Engine->GetAllocator(), stagingBuffer.allocation, &data);
+	memcpy(data, mesh.vertices.data(), vertexBufferSize);
+	memcpy(static_cast<char*>(data) + vertexBufferSize, mesh.indices.data(), indexBufferSize);
+	vmaUnmapMemory(m_Engine->GetAllocator(), stagingBuffer.allocation);
+
+	// the frames drawing the mesh wait for the copy on the GPU, the CPU carries on
+	const uint64_t upload = m_Engine->SubmitUpload([&](VkCommandBuffer cmd)
+		{
+			VkBufferCopy copy;
+			copy.srcOffset = 0;
+			copy.dstOffset = static_cast<VkDeviceSize>(vertexAllocation.offset) * sizeof(Vertex);
+			copy.size = vertexBufferSize;
+			vkCmdCopyBuffer(cmd, stagingBuffer.buffer, m_VertexBuffer.buffer, 1, &copy);
+
+			copy.srcOffset = vertexBufferSize;
+			copy.dstOffset = static_cast<VkDeviceSize>(indexAllocation.offset) * sizeof(uint32_t);
+			copy.size = indexBufferSize;
+			vkCmdCopyBuffer(cmd, stagingBuffer.buffer, m_IndexBuffer.buffer, 1, &copy);
+		});
+
+	VulkanEngine* engine = m_Engine;
+	m_Engine->RetireAfterUpload(upload, [=]
+		{
+			vmaDestroyBuffer(engine->GetAllocator(), stagingBuffer.buffer, stagingBuffer.allocation);
+		});
+
+	mesh.vertexAllocation = vertexAllocation;
+	mesh.indexAllocation = indexAllocation;
+	m_Meshes.push_back(&mesh);
+	return true;
+}
+
+void GeometryPool::Free(Mesh& mesh)
+{
+	auto found = std::find(m_Meshes.begin(), m_Meshes.end(), &mesh);
+	if (found == m_Meshes.end())
+	{
+		return;
+	}
+	m_Meshes.erase(found);
+
+	const OffsetAllocation vertexAllocation = mesh.vertexAllocation;
+	const OffsetAllocation indexAllocation = mesh.indexAllocation;
+	mesh.vertexAllocation = {};
+	mesh.indexAllocation = {};
+
+	// a defragment in between rebuilds the allocators, the stale ranges are gone by then
+	const uint32_t generation = m_Generation;
+	m_Engine->GetFrameDeletionQueue().PushFunction([=]
+		{
+			if (generation != m_Generation)
+			{
+				return;
+			}
+			m_VertexAllocator.Free(vertexAllocation);
+			m_IndexAllocator.Free(indexAllocation);
+			m_RangesFreed = true;
+		});
+}
+
+void GeometryPool::Update()
+{
+	if (!m_RangesFreed)
+	{
+		return;
+	}
+	m_RangesFreed = false;
+
+	// many small holes, no single range left for a mesh as big as the ones that were freed
+	const OffsetAllocatorReport vertexReport = m_VertexAllocator.GetReport();
+	const OffsetAllocatorReport indexReport = m_IndexAllocator.GetReport();
+	const bool vertexFragmented = vertexReport.largestFreeRegion < vertexReport.totalFreeSpace * GEOMETRYPOOL_DEFRAG_THRESHOLD;
+	const bool indexFragmented = indexReport.largestFreeRegion < indexReport.totalFreeSpace * GEOMETRYPOOL_DEFRAG_THRESHOLD;
+	if (vertexFragmented || indexFragmented)
+	{
+		Defragment();
+	}
+}
+
+void GeometryPool::Defragment()
+{
+	PROFILE_SCOPE("GeometryPool::Defragment");
+	// keep the relative order so meshes loaded together stay close in memory
+	std::sort(m_Meshes.begin(), m_Meshes.end(), [](const Mesh* a, const Mesh* b)
+		{
+			return a->vertexAllocation.offset < b->vertexAllocation.offset;
+		});
+
+	OffsetAllocator vertexAllocator(m_VertexAllocator.GetSize(), MAX_POOL_ALLOCATIONS);
+	OffsetAllocator indexAllocator(m_IndexAllocator.GetSize(), MAX_POOL_ALLOCATIONS);
+
+	std::vector<VkBufferCopy> vertexCopies;
+	std::vector<VkBufferCopy> indexCopies;
+	std::vector<std::pair<OffsetAllocation, OffsetAllocation>> newAllocations;
+	vertexCopies.reserve(m_Meshes.size());
+	indexCopies.reserve(m_Meshes.size());
+	newAllocations.reserve(m_Meshes.size());
+
+	for (const Mesh* mesh : m_Meshes)
+	{
+		const uint32_t vertexCount = m_VertexAllocator.AllocationSize(mesh->vertexAllocation);
+		const uint32_t indexCount = m_IndexAllocator.AllocationSize(mesh->indexAllocation);
+
+		// a fresh allocator hands ranges out back to back
+		const OffsetAllocation vertexAllocation = vertexAllocator.Allocate(vertexCount);
+		const OffsetAllocation indexAllocation = indexAllocator.Allocate(indexCount);
+		newAllocations.emplace_back(vertexAllocation, indexAllocation);
+
+		VkBufferCopy vertexCopy;
+		vertexCopy.srcOffset = static_cast<VkDeviceSize>(mesh->vertexAllocation.offset) * sizeof(Vertex);
+		vertexCopy.dstOffset = static_cast<VkDeviceSize>(vertexAllocation.offset) * sizeof(Vertex);
+		vertexCopy.size = static_cast<VkDeviceSize>(vertexCount) * sizeof(Vertex);
+		vertexCopies.push_back(vertexCopy);
+
+		VkBufferCopy indexCopy;
+		indexCopy.srcOffset = static_cast<VkDeviceSize>(mesh->indexAllocation.offset) * sizeof(uint32_t);
+		indexCopy.dstOffset = static_cast<VkDeviceSize>(indexAllocation.offset) * sizeof(uint32_t);
+		indexCopy.size = static_cast<VkDeviceSize>(indexCount) * sizeof(uint32_t);
+		indexCopies.push_back(indexCopy);
+	}
+
+	AllocatedBuffer vertexBuffer = CreateGeometryBuffer(static_cast<size_t>(m_VertexAllocator.GetSize()) * sizeof(Vertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	AllocatedBuffer indexBuffer = CreateGeometryBuffer(static_cast<size_t>(m_IndexAllocator.GetSize()) * sizeof(uint32_t), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+	if (!m_Meshes.empty())
+	{
+		m_Engine->ImmediateSubmit([&](VkCommandBuffer cmd)
+			{
+				vkCmdCopyBuffer(cmd, m_VertexBuffer.buffer, vertexBuffer.buffer, static_cast<uint32_t>(vertexCopies.size()), vertexCopies.data());
+				vkCmdCopyBuffer(cmd, m_IndexBuffer.buffer, indexBuffer.buffer, static_cast<uint32_t>(indexCopies.size()), indexCopies.data());
+			});
+	}
+
+	// frames still in flight read the old buffers
+	const AllocatedBuffer oldVertexBuffer = m_VertexBuffer;
+	const AllocatedBuffer oldIndexBuffer = m_IndexBuffer;
+	VmaAllocator allocator = m_Engine->GetAllocator();
+	m_Engine->GetMemoryManager().UnregisterMovableBuffer(oldVertexBuffer.allocation);
+	m_Engine->GetMemoryManager().UnregisterMovableBuffer(oldIndexBuffer.allocation);
+	m_Engine->GetFrameDeletionQueue().PushFunction([=]
+		{
+			vmaDestroyBuffer(allocator, oldVertexBuffer.buffer, oldVertexBuffer.allocation);
+			vmaDestroyBuffer(allocator, oldIndexBuffer.buffer, oldIndexBuffer.allocation);
+		});
+
+	m_VertexBuffer = vertexBuffer;
+	m_IndexBuffer = indexBuffer;
+	RegisterMovable();
+	m_VertexAllocator = std::move(vertexAllocator);
+	m_IndexAllocator = std::move(indexAllocator);
+	m_Generation++;
+	m_Defragmentations++;
+
+	for (size_t i = 0; i < m_Meshes.size(); ++i)
+	{
+		m_Meshes[i]->vertexAllocation = newAllocations[i].first;
+		m_Meshes[i]->indexAllocation = newAllocations[i].second;
+	}
+}
+
+void GeometryPool::Bind(VkCommandBuffer cmd) const
+{
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(cmd, 0, 1, &m_VertexBuffer.buffer, &offset);
+	vkCmdBindIndexBuffer(cmd, m_IndexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+GeometryPoolStats GeometryPool::GetStats() const
+{
+	const OffsetAllocatorReport vertexReport = m_VertexAllocator.GetReport();
+	const OffsetAllocatorReport indexReport = m_IndexAllocator.GetReport();
+
+	GeometryPoolStats stats;
+	stats.meshCount = static_cast<uint32_t>(m_Meshes.size());
+	stats.vertexCapacity = m_VertexAllocator.GetSize();
+	stats.vertexFree = vertexReport.totalFreeSpace;
+	stats.vertexLargestFree = vertexReport.largestFreeRegion;
+	stats.indexCapacity = m_IndexAllocator.GetSize();
+	stats.indexFree = indexReport.totalFreeSpace;
+	stats.indexLargestFree = indexReport.largestFreeRegion;
+	stats.defragmentations = m_Defragmentations;
+	return stats;
+}
+
+AllocatedBuffer GeometryPool::CreateGeometryBuffer(size_t size, VkBufferUsageFlags usage)
+{
+	// transfer source as well so Defragment and the memory manager can copy out of it
+	return m_Engine->CreateBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_GPU_ONLY, MemoryCategory::Meshes);
+}
+
+void GeometryPool::RegisterMovable()
+{
+	// Bind reads the handles every frame, so a moved buffer only has to be swapped in
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.size = static_cast<VkDeviceSize>(m_VertexAllocator.GetSize()) * sizeof(Vertex);
+	m_Engine->GetMemoryManager().RegisterMovableBuffer(m_VertexBuffer, bufferInfo, [this](VkBuffer buffer)
+		{
+			m_VertexBuffer.buffer = buffer;
+		});
+
+	bufferInfo.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+	bufferInfo.size = static_cast<VkDeviceSize>(m_IndexAllocator.GetSize()) * sizeof(uint32_t);
+	m_Engine->GetMemoryManager().RegisterMovableBuffer(m_IndexBuffer, bufferInfo, [this](VkBuffer buffer)
+		{
+			m_IndexBuffer.buffer = buffer;
+		});
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+
+#include "vk_types.h"
+#include "OffsetAllocator.h"
+
+class VulkanEngine;
+struct Mesh;
+
+// the pool is repacked once the largest free range of either buffer is below this fraction of its free space
+#define GEOMETRYPOOL_DEFRAG_THRESHOLD 0.5f
+
+struct GeometryPoolStats
+{
+	uint32_t meshCount;
+	uint32_t vertexCapacity;
+	uint32_t vertexFree;
+	uint32_t vertexLargestFree;
+	uint32_t indexCapacity;
+	uint32_t indexFree;
+	uint32_t indexLargestFree;
+	uint32_t defragmentations;
+};
+
+// One device local vertex buffer and one index buffer shared by every mesh.
+// Meshes own ranges handed out by an OffsetAllocator and are drawn with vertexOffset/firstIndex,
+// so the whole scene binds geometry once per frame.
+class GeometryPool
+{
+public:
+	void Init(VulkanEngine& engine, uint32_t maxVertices, uint32_t maxIndices);
+	void Cleanup();
+
+	bool Upload(Mesh& mesh);
+	// the ranges return to the allocator once the frames that may still read them have retired
+	void Free(Mesh& mesh);
+
+	// repacks every live mesh to the front of fresh buffers, closing all holes left by Free
+	void Defragment();
+	// call at a frame boundary before anything is recorded, defragments when freed ranges split up the free space
+	void Update();
+
+	void Bind(VkCommandBuffer cmd) const;
+	GeometryPoolStats GetStats() const;
+
+private:
+	AllocatedBuffer CreateGeometryBuffer(size_t size, VkBufferUsageFlags usage);
+	// lets the memory manager relocate the vertex and index buffers while compacting the mesh pool
+	void RegisterMovable();
+
+	VulkanEngine* m_Engine{ nullptr };
+
+	AllocatedBuffer m_VertexBuffer{};
+	AllocatedBuffer m_IndexBuffer{};
+
+	OffsetAllocator m_VertexAllocator;
+	OffsetAllocator m_IndexAllocator;
+
+	std::vector<Mesh*> m_Meshes;
+	uint32_t m_Generation{ 0 };
+	// ranges came back since the last Update looked at the free space
+	bool m_RangesFreed{ false };
+	uint32_t m_Defragmentations{ 0 };
+};
@@ -0,0 +1,301 @@
+#include "vk_GpuProfiler.h"
+
+#include <cstring>
+#include <iostream>
+
+#include "imgui.h"
+
+namespace
+{
+	constexpr uint32_t INVALID_ZONE = 0xffffffff;
+}
+
+void GpuProfiler::Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, uint32_t framesInFlight)
+{
+	m_Device = device;
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	uint32_t familyCount = 0;
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+	std::vector<VkQueueFamilyProperties> families(familyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+
+	const uint32_t validBits = queueFamily < familyCount ? families[queueFamily].timestampValidBits : 0;
+	m_Supported = validBits > 0 && properties.limits.timestampPeriod > 0.f;
+	if (!m_Supported)
+	{
+		std::cout << "GPU profiler disabled, the graphics queue has no timestamp support" << std::endl;
+		return;
+	}
+
+	m_TimestampPeriod = properties.limits.timestampPeriod;
+	m_TimestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+	VkQueryPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	poolInfo.pNext = nullptr;
+	poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount = GPUPROFILER_MAX_ZONES * 2;
+
+	m_Frames.resize(framesInFlight);
+	for (FrameQueries& frame : m_Frames)
+	{
+		vkCreateQueryPool(m_Device, &poolInfo, nullptr, &frame.pool);
+		frame.zones.reserve(GPUPROFILER_MAX_ZONES);
+		frame.frameNumber = 0;
+		frame.pending = false;
+	}
+
+	poolInfo.queryCount = 2;
+	vkCreateQueryPool(m_Device, &poolInfo, nullptr, &m_ImmediatePool);
+
+	m_Results.resize(GPUPROFILER_MAX_ZONES * 2);
+	m_Timings.reserve(GPUPROFILER_MAX_ZONES);
+	m_History.reserve(GPUPROFILER_MAX_ZONES);
+}
+
+void GpuProfiler::Cleanup()
+{
+	for (FrameQueries& frame : m_Frames)
+	{
+		vkDestroyQueryPool(m_Device, frame.pool, nullptr);
+	}
+	m_Frames.clear();
+
+	if (m_ImmediatePool != VK_NULL_HANDLE)
+	{
+		vkDestroyQueryPool(m_Device, m_ImmediatePool, nullptr);
+		m_ImmediatePool = VK_NULL_HANDLE;
+	}
+}
+
+void GpuProfiler::BeginFrame(VkCommandBuffer cmd, uint64_t frameNumber)
+{
+	if (!m_Supported)
+	{
+		return;
+	}
+
+	m_CurrentFrame = static_cast<uint32_t>(frameNumber % m_Frames.size());
+	m_Depth = 0;
+	ResolveFrame(m_Frames[m_CurrentFrame].frameNumber);
+
+	FrameQueries& frame = m_Frames[m_CurrentFrame];
+	frame.zones.clear();
+	frame.frameNumber = frameNumber;
+	frame.pending = true;
+	vkCmdResetQueryPool(cmd, frame.pool, 0, GPUPROFILER_MAX_ZONES * 2);
+}
+
+bool GpuProfiler::ResolveFrame(uint64_t frameNumber)
+{
+	if (!m_Supported)
+	{
+		return false;
+	}
+
+	FrameQueries& frame = m_Frames[frameNumber % m_Frames.size()];
+	if (!frame.pending || frame.frameNumber != frameNumber)
+	{
+		return false;
+	}
+	frame.pending = false;
+
+	const uint32_t queryCount = static_cast<uint32_t>(frame.zones.size()) * 2;
+	if (queryCount == 0)
+	{
+		return false;
+	}
+
+	// the frame's timeline value has been reached, so without the wait bit this is a plain copy
+	const VkResult result = vkGetQueryPoolResults(m_Device, frame.pool, 0, queryCount, queryCount * sizeof(uint64_t), m_Results.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+	if (result != VK_SUCCESS)
+	{
+		return false;
+	}
+
+	m_Timings.clear();
+	for (size_t i = 0; i < frame.zones.size(); ++i)
+	{
+		const Zone& zone = frame.zones[i];
+		const float ms = TicksToMs(m_Results[i * 2], m_Results[i * 2 + 1]);
+
+		GpuZoneTiming timing;
+		timing.name = zone.name;
+		timing.depth = zone.depth;
+		timing.lastMs = ms;
+		timing.averageMs = AddSample(timing.name, ms);
+		m_Timings.push_back(timing);
+	}
+	m_TimingsFrame = frameNumber;
+	m_HasTimings = true;
+	return true;
+}
+
+uint32_t GpuProfiler::BeginZone(VkCommandBuffer cmd, const char* name)
+{
+	if (!m_Supported)
+	{
+		return INVALID_ZONE;
+	}
+
+	FrameQueries& frame = m_Frames[m_CurrentFrame];
+	if (frame.zones.size() == GPUPROFILER_MAX_ZONES)
+	{
+		return INVALID_ZONE;
+	}
+
+	const uint32_t zone = static_cast<uint32_t>(frame.zones.size());
+	frame.zones.push_back({ name, m_Depth++ });
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.pool, zone * 2);
+	return zone;
+}
+
+void GpuProfiler::EndZone(VkCommandBuffer cmd, uint32_t zone)
+{
+	if (zone == INVALID_ZONE)
+	{
+		return;
+	}
+
+	m_Depth--;
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_Frames[m_CurrentFrame].pool, zone * 2 + 1);
+}
+
+void GpuProfiler::BeginImmediate(VkCommandBuffer cmd)
+{
+	if (!m_Supported)
+	{
+		return;
+	}
+
+	vkCmdResetQueryPool(cmd, m_ImmediatePool, 0, 2);
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_ImmediatePool, 0);
+}
+
+void GpuProfiler::EndImmediate(VkCommandBuffer cmd)
+{
+	if (!m_Supported)
+	{
+		return;
+	}
+
+	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_ImmediatePool, 1);
+	m_ImmediatePending = true;
+}
+
+void GpuProfiler::ResolveImmediate()
+{
+	if (!m_ImmediatePending)
+	{
+		return;
+	}
+	m_ImmediatePending = false;
+
+	uint64_t results[2];
+	if (vkGetQueryPoolResults(m_Device, m_ImmediatePool, 0, 2, sizeof(results), results, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+	{
+		m_ImmediateLastMs = TicksToMs(results[0], results[1]);
+		m_ImmediateTotalMs += m_ImmediateLastMs;
+		m_ImmediateCount++;
+	}
+}
+
+float GpuProfiler::GetLastMs(const char* name) const
+{
+	for (const GpuZoneTiming& timing : m_Timings)
+	{
+		if (strcmp(timing.name, name) == 0)
+		{
+			return timing.lastMs;
+		}
+	}
+	return 0.f;
+}
+
+float GpuProfiler::GetAverageMs(const char* name) const
+{
+	const size_t index = FindHistory(name);
+	if (index == m_History.size() || m_History[index].count == 0)
+	{
+		return 0.f;
+	}
+
+	const History& history = m_History[index];
+	float sum = 0.f;
+	for (uint32_t i = 0; i < history.count; ++i)
+	{
+		sum += history.samples[i];
+	}
+	return sum / history.count;
+}
+
+void GpuProfiler::DrawImGui() const
+{
+	ImGui::SetNextWindowPos(ImVec2(480.f, 10.f), ImGuiCond_FirstUseEver);
+	ImGui::Begin("GPU", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+
+	if (!m_Supported)
+	{
+		ImGui::Text("timestamps not supported");
+		ImGui::End();
+		return;
+	}
+
+	ImGui::Text("%-24s %8s %8s", "zone", "last", "avg");
+	for (const GpuZoneTiming& timing : m_Timings)
+	{
+		ImGui::Text("%*s%-*s %6.3fms %6.3fms", timing.depth * 2, "", 24 - static_cast<int>(timing.depth) * 2, timing.name, timing.lastMs, timing.averageMs);
+	}
+
+	if (m_ImmediateCount > 0)
+	{
+		ImGui::Separator();
+		ImGui::Text("uploads: %u submits, last %.3fms, total %.3fms", m_ImmediateCount, m_ImmediateLastMs, m_ImmediateTotalMs);
+	}
+
+	ImGui::End();
+}
+
+float GpuProfiler::TicksToMs(uint64_t begin, uint64_t end) const
+{
+	const uint64_t ticks = (end - begin) & m_TimestampMask;
+	return static_cast<float>(static_cast<double>(ticks) * m_TimestampPeriod / 1000000.0);
+}
+
+size_t GpuProfiler::FindHistory(const char* name) const
+{
+	for (size_t i = 0; i < m_History.size(); ++i)
+	{
+		if (strcmp(m_History[i].name, name) == 0)
+		{
+			return i;
+		}
+	}
+	return m_History.size();
+}
+
+float GpuProfiler::AddSample(const char* name, float ms)
+{
+	const size_t index = FindHistory(name);
+	if (index == m_History.size())
+	{
+		m_History.push_back({ name, {}, 0, 0 });
+	}
+	History& history = m_History[index];
+	history.samples[history.next] = ms;
+	history.next = (history.next + 1) % GPUPROFILER_HISTORY;
+	if (history.count < GPUPROFILER_HISTORY)
+	{
+		history.count++;
+	}
+
+	float sum = 0.f;
+	for (uint32_t i = 0; i < history.count; ++i)
+	{
+		sum += history.samples[i];
+	}
+	return sum / history.count;
+}
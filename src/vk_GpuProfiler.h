@@ -0,0 +1,118 @@
+#pragma once
+
+#include <vector>
+
+#include "vk_types.h"
+
+#define GPUPROFILER_MAX_ZONES 64
+#define GPUPROFILER_HISTORY 64
+
+struct GpuZoneTiming
+{
+	// the name BeginZone was given
+	const char* name;
+	uint32_t depth;
+	float lastMs;
+	float averageMs;
+};
+
+// Timestamp queries around scoped zones of a frame's command buffer.
+// Every frame in flight owns a query pool, its results are read back when the frame slot comes around again,
+// after the engine has waited for that frame on the graphics timeline, so reading never stalls.
+class GpuProfiler
+{
+public:
+	void Init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, uint32_t framesInFlight);
+	void Cleanup();
+
+	// resolves what this frame slot recorded last time and resets its queries, call right after vkBeginCommandBuffer
+	void BeginFrame(VkCommandBuffer cmd, uint64_t frameNumber);
+	// reads back a finished frame without recording anything, for draining the last frames after a device wait
+	bool ResolveFrame(uint64_t frameNumber);
+	// name is kept, not copied, it has to outlive the frame's readback like a literal or a render graph pass name does
+	uint32_t BeginZone(VkCommandBuffer cmd, const char* name);
+	void EndZone(VkCommandBuffer cmd, uint32_t zone);
+
+	// for one-off submissions that wait for their upload, ResolveImmediate reads the result after that wait
+	void BeginImmediate(VkCommandBuffer cmd);
+	void EndImmediate(VkCommandBuffer cmd);
+	void ResolveImmediate();
+
+	const std::vector<GpuZoneTiming>& GetTimings() const { return m_Timings; }
+	// frame number GetTimings belongs to, frames resolve one frames-in-flight count late
+	uint64_t GetTimingsFrame() const { return m_TimingsFrame; }
+	bool HasTimings() const { return m_HasTimings; }
+	float GetLastMs(const char* name) const;
+	float GetAverageMs(const char* name) const;
+	bool IsSupported() const { return m_Supported; }
+
+	void DrawImGui() const;
+
+private:
+	struct Zone
+	{
+		const char* name;
+		uint32_t depth;
+	};
+
+	struct FrameQueries
+	{
+		VkQueryPool pool;
+		std::vector<Zone> zones;
+		uint64_t frameNumber;
+		bool pending;
+	};
+
+	struct History
+	{
+		const char* name;
+		float samples[GPUPROFILER_HISTORY];
+		uint32_t count;
+		uint32_t next;
+	};
+
+	float TicksToMs(uint64_t begin, uint64_t end) const;
+	// index into m_History, its size when the name has no history yet
+	size_t FindHistory(const char* name) const;
+	float AddSample(const char* name, float ms);
+
+	VkDevice m_Device{ VK_NULL_HANDLE };
+	bool m_Supported{ false };
+	float m_TimestampPeriod{ 1.f };
+	uint64_t m_TimestampMask{ ~0ull };
+
+	std::vector<FrameQueries> m_Frames;
+	uint32_t m_CurrentFrame{ 0 };
+	uint32_t m_Depth{ 0 };
+	std::vector<uint64_t> m_Results;
+
+	VkQueryPool m_ImmediatePool{ VK_NULL_HANDLE };
+	bool m_ImmediatePending{ false };
+	float m_ImmediateLastMs{ 0.f };
+	float m_ImmediateTotalMs{ 0.f };
+	uint32_t m_ImmediateCount{ 0 };
+
+	std::vector<GpuZoneTiming> m_Timings;
+	uint64_t m_TimingsFrame{ 0 };
+	bool m_HasTimings{ false };
+	// one per zone name, a few dozen at most, so a linear search beats hashing a string every sample
+	std::vector<History> m_History;
+};
+
+class GpuProfileScope
+{
+public:
+	GpuProfileScope(GpuProfiler& profiler, VkCommandBuffer cmd, const char* name) : m_Profiler(profiler), m_Cmd(cmd)
+	{
+		m_Zone = m_Profiler.BeginZone(cmd, name);
+	}
+	~GpuProfileScope()
+	{
+		m_Profiler.EndZone(m_Cmd, m_Zone);
+	}
+
+private:
+	GpuProfiler& m_Profiler;
+	VkCommandBuffer m_Cmd;
+	uint32_t m_Zone;
+};
@@ -0,0 +1,485 @@
+#include "vk_MemoryManager.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "CpuProfiler.h"
+
+namespace
+{
+	const char* s_CategoryNames[] = { "general", "meshes", "textures", "per frame", "staging" };
+
+	float Fragmentation(const VmaPoolStats& stats)
+	{
+		if (stats.unusedSize == 0)
+		{
+			return 0.f;
+		}
+		return 1.f - static_cast<float>(stats.unusedRangeSizeMax) / static_cast<float>(stats.unusedSize);
+	}
+}
+
+VmaAllocator MemoryManager::Init(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight, bool memoryBudget)
+{
+	m_Device = device;
+	m_FramesInFlight = framesInFlight;
+	m_BudgetExtension = memoryBudget;
+
+	VmaAllocatorCreateInfo allocatorInfo{};
+	allocatorInfo.physicalDevice = physicalDevice;
+	allocatorInfo.device = device;
+	allocatorInfo.instance = instance;
+	// without the extension VMA estimates the budget from the heap sizes
+	allocatorInfo.flags = memoryBudget ? static_cast<VmaAllocatorCreateFlags>(VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT) : 0;
+	allocatorInfo.vulkanApiVersion = VK_API_VERSION_1_1;
+	vmaCreateAllocator(&allocatorInfo, &m_Allocator);
+
+	const VkPhysicalDeviceMemoryProperties* memoryProperties;
+	vmaGetMemoryProperties(m_Allocator, &memoryProperties);
+	m_HeapCount = memoryProperties->memoryHeapCount;
+
+	CreatePools();
+	UpdateBudgets();
+
+	std::cout << "memory budget " << (memoryBudget ? "from VK_EXT_memory_budget" : "estimated from heap sizes") << std::endl;
+	return m_Allocator;
+}
+
+void MemoryManager::Cleanup()
+{
+	if (m_DefragContext)
+	{
+		FinishDefragmentation();
+	}
+	DestroyRetiredBuffers(UINT64_MAX);
+
+	for (VmaPool& pool : m_Pools)
+	{
+		if (pool)
+		{
+			vmaDestroyPool(m_Allocator, pool);
+			pool = VK_NULL_HANDLE;
+		}
+	}
+	vmaDestroyAllocator(m_Allocator);
+	m_Allocator = VK_NULL_HANDLE;
+}
+
+void MemoryManager::CreatePools()
+{
+	// representative resources of each category pick the memory type its pool lives in
+	struct PoolDesc
+	{
+		MemoryCategory category;
+		VmaMemoryUsage memoryUsage;
+		VkBufferUsageFlags bufferUsage;
+	};
+	const PoolDesc bufferPools[] =
+	{
+		{ MemoryCategory::Meshes, VMA_MEMORY_USAGE_GPU_ONLY, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT },
+		{ MemoryCategory::PerFrame, VMA_MEMORY_USAGE_CPU_TO_GPU, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT },
+		{ MemoryCategory::Staging, VMA_MEMORY_USAGE_CPU_ONLY, VK_BUFFER_USAGE_TRANSFER_SRC_BIT },
+	};
+
+	for (const PoolDesc& desc : bufferPools)
+	{
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.size = 1024;
+		bufferInfo.usage = desc.bufferUsage;
+
+		VmaAllocationCreateInfo allocInfo{};
+		allocInfo.usage = desc.memoryUsage;
+
+		VmaPoolCreateInfo poolInfo{};
+		if (vmaFindMemoryTypeIndexForBufferInfo(m_Allocator, &bufferInfo, &allocInfo, &poolInfo.memoryTypeIndex) != VK_SUCCESS)
+		{
+			std::cout << "no memory type for the " << GetCategoryName(desc.category) << " pool" << std::endl;
+			continue;
+		}
+		if (vmaCreatePool(m_Allocator, &poolInfo, &m_Pools[static_cast<uint32_t>(desc.category)]) != VK_SUCCESS)
+		{
+			std::cout << "failed to create the " << GetCategoryName(desc.category) << " pool" << std::endl;
+			continue;
+		}
+		vmaSetPoolName(m_Allocator, GetPool(desc.category), GetCategoryName(desc.category));
+	}
+
+	VkImageCreateInfo imageInfo{};
+	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+	imageInfo.imageType = VK_IMAGE_TYPE_2D;
+	imageInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+	imageInfo.extent = { 256, 256, 1 };
+	imageInfo.mipLevels = 1;
+	imageInfo.arrayLayers = 1;
+	imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+	imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+	imageInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+
+	VmaAllocationCreateInfo allocInfo{};
+	allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+
+	VmaPoolCreateInfo poolInfo{};
+	// only optimal images go in here, so buffer/image granularity never has to be respected
+	poolInfo.flags = VMA_POOL_CREATE_IGNORE_BUFFER_IMAGE_GRANULARITY_BIT;
+	if (vmaFindMemoryTypeIndexForImageInfo(m_Allocator, &imageInfo, &allocInfo, &poolInfo.memoryTypeIndex) == VK_SUCCESS
+		&& vmaCreatePool(m_Allocator, &poolInfo, &m_Pools[static_cast<uint32_t>(MemoryCategory::Textures)]) == VK_SUCCESS)
+	{
+		vmaSetPoolName(m_Allocator, GetPool(MemoryCategory::Textures), GetCategoryName(MemoryCategory::Textures));
+	}
+}
+
+VkResult MemoryManager::CreateBuffer(const VkBufferCreateInfo& bufferInfo, VmaMemoryUsage memoryUsage, MemoryCategory category, AllocatedBuffer& outBuffer)
+{
+	VmaAllocationCreateInfo allocInfo{};
+	allocInfo.usage = memoryUsage;
+	allocInfo.pool = GetPool(category);
+	if (category == MemoryCategory::Meshes)
+	{
+		allocInfo.flags = VMA_ALLOCATION_CREATE_WITHIN_BUDGET_BIT;
+	}
+
+	VkResult result = vmaCreateBuffer(m_Allocator, &bufferInfo, &allocInfo, &outBuffer.buffer, &outBuffer.allocation, nullptr);
+	if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY && allocInfo.pool)
+	{
+		// eviction only takes effect over the next frames, this buffer falls back to a dedicated allocation below
+		Evict(m_HeapCount, bufferInfo.size);
+	}
+	if (result != VK_SUCCESS && allocInfo.pool)
+	{
+		// the pool's memory type may not suit this buffer's usage, or the budget could not be met
+		allocInfo.pool = VK_NULL_HANDLE;
+		allocInfo.flags = 0;
+		result = vmaCreateBuffer(m_Allocator, &bufferInfo, &allocInfo, &outBuffer.buffer, &outBuffer.allocation, nullptr);
+	}
+	return result;
+}
+
+VkResult MemoryManager::CreateImage(const VkImageCreateInfo& imageInfo, VmaMemoryUsage memoryUsage, MemoryCategory category, AllocatedImage& outImage)
+{
+	VmaAllocationCreateInfo allocInfo{};
+	allocInfo.usage = memoryUsage;
+	allocInfo.pool = GetPool(category);
+	if (category == MemoryCategory::Textures)
+	{
+		allocInfo.flags = VMA_ALLOCATION_CREATE_WITHIN_BUDGET_BIT;
+	}
+
+	VkResult result = vmaCreateImage(m_Allocator, &imageInfo, &allocInfo, &outImage.image, &outImage.allocation, nullptr);
+	if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY && allocInfo.pool)
+	{
+		// the request size is not known before the image exists, ask for its uncompressed size.
+		// eviction only takes effect over the next frames, this image falls back to a dedicated allocation below
+		const VkDeviceSize estimate = static_cast<VkDeviceSize>(imageInfo.extent.width) * imageInfo.extent.height * 4;
+		Evict(m_HeapCount, estimate);
+	}
+	if (result != VK_SUCCESS && allocInfo.pool)
+	{
+		allocInfo.pool = VK_NULL_HANDLE;
+		allocInfo.flags = 0;
+		result = vmaCreateImage(m_Allocator, &imageInfo, &allocInfo, &outImage.image, &outImage.allocation, nullptr);
+	}
+	return result;
+}
+
+void MemoryManager::AddEvictionCallback(EvictionCallback&& callback)
+{
+	m_EvictionCallbacks.push_back(std::move(callback));
+}
+
+void MemoryManager::RegisterMovableBuffer(const AllocatedBuffer& buffer, const VkBufferCreateInfo& bufferInfo, BufferMovedCallback&& onMoved)
+{
+	MovableBuffer movable;
+	movable.buffer = buffer.buffer;
+	movable.bufferInfo = bufferInfo;
+	movable.bufferInfo.pNext = nullptr;
+	movable.onMoved = std::move(onMoved);
+	m_MovableBuffers[buffer.allocation] = std::move(movable);
+}
+
+void MemoryManager::UnregisterMovableBuffer(VmaAllocation allocation)
+{
+	// the running defragmentation may hold the allocation, finish it before the owner frees it
+	if (m_DefragContext && std::find(m_DefragAllocations.begin(), m_DefragAllocations.end(), allocation) != m_DefragAllocations.end())
+	{
+		vkDeviceWaitIdle(m_Device);
+		FinishDefragmentation();
+	}
+	m_MovableBuffers.erase(allocation);
+}
+
+void MemoryManager::BeginFrame(VkCommandBuffer cmd, uint64_t frameNumber)
+{
+	PROFILE_FUNCTION();
+	vmaSetCurrentFrameIndex(m_Allocator, static_cast<uint32_t>(frameNumber));
+	DestroyRetiredBuffers(frameNumber);
+	UpdateBudgets();
+
+	if (!m_DefragContext && frameNumber >= m_NextDefragCheck)
+	{
+		m_NextDefragCheck = frameNumber + MEMORY_DEFRAG_CHECK_INTERVAL;
+		if (NeedsDefragmentation())
+		{
+			StartDefragmentation();
+		}
+	}
+
+	if (m_DefragContext)
+	{
+		RunDefragmentationPass(cmd, frameNumber);
+	}
+}
+
+MemoryCategoryStats MemoryManager::GetCategoryStats(MemoryCategory category) const
+{
+	MemoryCategoryStats result;
+	if (category != MemoryCategory::General)
+	{
+		VmaPool pool = GetPool(category);
+		if (!pool)
+		{
+			return result;
+		}
+
+		VmaPoolStats stats;
+		vmaGetPoolStats(m_Allocator, pool, &stats);
+		result.blockBytes = stats.size;
+		result.usedBytes = stats.size - stats.unusedSize;
+		result.allocationCount = stats.allocationCount;
+		result.blockCount = stats.blockCount;
+		result.fragmentation = Fragmentation(stats);
+		return result;
+	}
+
+	// everything that did not land in a pool
+	VmaStats stats;
+	vmaCalculateStats(m_Allocator, &stats);
+	result.blockBytes = stats.total.usedBytes + stats.total.unusedBytes;
+	result.usedBytes = stats.total.usedBytes;
+	result.allocationCount = stats.total.allocationCount;
+	result.blockCount = stats.total.blockCount;
+	for (uint32_t i = 1; i < static_cast<uint32_t>(MemoryCategory::Count); ++i)
+	{
+		const MemoryCategoryStats pooled = GetCategoryStats(static_cast<MemoryCategory>(i));
+		result.blockBytes -= pooled.blockBytes;
+		result.usedBytes -= pooled.usedBytes;
+		result.allocationCount -= pooled.allocationCount;
+		result.blockCount -= pooled.blockCount;
+	}
+	return result;
+}
+
+uint32_t MemoryManager::GetHeapIndex(VmaAllocation allocation) const
+{
+	VmaAllocationInfo info;
+	vmaGetAllocationInfo(m_Allocator, allocation, &info);
+
+	const VkPhysicalDeviceMemoryProperties* memoryProperties;
+	vmaGetMemoryProperties(m_Allocator, &memoryProperties);
+	return memoryProperties->memoryTypes[info.memoryType].heapIndex;
+}
+
+const char* MemoryManager::GetCategoryName(MemoryCategory category)
+{
+	return s_CategoryNames[static_cast<uint32_t>(category)];
+}
+
+void MemoryManager::UpdateBudgets()
+{
+	vmaGetBudget(m_Allocator, m_Budgets);
+
+	for (uint32_t heap = 0; heap < m_HeapCount; ++heap)
+	{
+		const VmaBudget& budget = m_Budgets[heap];
+		if (budget.budget == 0 || budget.usage <= static_cast<VkDeviceSize>(budget.budget * MEMORY_EVICT_THRESHOLD))
+		{
+			continue;
+		}
+		Evict(heap, budget.usage - static_cast<VkDeviceSize>(budget.budget * MEMORY_EVICT_TARGET));
+	}
+}
+
+void MemoryManager::Evict(uint32_t heap, VkDeviceSize bytesToFree)
+{
+	if (m_EvictionCallbacks.empty())
+	{
+		return;
+	}
+
+	m_EvictionStats.requests++;
+	m_EvictionStats.bytesRequested += bytesToFree;
+
+	// heap == m_HeapCount means the failing heap is unknown, every callback frees from wherever it can
+	VkDeviceSize scheduled = 0;
+	for (EvictionCallback& callback : m_EvictionCallbacks)
+	{
+		if (scheduled >= bytesToFree)
+		{
+			break;
+		}
+		scheduled += callback(heap, bytesToFree - scheduled);
+	}
+
+	m_EvictionStats.bytesScheduled += scheduled;
+}
+
+bool MemoryManager::NeedsDefragmentation() const
+{
+	if (m_MovableBuffers.empty())
+	{
+		return false;
+	}
+
+	// movable buffers live in the buffer pools, textures are optimal images that VMA cannot move
+	for (MemoryCategory category : { MemoryCategory::Meshes, MemoryCategory::PerFrame })
+	{
+		const MemoryCategoryStats stats = GetCategoryStats(category);
+		if (stats.blockCount > 1 || stats.fragmentation > MEMORY_DEFRAG_FRAGMENTATION)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void MemoryManager::StartDefragmentation()
+{
+	m_DefragAllocations.clear();
+	for (const auto& movable : m_MovableBuffers)
+	{
+		m_DefragAllocations.push_back(movable.first);
+	}
+
+	// the copies are recorded by RunDefragmentationPass, so only GPU moves are allowed
+	VmaDefragmentationInfo2 defragInfo{};
+	defragInfo.flags = VMA_DEFRAGMENTATION_FLAG_INCREMENTAL;
+	defragInfo.allocationCount = static_cast<uint32_t>(m_DefragAllocations.size());
+	defragInfo.pAllocations = m_DefragAllocations.data();
+	defragInfo.maxCpuBytesToMove = 0;
+	defragInfo.maxCpuAllocationsToMove = 0;
+	defragInfo.maxGpuBytesToMove = VK_WHOLE_SIZE;
+	defragInfo.maxGpuAllocationsToMove = UINT32_MAX;
+	defragInfo.commandBuffer = VK_NULL_HANDLE;
+
+	m_DefragRunStats = {};
+	const VkResult result = vmaDefragmentationBegin(m_Allocator, &defragInfo, &m_DefragRunStats, &m_DefragContext);
+	m_DefragStats.runs++;
+	m_DefragStats.active = true;
+	m_PassOpen = false;
+
+	if (result == VK_SUCCESS)
+	{
+		// nothing worth moving
+		FinishDefragmentation();
+	}
+	else if (result != VK_NOT_READY)
+	{
+		std::cout << "defragmentation failed to start: " << result << std::endl;
+		FinishDefragmentation();
+	}
+}
+
+void MemoryManager::RunDefragmentationPass(VkCommandBuffer cmd, uint64_t frameNumber)
+{
+	if (m_PassOpen)
+	{
+		// VMA frees the old ranges on commit, the frame that copied out of them has to be done
+		if (frameNumber < m_PassFrame + m_FramesInFlight)
+		{
+			return;
+		}
+
+		m_PassOpen = false;
+		if (vmaEndDefragmentationPass(m_Allocator, m_DefragContext) == VK_SUCCESS)
+		{
+			FinishDefragmentation();
+			return;
+		}
+	}
+
+	m_DefragMoves.resize(MEMORY_DEFRAG_MOVES_PER_PASS);
+	VmaDefragmentationPassInfo passInfo{};
+	passInfo.moveCount = MEMORY_DEFRAG_MOVES_PER_PASS;
+	passInfo.pMoves = m_DefragMoves.data();
+	vmaBeginDefragmentationPass(m_Allocator, m_DefragContext, &passInfo);
+
+	m_PassOpen = true;
+	m_PassFrame = frameNumber;
+	m_DefragStats.passes++;
+
+	if (passInfo.moveCount == 0)
+	{
+		return;
+	}
+
+	// everything earlier in the queue that touched the old locations finishes before the copies
+	VkMemoryBarrier barrier{};
+	barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+	for (uint32_t i = 0; i < passInfo.moveCount; ++i)
+	{
+		const VmaDefragmentationPassMoveInfo& move = m_DefragMoves[i];
+		auto movable = m_MovableBuffers.find(move.allocation);
+		if (movable == m_MovableBuffers.end())
+		{
+			continue;
+		}
+
+		// same create info as before, so the requirements VMA planned the move with still hold
+		VkBuffer newBuffer;
+		if (vkCreateBuffer(m_Device, &movable->second.bufferInfo, nullptr, &newBuffer) != VK_SUCCESS)
+		{
+			std::cout << "failed to recreate a moved buffer" << std::endl;
+			continue;
+		}
+		vkBindBufferMemory(m_Device, newBuffer, move.memory, move.offset);
+
+		VkBufferCopy copy{};
+		copy.size = movable->second.bufferInfo.size;
+		vkCmdCopyBuffer(cmd, movable->second.buffer, newBuffer, 1, &copy);
+
+		// earlier frames may still read the old buffer, it goes once this one retired
+		m_RetiredBuffers.push_back({ frameNumber, movable->second.buffer });
+		movable->second.buffer = newBuffer;
+		movable->second.onMoved(newBuffer);
+
+		m_DefragStats.allocationsMoved++;
+		m_DefragStats.bytesMoved += copy.size;
+	}
+
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void MemoryManager::FinishDefragmentation()
+{
+	if (m_PassOpen)
+	{
+		vmaEndDefragmentationPass(m_Allocator, m_DefragContext);
+		m_PassOpen = false;
+	}
+	vmaDefragmentationEnd(m_Allocator, m_DefragContext);
+	m_DefragContext = VK_NULL_HANDLE;
+	m_DefragAllocations.clear();
+
+	m_DefragStats.bytesFreed += m_DefragRunStats.bytesFreed;
+	m_DefragStats.active = false;
+}
+
+void MemoryManager::DestroyRetiredBuffers(uint64_t frameNumber)
+{
+	auto retired = std::remove_if(m_RetiredBuffers.begin(), m_RetiredBuffers.end(), [&](const RetiredBuffer& buffer)
+		{
+			if (frameNumber != UINT64_MAX && frameNumber < buffer.frameNumber + m_FramesInFlight)
+			{
+				return false;
+			}
+			vkDestroyBuffer(m_Device, buffer.buffer, nullptr);
+			return true;
+		});
+	m_RetiredBuffers.erase(retired, m_RetiredBuffers.end());
+}
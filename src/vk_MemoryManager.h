@@ -0,0 +1,150 @@
+#pragma once
+
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "vk_types.h"
+
+// eviction starts above the first fraction of a heap's budget and tries to get back under the second
+#define MEMORY_EVICT_THRESHOLD 0.9f
+#define MEMORY_EVICT_TARGET 0.8f
+// at most this many allocations are moved per defragmentation pass, one pass per framesInFlight frames
+#define MEMORY_DEFRAG_MOVES_PER_PASS 16
+#define MEMORY_DEFRAG_CHECK_INTERVAL 120
+// share of a pool's free space that has to sit outside its largest free range before a run starts
+#define MEMORY_DEFRAG_FRAGMENTATION 0.25f
+
+enum class MemoryCategory : uint32_t
+{
+	// default VMA heaps, for one-off allocations like readbacks
+	General,
+	Meshes,
+	Textures,
+	PerFrame,
+	Staging,
+	Count
+};
+
+struct MemoryCategoryStats
+{
+	VkDeviceSize blockBytes = 0;
+	VkDeviceSize usedBytes = 0;
+	size_t allocationCount = 0;
+	size_t blockCount = 0;
+	// 0 when all free space is one range, towards 1 the more it is split up
+	float fragmentation = 0.f;
+};
+
+struct MemoryDefragStats
+{
+	uint32_t runs = 0;
+	uint32_t passes = 0;
+	uint32_t allocationsMoved = 0;
+	VkDeviceSize bytesMoved = 0;
+	VkDeviceSize bytesFreed = 0;
+	bool active = false;
+};
+
+struct MemoryEvictionStats
+{
+	uint32_t requests = 0;
+	VkDeviceSize bytesRequested = 0;
+	// what the callbacks promised to release, it comes back over the following frames
+	VkDeviceSize bytesScheduled = 0;
+};
+
+// eviction is deferred: the callback schedules releasing memory from the heap and returns how many bytes it will
+// release, the rest is asked of the next callback. the memory comes back once the frames still using it retired,
+// so nothing may be retried on the strength of it in the same frame.
+// heap is GetHeapCount() when a pool allocation failed and any heap may help
+using EvictionCallback = std::function<VkDeviceSize(uint32_t heap, VkDeviceSize bytesToFree)>;
+// the owner swaps its handle (and any descriptor pointing at it) to the buffer now bound at the new location
+using BufferMovedCallback = std::function<void(VkBuffer buffer)>;
+
+// Owns the VMA allocator. Allocations are sorted into one pool per category so usage and fragmentation
+// can be read per kind of resource, and heap budgets come from VK_EXT_memory_budget when the device has it.
+// Once per frame the budgets are checked and eviction callbacks run when a heap gets close to its budget.
+// Buffers registered as movable are compacted in the background with VMA's incremental defragmentation:
+// each pass records its copies into the frame's command buffer and is committed once that frame retired.
+class MemoryManager
+{
+public:
+	VmaAllocator Init(VkInstance instance, VkPhysicalDevice physicalDevice, VkDevice device, uint32_t framesInFlight, bool memoryBudget);
+	// destroys the pools and the allocator, everything allocated through them has to be freed already
+	void Cleanup();
+
+	VkResult CreateBuffer(const VkBufferCreateInfo& bufferInfo, VmaMemoryUsage memoryUsage, MemoryCategory category, AllocatedBuffer& outBuffer);
+	VkResult CreateImage(const VkImageCreateInfo& imageInfo, VmaMemoryUsage memoryUsage, MemoryCategory category, AllocatedImage& outImage);
+
+	void AddEvictionCallback(EvictionCallback&& callback);
+
+	// the buffer may be moved to another place in its pool, bufferInfo is used to recreate it there and needs
+	// both transfer usages, unregister before the buffer is destroyed
+	void RegisterMovableBuffer(const AllocatedBuffer& buffer, const VkBufferCreateInfo& bufferInfo, BufferMovedCallback&& onMoved);
+	void UnregisterMovableBuffer(VmaAllocation allocation);
+
+	// call after the frame's timeline wait and vkBeginCommandBuffer, outside of any render pass
+	void BeginFrame(VkCommandBuffer cmd, uint64_t frameNumber);
+
+	MemoryCategoryStats GetCategoryStats(MemoryCategory category) const;
+	uint32_t GetHeapCount() const { return m_HeapCount; }
+	uint32_t GetHeapIndex(VmaAllocation allocation) const;
+	const VmaBudget& GetBudget(uint32_t heap) const { return m_Budgets[heap]; }
+	bool HasBudgetExtension() const { return m_BudgetExtension; }
+	const MemoryDefragStats& GetDefragStats() const { return m_DefragStats; }
+	const MemoryEvictionStats& GetEvictionStats() const { return m_EvictionStats; }
+
+	static const char* GetCategoryName(MemoryCategory category);
+
+private:
+	struct MovableBuffer
+	{
+		VkBuffer buffer;
+		VkBufferCreateInfo bufferInfo;
+		BufferMovedCallback onMoved;
+	};
+
+	struct RetiredBuffer
+	{
+		uint64_t frameNumber;
+		VkBuffer buffer;
+	};
+
+	void CreatePools();
+	VmaPool GetPool(MemoryCategory category) const { return m_Pools[static_cast<uint32_t>(category)]; }
+
+	void UpdateBudgets();
+	void Evict(uint32_t heap, VkDeviceSize bytesToFree);
+
+	bool NeedsDefragmentation() const;
+	void StartDefragmentation();
+	void RunDefragmentationPass(VkCommandBuffer cmd, uint64_t frameNumber);
+	void FinishDefragmentation();
+	void DestroyRetiredBuffers(uint64_t frameNumber);
+
+	VkDevice m_Device{ VK_NULL_HANDLE };
+	VmaAllocator m_Allocator{ VK_NULL_HANDLE };
+	uint32_t m_FramesInFlight{ 0 };
+	bool m_BudgetExtension{ false };
+
+	VmaPool m_Pools[static_cast<uint32_t>(MemoryCategory::Count)]{};
+
+	uint32_t m_HeapCount{ 0 };
+	VmaBudget m_Budgets[VK_MAX_MEMORY_HEAPS]{};
+	std::vector<EvictionCallback> m_EvictionCallbacks;
+	MemoryEvictionStats m_EvictionStats;
+
+	std::unordered_map<VmaAllocation, MovableBuffer> m_MovableBuffers;
+	std::vector<RetiredBuffer> m_RetiredBuffers;
+
+	VmaDefragmentationContext m_DefragContext{ VK_NULL_HANDLE };
+	VmaDefragmentationStats m_DefragRunStats{};
+	std::vector<VmaAllocation> m_DefragAllocations;
+	std::vector<VmaDefragmentationPassMoveInfo> m_DefragMoves;
+	// frame whose command buffer holds the copies of the open pass
+	uint64_t m_PassFrame{ 0 };
+	bool m_PassOpen{ false };
+	uint64_t m_NextDefragCheck{ 0 };
+	MemoryDefragStats m_DefragStats;
+};
@@ -1,9 +1,39 @@
 #include "vk_Mesh.h"
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
 #include <iostream>
+#include <map>
+#include <numeric>
 #include <ostream>
+#include <unordered_map>
 
 #include "tiny_obj_loader.h"
+#include "CpuProfiler.h"
+#include "ObjParser.h"
+
+namespace
+{
+	struct ObjIndexHash
+	{
+		size_t operator()(const tinyobj::index_t& index) const
+		{
+			size_t hash = static_cast<size_t>(index.vertex_index) * 73856093u;
+			hash ^= static_cast<size_t>(index.normal_index) * 19349663u;
+			hash ^= static_cast<size_t>(index.texcoord_index) * 83492791u;
+			return hash;
+		}
+	};
+
+	struct ObjIndexEqual
+	{
+		bool operator()(const tinyobj::index_t& a, const tinyobj::index_t& b) const
+		{
+			return a.vertex_index == b.vertex_index && a.normal_index == b.normal_index && a.texcoord_index == b.texcoord_index;
+		}
+	};
+}
 
 VertexInputDescription Vertex::GetVertexDescription()
 {
@@ -47,16 +77,45 @@ VertexInputDescription Vertex::GetVertexDescription()
 	return description;
 }
 
-bool Mesh::LoadFromObj(const char* filename)
+bool Mesh::LoadFromObj(const VirtualFileSystem& fileSystem, const char* filename, ObjImporter importer)
 {
+	PROFILE_SCOPE("Mesh::LoadFromObj");
+	const FileData file = fileSystem.Open(filename);
+	if (!file.IsValid())
+	{
+		std::cerr << "Cannot open file [" << filename << "]" << std::endl;
+		return false;
+	}
+
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
+	std::vector<tinyobj::material_t> objMaterials;
 
 	std::string warn;
 	std::string err;
 
-	tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename, nullptr);
+	// mtllib paths are relative to the obj
+	std::string baseDir(filename);
+	const size_t slash = baseDir.find_last_of("/\\");
+	baseDir = slash == std::string::npos ? std::string() : baseDir.substr(0, slash + 1);
+	ObjMaterialReader materialReader(fileSystem, baseDir);
+
+	bool parsed = false;
+	if (importer == ObjImporter::Fast)
+	{
+		const ObjParseResult result = ParseObjFast(reinterpret_cast<const char*>(file.GetData()), file.GetSize(), materialReader, attrib, shapes, objMaterials, warn, err);
+		parsed = result == ObjParseResult::Ok;
+		if (!parsed)
+		{
+			std::cout << filename << " needs tinyobjloader, parsing it again" << std::endl;
+		}
+	}
+	if (!parsed)
+	{
+		MemoryStreamBuffer buffer(file.GetData(), file.GetSize());
+		std::istream stream(&buffer);
+		tinyobj::LoadObj(&attrib, &shapes, &objMaterials, &warn, &err, &stream, &materialReader);
+	}
 	if (!warn.empty()) std::cout << "WARN: " << warn << std::endl;
 	if (!err.empty())
 	{
@@ -64,24 +123,112 @@ bool Mesh::LoadFromObj(const char* filename)
 		return false;
 	}
 
+	// faces without usemtl get a default material at the end
+	std::vector<MeshMaterial> records(objMaterials.size() + 1);
+	for (size_t m = 0; m < objMaterials.size(); ++m)
+	{
+		const tinyobj::material_t& source = objMaterials[m];
+		records[m].name = source.name;
+		records[m].diffuseColor = { source.diffuse[0], source.diffuse[1], source.diffuse[2] };
+		records[m].diffuseTexture = source.diffuse_texname;
+		records[m].alphaTested = !source.alpha_texname.empty() || source.dissolve < 1.f;
+	}
+	records.back().name = "default";
+
+	// materials with the same render state are numbered next to each other, so their sections follow each other
+	std::vector<uint32_t> order(records.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+		{
+			if (records[a].alphaTested != records[b].alphaTested)
+			{
+				return !records[a].alphaTested;
+			}
+			return records[a].diffuseTexture < records[b].diffuseTexture;
+		});
+	std::vector<uint32_t> remap(records.size());
+	materials.clear();
+	for (uint32_t i = 0; i < order.size(); ++i)
+	{
+		remap[order[i]] = i;
+		materials.push_back(std::move(records[order[i]]));
+	}
+
+	// obj corners that share position, normal and uv collapse into one indexed vertex
+	std::unordered_map<tinyobj::index_t, uint32_t, ObjIndexHash, ObjIndexEqual> uniqueVertices;
+	// material in the top bits, then the chunk coordinates, so the map iterates material by material
+	std::map<uint64_t, std::vector<uint32_t>> sectionIndices;
+
 	for (size_t s = 0; s < shapes.size(); s++)
 	{
 		size_t indexOffset = 0;
 		for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++)
 		{
 			int fv = 3;
+			uint32_t face[3];
 			for (size_t v = 0; v < fv; v++)
 			{
 				tinyobj::index_t idx = shapes[s].mesh.indices[indexOffset + v];
-				Vertex vertex;
+
+				auto found = uniqueVertices.find(idx);
+				if (found != uniqueVertices.end())
+				{
+					face[v] = found->second;
+					continue;
+				}
+
+				Vertex vertex{};
 				vertex.position = { attrib.vertices[3 * idx.vertex_index + 0], attrib.vertices[3 * idx.vertex_index + 1], attrib.vertices[3 * idx.vertex_index + 2] };
-				vertex.normal = { attrib.normals[3 * idx.normal_index + 0], attrib.normals[3 * idx.normal_index + 1], attrib.normals[3 * idx.normal_index + 2] };
-				vertex.color = { attrib.normals[3 * idx.normal_index + 0], attrib.normals[3 * idx.normal_index + 1], attrib.normals[3 * idx.normal_index + 2] };
-				vertex.uv = { attrib.texcoords[2 * idx.texcoord_index + 0], 1 - attrib.texcoords[2 * idx.texcoord_index + 1] };
+				if (idx.normal_index >= 0)
+				{
+					vertex.normal = { attrib.normals[3 * idx.normal_index + 0], attrib.normals[3 * idx.normal_index + 1], attrib.normals[3 * idx.normal_index + 2] };
+					vertex.color = vertex.normal;
+				}
+				if (idx.texcoord_index >= 0)
+				{
+					vertex.uv = { attrib.texcoords[2 * idx.texcoord_index + 0], 1 - attrib.texcoords[2 * idx.texcoord_index + 1] };
+				}
+
+				const uint32_t newIndex = static_cast<uint32_t>(vertices.size());
+				uniqueVertices.emplace(idx, newIndex);
 				vertices.push_back(vertex);
+				face[v] = newIndex;
 			}
 			indexOffset += fv;
+
+			const int materialId = f < shapes[s].mesh.material_ids.size() ? shapes[s].mesh.material_ids[f] : -1;
+			const uint32_t material = remap[materialId >= 0 && materialId < static_cast<int>(objMaterials.size()) ? materialId : objMaterials.size()];
+
+			const glm::vec3 centroid = (vertices[face[0]].position + vertices[face[1]].position + vertices[face[2]].position) / 3.f;
+			uint64_t key = static_cast<uint64_t>(material) << 48;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				const float chunk = std::floor(centroid[axis] / MESH_CHUNK_SIZE) + 32768.f;
+				key |= static_cast<uint64_t>(std::clamp(chunk, 0.f, 65535.f)) << (32 - 16 * axis);
+			}
+
+			std::vector<uint32_t>& target = sectionIndices[key];
+			target.insert(target.end(), face, face + 3);
+		}
+	}
+
+	// every section becomes one contiguous range, a material's chunks are adjacent and form its batch
+	sections.clear();
+	for (const auto& [key, sectionData] : sectionIndices)
+	{
+		MeshSection section{};
+		section.material = static_cast<uint32_t>(key >> 48);
+		section.firstIndex = static_cast<uint32_t>(indices.size());
+		section.indexCount = static_cast<uint32_t>(sectionData.size());
+		section.boundsMin = glm::vec3(FLT_MAX);
+		section.boundsMax = glm::vec3(-FLT_MAX);
+		for (uint32_t index : sectionData)
+		{
+			section.boundsMin = glm::min(section.boundsMin, vertices[index].position);
+			section.boundsMax = glm::max(section.boundsMax, vertices[index].position);
 		}
+		indices.insert(indices.end(), sectionData.begin(), sectionData.end());
+		sections.push_back(section);
 	}
 
 	return true;
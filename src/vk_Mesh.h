@@ -1,10 +1,15 @@
 #pragma once
 
 #include "vk_types.h"
+#include "vk_Meshlet.h"
+#include "OffsetAllocator.h"
+#include <string>
 #include <vector>
 #include <glm/vec3.hpp>
 #include <glm/vec2.hpp>
 
+class VirtualFileSystem;
+
 struct VertexInputDescription
 {
 	std::vector<VkVertexInputBindingDescription> bindings;
@@ -24,10 +29,59 @@ struct Vertex
 
 };
 
+// how LoadFromObj reads the file, both build the same mesh
+enum class ObjImporter
+{
+	TinyObj,
+	// ParseObjFast, memory mapped and parsed on every core, hands what it does not support to tinyobjloader
+	Fast
+};
+
+// edge length of the spatial chunks LoadFromObj splits every material into
+#define MESH_CHUNK_SIZE 32.f
+
+// a material record of the obj's mtl file
+struct MeshMaterial
+{
+	std::string name;
+	glm::vec3 diffuseColor{ 1.f };
+	// map_Kd as written in the mtl file, relative to it
+	std::string diffuseTexture;
+	// map_d or d < 1, drawn with alpha testing
+	bool alphaTested{ false };
+};
+
+// One material inside one spatial chunk, a contiguous range of Mesh::indices.
+// Sections are sorted by material, so all chunks of a material form one batched range,
+// and materials with the same render state follow each other.
+struct MeshSection
+{
+	uint32_t material;
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	// filled by BuildMeshlets, clusters never cross a section
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+};
+
 struct Mesh
 {
 	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+
+	// empty for meshes that were not imported with materials, they draw as one range
+	std::vector<MeshMaterial> materials;
+	std::vector<MeshSection> sections;
+
+	std::vector<Meshlet> meshlets;
+	MeshletCullData meshletCullData;
 
-	AllocatedBuffer vertexBuffer;
-	bool LoadFromObj(const char* filename);
+	// ranges inside the engine's GeometryPool, drawn with vertexOffset = vertexAllocation.offset
+	OffsetAllocation vertexAllocation;
+	OffsetAllocation indexAllocation;
+	// the obj and its mtl files are read through the file system, from a mounted pack or from disk
+	bool LoadFromObj(const VirtualFileSystem& fileSystem, const char* filename, ObjImporter importer = ObjImporter::Fast);
 };
\ No newline at end of file
@@ -0,0 +1,399 @@
+#include "vk_Meshlet.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#include "vk_Mesh.h"
+#include "CpuProfiler.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define INFERNO_MESHLET_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+	uint32_t SpreadBits(uint32_t v)
+	{
+		v = (v | (v << 16)) & 0x030000FF;
+		v = (v | (v << 8)) & 0x0300F00F;
+		v = (v | (v << 4)) & 0x030C30C3;
+		v = (v | (v << 2)) & 0x09249249;
+		return v;
+	}
+
+	uint32_t MortonCode(const glm::vec3& normalized)
+	{
+		const glm::vec3 scaled = glm::clamp(normalized * 1023.f, glm::vec3(0.f), glm::vec3(1023.f));
+		return (SpreadBits(static_cast<uint32_t>(scaled.x)) << 2) | (SpreadBits(static_cast<uint32_t>(scaled.y)) << 1) | SpreadBits(static_cast<uint32_t>(scaled.z));
+	}
+
+	void ComputeMeshletBounds(const Mesh& mesh, Meshlet& meshlet)
+	{
+		glm::vec3 boundsMin(FLT_MAX);
+		glm::vec3 boundsMax(-FLT_MAX);
+		for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; ++i)
+		{
+			const glm::vec3& p = mesh.vertices[mesh.indices[i]].position;
+			boundsMin = glm::min(boundsMin, p);
+			boundsMax = glm::max(boundsMax, p);
+		}
+		meshlet.center = (boundsMin + boundsMax) * 0.5f;
+
+		float radiusSq = 0.f;
+		glm::vec3 normalSum(0.f);
+		for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3)
+		{
+			const glm::vec3& a = mesh.vertices[mesh.indices[i + 0]].position;
+			const glm::vec3& b = mesh.vertices[mesh.indices[i + 1]].position;
+			const glm::vec3& c = mesh.vertices[mesh.indices[i + 2]].position;
+
+			radiusSq = std::max(radiusSq, glm::dot(a - meshlet.center, a - meshlet.center));
+			radiusSq = std::max(radiusSq, glm::dot(b - meshlet.center, b - meshlet.center));
+			radiusSq = std::max(radiusSq, glm::dot(c - meshlet.center, c - meshlet.center));
+
+			// unnormalized cross product weights the average by triangle area
+			normalSum += glm::cross(b - a, c - a);
+		}
+		meshlet.radius = std::sqrt(radiusSq);
+
+		meshlet.coneAxis = glm::vec3(0.f);
+		meshlet.coneCutoff = 1.f;
+
+		const float axisLength = glm::length(normalSum);
+		if (axisLength < FLT_EPSILON)
+		{
+			return;
+		}
+		const glm::vec3 axis = normalSum / axisLength;
+
+		float minDot = 1.f;
+		for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3)
+		{
+			const glm::vec3& a = mesh.vertices[mesh.indices[i + 0]].position;
+			const glm::vec3& b = mesh.vertices[mesh.indices[i + 1]].position;
+			const glm::vec3& c = mesh.vertices[mesh.indices[i + 2]].position;
+
+			const glm::vec3 normal = glm::cross(b - a, c - a);
+			const float normalLength = glm::length(normal);
+			if (normalLength < FLT_EPSILON)
+			{
+				continue;
+			}
+			minDot = std::min(minDot, glm::dot(normal / normalLength, axis));
+		}
+
+		// a cone wider than a hemisphere can always see some front face, leave it uncullable
+		if (minDot <= 0.f)
+		{
+			return;
+		}
+		meshlet.coneAxis = axis;
+		meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+	}
+
+	void ExtractFrustumPlanes(const glm::mat4& m, glm::vec4 planes[6])
+	{
+		const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+		const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+		const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+		const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+		planes[0] = row3 + row0;
+		planes[1] = row3 - row0;
+		planes[2] = row3 + row1;
+		planes[3] = row3 - row1;
+		// vulkan clip space depth is [0, w]
+		planes[4] = row2;
+		planes[5] = row3 - row2;
+
+		for (int i = 0; i < 6; ++i)
+		{
+			planes[i] /= glm::length(glm::vec3(planes[i]));
+		}
+	}
+
+	void ClassifyCluster(uint32_t index, bool outside, bool backFacing, std::vector<uint8_t>& outVisibility, MeshletStats& stats)
+	{
+		if (outside)
+		{
+			stats.frustumCulled++;
+			outVisibility[index] = 0;
+		}
+		else if (backFacing)
+		{
+			stats.backfaceCulled++;
+			outVisibility[index] = 0;
+		}
+		else
+		{
+			stats.visibleClusters++;
+			outVisibility[index] = 1;
+		}
+	}
+}
+
+void vkutil::BuildMeshlets(Mesh& mesh)
+{
+	PROFILE_FUNCTION();
+	if (mesh.indices.empty())
+	{
+		mesh.indices.resize(mesh.vertices.size());
+		for (uint32_t i = 0; i < mesh.indices.size(); ++i)
+		{
+			mesh.indices[i] = i;
+		}
+	}
+
+	const uint32_t triangleCount = static_cast<uint32_t>(mesh.indices.size() / 3);
+
+	glm::vec3 boundsMin(FLT_MAX);
+	glm::vec3 boundsMax(-FLT_MAX);
+	for (const Vertex& vertex : mesh.vertices)
+	{
+		boundsMin = glm::min(boundsMin, vertex.position);
+		boundsMax = glm::max(boundsMax, vertex.position);
+	}
+	const glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(FLT_EPSILON));
+
+	// sections are already contiguous and in order, triangles only move inside their own section
+	std::vector<uint32_t> triangleSection(triangleCount, 0);
+	for (uint32_t s = 0; s < mesh.sections.size(); ++s)
+	{
+		const MeshSection& section = mesh.sections[s];
+		std::fill_n(triangleSection.begin() + section.firstIndex / 3, section.indexCount / 3, s);
+	}
+
+	// walk the triangles along a morton curve so every cluster stays spatially tight
+	std::vector<std::pair<uint64_t, uint32_t>> sortKeys(triangleCount);
+	for (uint32_t t = 0; t < triangleCount; ++t)
+	{
+		const glm::vec3 centroid = (mesh.vertices[mesh.indices[t * 3 + 0]].position
+			+ mesh.vertices[mesh.indices[t * 3 + 1]].position
+			+ mesh.vertices[mesh.indices[t * 3 + 2]].position) / 3.f;
+		sortKeys[t] = { (static_cast<uint64_t>(triangleSection[t]) << 32) | MortonCode((centroid - boundsMin) / extent), t };
+	}
+	std::sort(sortKeys.begin(), sortKeys.end());
+
+	std::vector<uint32_t> sortedIndices(triangleCount * 3);
+	for (uint32_t t = 0; t < triangleCount; ++t)
+	{
+		const uint32_t source = sortKeys[t].second;
+		sortedIndices[t * 3 + 0] = mesh.indices[source * 3 + 0];
+		sortedIndices[t * 3 + 1] = mesh.indices[source * 3 + 1];
+		sortedIndices[t * 3 + 2] = mesh.indices[source * 3 + 2];
+	}
+	mesh.indices.swap(sortedIndices);
+
+	mesh.meshlets.clear();
+	for (MeshSection& section : mesh.sections)
+	{
+		section.firstMeshlet = 0;
+		section.meshletCount = 0;
+	}
+
+	std::vector<uint32_t> vertexStamp(mesh.vertices.size(), UINT32_MAX);
+	Meshlet current{};
+	uint32_t meshletId = 0;
+	uint32_t currentSection = 0;
+
+	for (uint32_t t = 0; t < triangleCount; ++t)
+	{
+		// the sort kept section order, so a section's triangles are still where its range says
+		const uint32_t section = triangleSection[t];
+		if (section != currentSection && current.indexCount > 0)
+		{
+			ComputeMeshletBounds(mesh, current);
+			mesh.meshlets.push_back(current);
+			mesh.sections[currentSection].meshletCount++;
+
+			meshletId++;
+			current = Meshlet{};
+			current.firstIndex = t * 3;
+		}
+		if (section != currentSection || t == 0)
+		{
+			currentSection = section;
+			if (!mesh.sections.empty())
+			{
+				mesh.sections[section].firstMeshlet = static_cast<uint32_t>(mesh.meshlets.size());
+			}
+		}
+
+		const uint32_t a = mesh.indices[t * 3 + 0];
+		const uint32_t b = mesh.indices[t * 3 + 1];
+		const uint32_t c = mesh.indices[t * 3 + 2];
+
+		auto countNewVertices = [&]()
+		{
+			uint32_t count = vertexStamp[a] != meshletId;
+			count += vertexStamp[b] != meshletId && b != a;
+			count += vertexStamp[c] != meshletId && c != a && c != b;
+			return count;
+		};
+
+		uint32_t newVertices = countNewVertices();
+		if (current.vertexCount + newVertices > MESHLET_MAX_VERTICES || current.indexCount / 3 + 1 > MESHLET_MAX_TRIANGLES)
+		{
+			ComputeMeshletBounds(mesh, current);
+			mesh.meshlets.push_back(current);
+			if (!mesh.sections.empty())
+			{
+				mesh.sections[section].meshletCount++;
+			}
+
+			meshletId++;
+			current = Meshlet{};
+			current.firstIndex = t * 3;
+			newVertices = countNewVertices();
+		}
+
+		vertexStamp[a] = meshletId;
+		vertexStamp[b] = meshletId;
+		vertexStamp[c] = meshletId;
+		current.vertexCount += newVertices;
+		current.indexCount += 3;
+	}
+
+	if (current.indexCount > 0)
+	{
+		ComputeMeshletBounds(mesh, current);
+		mesh.meshlets.push_back(current);
+		if (!mesh.sections.empty())
+		{
+			mesh.sections[currentSection].meshletCount++;
+		}
+	}
+
+	const size_t paddedCount = (mesh.meshlets.size() + 3) & ~size_t(3);
+	MeshletCullData& cullData = mesh.meshletCullData;
+	for (std::vector<float>* stream : { &cullData.centerX, &cullData.centerY, &cullData.centerZ, &cullData.radius, &cullData.axisX, &cullData.axisY, &cullData.axisZ, &cullData.cutoff })
+	{
+		stream->assign(paddedCount, 0.f);
+	}
+
+	for (size_t i = 0; i < mesh.meshlets.size(); ++i)
+	{
+		const Meshlet& meshlet = mesh.meshlets[i];
+		cullData.centerX[i] = meshlet.center.x;
+		cullData.centerY[i] = meshlet.center.y;
+		cullData.centerZ[i] = meshlet.center.z;
+		cullData.radius[i] = meshlet.radius;
+		cullData.axisX[i] = meshlet.coneAxis.x;
+		cullData.axisY[i] = meshlet.coneAxis.y;
+		cullData.axisZ[i] = meshlet.coneAxis.z;
+		cullData.cutoff[i] = meshlet.coneCutoff;
+	}
+}
+
+void vkutil::CullMeshlets(const MeshletCullData& cullData, size_t firstMeshlet, size_t meshletCount, const glm::mat4& modelViewProjection, const glm::vec3& localCameraPos, std::vector<uint8_t>& outVisibility, MeshletStats& stats)
+{
+	glm::vec4 planes[6];
+	ExtractFrustumPlanes(modelViewProjection, planes);
+
+	const size_t end = firstMeshlet + meshletCount;
+	if (outVisibility.size() < end)
+	{
+		outVisibility.resize(end);
+	}
+	stats.totalClusters += static_cast<uint32_t>(meshletCount);
+
+#ifdef INFERNO_MESHLET_SSE
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int p = 0; p < 6; ++p)
+	{
+		planeX[p] = _mm_set1_ps(planes[p].x);
+		planeY[p] = _mm_set1_ps(planes[p].y);
+		planeZ[p] = _mm_set1_ps(planes[p].z);
+		planeW[p] = _mm_set1_ps(planes[p].w);
+	}
+	const __m128 camX = _mm_set1_ps(localCameraPos.x);
+	const __m128 camY = _mm_set1_ps(localCameraPos.y);
+	const __m128 camZ = _mm_set1_ps(localCameraPos.z);
+
+	// starting on a multiple of four keeps every load inside the padded arrays, lanes outside the range are skipped
+	for (size_t i = firstMeshlet & ~size_t(3); i < end; i += 4)
+	{
+		const __m128 cx = _mm_loadu_ps(&cullData.centerX[i]);
+		const __m128 cy = _mm_loadu_ps(&cullData.centerY[i]);
+		const __m128 cz = _mm_loadu_ps(&cullData.centerZ[i]);
+		const __m128 r = _mm_loadu_ps(&cullData.radius[i]);
+		const __m128 negR = _mm_sub_ps(_mm_setzero_ps(), r);
+
+		__m128 outside = _mm_setzero_ps();
+		for (int p = 0; p < 6; ++p)
+		{
+			__m128 d = _mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy));
+			d = _mm_add_ps(d, _mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeW[p]));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(d, negR));
+		}
+
+		const __m128 dx = _mm_sub_ps(cx, camX);
+		const __m128 dy = _mm_sub_ps(cy, camY);
+		const __m128 dz = _mm_sub_ps(cz, camZ);
+		const __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+		__m128 coneDot = _mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(&cullData.axisX[i])), _mm_mul_ps(dy, _mm_loadu_ps(&cullData.axisY[i])));
+		coneDot = _mm_add_ps(coneDot, _mm_mul_ps(dz, _mm_loadu_ps(&cullData.axisZ[i])));
+		const __m128 threshold = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&cullData.cutoff[i]), length), r);
+		const __m128 backFacing = _mm_cmpge_ps(coneDot, threshold);
+
+		const int outsideMask = _mm_movemask_ps(outside);
+		const int backFacingMask = _mm_movemask_ps(backFacing);
+		const size_t laneCount = std::min<size_t>(4, end - i);
+		for (size_t lane = i < firstMeshlet ? firstMeshlet - i : 0; lane < laneCount; ++lane)
+		{
+			ClassifyCluster(static_cast<uint32_t>(i + lane), (outsideMask >> lane) & 1, (backFacingMask >> lane) & 1, outVisibility, stats);
+		}
+	}
+#else
+	for (size_t i = firstMeshlet; i < end; ++i)
+	{
+		const glm::vec3 center(cullData.centerX[i], cullData.centerY[i], cullData.centerZ[i]);
+		const float radius = cullData.radius[i];
+
+		bool outside = false;
+		for (int p = 0; p < 6; ++p)
+		{
+			outside |= glm::dot(glm::vec3(planes[p]), center) + planes[p].w < -radius;
+		}
+
+		const glm::vec3 toCluster = center - localCameraPos;
+		const glm::vec3 axis(cullData.axisX[i], cullData.axisY[i], cullData.axisZ[i]);
+		const bool backFacing = glm::dot(toCluster, axis) >= cullData.cutoff[i] * glm::length(toCluster) + radius;
+
+		ClassifyCluster(static_cast<uint32_t>(i), outside, backFacing, outVisibility, stats);
+	}
+#endif
+}
+
+void vkutil::CullSections(const std::vector<MeshSection>& sections, size_t firstSection, size_t sectionCount, const glm::mat4& modelViewProjection, std::vector<uint8_t>& outVisibility, MeshletStats& stats)
+{
+	glm::vec4 planes[6];
+	ExtractFrustumPlanes(modelViewProjection, planes);
+
+	const size_t end = firstSection + sectionCount;
+	if (outVisibility.size() < end)
+	{
+		outVisibility.resize(end);
+	}
+	stats.totalSections += static_cast<uint32_t>(sectionCount);
+
+	for (size_t i = firstSection; i < end; ++i)
+	{
+		const glm::vec3 center = (sections[i].boundsMin + sections[i].boundsMax) * 0.5f;
+		const glm::vec3 halfExtent = (sections[i].boundsMax - sections[i].boundsMin) * 0.5f;
+
+		// the box is outside once its corner furthest along the plane normal is behind the plane
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; ++p)
+		{
+			const glm::vec3 normal(planes[p]);
+			const float reach = glm::dot(glm::abs(normal), halfExtent);
+			outside = glm::dot(normal, center) + planes[p].w < -reach;
+		}
+
+		outVisibility[i] = outside ? 0 : 1;
+		stats.culledSections += outside ? 1 : 0;
+	}
+}
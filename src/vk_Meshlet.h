@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+struct Mesh;
+struct MeshSection;
+
+constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+struct Meshlet
+{
+	// range inside Mesh::indices, indices still address the shared vertex buffer
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	uint32_t vertexCount;
+
+	glm::vec3 center;
+	float radius;
+
+	// cluster is back facing when dot(center - camera, coneAxis) >= coneCutoff * |center - camera| + radius
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+// Bounds of every meshlet in SoA layout so the culler can test four clusters per instruction.
+// Arrays are padded to a multiple of four, the culler ignores lanes past the real meshlet count.
+struct MeshletCullData
+{
+	std::vector<float> centerX, centerY, centerZ, radius;
+	std::vector<float> axisX, axisY, axisZ, cutoff;
+
+	size_t PaddedCount() const { return centerX.size(); }
+};
+
+struct MeshletStats
+{
+	uint32_t totalClusters = 0;
+	uint32_t visibleClusters = 0;
+	uint32_t frustumCulled = 0;
+	uint32_t backfaceCulled = 0;
+	uint32_t drawCommands = 0;
+	uint32_t visibleTriangles = 0;
+	uint32_t totalSections = 0;
+	uint32_t culledSections = 0;
+	// visible clusters, chunks and objects left out of the frame because the indirect buffer was full
+	uint32_t droppedDraws = 0;
+};
+
+namespace vkutil
+{
+	// Reorders mesh.indices into spatially coherent clusters and fills mesh.meshlets and mesh.meshletCullData.
+	// Triangles stay inside their mesh section, every section gets its own clusters.
+	void BuildMeshlets(Mesh& mesh);
+
+	// Frustum and normal cone test of the clusters in [firstMeshlet, firstMeshlet + meshletCount).
+	// modelViewProjection and localCameraPos are in mesh space.
+	// outVisibility is indexed by meshlet, 1 when the cluster should be drawn.
+	void CullMeshlets(const MeshletCullData& cullData, size_t firstMeshlet, size_t meshletCount, const glm::mat4& modelViewProjection, const glm::vec3& localCameraPos, std::vector<uint8_t>& outVisibility, MeshletStats& stats);
+
+	// Frustum test of the section bounds in [firstSection, firstSection + sectionCount), outVisibility is indexed by section.
+	void CullSections(const std::vector<MeshSection>& sections, size_t firstSection, size_t sectionCount, const glm::mat4& modelViewProjection, std::vector<uint8_t>& outVisibility, MeshletStats& stats);
+}
@@ -0,0 +1,178 @@
+#include "vk_PerfHud.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "imgui.h"
+#include "vk_engine.h"
+
+void PerfHud::AddFrame(float cpuMs, float gpuMs)
+{
+	m_CpuHistory[m_Next] = cpuMs;
+	m_GpuHistory[m_Next] = gpuMs;
+	m_Next = (m_Next + 1) % PERFHUD_HISTORY;
+	m_Count = std::min<uint32_t>(m_Count + 1, PERFHUD_HISTORY);
+}
+
+void PerfHud::Draw(VulkanEngine& engine)
+{
+	if (!m_Visible)
+	{
+		m_BuildMs = 0.f;
+		return;
+	}
+
+	const auto begin = std::chrono::steady_clock::now();
+
+	ImGui::SetNextWindowPos(ImVec2(10.f, 10.f), ImGuiCond_FirstUseEver);
+	ImGui::Begin("Performance (F1)", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+
+	const uint32_t last = (m_Next + PERFHUD_HISTORY - 1) % PERFHUD_HISTORY;
+	const float cpuMs = m_Count ? m_CpuHistory[last] : 0.f;
+	const float gpuMs = m_Count ? m_GpuHistory[last] : 0.f;
+
+	float worst = 0.f;
+	float sum = 0.f;
+	for (uint32_t i = 0; i < m_Count; ++i)
+	{
+		worst = std::max(worst, m_CpuHistory[i]);
+		sum += m_CpuHistory[i];
+	}
+	const float average = m_Count ? sum / m_Count : 0.f;
+
+	ImGui::Text("frame %.2f ms (%.0f fps), avg %.2f ms, worst %.2f ms", cpuMs, cpuMs > 0.f ? 1000.f / cpuMs : 0.f, average, worst);
+	// the ring is plotted oldest first, ImGui wraps around from the offset
+	const uint32_t offset = m_Count == PERFHUD_HISTORY ? m_Next : 0;
+	const float scale = std::max(worst, 16.7f) * 1.1f;
+	ImGui::PlotLines("cpu", m_CpuHistory, static_cast<int>(m_Count), static_cast<int>(offset), nullptr, 0.f, scale, ImVec2(320.f, 60.f));
+	ImGui::PlotLines("gpu", m_GpuHistory, static_cast<int>(m_Count), static_cast<int>(offset), nullptr, 0.f, scale, ImVec2(320.f, 60.f));
+
+	ImGui::Text("cpu %.2f ms | gpu %.2f ms -> %s bound", cpuMs, gpuMs, gpuMs > cpuMs * 0.9f ? "gpu" : "cpu");
+	const LatencyStats& latency = engine.GetLatencyStats();
+	ImGui::Text("latency %.2f ms, avg %.2f ms, worst %.2f ms | present %s (F2), low latency %s (F3)", latency.lastMs, latency.averageMs, latency.worstMs,
+		engine.GetPresentModeName(), engine.IsLowLatency() ? "on" : "off");
+
+	const DynamicResolution& resolution = engine.GetDynamicResolution();
+	if (resolution.IsEnabled())
+	{
+		const DynamicResolutionStats& scaling = resolution.GetStats();
+		ImGui::Text("resolution %ux%u of %ux%u (%.0f%%), budget %.2f ms, %u drops, %u raises", engine.m_RenderExtent.width, engine.m_RenderExtent.height,
+			engine.m_WindowExtent.width, engine.m_WindowExtent.height, scaling.scale * 100.f, resolution.GetBudgetMs(), scaling.drops, scaling.raises);
+	}
+	const Simulation& simulation = engine.GetSimulation();
+	const SimulationStats simulationStats = simulation.GetStats();
+	ImGui::Text("simulation: %llu ticks at %.0f Hz, %.3f ms per tick, %u dropped", static_cast<unsigned long long>(simulationStats.ticks),
+		simulation.GetTickRate(), simulationStats.tickMs, simulationStats.droppedTicks);
+	const BvhStats& bvh = engine.GetSceneBvh().GetStats();
+	if (bvh.nodes > 0)
+	{
+		const glm::vec2& mouse = engine.GetMousePosition();
+		const auto pickStart = std::chrono::steady_clock::now();
+		RayHit hit;
+		const bool picked = engine.PickScene(mouse.x, mouse.y, hit);
+		const float pickUs = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - pickStart).count();
+		ImGui::Text("scene bvh: %u nodes, depth %u, built in %.1f ms on %u threads", bvh.nodes, bvh.maxDepth, bvh.buildMs, bvh.threads);
+		if (picked)
+		{
+			ImGui::Text("pick: triangle %u at %.1f, %.2f us", hit.triangle, hit.t, pickUs);
+		}
+		else
+		{
+			ImGui::Text("pick: nothing under the cursor, %.2f us", pickUs);
+		}
+	}
+	const FrameStats& frame = engine.GetFrameStats();
+	const MeshletStats& meshlets = engine.GetMeshletStats();
+	ImGui::Separator();
+	ImGui::Text("draw calls %u, indirect commands %u", frame.drawCalls, frame.drawCommands);
+	ImGui::Text("objects %u, triangles %llu", frame.objects, static_cast<unsigned long long>(frame.triangles));
+	ImGui::Text("frame allocator %.1f KB, heap allocations %u", frame.frameAllocatorBytes / 1024.f, frame.heapAllocations);
+	ImGui::Text("clusters %u/%u visible, %u frustum culled, %u backface culled",
+		meshlets.visibleClusters, meshlets.totalClusters, meshlets.frustumCulled, meshlets.backfaceCulled);
+	ImGui::Text("chunks %u/%u visible", meshlets.totalSections - meshlets.culledSections, meshlets.totalSections);
+	if (meshlets.droppedDraws > 0)
+	{
+		ImGui::Text("indirect buffer full, %u draws dropped", meshlets.droppedDraws);
+	}
+	const ShadowStats& shadows = engine.GetShadowMaps().GetStats();
+	ImGui::Text("shadows: %u cascades refreshed (%u total), %u static / %u dynamic draws, cache %.2f ms", shadows.cascadesRefreshed,
+		shadows.totalRefreshes, shadows.staticDraws, shadows.dynamicDraws, engine.GetGpuProfiler().GetLastMs("shadow cache"));
+	const ResourceRegistryStats resources = engine.GetRegistry().GetStats();
+	ImGui::Text("resources: %u meshes, %u materials, %u textures, %u buffers", resources.meshes, resources.materials, resources.textures, resources.buffers);
+	const GeometryPoolStats geometry = engine.GetGeometryPool().GetStats();
+	ImGui::Text("geometry pool: %u/%u vertices free (largest %u), %u/%u indices free (largest %u), %u defragmentations", geometry.vertexFree,
+		geometry.vertexCapacity, geometry.vertexLargestFree, geometry.indexFree, geometry.indexCapacity, geometry.indexLargestFree, geometry.defragmentations);
+
+	ImGui::Separator();
+	const MemoryManager& memory = engine.GetMemoryManager();
+	const VkPhysicalDeviceMemoryProperties* memoryProperties;
+	vmaGetMemoryProperties(engine.GetAllocator(), &memoryProperties);
+	ImGui::Text("heap budgets %s", memory.HasBudgetExtension() ? "(VK_EXT_memory_budget)" : "(estimated)");
+	for (uint32_t heap = 0; heap < memory.GetHeapCount(); ++heap)
+	{
+		const VmaBudget& budget = memory.GetBudget(heap);
+		const float usedMb = budget.usage / (1024.f * 1024.f);
+		const float budgetMb = budget.budget / (1024.f * 1024.f);
+		const bool deviceLocal = (memoryProperties->memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+
+		char overlay[64];
+		snprintf(overlay, sizeof(overlay), "%.0f / %.0f MB", usedMb, budgetMb);
+		ImGui::Text("heap %u %s", heap, deviceLocal ? "(device)" : "(host)  ");
+		ImGui::SameLine();
+		ImGui::ProgressBar(budgetMb > 0.f ? usedMb / budgetMb : 0.f, ImVec2(200.f, 0.f), overlay);
+	}
+
+	// pool stats walk the pool's blocks, cheap enough for the handful of pools there are
+	ImGui::Columns(5, "memory categories", false);
+	ImGui::Text("category"); ImGui::NextColumn();
+	ImGui::Text("used MB"); ImGui::NextColumn();
+	ImGui::Text("blocks MB"); ImGui::NextColumn();
+	ImGui::Text("allocations"); ImGui::NextColumn();
+	ImGui::Text("fragmented"); ImGui::NextColumn();
+	for (uint32_t i = 0; i < static_cast<uint32_t>(MemoryCategory::Count); ++i)
+	{
+		const MemoryCategory category = static_cast<MemoryCategory>(i);
+		const MemoryCategoryStats stats = memory.GetCategoryStats(category);
+		ImGui::Text("%s", MemoryManager::GetCategoryName(category)); ImGui::NextColumn();
+		ImGui::Text("%.2f", stats.usedBytes / (1024.f * 1024.f)); ImGui::NextColumn();
+		ImGui::Text("%.2f", stats.blockBytes / (1024.f * 1024.f)); ImGui::NextColumn();
+		ImGui::Text("%zu", stats.allocationCount); ImGui::NextColumn();
+		ImGui::Text("%.0f%%", stats.fragmentation * 100.f); ImGui::NextColumn();
+	}
+	ImGui::Columns(1);
+
+	const MemoryDefragStats& defrag = memory.GetDefragStats();
+	ImGui::Text("defrag: %s, %u runs, %u passes, %u moved (%.2f MB), %.2f MB freed", defrag.active ? "running" : "idle",
+		defrag.runs, defrag.passes, defrag.allocationsMoved, defrag.bytesMoved / (1024.f * 1024.f), defrag.bytesFreed / (1024.f * 1024.f));
+	const MemoryEvictionStats& eviction = memory.GetEvictionStats();
+	ImGui::Text("eviction: %u requests, %.2f of %.2f MB scheduled", eviction.requests,
+		eviction.bytesScheduled / (1024.f * 1024.f), eviction.bytesRequested / (1024.f * 1024.f));
+
+	const TextureStreamerStats& streaming = engine.GetTextureStreamer().GetStats();
+	ImGui::Text("textures: %u streamed, %.2f of %.2f MB resident, %u loads pending, %.2f MB this frame", streaming.textureCount,
+		streaming.residentBytes / (1024.f * 1024.f), streaming.budgetBytes / (1024.f * 1024.f), streaming.pendingLoads, streaming.frameUploadBytes / (1024.f * 1024.f));
+	ImGui::Text("texture mips: %u streamed in (%.2f MB), %u evicted", streaming.mipsStreamed, streaming.bytesStreamed / (1024.f * 1024.f), streaming.mipsEvicted);
+
+	const StagingStats& staging = engine.GetStagingStats();
+	ImGui::Text("staging: %u uploads, %.2f MB total, %.2f MB this frame, largest %.2f MB", staging.uploads,
+		staging.totalBytes / (1024.f * 1024.f), staging.frameBytes / (1024.f * 1024.f), staging.largestBytes / (1024.f * 1024.f));
+
+	const PipelineCache& pipelineCache = engine.GetPipelineCache();
+	const PipelineCacheStats& pipelines = pipelineCache.GetStats();
+	if (pipelineCache.HasFeedback())
+	{
+		ImGui::Text("pipelines: %u created, %u/%u cache hits, %.2f ms", pipelines.pipelinesCreated, pipelines.cacheHits, pipelines.feedbackCount, pipelines.creationMs);
+	}
+	else
+	{
+		ImGui::Text("pipelines: %u created, %.2f ms, no creation feedback", pipelines.pipelinesCreated, pipelines.creationMs);
+	}
+
+	ImGui::Separator();
+	ImGui::Text("hud %.3f ms", m_BuildMs);
+	ImGui::End();
+
+	engine.GetGpuProfiler().DrawImGui();
+
+	m_BuildMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
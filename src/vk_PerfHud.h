@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+#define PERFHUD_HISTORY 240
+
+class VulkanEngine;
+
+// Overlay with the numbers we look at first when a frame is slow: frame time history, cpu/gpu split,
+// draw and culling counts, VMA heap budgets, staging traffic and pipeline cache hits.
+// Everything it reads is already collected by the engine, building the windows is all it costs.
+class PerfHud
+{
+public:
+	void Toggle() { m_Visible = !m_Visible; }
+	bool IsVisible() const { return m_Visible; }
+
+	void AddFrame(float cpuMs, float gpuMs);
+	void Draw(VulkanEngine& engine);
+
+	// cpu time spent building the overlay last frame
+	float GetBuildMs() const { return m_BuildMs; }
+
+private:
+	float m_CpuHistory[PERFHUD_HISTORY]{};
+	float m_GpuHistory[PERFHUD_HISTORY]{};
+	uint32_t m_Next{ 0 };
+	uint32_t m_Count{ 0 };
+
+	bool m_Visible{ true };
+	float m_BuildMs{ 0.f };
+};
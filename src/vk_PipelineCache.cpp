@@ -0,0 +1,149 @@
+#include "vk_PipelineCache.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+void PipelineCache::Init(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& path, bool feedbackSupported)
+{
+	m_Device = device;
+	m_Path = path;
+	m_FeedbackSupported = feedbackSupported;
+
+	std::vector<char> data;
+	std::ifstream file(path, std::ios::binary | std::ios::ate);
+	if (file.is_open())
+	{
+		data.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(data.data(), data.size());
+	}
+
+	// the header carries the vendor, device and cache uuid, a cache written by another driver is thrown away
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+	constexpr size_t headerSize = 16 + VK_UUID_SIZE;
+	if (data.size() >= headerSize)
+	{
+		uint32_t vendorId;
+		uint32_t deviceId;
+		memcpy(&vendorId, data.data() + 8, sizeof(uint32_t));
+		memcpy(&deviceId, data.data() + 12, sizeof(uint32_t));
+		if (vendorId != properties.vendorID || deviceId != properties.deviceID || memcmp(data.data() + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		{
+			std::cout << "pipeline cache " << path << " belongs to another device, starting empty" << std::endl;
+			data.clear();
+		}
+	}
+	else
+	{
+		data.clear();
+	}
+
+	VkPipelineCacheCreateInfo cacheInfo{};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.pNext = nullptr;
+	cacheInfo.initialDataSize = data.size();
+	cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	if (vkCreatePipelineCache(m_Device, &cacheInfo, nullptr, &m_Cache) != VK_SUCCESS)
+	{
+		std::cout << "failed to create pipeline cache" << std::endl;
+		m_Cache = VK_NULL_HANDLE;
+		return;
+	}
+	m_Stats.loadedBytes = data.size();
+}
+
+void PipelineCache::Save() const
+{
+	if (m_Cache == VK_NULL_HANDLE || m_Path.empty())
+	{
+		return;
+	}
+
+	size_t size = 0;
+	vkGetPipelineCacheData(m_Device, m_Cache, &size, nullptr);
+	std::vector<char> data(size);
+	if (size == 0 || vkGetPipelineCacheData(m_Device, m_Cache, &size, data.data()) != VK_SUCCESS)
+	{
+		return;
+	}
+
+	std::ofstream file(m_Path, std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cout << "failed to write pipeline cache " << m_Path << std::endl;
+		return;
+	}
+	file.write(data.data(), size);
+}
+
+void PipelineCache::Cleanup()
+{
+	if (m_Cache != VK_NULL_HANDLE)
+	{
+		vkDestroyPipelineCache(m_Device, m_Cache, nullptr);
+		m_Cache = VK_NULL_HANDLE;
+	}
+}
+
+template<typename CreateInfo, typename CreateFunction>
+VkPipeline PipelineCache::CreatePipeline(CreateInfo& pipelineInfo, CreateFunction&& create)
+{
+	VkPipelineCreationFeedbackEXT feedback{};
+	VkPipelineCreationFeedbackCreateInfoEXT feedbackInfo{};
+	if (m_FeedbackSupported)
+	{
+		feedbackInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT;
+		feedbackInfo.pNext = pipelineInfo.pNext;
+		feedbackInfo.pPipelineCreationFeedback = &feedback;
+		feedbackInfo.pipelineStageCreationFeedbackCount = 0;
+		feedbackInfo.pPipelineStageCreationFeedbacks = nullptr;
+		pipelineInfo.pNext = &feedbackInfo;
+	}
+
+	const auto begin = std::chrono::steady_clock::now();
+	VkPipeline pipeline;
+	const VkResult result = create(pipeline);
+	m_Stats.creationMs += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+	if (m_FeedbackSupported)
+	{
+		pipelineInfo.pNext = feedbackInfo.pNext;
+	}
+	if (result != VK_SUCCESS)
+	{
+		return VK_NULL_HANDLE;
+	}
+
+	m_Stats.pipelinesCreated++;
+	if (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT)
+	{
+		m_Stats.feedbackCount++;
+		if (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT)
+		{
+			m_Stats.cacheHits++;
+		}
+	}
+	return pipeline;
+}
+
+VkPipeline PipelineCache::CreateGraphicsPipeline(VkGraphicsPipelineCreateInfo& pipelineInfo)
+{
+	return CreatePipeline(pipelineInfo, [&](VkPipeline& pipeline)
+		{
+			return vkCreateGraphicsPipelines(m_Device, m_Cache, 1, &pipelineInfo, nullptr, &pipeline);
+		});
+}
+
+VkPipeline PipelineCache::CreateComputePipeline(VkComputePipelineCreateInfo& pipelineInfo)
+{
+	return CreatePipeline(pipelineInfo, [&](VkPipeline& pipeline)
+		{
+			return vkCreateComputePipelines(m_Device, m_Cache, 1, &pipelineInfo, nullptr, &pipeline);
+		});
+}
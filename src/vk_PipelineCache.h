@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+
+#include "vk_types.h"
+
+struct PipelineCacheStats
+{
+	uint32_t pipelinesCreated = 0;
+	// only known when VK_EXT_pipeline_creation_feedback is enabled
+	uint32_t cacheHits = 0;
+	uint32_t feedbackCount = 0;
+	float creationMs = 0.f;
+	size_t loadedBytes = 0;
+};
+
+// VkPipelineCache that is loaded from and saved to disk, so pipelines built on an earlier run come back from the driver cache.
+// With creation feedback available every pipeline reports whether the cache served it and how long it took.
+class PipelineCache
+{
+public:
+	void Init(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& path, bool feedbackSupported);
+	void Save() const;
+	void Cleanup();
+
+	VkPipeline CreateGraphicsPipeline(VkGraphicsPipelineCreateInfo& pipelineInfo);
+	VkPipeline CreateComputePipeline(VkComputePipelineCreateInfo& pipelineInfo);
+
+	VkPipelineCache GetCache() const { return m_Cache; }
+	const PipelineCacheStats& GetStats() const { return m_Stats; }
+	bool HasFeedback() const { return m_FeedbackSupported; }
+
+private:
+	// chains the creation feedback into pipelineInfo around create and counts the result
+	template<typename CreateInfo, typename CreateFunction>
+	VkPipeline CreatePipeline(CreateInfo& pipelineInfo, CreateFunction&& create);
+
+	VkDevice m_Device{ VK_NULL_HANDLE };
+	VkPipelineCache m_Cache{ VK_NULL_HANDLE };
+	std::string m_Path;
+	bool m_FeedbackSupported{ false };
+	PipelineCacheStats m_Stats;
+};
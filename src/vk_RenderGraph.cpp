@@ -0,0 +1,1041 @@
+#include "vk_RenderGraph.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+#include "vk_initializers.h"
+#include "CpuProfiler.h"
+#include "vk_GpuProfiler.h"
+
+namespace
+{
+	constexpr VkAccessFlags READ_ACCESS = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT |
+		VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_INPUT_ATTACHMENT_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_HOST_READ_BIT | VK_ACCESS_MEMORY_READ_BIT;
+
+	constexpr VkAccessFlags WRITE_ACCESS = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+	bool IsDepthFormat(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_D16_UNORM:
+		case VK_FORMAT_X8_D24_UNORM_PACK32:
+		case VK_FORMAT_D32_SFLOAT:
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	bool HasStencil(VkFormat format)
+	{
+		return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+	}
+
+	// a write that does not look at the old contents starts a new version of the resource
+	bool ReadsPrevious(const RGUsage& usage)
+	{
+		return !usage.clear && (usage.access & READ_ACCESS) != 0;
+	}
+
+	VkImageUsageFlags UsageFromLayout(VkImageLayout layout)
+	{
+		switch (layout)
+		{
+		case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+			return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+			return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+		case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
+			return VK_IMAGE_USAGE_SAMPLED_BIT;
+		case VK_IMAGE_LAYOUT_GENERAL:
+			return VK_IMAGE_USAGE_STORAGE_BIT;
+		case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+			return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+			return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+		default:
+			return 0;
+		}
+	}
+
+	const char* LayoutName(VkImageLayout layout)
+	{
+		switch (layout)
+		{
+		case VK_IMAGE_LAYOUT_UNDEFINED: return "UNDEFINED";
+		case VK_IMAGE_LAYOUT_GENERAL: return "GENERAL";
+		case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL: return "COLOR_ATTACHMENT";
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL: return "DEPTH_ATTACHMENT";
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL: return "DEPTH_READ_ONLY";
+		case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL: return "SHADER_READ_ONLY";
+		case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL: return "TRANSFER_SRC";
+		case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL: return "TRANSFER_DST";
+		case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR: return "PRESENT_SRC";
+		default: return "OTHER";
+		}
+	}
+
+	const char* PassTypeName(RGPassType type)
+	{
+		switch (type)
+		{
+		case RGPassType::Graphics: return "graphics";
+		case RGPassType::Compute: return "compute";
+		default: return "transfer";
+		}
+	}
+}
+
+RGResource RenderGraphBuilder::CreateImage(const std::string& name, const RGImageDesc& desc)
+{
+	RenderGraph::ResourceNode node;
+	node.name = name;
+	node.isImage = true;
+	node.imported = false;
+	node.desc = desc;
+	node.aspect = IsDepthFormat(desc.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+	if (HasStencil(desc.format))
+	{
+		node.aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+
+	m_Graph.m_Resources.push_back(node);
+	return static_cast<RGResource>(m_Graph.m_Resources.size() - 1);
+}
+
+void RenderGraphBuilder::WriteColor(RGResource image)
+{
+	RGUsage& usage = AddUsage(image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, true);
+	usage.attachment = true;
+}
+
+void RenderGraphBuilder::WriteColor(RGResource image, VkClearColorValue clear)
+{
+	RGUsage& usage = AddUsage(image, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, true);
+	usage.attachment = true;
+	usage.clear = true;
+	usage.clearValue.color = clear;
+}
+
+void RenderGraphBuilder::WriteDepth(RGResource image)
+{
+	RGUsage& usage = AddUsage(image, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, true);
+	usage.attachment = true;
+}
+
+void RenderGraphBuilder::WriteDepth(RGResource image, float clearDepth)
+{
+	// depth testing reads the attachment even right after a clear
+	RGUsage& usage = AddUsage(image, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, true);
+	usage.attachment = true;
+	usage.clear = true;
+	usage.clearValue.depthStencil.depth = clearDepth;
+	usage.clearValue.depthStencil.stencil = 0;
+}
+
+void RenderGraphBuilder::ReadDepth(RGResource image)
+{
+	RGUsage& usage = AddUsage(image, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, false);
+	usage.attachment = true;
+}
+
+void RenderGraphBuilder::ReadTexture(RGResource image)
+{
+	AddUsage(image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, ShaderStages(), VK_ACCESS_SHADER_READ_BIT, false);
+}
+
+void RenderGraphBuilder::WriteStorageImage(RGResource image)
+{
+	AddUsage(image, VK_IMAGE_LAYOUT_GENERAL, ShaderStages(), VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, true);
+}
+
+void RenderGraphBuilder::ReadTransfer(RGResource image)
+{
+	AddUsage(image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, false);
+}
+
+void RenderGraphBuilder::WriteTransfer(RGResource image)
+{
+	AddUsage(image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, true);
+}
+
+void RenderGraphBuilder::ReadBuffer(RGResource buffer, VkPipelineStageFlags stages, VkAccessFlags access)
+{
+	AddUsage(buffer, VK_IMAGE_LAYOUT_UNDEFINED, stages, access, false);
+}
+
+void RenderGraphBuilder::WriteBuffer(RGResource buffer, VkPipelineStageFlags stages, VkAccessFlags access)
+{
+	AddUsage(buffer, VK_IMAGE_LAYOUT_UNDEFINED, stages, access, true);
+}
+
+void RenderGraphBuilder::SetSideEffect()
+{
+	m_Graph.m_Passes[m_Pass].sideEffect = true;
+}
+
+RGUsage& RenderGraphBuilder::AddUsage(RGResource resource, VkImageLayout layout, VkPipelineStageFlags stages, VkAccessFlags access, bool write)
+{
+	RGUsage usage{};
+	usage.resource = resource;
+	usage.layout = layout;
+	usage.stages = stages;
+	usage.access = access;
+	usage.write = write;
+	usage.attachment = false;
+	usage.clear = false;
+
+	std::vector<RGUsage>& usages = m_Graph.m_Passes[m_Pass].usages;
+	usages.push_back(usage);
+	return usages.back();
+}
+
+VkPipelineStageFlags RenderGraphBuilder::ShaderStages() const
+{
+	if (m_Graph.m_Passes[m_Pass].type == RGPassType::Compute)
+	{
+		return VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+	}
+	return VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+}
+
+void RenderGraph::Init(VkDevice device, VmaAllocator allocator)
+{
+	m_Device = device;
+	m_Allocator = allocator;
+}
+
+void RenderGraph::Destroy()
+{
+	ReleaseCompiled();
+	m_Resources.clear();
+	m_Passes.clear();
+}
+
+RGResource RenderGraph::ImportImage(const std::string& name, const RGImageDesc& desc, VkImage image, VkImageView view,
+	VkImageLayout initialLayout, VkPipelineStageFlags initialStages,
+	VkImageLayout finalLayout, VkPipelineStageFlags finalStages, VkAccessFlags finalAccess)
+{
+	ResourceNode node;
+	node.name = name;
+	node.isImage = true;
+	node.imported = true;
+	node.desc = desc;
+	node.aspect = IsDepthFormat(desc.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+	if (HasStencil(desc.format))
+	{
+		node.aspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+	node.image = image;
+	node.view = view;
+	node.initialLayout = initialLayout;
+	node.initialStages = initialStages;
+	node.finalLayout = finalLayout;
+	node.finalStages = finalStages;
+	node.finalAccess = finalAccess;
+
+	m_Resources.push_back(node);
+	return static_cast<RGResource>(m_Resources.size() - 1);
+}
+
+RGResource RenderGraph::ImportBuffer(const std::string& name, VkBuffer buffer)
+{
+	ResourceNode node;
+	node.name = name;
+	node.isImage = false;
+	node.imported = true;
+	node.desc = {};
+	node.aspect = 0;
+	node.buffer = buffer;
+
+	m_Resources.push_back(node);
+	return static_cast<RGResource>(m_Resources.size() - 1);
+}
+
+void RenderGraph::SetImportedImage(RGResource resource, VkImage image, VkImageView view)
+{
+	m_Resources[resource].image = image;
+	m_Resources[resource].view = view;
+}
+
+void RenderGraph::SetImportedBuffer(RGResource resource, VkBuffer buffer)
+{
+	m_Resources[resource].buffer = buffer;
+}
+
+void RenderGraph::SetImageExtent(RGResource resource, VkExtent2D extent)
+{
+	m_Resources[resource].desc.extent = extent;
+}
+
+RGPass RenderGraph::AddPass(const std::string& name, RGPassType type, const std::function<void(RenderGraphBuilder&)>& setup, std::function<void(VkCommandBuffer)>&& execute)
+{
+	PassNode pass;
+	pass.name = name;
+	pass.type = type;
+	pass.execute = std::move(execute);
+	m_Passes.push_back(std::move(pass));
+
+	const RGPass index = static_cast<RGPass>(m_Passes.size() - 1);
+	RenderGraphBuilder builder(*this, index);
+	setup(builder);
+	return index;
+}
+
+void RenderGraph::Compile()
+{
+	PROFILE_SCOPE("RenderGraph::Compile");
+	ReleaseCompiled();
+
+	CullPasses();
+	ComputeLifetimes();
+	CreateTransientImages();
+	BuildBarriers();
+	CreateRenderPasses();
+
+	m_Compiled = true;
+}
+
+void RenderGraph::Recompile(const std::function<void(std::function<void()>&&)>& retire)
+{
+	PROFILE_SCOPE("RenderGraph::Recompile");
+	retire(TakeCompiled());
+
+	CullPasses();
+	ComputeLifetimes();
+	CreateTransientImages();
+	BuildBarriers();
+	CreateRenderPasses();
+
+	m_Compiled = true;
+}
+
+void RenderGraph::Execute(VkCommandBuffer cmd)
+{
+	PROFILE_SCOPE("RenderGraph::Execute");
+	for (PassNode& pass : m_Passes)
+	{
+		if (pass.culled)
+		{
+			continue;
+		}
+
+		const uint32_t zone = m_Profiler ? m_Profiler->BeginZone(cmd, pass.name.c_str()) : 0;
+		RecordBarriers(cmd, pass.barriers);
+
+		if (pass.type == RGPassType::Graphics)
+		{
+			VkRenderPassBeginInfo rpInfo{};
+			rpInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+			rpInfo.pNext = nullptr;
+
+			rpInfo.renderPass = pass.renderPass;
+			rpInfo.renderArea.offset.x = 0;
+			rpInfo.renderArea.offset.y = 0;
+			rpInfo.renderArea.extent = pass.extent;
+			rpInfo.framebuffer = GetFramebuffer(pass);
+
+			rpInfo.clearValueCount = static_cast<uint32_t>(pass.clearValues.size());
+			rpInfo.pClearValues = pass.clearValues.data();
+
+			vkCmdBeginRenderPass(cmd, &rpInfo, VK_SUBPASS_CONTENTS_INLINE);
+			pass.execute(cmd);
+			vkCmdEndRenderPass(cmd);
+		}
+		else
+		{
+			pass.execute(cmd);
+		}
+
+		if (m_Profiler)
+		{
+			m_Profiler->EndZone(cmd, zone);
+		}
+	}
+
+	RecordBarriers(cmd, m_FinalBarriers);
+}
+
+VkRenderPass RenderGraph::GetRenderPass(RGPass pass) const
+{
+	return m_Passes[pass].renderPass;
+}
+
+VkImage RenderGraph::GetImage(RGResource resource) const
+{
+	return m_Resources[resource].image;
+}
+
+VkImageView RenderGraph::GetImageView(RGResource resource) const
+{
+	return m_Resources[resource].view;
+}
+
+bool RenderGraph::IsPassCulled(RGPass pass) const
+{
+	return m_Passes[pass].culled;
+}
+
+void RenderGraph::CullPasses()
+{
+	// walk backwards: a pass survives when something after it (or outside the graph) consumes what it writes
+	std::vector<bool> live(m_Resources.size(), false);
+	for (size_t i = m_Passes.size(); i-- > 0;)
+	{
+		PassNode& pass = m_Passes[i];
+
+		bool needed = pass.sideEffect;
+		for (const RGUsage& usage : pass.usages)
+		{
+			if (usage.write && (m_Resources[usage.resource].imported || live[usage.resource]))
+			{
+				needed = true;
+			}
+		}
+
+		pass.culled = !needed;
+		if (!needed)
+		{
+			continue;
+		}
+
+		for (const RGUsage& usage : pass.usages)
+		{
+			if (usage.write && !ReadsPrevious(usage))
+			{
+				live[usage.resource] = false;
+			}
+		}
+		for (const RGUsage& usage : pass.usages)
+		{
+			if (!usage.write || ReadsPrevious(usage))
+			{
+				live[usage.resource] = true;
+			}
+		}
+	}
+}
+
+void RenderGraph::ComputeLifetimes()
+{
+	for (ResourceNode& resource : m_Resources)
+	{
+		resource.usage = resource.desc.usage;
+		resource.firstPass = RG_INVALID;
+		resource.lastPass = RG_INVALID;
+		resource.aliasSlot = RG_INVALID;
+	}
+
+	for (uint32_t i = 0; i < m_Passes.size(); ++i)
+	{
+		if (m_Passes[i].culled)
+		{
+			continue;
+		}
+		for (const RGUsage& usage : m_Passes[i].usages)
+		{
+			ResourceNode& resource = m_Resources[usage.resource];
+			if (resource.firstPass == RG_INVALID)
+			{
+				resource.firstPass = i;
+			}
+			resource.lastPass = i;
+			resource.usage |= UsageFromLayout(usage.layout);
+		}
+	}
+}
+
+void RenderGraph::CreateTransientImages()
+{
+	std::vector<std::pair<RGResource, VkMemoryRequirements>> transients;
+	for (RGResource i = 0; i < m_Resources.size(); ++i)
+	{
+		ResourceNode& resource = m_Resources[i];
+		if (resource.imported || !resource.isImage || resource.firstPass == RG_INVALID)
+		{
+			continue;
+		}
+
+		const VkExtent3D extent = { resource.desc.extent.width, resource.desc.extent.height, 1 };
+		VkImageCreateInfo imageInfo = vkinit::ImageCreateInfo(resource.desc.format, resource.usage, extent);
+		if (vkCreateImage(m_Device, &imageInfo, nullptr, &resource.image) != VK_SUCCESS)
+		{
+			std::cout << "Failed to create render graph image " << resource.name << std::endl;
+			continue;
+		}
+
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(m_Device, resource.image, &requirements);
+		resource.memorySize = requirements.size;
+		transients.emplace_back(i, requirements);
+	}
+
+	// biggest first, smaller images then fill slots whose owners are dead by the time they start
+	std::sort(transients.begin(), transients.end(), [](const auto& a, const auto& b)
+		{
+			return a.second.size > b.second.size;
+		});
+
+	for (const auto& [index, requirements] : transients)
+	{
+		ResourceNode& resource = m_Resources[index];
+
+		uint32_t slotIndex = RG_INVALID;
+		for (uint32_t s = 0; s < m_AliasSlots.size() && slotIndex == RG_INVALID; ++s)
+		{
+			const AliasSlot& slot = m_AliasSlots[s];
+			if ((slot.requirements.memoryTypeBits & requirements.memoryTypeBits) == 0)
+			{
+				continue;
+			}
+
+			bool overlaps = false;
+			for (RGResource other : slot.resources)
+			{
+				const ResourceNode& otherResource = m_Resources[other];
+				if (!(resource.lastPass < otherResource.firstPass || otherResource.lastPass < resource.firstPass))
+				{
+					overlaps = true;
+					break;
+				}
+			}
+			if (!overlaps)
+			{
+				slotIndex = s;
+			}
+		}
+
+		if (slotIndex == RG_INVALID)
+		{
+			AliasSlot slot;
+			slot.requirements = requirements;
+			m_AliasSlots.push_back(slot);
+			slotIndex = static_cast<uint32_t>(m_AliasSlots.size() - 1);
+		}
+
+		AliasSlot& slot = m_AliasSlots[slotIndex];
+		slot.requirements.size = std::max(slot.requirements.size, requirements.size);
+		slot.requirements.alignment = std::max(slot.requirements.alignment, requirements.alignment);
+		slot.requirements.memoryTypeBits &= requirements.memoryTypeBits;
+		slot.resources.push_back(index);
+		resource.aliasSlot = slotIndex;
+	}
+
+	for (AliasSlot& slot : m_AliasSlots)
+	{
+		VmaAllocationCreateInfo allocInfo{};
+		allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+		if (vmaAllocateMemory(m_Allocator, &slot.requirements, &allocInfo, &slot.allocation, nullptr) != VK_SUCCESS)
+		{
+			std::cout << "Failed to allocate render graph memory" << std::endl;
+			continue;
+		}
+
+		// passes run in order, so keep the slot's occupants in the order they come alive
+		std::sort(slot.resources.begin(), slot.resources.end(), [this](RGResource a, RGResource b)
+			{
+				return m_Resources[a].firstPass < m_Resources[b].firstPass;
+			});
+
+		for (RGResource index : slot.resources)
+		{
+			ResourceNode& resource = m_Resources[index];
+			vmaBindImageMemory(m_Allocator, slot.allocation, resource.image);
+
+			VkImageViewCreateInfo viewInfo = vkinit::ImageViewCreateInfo(resource.desc.format, resource.image, resource.aspect & ~VK_IMAGE_ASPECT_STENCIL_BIT);
+			vkCreateImageView(m_Device, &viewInfo, nullptr, &resource.view);
+		}
+	}
+}
+
+void RenderGraph::BuildBarriers()
+{
+	const size_t resourceCount = m_Resources.size();
+
+	// dry run to learn the state every resource is left in, which is where the next frame picks it up
+	std::vector<ResourceState> states(resourceCount, ResourceState{ VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, 0, 0, 0 });
+	for (PassNode& pass : m_Passes)
+	{
+		if (pass.culled)
+		{
+			continue;
+		}
+		BarrierBatch scratch;
+		for (const RGUsage& usage : pass.usages)
+		{
+			Transition(states[usage.resource], usage, m_Resources[usage.resource].isImage, scratch);
+		}
+	}
+	const std::vector<ResourceState> lastStates = states;
+
+	for (RGResource i = 0; i < resourceCount; ++i)
+	{
+		const ResourceNode& resource = m_Resources[i];
+		ResourceState& state = states[i];
+		state = ResourceState{ VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, 0, 0, 0 };
+
+		if (resource.imported)
+		{
+			state.layout = resource.initialLayout;
+			state.writeStages = resource.initialStages;
+		}
+		else if (resource.aliasSlot != RG_INVALID)
+		{
+			// the memory was last touched by the previous occupant of the slot, or by this image last frame
+			const std::vector<RGResource>& occupants = m_AliasSlots[resource.aliasSlot].resources;
+			const size_t position = std::find(occupants.begin(), occupants.end(), i) - occupants.begin();
+			const RGResource previous = occupants[(position + occupants.size() - 1) % occupants.size()];
+			const ResourceState& previousState = lastStates[previous];
+
+			state.writeStages = previousState.writeStages | previousState.readStages;
+			state.writeAccess = previousState.writeAccess;
+		}
+	}
+
+	for (PassNode& pass : m_Passes)
+	{
+		if (pass.culled)
+		{
+			continue;
+		}
+		for (const RGUsage& usage : pass.usages)
+		{
+			Transition(states[usage.resource], usage, m_Resources[usage.resource].isImage, pass.barriers);
+		}
+	}
+
+	for (RGResource i = 0; i < resourceCount; ++i)
+	{
+		const ResourceNode& resource = m_Resources[i];
+		if (!resource.imported || !resource.isImage || resource.firstPass == RG_INVALID || resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED)
+		{
+			continue;
+		}
+
+		RGUsage handOff{};
+		handOff.resource = i;
+		handOff.layout = resource.finalLayout;
+		handOff.stages = resource.finalStages;
+		handOff.access = resource.finalAccess;
+		handOff.write = false;
+		Transition(states[i], handOff, true, m_FinalBarriers);
+	}
+}
+
+void RenderGraph::Transition(ResourceState& state, const RGUsage& usage, bool isImage, BarrierBatch& batch) const
+{
+	const VkImageLayout oldLayout = state.layout;
+	const bool layoutChange = isImage && state.layout != usage.layout;
+
+	bool needsBarrier = false;
+	VkPipelineStageFlags srcStages = 0;
+	VkAccessFlags srcAccess = 0;
+
+	if (usage.write || layoutChange)
+	{
+		// writes and layout transitions wait for every earlier reader and writer
+		srcStages = state.writeStages | state.readStages;
+		srcAccess = state.writeAccess;
+		needsBarrier = layoutChange || srcStages != 0;
+
+		state.layout = isImage ? usage.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+		state.writeStages = usage.stages;
+		state.writeAccess = usage.access & WRITE_ACCESS;
+		state.readStages = 0;
+		state.visibleStages = usage.stages;
+		state.visibleAccess = usage.access;
+	}
+	else
+	{
+		// reads only wait when the last write is not yet visible to these stages
+		const bool visible = (usage.stages & ~state.visibleStages) == 0 && (usage.access & ~state.visibleAccess) == 0;
+		if (state.writeStages != 0 && !visible)
+		{
+			needsBarrier = true;
+			srcStages = state.writeStages;
+			srcAccess = state.writeAccess;
+			state.visibleStages |= usage.stages;
+			state.visibleAccess |= usage.access;
+		}
+		state.readStages |= usage.stages;
+	}
+
+	if (!needsBarrier)
+	{
+		return;
+	}
+
+	batch.srcStages |= srcStages != 0 ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	batch.dstStages |= usage.stages;
+
+	Barrier barrier;
+	barrier.resource = usage.resource;
+	barrier.oldLayout = isImage ? oldLayout : VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.newLayout = isImage ? usage.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+	barrier.srcAccess = srcAccess;
+	barrier.dstAccess = usage.access;
+	batch.barriers.push_back(barrier);
+}
+
+void RenderGraph::CreateRenderPasses()
+{
+	for (uint32_t passIndex = 0; passIndex < m_Passes.size(); ++passIndex)
+	{
+		PassNode& pass = m_Passes[passIndex];
+		if (pass.culled || pass.type != RGPassType::Graphics)
+		{
+			continue;
+		}
+
+		std::vector<VkAttachmentDescription> attachments;
+		std::vector<VkAttachmentReference> colorReferences;
+		VkAttachmentReference depthReference{};
+		bool hasDepth = false;
+
+		for (const RGUsage& usage : pass.usages)
+		{
+			if (!usage.attachment)
+			{
+				continue;
+			}
+			const ResourceNode& resource = m_Resources[usage.resource];
+
+			// contents only matter when an earlier pass wrote them or they came from outside the graph
+			const bool hasContents = resource.firstPass < passIndex || (resource.imported && resource.initialLayout != VK_IMAGE_LAYOUT_UNDEFINED);
+			const bool usedLater = resource.lastPass > passIndex || resource.imported;
+
+			VkAttachmentDescription attachment{};
+			attachment.format = resource.desc.format;
+			attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+			attachment.loadOp = usage.clear ? VK_ATTACHMENT_LOAD_OP_CLEAR : (hasContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE);
+			attachment.storeOp = usage.write && usedLater ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			// barriers recorded before the pass already put the image in this layout
+			attachment.initialLayout = usage.layout;
+			attachment.finalLayout = usage.layout;
+
+			VkAttachmentReference reference{};
+			reference.attachment = static_cast<uint32_t>(attachments.size());
+			reference.layout = usage.layout;
+
+			if (usage.layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL)
+			{
+				colorReferences.push_back(reference);
+			}
+			else
+			{
+				depthReference = reference;
+				hasDepth = true;
+			}
+
+			attachments.push_back(attachment);
+			pass.attachments.push_back(usage.resource);
+			pass.clearValues.push_back(usage.clearValue);
+			if (pass.extent.width == 0)
+			{
+				pass.extent = resource.desc.extent;
+			}
+		}
+
+		VkSubpassDescription subpass{};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
+		subpass.pColorAttachments = colorReferences.data();
+		subpass.pDepthStencilAttachment = hasDepth ? &depthReference : nullptr;
+
+		VkRenderPassCreateInfo renderPassInfo{};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassInfo.pAttachments = attachments.data();
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+		renderPassInfo.dependencyCount = 0;
+		renderPassInfo.pDependencies = nullptr;
+
+		if (vkCreateRenderPass(m_Device, &renderPassInfo, nullptr, &pass.renderPass) != VK_SUCCESS)
+		{
+			std::cout << "Failed to create render pass for " << pass.name << std::endl;
+		}
+	}
+}
+
+void RenderGraph::RecordBarriers(VkCommandBuffer cmd, const BarrierBatch& batch)
+{
+	if (batch.barriers.empty())
+	{
+		return;
+	}
+
+	m_ImageBarriers.clear();
+	m_BufferBarriers.clear();
+	for (const Barrier& barrier : batch.barriers)
+	{
+		const ResourceNode& resource = m_Resources[barrier.resource];
+		if (resource.isImage)
+		{
+			VkImageMemoryBarrier imageBarrier{};
+			imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageBarrier.srcAccessMask = barrier.srcAccess;
+			imageBarrier.dstAccessMask = barrier.dstAccess;
+			imageBarrier.oldLayout = barrier.oldLayout;
+			imageBarrier.newLayout = barrier.newLayout;
+			imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			imageBarrier.image = resource.image;
+			imageBarrier.subresourceRange.aspectMask = resource.aspect;
+			imageBarrier.subresourceRange.baseMipLevel = 0;
+			imageBarrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+			imageBarrier.subresourceRange.baseArrayLayer = 0;
+			imageBarrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+			m_ImageBarriers.push_back(imageBarrier);
+		}
+		else
+		{
+			VkBufferMemoryBarrier bufferBarrier{};
+			bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+			bufferBarrier.srcAccessMask = barrier.srcAccess;
+			bufferBarrier.dstAccessMask = barrier.dstAccess;
+			bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			bufferBarrier.buffer = resource.buffer;
+			bufferBarrier.offset = 0;
+			bufferBarrier.size = VK_WHOLE_SIZE;
+			m_BufferBarriers.push_back(bufferBarrier);
+		}
+	}
+
+	vkCmdPipelineBarrier(cmd, batch.srcStages, batch.dstStages, 0, 0, nullptr,
+		static_cast<uint32_t>(m_BufferBarriers.size()), m_BufferBarriers.data(),
+		static_cast<uint32_t>(m_ImageBarriers.size()), m_ImageBarriers.data());
+}
+
+VkFramebuffer RenderGraph::GetFramebuffer(const PassNode& pass)
+{
+	std::vector<VkImageView>& views = m_FramebufferViews;
+	views.clear();
+	for (RGResource attachment : pass.attachments)
+	{
+		views.push_back(m_Resources[attachment].view);
+	}
+
+	for (const FramebufferEntry& entry : m_Framebuffers)
+	{
+		if (entry.renderPass == pass.renderPass && entry.views == views)
+		{
+			return entry.framebuffer;
+		}
+	}
+
+	VkFramebufferCreateInfo framebufferInfo{};
+	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+	framebufferInfo.pNext = nullptr;
+
+	framebufferInfo.renderPass = pass.renderPass;
+	framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+	framebufferInfo.pAttachments = views.data();
+	framebufferInfo.width = pass.extent.width;
+	framebufferInfo.height = pass.extent.height;
+	framebufferInfo.layers = 1;
+
+	FramebufferEntry entry;
+	entry.renderPass = pass.renderPass;
+	entry.views = views;
+	if (vkCreateFramebuffer(m_Device, &framebufferInfo, nullptr, &entry.framebuffer) != VK_SUCCESS)
+	{
+		std::cout << "Failed to create framebuffer for " << pass.name << std::endl;
+		return VK_NULL_HANDLE;
+	}
+	m_Framebuffers.push_back(entry);
+	return entry.framebuffer;
+}
+
+void RenderGraph::ReleaseCompiled()
+{
+	TakeCompiled()();
+}
+
+std::function<void()> RenderGraph::TakeCompiled()
+{
+	if (m_Device == VK_NULL_HANDLE)
+	{
+		return [] {};
+	}
+
+	std::vector<VkFramebuffer> framebuffers;
+	for (const FramebufferEntry& entry : m_Framebuffers)
+	{
+		framebuffers.push_back(entry.framebuffer);
+	}
+	m_Framebuffers.clear();
+
+	std::vector<VkRenderPass> renderPasses;
+	for (PassNode& pass : m_Passes)
+	{
+		if (pass.renderPass != VK_NULL_HANDLE)
+		{
+			renderPasses.push_back(pass.renderPass);
+		}
+		pass.renderPass = VK_NULL_HANDLE;
+		pass.barriers = {};
+		pass.attachments.clear();
+		pass.clearValues.clear();
+		pass.extent = { 0, 0 };
+	}
+
+	std::vector<VkImageView> views;
+	std::vector<VkImage> images;
+	for (ResourceNode& resource : m_Resources)
+	{
+		if (resource.imported)
+		{
+			continue;
+		}
+		if (resource.view != VK_NULL_HANDLE)
+		{
+			views.push_back(resource.view);
+		}
+		if (resource.image != VK_NULL_HANDLE)
+		{
+			images.push_back(resource.image);
+		}
+		resource.view = VK_NULL_HANDLE;
+		resource.image = VK_NULL_HANDLE;
+	}
+
+	std::vector<VmaAllocation> allocations;
+	for (AliasSlot& slot : m_AliasSlots)
+	{
+		allocations.push_back(slot.allocation);
+	}
+	m_AliasSlots.clear();
+	m_FinalBarriers = {};
+	m_Compiled = false;
+
+	VkDevice device = m_Device;
+	VmaAllocator allocator = m_Allocator;
+	return [=]
+		{
+			for (VkFramebuffer framebuffer : framebuffers)
+			{
+				vkDestroyFramebuffer(device, framebuffer, nullptr);
+			}
+			for (VkRenderPass renderPass : renderPasses)
+			{
+				vkDestroyRenderPass(device, renderPass, nullptr);
+			}
+			for (VkImageView view : views)
+			{
+				vkDestroyImageView(device, view, nullptr);
+			}
+			for (VkImage image : images)
+			{
+				vkDestroyImage(device, image, nullptr);
+			}
+			for (VmaAllocation allocation : allocations)
+			{
+				vmaFreeMemory(allocator, allocation);
+			}
+		};
+}
+
+std::string RenderGraph::Dump() const
+{
+	std::ostringstream out;
+
+	uint32_t culledCount = 0;
+	for (const PassNode& pass : m_Passes)
+	{
+		culledCount += pass.culled ? 1 : 0;
+	}
+
+	VkDeviceSize transientBytes = 0;
+	VkDeviceSize slotBytes = 0;
+	for (const ResourceNode& resource : m_Resources)
+	{
+		transientBytes += resource.imported ? 0 : resource.memorySize;
+	}
+	for (const AliasSlot& slot : m_AliasSlots)
+	{
+		slotBytes += slot.requirements.size;
+	}
+
+	out << "render graph: " << m_Passes.size() << " passes (" << culledCount << " culled), "
+		<< m_Resources.size() << " resources" << (m_Compiled ? "" : ", not compiled") << "\n";
+
+	auto dumpBarriers = [&](const BarrierBatch& batch)
+	{
+		if (batch.barriers.empty())
+		{
+			return;
+		}
+		out << "    barrier src 0x" << std::hex << batch.srcStages << " -> dst 0x" << batch.dstStages << std::dec << "\n";
+		for (const Barrier& barrier : batch.barriers)
+		{
+			const ResourceNode& resource = m_Resources[barrier.resource];
+			out << "      " << resource.name;
+			if (resource.isImage)
+			{
+				out << " " << LayoutName(barrier.oldLayout) << " -> " << LayoutName(barrier.newLayout);
+			}
+			out << " access 0x" << std::hex << barrier.srcAccess << " -> 0x" << barrier.dstAccess << std::dec << "\n";
+		}
+	};
+
+	for (size_t i = 0; i < m_Passes.size(); ++i)
+	{
+		const PassNode& pass = m_Passes[i];
+		out << "  pass " << i << " '" << pass.name << "' " << PassTypeName(pass.type) << (pass.culled ? " CULLED" : "") << "\n";
+		for (const RGUsage& usage : pass.usages)
+		{
+			const ResourceNode& resource = m_Resources[usage.resource];
+			out << "    " << (usage.write ? "write " : "read  ") << resource.name;
+			if (resource.isImage)
+			{
+				out << " as " << LayoutName(usage.layout);
+			}
+			if (usage.clear)
+			{
+				out << " (clear)";
+			}
+			out << "\n";
+		}
+		if (!pass.culled)
+		{
+			dumpBarriers(pass.barriers);
+		}
+	}
+
+	if (!m_FinalBarriers.barriers.empty())
+	{
+		out << "  final transitions\n";
+		dumpBarriers(m_FinalBarriers);
+	}
+
+	out << "  transient memory: " << transientBytes / 1024 << " KB requested, " << slotBytes / 1024 << " KB allocated in " << m_AliasSlots.size() << " slots\n";
+	for (size_t s = 0; s < m_AliasSlots.size(); ++s)
+	{
+		const AliasSlot& slot = m_AliasSlots[s];
+		out << "    slot " << s << " (" << slot.requirements.size / 1024 << " KB):";
+		for (RGResource index : slot.resources)
+		{
+			const ResourceNode& resource = m_Resources[index];
+			out << " " << resource.name << " [" << resource.firstPass << ".." << resource.lastPass << "]";
+		}
+		out << "\n";
+	}
+
+	return out.str();
+}
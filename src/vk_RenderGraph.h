@@ -0,0 +1,232 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "vk_types.h"
+
+class GpuProfiler;
+
+using RGResource = uint32_t;
+using RGPass = uint32_t;
+constexpr uint32_t RG_INVALID = 0xffffffff;
+
+enum class RGPassType
+{
+	Graphics,
+	Compute,
+	Transfer
+};
+
+struct RGImageDesc
+{
+	VkFormat format;
+	VkExtent2D extent;
+	// added on top of whatever the passes using the image need
+	VkImageUsageFlags usage = 0;
+};
+
+// how a pass touches a resource, turned into layouts, stages and access masks while recording
+struct RGUsage
+{
+	RGResource resource;
+	VkImageLayout layout;
+	VkPipelineStageFlags stages;
+	VkAccessFlags access;
+	bool write;
+	bool attachment;
+	bool clear;
+	VkClearValue clearValue;
+};
+
+class RenderGraph;
+
+// handed to a pass' setup callback, every call declares one read or write
+class RenderGraphBuilder
+{
+public:
+	RGResource CreateImage(const std::string& name, const RGImageDesc& desc);
+
+	void WriteColor(RGResource image);
+	void WriteColor(RGResource image, VkClearColorValue clear);
+	void WriteDepth(RGResource image);
+	void WriteDepth(RGResource image, float clearDepth);
+	void ReadDepth(RGResource image);
+
+	void ReadTexture(RGResource image);
+	void WriteStorageImage(RGResource image);
+	void ReadTransfer(RGResource image);
+	void WriteTransfer(RGResource image);
+
+	void ReadBuffer(RGResource buffer, VkPipelineStageFlags stages, VkAccessFlags access);
+	void WriteBuffer(RGResource buffer, VkPipelineStageFlags stages, VkAccessFlags access);
+
+	// the pass is kept even when nothing reads what it writes
+	void SetSideEffect();
+
+private:
+	friend class RenderGraph;
+	RenderGraphBuilder(RenderGraph& graph, RGPass pass) : m_Graph(graph), m_Pass(pass) {}
+
+	RGUsage& AddUsage(RGResource resource, VkImageLayout layout, VkPipelineStageFlags stages, VkAccessFlags access, bool write);
+	VkPipelineStageFlags ShaderStages() const;
+
+	RenderGraph& m_Graph;
+	RGPass m_Pass;
+};
+
+// Passes declare what they read and write, Compile orders the work once:
+// unused passes are culled, barriers and layout transitions are derived from the declared usages,
+// and transient images whose lifetimes do not overlap share one memory allocation.
+// Execute then replays the compiled graph every frame, imported images can be swapped in between.
+class RenderGraph
+{
+public:
+	void Init(VkDevice device, VmaAllocator allocator);
+	void Destroy();
+
+	// the image arrives in initialLayout after initialStages and is left in finalLayout for finalStages/finalAccess
+	RGResource ImportImage(const std::string& name, const RGImageDesc& desc, VkImage image, VkImageView view,
+		VkImageLayout initialLayout, VkPipelineStageFlags initialStages,
+		VkImageLayout finalLayout, VkPipelineStageFlags finalStages, VkAccessFlags finalAccess);
+	RGResource ImportBuffer(const std::string& name, VkBuffer buffer);
+	void SetImportedImage(RGResource resource, VkImage image, VkImageView view);
+	// per frame buffers are swapped in before Execute, like the swapchain image
+	void SetImportedBuffer(RGResource resource, VkBuffer buffer);
+	// takes effect on the next Compile or Recompile
+	void SetImageExtent(RGResource resource, VkExtent2D extent);
+
+	RGPass AddPass(const std::string& name, RGPassType type, const std::function<void(RenderGraphBuilder&)>& setup, std::function<void(VkCommandBuffer)>&& execute);
+
+	void Compile();
+	// compiles again, the previous compiled objects are handed to retire instead of destroyed
+	// so frames still in flight can keep using them
+	void Recompile(const std::function<void(std::function<void()>&&)>& retire);
+	void Execute(VkCommandBuffer cmd);
+
+	// every executed pass, barriers included, gets its own timestamp zone
+	void SetProfiler(GpuProfiler* profiler) { m_Profiler = profiler; }
+
+	// valid after Compile, graphics pipelines are built against these
+	VkRenderPass GetRenderPass(RGPass pass) const;
+	VkImage GetImage(RGResource resource) const;
+	VkImageView GetImageView(RGResource resource) const;
+	bool IsPassCulled(RGPass pass) const;
+
+	// human readable listing of passes, barriers and memory aliasing
+	std::string Dump() const;
+
+private:
+	friend class RenderGraphBuilder;
+
+	struct ResourceNode
+	{
+		std::string name;
+		bool isImage;
+		bool imported;
+		RGImageDesc desc;
+		VkImageAspectFlags aspect;
+		VkImage image{ VK_NULL_HANDLE };
+		VkImageView view{ VK_NULL_HANDLE };
+		VkBuffer buffer{ VK_NULL_HANDLE };
+
+		VkImageLayout initialLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+		VkPipelineStageFlags initialStages{ 0 };
+		VkImageLayout finalLayout{ VK_IMAGE_LAYOUT_UNDEFINED };
+		VkPipelineStageFlags finalStages{ 0 };
+		VkAccessFlags finalAccess{ 0 };
+
+		// compiled
+		VkImageUsageFlags usage{ 0 };
+		uint32_t firstPass{ RG_INVALID };
+		uint32_t lastPass{ RG_INVALID };
+		uint32_t aliasSlot{ RG_INVALID };
+		VkDeviceSize memorySize{ 0 };
+	};
+
+	struct Barrier
+	{
+		RGResource resource;
+		VkImageLayout oldLayout;
+		VkImageLayout newLayout;
+		VkAccessFlags srcAccess;
+		VkAccessFlags dstAccess;
+	};
+
+	struct BarrierBatch
+	{
+		VkPipelineStageFlags srcStages{ 0 };
+		VkPipelineStageFlags dstStages{ 0 };
+		std::vector<Barrier> barriers;
+	};
+
+	struct PassNode
+	{
+		std::string name;
+		RGPassType type;
+		std::vector<RGUsage> usages;
+		std::function<void(VkCommandBuffer)> execute;
+		bool sideEffect{ false };
+		bool culled{ false };
+
+		// compiled
+		BarrierBatch barriers;
+		VkRenderPass renderPass{ VK_NULL_HANDLE };
+		std::vector<RGResource> attachments;
+		std::vector<VkClearValue> clearValues;
+		VkExtent2D extent{ 0, 0 };
+	};
+
+	struct ResourceState
+	{
+		VkImageLayout layout;
+		VkPipelineStageFlags writeStages;
+		VkAccessFlags writeAccess;
+		VkPipelineStageFlags readStages;
+		// stages and access types that already see the last write
+		VkPipelineStageFlags visibleStages;
+		VkAccessFlags visibleAccess;
+	};
+
+	struct AliasSlot
+	{
+		VkMemoryRequirements requirements;
+		std::vector<RGResource> resources;
+		VmaAllocation allocation{ VK_NULL_HANDLE };
+	};
+
+	struct FramebufferEntry
+	{
+		VkRenderPass renderPass;
+		std::vector<VkImageView> views;
+		VkFramebuffer framebuffer;
+	};
+
+	void CullPasses();
+	void ComputeLifetimes();
+	void CreateTransientImages();
+	void BuildBarriers();
+	void CreateRenderPasses();
+	void Transition(ResourceState& state, const RGUsage& usage, bool isImage, BarrierBatch& batch) const;
+	void RecordBarriers(VkCommandBuffer cmd, const BarrierBatch& batch);
+	VkFramebuffer GetFramebuffer(const PassNode& pass);
+	void ReleaseCompiled();
+	// resets the compiled state, the returned function destroys the Vulkan objects it held
+	std::function<void()> TakeCompiled();
+
+	VkDevice m_Device{ VK_NULL_HANDLE };
+	VmaAllocator m_Allocator{ VK_NULL_HANDLE };
+
+	std::vector<ResourceNode> m_Resources;
+	std::vector<PassNode> m_Passes;
+	std::vector<AliasSlot> m_AliasSlots;
+	std::vector<FramebufferEntry> m_Framebuffers;
+	BarrierBatch m_FinalBarriers;
+	std::vector<VkImageMemoryBarrier> m_ImageBarriers;
+	std::vector<VkBufferMemoryBarrier> m_BufferBarriers;
+	// reused by GetFramebuffer every frame
+	std::vector<VkImageView> m_FramebufferViews;
+	GpuProfiler* m_Profiler{ nullptr };
+	bool m_Compiled{ false };
+};
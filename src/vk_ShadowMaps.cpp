@@ -0,0 +1,578 @@
+#include "vk_ShadowMaps.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "vk_engine.h"
+#include "vk_initializers.h"
+#include "CpuProfiler.h"
+
+static_assert(SHADOWMAPS_CASCADES == 4, "GPUShadowData::splitDepths holds one split per cascade");
+
+namespace
+{
+	bool BoxesOverlap(const glm::vec3& minA, const glm::vec3& maxA, const glm::vec3& minB, const glm::vec3& maxB)
+	{
+		return glm::all(glm::lessThanEqual(minA, maxB)) && glm::all(glm::lessThanEqual(minB, maxA));
+	}
+}
+
+void ShadowMaps::Init(VulkanEngine& engine, VkDescriptorSetLayout objectSetLayout)
+{
+	m_Engine = &engine;
+	const VkDevice device = m_Engine->m_Device;
+	m_LightDirection = glm::normalize(m_LightDirection);
+	UpdateLightView();
+
+	// the cache pass clears, the graph's per frame passes load what the copy put there
+	VkAttachmentDescription depthAttachment{};
+	depthAttachment.format = SHADOWMAPS_FORMAT;
+	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference depthReference{ 0, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+	VkSubpassDescription subpass{};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.pDepthStencilAttachment = &depthReference;
+
+	VkRenderPassCreateInfo renderPassInfo{};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.pNext = nullptr;
+	renderPassInfo.attachmentCount = 1;
+	renderPassInfo.pAttachments = &depthAttachment;
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+	if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &m_CacheRenderPass) != VK_SUCCESS)
+	{
+		std::cout << "failed to create the shadow cache render pass" << std::endl;
+		return;
+	}
+
+	const VkExtent3D extent{ SHADOWMAPS_RESOLUTION, SHADOWMAPS_RESOLUTION, 1 };
+	VmaAllocationCreateInfo allocInfo{};
+	allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	for (Cascade& cascade : m_Cascades)
+	{
+		VkImageCreateInfo cacheInfo = vkinit::ImageCreateInfo(SHADOWMAPS_FORMAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, extent);
+		vmaCreateImage(m_Engine->GetAllocator(), &cacheInfo, &allocInfo, &cascade.cache.image, &cascade.cache.allocation, nullptr);
+		VkImageViewCreateInfo cacheViewInfo = vkinit::ImageViewCreateInfo(SHADOWMAPS_FORMAT, cascade.cache.image, VK_IMAGE_ASPECT_DEPTH_BIT);
+		vkCreateImageView(device, &cacheViewInfo, nullptr, &cascade.cacheView);
+
+		VkImageCreateInfo shadowInfo = vkinit::ImageCreateInfo(SHADOWMAPS_FORMAT,
+			VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, extent);
+		vmaCreateImage(m_Engine->GetAllocator(), &shadowInfo, &allocInfo, &cascade.shadow.image, &cascade.shadow.allocation, nullptr);
+		VkImageViewCreateInfo shadowViewInfo = vkinit::ImageViewCreateInfo(SHADOWMAPS_FORMAT, cascade.shadow.image, VK_IMAGE_ASPECT_DEPTH_BIT);
+		vkCreateImageView(device, &shadowViewInfo, nullptr, &cascade.shadowView);
+
+		VkFramebufferCreateInfo framebufferInfo{};
+		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferInfo.pNext = nullptr;
+		framebufferInfo.renderPass = m_CacheRenderPass;
+		framebufferInfo.attachmentCount = 1;
+		framebufferInfo.pAttachments = &cascade.cacheView;
+		framebufferInfo.width = SHADOWMAPS_RESOLUTION;
+		framebufferInfo.height = SHADOWMAPS_RESOLUTION;
+		framebufferInfo.layers = 1;
+		vkCreateFramebuffer(device, &framebufferInfo, nullptr, &cascade.cacheFramebuffer);
+	}
+
+	// the render graph expects the shadow maps where the previous frame's fragment shader left them
+	m_Engine->ImmediateSubmit([&](VkCommandBuffer cmd)
+		{
+			std::array<VkImageMemoryBarrier, SHADOWMAPS_CASCADES> barriers{};
+			for (uint32_t i = 0; i < SHADOWMAPS_CASCADES; ++i)
+			{
+				barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+				barriers[i].srcAccessMask = 0;
+				barriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+				barriers[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+				barriers[i].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+				barriers[i].image = m_Cascades[i].shadow.image;
+				barriers[i].subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+			}
+			vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+				static_cast<uint32_t>(barriers.size()), barriers.data());
+		});
+
+	// linear filtering with compare gives 2x2 pcf per tap, outside the map counts as lit
+	VkSamplerCreateInfo samplerInfo = vkinit::SamplerCreateInfo(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER);
+	samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+	samplerInfo.compareEnable = VK_TRUE;
+	samplerInfo.compareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+	vkCreateSampler(device, &samplerInfo, nullptr, &m_Sampler);
+
+	const uint32_t frameCount = m_Engine->GetFramesInFlight();
+	const VkDescriptorPoolSize poolSize{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, frameCount };
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.pNext = nullptr;
+	poolInfo.flags = 0;
+	poolInfo.maxSets = frameCount;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	vkCreateDescriptorPool(device, &poolInfo, nullptr, &m_DescriptorPool);
+
+	m_Frames.resize(frameCount);
+	for (FrameResources& frame : m_Frames)
+	{
+		frame.shadowData = m_Engine->CreateBuffer(sizeof(GPUShadowData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, MemoryCategory::PerFrame);
+		frame.objects = m_Engine->CreateBuffer(MAXOBJECTS * sizeof(GPUObjectData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, MemoryCategory::PerFrame);
+
+		VkDescriptorSetAllocateInfo setInfo{};
+		setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		setInfo.pNext = nullptr;
+		setInfo.descriptorPool = m_DescriptorPool;
+		setInfo.descriptorSetCount = 1;
+		setInfo.pSetLayouts = &objectSetLayout;
+		vkAllocateDescriptorSets(device, &setInfo, &frame.objectSet);
+
+		VkDescriptorBufferInfo bufferInfo{ frame.objects.buffer, 0, MAXOBJECTS * sizeof(GPUObjectData) };
+		VkWriteDescriptorSet write{};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.pNext = nullptr;
+		write.dstBinding = 0;
+		write.dstSet = frame.objectSet;
+		write.descriptorCount = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = &bufferInfo;
+		vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+	}
+
+	VkPushConstantRange pushConstant;
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(glm::mat4);
+	pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	VkPipelineLayoutCreateInfo layoutInfo = vkinit::PipelineLayoutCreateInfo();
+	layoutInfo.setLayoutCount = 1;
+	layoutInfo.pSetLayouts = &objectSetLayout;
+	layoutInfo.pushConstantRangeCount = 1;
+	layoutInfo.pPushConstantRanges = &pushConstant;
+	vkCreatePipelineLayout(device, &layoutInfo, nullptr, &m_PipelineLayout);
+	BuildPipeline(m_Pipeline);
+}
+
+void ShadowMaps::Cleanup()
+{
+	const VkDevice device = m_Engine->m_Device;
+	vkDestroyPipeline(device, m_Pipeline, nullptr);
+	vkDestroyPipelineLayout(device, m_PipelineLayout, nullptr);
+	vkDestroySampler(device, m_Sampler, nullptr);
+	for (FrameResources& frame : m_Frames)
+	{
+		vmaDestroyBuffer(m_Engine->GetAllocator(), frame.shadowData.buffer, frame.shadowData.allocation);
+		vmaDestroyBuffer(m_Engine->GetAllocator(), frame.objects.buffer, frame.objects.allocation);
+	}
+	m_Frames.clear();
+	vkDestroyDescriptorPool(device, m_DescriptorPool, nullptr);
+
+	for (Cascade& cascade : m_Cascades)
+	{
+		vkDestroyFramebuffer(device, cascade.cacheFramebuffer, nullptr);
+		vkDestroyImageView(device, cascade.cacheView, nullptr);
+		vkDestroyImageView(device, cascade.shadowView, nullptr);
+		vmaDestroyImage(m_Engine->GetAllocator(), cascade.cache.image, cascade.cache.allocation);
+		vmaDestroyImage(m_Engine->GetAllocator(), cascade.shadow.image, cascade.shadow.allocation);
+	}
+	vkDestroyRenderPass(device, m_CacheRenderPass, nullptr);
+}
+
+bool ShadowMaps::BuildPipeline(VkPipeline& outPipeline)
+{
+	PROFILE_FUNCTION();
+	outPipeline = VK_NULL_HANDLE;
+
+	VkShaderModule shadowVertShader;
+	if (!m_Engine->LoadShaderModule(SHADERDIRECTORY "shadow.vert.spv", &shadowVertShader))
+	{
+		std::cout << "Failed to load the shadow shader\n";
+		return false;
+	}
+
+	// depth only, no fragment stage
+	PipelineBuilder pipelineBuilder;
+	pipelineBuilder.m_ShaderStages.push_back(vkinit::PipelineShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, shadowVertShader));
+
+	VertexInputDescription vertexDescription = Vertex::GetVertexDescription();
+	pipelineBuilder.m_VertexInputState = vkinit::PipelineVertexInputStateCreateInfo();
+	pipelineBuilder.m_VertexInputState.pVertexAttributeDescriptions = vertexDescription.attributes.data();
+	pipelineBuilder.m_VertexInputState.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertexDescription.attributes.size());
+	pipelineBuilder.m_VertexInputState.pVertexBindingDescriptions = vertexDescription.bindings.data();
+	pipelineBuilder.m_VertexInputState.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexDescription.bindings.size());
+	pipelineBuilder.m_InputAssemblyState = vkinit::PipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+
+	pipelineBuilder.m_Viewport = { 0.f, 0.f, static_cast<float>(SHADOWMAPS_RESOLUTION), static_cast<float>(SHADOWMAPS_RESOLUTION), 0.f, 1.f };
+	pipelineBuilder.m_Scissor = { { 0, 0 }, { SHADOWMAPS_RESOLUTION, SHADOWMAPS_RESOLUTION } };
+	pipelineBuilder.m_DepthStencilState = vkinit::PipelineDepthStencilCreateInfo(true, true, VK_COMPARE_OP_LESS_OR_EQUAL);
+
+	// slope scaled bias keeps surfaces at a grazing angle to the light from shadowing themselves
+	pipelineBuilder.m_Rasterizer = vkinit::PipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL);
+	pipelineBuilder.m_Rasterizer.depthBiasEnable = VK_TRUE;
+	pipelineBuilder.m_Rasterizer.depthBiasConstantFactor = 1.25f;
+	pipelineBuilder.m_Rasterizer.depthBiasSlopeFactor = 1.75f;
+	pipelineBuilder.m_Multisampling = vkinit::PipelineMultisampleStateCreateInfo();
+	pipelineBuilder.m_ColorBlendAttachmentState = vkinit::PipelineColorBlendAttachmentCreateInfo();
+	pipelineBuilder.m_ColorAttachmentCount = 0;
+	pipelineBuilder.m_PipelineLayout = m_PipelineLayout;
+
+	// the graph's cascade passes only differ from the cache pass in load ops, so their render passes are compatible
+	outPipeline = pipelineBuilder.BuildPipeline(m_Engine->m_Device, m_CacheRenderPass, &m_Engine->GetPipelineCache());
+	vkDestroyShaderModule(m_Engine->m_Device, shadowVertShader, nullptr);
+	return outPipeline != VK_NULL_HANDLE;
+}
+
+bool ShadowMaps::ReloadPipeline(const std::function<void(std::function<void()>&&)>& retire)
+{
+	VkPipeline pipeline;
+	if (!BuildPipeline(pipeline))
+	{
+		std::cout << "keeping the current shadow pipeline" << std::endl;
+		return false;
+	}
+
+	const VkDevice device = m_Engine->m_Device;
+	const VkPipeline retired = m_Pipeline;
+	retire([=]
+		{
+			vkDestroyPipeline(device, retired, nullptr);
+		});
+	m_Pipeline = pipeline;
+	return true;
+}
+
+void ShadowMaps::SetLightDirection(const glm::vec3& direction)
+{
+	const glm::vec3 normalized = glm::normalize(direction);
+	if (normalized == m_LightDirection)
+	{
+		return;
+	}
+	m_LightDirection = normalized;
+	UpdateLightView();
+}
+
+void ShadowMaps::SetSceneBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	if (boundsMin == m_SceneMin && boundsMax == m_SceneMax)
+	{
+		return;
+	}
+	m_SceneMin = boundsMin;
+	m_SceneMax = boundsMax;
+	UpdateLightView();
+}
+
+void ShadowMaps::InvalidateRegion(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	for (Cascade& cascade : m_Cascades)
+	{
+		// the cascade's box in light space back in world space, bounded by its eight corners
+		const glm::mat4 inverse = glm::inverse(cascade.viewProjection);
+		glm::vec3 cascadeMin(std::numeric_limits<float>::max());
+		glm::vec3 cascadeMax(std::numeric_limits<float>::lowest());
+		for (uint32_t corner = 0; corner < 8; ++corner)
+		{
+			const glm::vec4 clip((corner & 1) ? 1.f : -1.f, (corner & 2) ? 1.f : -1.f, (corner & 4) ? 1.f : 0.f, 1.f);
+			const glm::vec4 world = inverse * clip;
+			cascadeMin = glm::min(cascadeMin, glm::vec3(world) / world.w);
+			cascadeMax = glm::max(cascadeMax, glm::vec3(world) / world.w);
+		}
+		if (BoxesOverlap(boundsMin, boundsMax, cascadeMin, cascadeMax))
+		{
+			cascade.dirty = true;
+		}
+	}
+}
+
+void ShadowMaps::UpdateLightView()
+{
+	// one light view for every cascade, placed so the whole scene lies in front of it.
+	// cascades only move sideways in it, which keeps their depth range and the caches comparable
+	const glm::vec3 center = (m_SceneMin + m_SceneMax) * 0.5f;
+	const float radius = std::max(glm::length(m_SceneMax - m_SceneMin) * 0.5f, 1.f);
+	const glm::vec3 up = std::abs(m_LightDirection.y) > 0.99f ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+	m_LightView = glm::lookAt(center - m_LightDirection * radius, center, up);
+	m_LightDepth = 2.f * radius;
+	for (Cascade& cascade : m_Cascades)
+	{
+		cascade.dirty = true;
+	}
+}
+
+void ShadowMaps::Update(uint32_t frameIndex, const glm::mat4& view, float fovY, float aspect, float zNear)
+{
+	PROFILE_FUNCTION();
+	const glm::mat4 inverseView = glm::inverse(view);
+	const float tanY = std::tan(fovY * 0.5f);
+	const float tanX = tanY * aspect;
+
+	GPUShadowData shadowData;
+	float splitNear = zNear;
+	for (uint32_t i = 0; i < SHADOWMAPS_CASCADES; ++i)
+	{
+		const float fraction = static_cast<float>(i + 1) / SHADOWMAPS_CASCADES;
+		const float logarithmic = zNear * std::pow(SHADOWMAPS_DISTANCE / zNear, fraction);
+		const float uniform = zNear + (SHADOWMAPS_DISTANCE - zNear) * fraction;
+		const float splitFar = SHADOWMAPS_SPLIT_LAMBDA * logarithmic + (1.f - SHADOWMAPS_SPLIT_LAMBDA) * uniform;
+
+		// the sphere around the split only depends on the projection, so turning the camera does not resize it
+		glm::vec3 corners[8];
+		glm::vec3 center(0.f);
+		for (uint32_t corner = 0; corner < 8; ++corner)
+		{
+			const float depth = (corner & 4) ? splitFar : splitNear;
+			corners[corner] = glm::vec3(((corner & 1) ? 1.f : -1.f) * tanX * depth, ((corner & 2) ? 1.f : -1.f) * tanY * depth, -depth);
+			center += corners[corner] / 8.f;
+		}
+		float radius = 0.f;
+		for (const glm::vec3& corner : corners)
+		{
+			radius = std::max(radius, glm::length(corner - center));
+		}
+		radius = std::ceil(radius * 16.f) / 16.f;
+
+		Cascade& cascade = m_Cascades[i];
+		const float halfSize = radius * (1.f + SHADOWMAPS_CACHE_MARGIN);
+		const glm::vec2 lightCenter = glm::vec2(m_LightView * inverseView * glm::vec4(center, 1.f));
+		const float texel = 2.f * halfSize / SHADOWMAPS_RESOLUTION;
+
+		// recentred on whole texels once the camera's sphere would leave the cached area
+		const glm::vec2 offset = glm::abs(lightCenter - cascade.center);
+		if (cascade.dirty || halfSize != cascade.halfSize || std::max(offset.x, offset.y) > radius * SHADOWMAPS_CACHE_MARGIN)
+		{
+			cascade.dirty = true;
+			cascade.halfSize = halfSize;
+			cascade.center = glm::floor(lightCenter / texel) * texel;
+			const glm::mat4 projection = glm::orthoRH_ZO(cascade.center.x - halfSize, cascade.center.x + halfSize,
+				cascade.center.y - halfSize, cascade.center.y + halfSize, 0.f, m_LightDepth);
+			cascade.viewProjection = projection * m_LightView;
+		}
+
+		shadowData.cascadeMatrices[i] = cascade.viewProjection * inverseView;
+		shadowData.splitDepths[i] = splitFar;
+		splitNear = splitFar;
+	}
+	shadowData.lightDirection = glm::vec4(-glm::normalize(glm::mat3(view) * m_LightDirection), 0.9f);
+
+	void* data;
+	vmaMapMemory(m_Engine->GetAllocator(), m_Frames[frameIndex].shadowData.allocation, &data);
+	memcpy(data, &shadowData, sizeof(GPUShadowData));
+	vmaUnmapMemory(m_Engine->GetAllocator(), m_Frames[frameIndex].shadowData.allocation);
+
+	// caster transforms in renderable order, the draws pick them by instance index
+	const std::vector<RenderObject>& renderables = m_Engine->GetRenderables();
+	const size_t objectCount = std::min<size_t>(renderables.size(), MAXOBJECTS);
+	vmaMapMemory(m_Engine->GetAllocator(), m_Frames[frameIndex].objects.allocation, &data);
+	GPUObjectData* objects = static_cast<GPUObjectData*>(data);
+	for (size_t i = 0; i < objectCount; ++i)
+	{
+		objects[i].modelMatrix = renderables[i].transformMatrix;
+	}
+	vmaUnmapMemory(m_Engine->GetAllocator(), m_Frames[frameIndex].objects.allocation);
+}
+
+void ShadowMaps::BindDepthPipeline(VkCommandBuffer cmd, uint32_t frameIndex, const glm::mat4& viewProjection) const
+{
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_Pipeline);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_PipelineLayout, 0, 1, &m_Frames[frameIndex].objectSet, 0, nullptr);
+	vkCmdPushConstants(cmd, m_PipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &viewProjection);
+	m_Engine->GetGeometryPool().Bind(cmd);
+}
+
+void ShadowMaps::RefreshCaches(VkCommandBuffer cmd, uint32_t frameIndex)
+{
+	PROFILE_FUNCTION();
+	m_Stats.cascadesRefreshed = 0;
+	m_Stats.staticDraws = 0;
+	if (m_Pipeline == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	GpuProfiler& profiler = m_Engine->GetGpuProfiler();
+	uint32_t zone = 0;
+	for (Cascade& cascade : m_Cascades)
+	{
+		if (!cascade.dirty)
+		{
+			continue;
+		}
+		if (m_Stats.cascadesRefreshed == 0)
+		{
+			zone = profiler.BeginZone(cmd, "shadow cache");
+		}
+		cascade.dirty = false;
+		m_Stats.cascadesRefreshed++;
+		m_Stats.totalRefreshes++;
+
+		// waits for last frame's copy out of the cache, the old contents are cleared anyway
+		VkImageMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		barrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.image = cascade.cache.image;
+		barrier.subresourceRange = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 };
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+		VkClearValue clear;
+		clear.depthStencil = { 1.f, 0 };
+		VkRenderPassBeginInfo rpInfo{};
+		rpInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		rpInfo.pNext = nullptr;
+		rpInfo.renderPass = m_CacheRenderPass;
+		rpInfo.framebuffer = cascade.cacheFramebuffer;
+		rpInfo.renderArea = { { 0, 0 }, { SHADOWMAPS_RESOLUTION, SHADOWMAPS_RESOLUTION } };
+		rpInfo.clearValueCount = 1;
+		rpInfo.pClearValues = &clear;
+
+		vkCmdBeginRenderPass(cmd, &rpInfo, VK_SUBPASS_CONTENTS_INLINE);
+		BindDepthPipeline(cmd, frameIndex, cascade.viewProjection);
+		DrawStaticCasters(cmd, cascade);
+		vkCmdEndRenderPass(cmd);
+
+		// the render graph picks the cache up as a copy source
+		barrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		barrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+		barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+	}
+	if (m_Stats.cascadesRefreshed > 0)
+	{
+		profiler.EndZone(cmd, zone);
+	}
+}
+
+void ShadowMaps::DrawStaticCasters(VkCommandBuffer cmd, const Cascade& cascade)
+{
+	const std::vector<RenderObject>& renderables = m_Engine->GetRenderables();
+	const ResourceRegistry& registry = m_Engine->GetRegistry();
+	const uint32_t objectCount = static_cast<uint32_t>(std::min<size_t>(renderables.size(), MAXOBJECTS));
+	for (uint32_t i = 0; i < objectCount; ++i)
+	{
+		const RenderObject& object = renderables[i];
+		const Mesh* mesh = object.dynamic ? nullptr : registry.Get(object.mesh);
+		if (mesh && !mesh->indices.empty())
+		{
+			DrawCaster(cmd, *mesh, object, i, cascade.viewProjection, m_Stats.staticDraws);
+		}
+	}
+}
+
+void ShadowMaps::DrawCaster(VkCommandBuffer cmd, const Mesh& mesh, const RenderObject& object, uint32_t objectIndex, const glm::mat4& viewProjection, uint32_t& outDraws)
+{
+	const int32_t vertexOffset = static_cast<int32_t>(mesh.vertexAllocation.offset);
+	const uint32_t endSection = std::min(object.firstSection + object.sectionCount, static_cast<uint32_t>(mesh.sections.size()));
+	if (object.sectionCount == 0 || object.firstSection >= endSection)
+	{
+		vkCmdDrawIndexed(cmd, static_cast<uint32_t>(mesh.indices.size()), 1, mesh.indexAllocation.offset, vertexOffset, objectIndex);
+		outDraws++;
+		return;
+	}
+
+	// chunks outside the cascade are skipped, visible neighbours share one draw
+	vkutil::CullSections(mesh.sections, object.firstSection, endSection - object.firstSection, viewProjection * object.transformMatrix, m_SectionVisibility, m_CullStats);
+	uint32_t firstIndex = 0;
+	uint32_t indexCount = 0;
+	for (uint32_t s = object.firstSection; s <= endSection; ++s)
+	{
+		const bool visible = s < endSection && m_SectionVisibility[s];
+		if (visible && indexCount > 0 && firstIndex + indexCount == mesh.sections[s].firstIndex)
+		{
+			indexCount += mesh.sections[s].indexCount;
+			continue;
+		}
+		if (indexCount > 0)
+		{
+			vkCmdDrawIndexed(cmd, indexCount, 1, mesh.indexAllocation.offset + firstIndex, vertexOffset, objectIndex);
+			outDraws++;
+			indexCount = 0;
+		}
+		if (visible)
+		{
+			firstIndex = mesh.sections[s].firstIndex;
+			indexCount = mesh.sections[s].indexCount;
+		}
+	}
+}
+
+void ShadowMaps::CopyCaches(VkCommandBuffer cmd)
+{
+	for (const Cascade& cascade : m_Cascades)
+	{
+		VkImageCopy region{};
+		region.srcSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1 };
+		region.dstSubresource = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 0, 1 };
+		region.extent = { SHADOWMAPS_RESOLUTION, SHADOWMAPS_RESOLUTION, 1 };
+		vkCmdCopyImage(cmd, cascade.cache.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, cascade.shadow.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+	}
+}
+
+void ShadowMaps::DrawDynamic(VkCommandBuffer cmd, uint32_t frameIndex, uint32_t cascade)
+{
+	if (cascade == 0)
+	{
+		m_Stats.dynamicDraws = 0;
+	}
+	if (m_Pipeline == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	const VkViewport viewport{ 0.f, 0.f, static_cast<float>(SHADOWMAPS_RESOLUTION), static_cast<float>(SHADOWMAPS_RESOLUTION), 0.f, 1.f };
+	const VkRect2D scissor{ { 0, 0 }, { SHADOWMAPS_RESOLUTION, SHADOWMAPS_RESOLUTION } };
+	vkCmdSetViewport(cmd, 0, 1, &viewport);
+	vkCmdSetScissor(cmd, 0, 1, &scissor);
+	BindDepthPipeline(cmd, frameIndex, m_Cascades[cascade].viewProjection);
+
+	// neighbouring dynamic objects of one whole mesh are one instanced draw, their transforms are back to back.
+	// objects drawing a section range, like the turning scene, are drawn one by one
+	const std::vector<RenderObject>& renderables = m_Engine->GetRenderables();
+	const ResourceRegistry& registry = m_Engine->GetRegistry();
+	const uint32_t objectCount = static_cast<uint32_t>(std::min<size_t>(renderables.size(), MAXOBJECTS));
+	uint32_t first = 0;
+	while (first < objectCount)
+	{
+		const RenderObject& object = renderables[first];
+		uint32_t end = first + 1;
+		const Mesh* mesh = object.dynamic ? registry.Get(object.mesh) : nullptr;
+		if (!mesh || mesh->indices.empty())
+		{
+			first = end;
+			continue;
+		}
+		if (object.sectionCount > 0)
+		{
+			DrawCaster(cmd, *mesh, object, first, m_Cascades[cascade].viewProjection, m_Stats.dynamicDraws);
+			first = end;
+			continue;
+		}
+		while (end < objectCount && renderables[end].dynamic && renderables[end].sectionCount == 0 && renderables[end].mesh == object.mesh)
+		{
+			end++;
+		}
+
+		vkCmdDrawIndexed(cmd, static_cast<uint32_t>(mesh->indices.size()), end - first, mesh->indexAllocation.offset,
+			static_cast<int32_t>(mesh->vertexAllocation.offset), first);
+		m_Stats.dynamicDraws++;
+		first = end;
+	}
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "vk_types.h"
+#include "vk_Meshlet.h"
+#include "glm/glm.hpp"
+
+class VulkanEngine;
+struct RenderObject;
+
+#define SHADOWMAPS_CASCADES 4
+#define SHADOWMAPS_RESOLUTION 2048
+#define SHADOWMAPS_FORMAT VK_FORMAT_D32_SFLOAT
+// view depth the last cascade ends at
+#define SHADOWMAPS_DISTANCE 120.f
+// blend between uniform (0) and logarithmic (1) cascade splits
+#define SHADOWMAPS_SPLIT_LAMBDA 0.75f
+// a cached cascade covers its split's bounding sphere plus this fraction of the radius on every side,
+// the camera can move that far before the static casters are rendered again
+#define SHADOWMAPS_CACHE_MARGIN 0.25f
+
+// std140 uniform the mesh fragment shader reads next to the shadow maps
+struct GPUShadowData
+{
+	// view space position to each cascade's shadow clip space
+	glm::mat4 cascadeMatrices[SHADOWMAPS_CASCADES];
+	// view depth every cascade ends at
+	glm::vec4 splitDepths;
+	// view space direction towards the light, w is its intensity
+	glm::vec4 lightDirection;
+};
+
+struct ShadowStats
+{
+	// cascades whose static cache was rendered this frame
+	uint32_t cascadesRefreshed = 0;
+	uint32_t totalRefreshes = 0;
+	uint32_t staticDraws = 0;
+	uint32_t dynamicDraws = 0;
+};
+
+// Cascaded shadow maps for the directional sun light.
+// Cascades are fit to bounding spheres of the view frustum splits and snapped to whole texels, so they do not
+// shimmer when the camera turns or moves. Static casters are rendered into a cache per cascade that is only
+// refreshed when the light turns, the camera left the cached area or the static geometry inside it changed.
+// Every frame the caches are copied into the sampled shadow maps and the dynamic casters are drawn on top.
+class ShadowMaps
+{
+public:
+	// caster transforms are read through a set with the engine's object set layout
+	void Init(VulkanEngine& engine, VkDescriptorSetLayout objectSetLayout);
+	void Cleanup();
+	// rebuilds the depth pipeline from the current SPIR-V, the old one is handed to retire
+	bool ReloadPipeline(const std::function<void(std::function<void()>&&)>& retire);
+
+	// world space direction the light shines in, every cache is refreshed when it changes
+	void SetLightDirection(const glm::vec3& direction);
+	const glm::vec3& GetLightDirection() const { return m_LightDirection; }
+	// box holding every caster, it sets the light's depth range
+	void SetSceneBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	// static casters inside the box changed, the cascades overlapping it are refreshed
+	void InvalidateRegion(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+	// fits the cascades to the camera, marks stale caches and writes the frame slot's shadow data and caster transforms
+	void Update(uint32_t frameIndex, const glm::mat4& view, float fovY, float aspect, float zNear);
+	// renders the stale caches, recorded outside of any render pass before the render graph executes
+	void RefreshCaches(VkCommandBuffer cmd, uint32_t frameIndex);
+	// the graph's transfer pass, every cache into its shadow map
+	void CopyCaches(VkCommandBuffer cmd);
+	// the graph's depth pass of one cascade, the dynamic casters on top of the copied cache
+	void DrawDynamic(VkCommandBuffer cmd, uint32_t frameIndex, uint32_t cascade);
+
+	VkImage GetCacheImage(uint32_t cascade) const { return m_Cascades[cascade].cache.image; }
+	VkImageView GetCacheView(uint32_t cascade) const { return m_Cascades[cascade].cacheView; }
+	VkImage GetShadowImage(uint32_t cascade) const { return m_Cascades[cascade].shadow.image; }
+	VkImageView GetShadowView(uint32_t cascade) const { return m_Cascades[cascade].shadowView; }
+	VkSampler GetSampler() const { return m_Sampler; }
+	VkBuffer GetShadowDataBuffer(uint32_t frameIndex) const { return m_Frames[frameIndex].shadowData.buffer; }
+	const ShadowStats& GetStats() const { return m_Stats; }
+
+private:
+	struct Cascade
+	{
+		AllocatedImage cache;
+		VkImageView cacheView;
+		VkFramebuffer cacheFramebuffer;
+		AllocatedImage shadow;
+		VkImageView shadowView;
+
+		// light space center and half size the cache was rendered with
+		glm::vec2 center{ 0.f };
+		float halfSize{ 0.f };
+		glm::mat4 viewProjection{ 1.f };
+		bool dirty{ true };
+	};
+
+	struct FrameResources
+	{
+		AllocatedBuffer shadowData;
+		// caster transforms, indexed like the engine's renderables
+		AllocatedBuffer objects;
+		VkDescriptorSet objectSet;
+	};
+
+	bool BuildPipeline(VkPipeline& outPipeline);
+	void UpdateLightView();
+	void BindDepthPipeline(VkCommandBuffer cmd, uint32_t frameIndex, const glm::mat4& viewProjection) const;
+	void DrawStaticCasters(VkCommandBuffer cmd, const Cascade& cascade);
+	// one object's section range, or its whole mesh without one, chunks outside the cascade are skipped
+	void DrawCaster(VkCommandBuffer cmd, const Mesh& mesh, const RenderObject& object, uint32_t objectIndex, const glm::mat4& viewProjection, uint32_t& outDraws);
+
+	VulkanEngine* m_Engine{ nullptr };
+	Cascade m_Cascades[SHADOWMAPS_CASCADES];
+	std::vector<FrameResources> m_Frames;
+	VkDescriptorPool m_DescriptorPool{ VK_NULL_HANDLE };
+	VkRenderPass m_CacheRenderPass{ VK_NULL_HANDLE };
+	VkSampler m_Sampler{ VK_NULL_HANDLE };
+	VkPipelineLayout m_PipelineLayout{ VK_NULL_HANDLE };
+	VkPipeline m_Pipeline{ VK_NULL_HANDLE };
+
+	glm::vec3 m_LightDirection{ -0.4f, -1.f, -0.3f };
+	glm::vec3 m_SceneMin{ -100.f };
+	glm::vec3 m_SceneMax{ 100.f };
+	glm::mat4 m_LightView{ 1.f };
+	float m_LightDepth{ 1.f };
+
+	std::vector<uint8_t> m_SectionVisibility;
+	MeshletStats m_CullStats;
+	ShadowStats m_Stats;
+};
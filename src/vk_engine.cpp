@@ -13,42 +13,106 @@
 #include "tiny_obj_loader.h"
 #include <iostream>
 #define VMA_IMPLEMENTATION
+#include <algorithm>
 #include <array>
-
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <thread>
+
+#include "CpuProfiler.h"
 #include "Texture.h"
+#include "imgui.h"
+#include "imgui_impl_sdl.h"
+#include "imgui_impl_vulkan.h"
 #include "vk_mem_alloc.h"
 
 
 
+namespace
+{
+	bool SamePath(const std::string& a, const std::string& b)
+	{
+		return std::filesystem::path(a).lexically_normal() == std::filesystem::path(b).lexically_normal();
+	}
+}
+
 #define VKCHECK(X) do { VkResult error = X; if(error) { std::cout <<"Detected Vulkan error: " << error << std::endl; exit(1); } } while(0)
 
-void VulkanEngine::Init()
-{
-	// We initialize SDL and create a window with it. 
-	SDL_Init(SDL_INIT_VIDEO);
-
-	constexpr SDL_WindowFlags window_flags = SDL_WINDOW_VULKAN;
-
-	_window = SDL_CreateWindow(
-		"Vulkan Engine",
-		SDL_WINDOWPOS_UNDEFINED,
-		SDL_WINDOWPOS_UNDEFINED,
-		m_WindowExtent.width,
-		m_WindowExtent.height,
-		window_flags
-	);
-
-	//everything went fine
-	InitVulkan();
-	InitSwapchain();
-	InitCommands();
-	InitDefaultRenderpass();
-	InitFramebuffer();
-	InitSyncStructures();
-	InitDescriptorSetLayout();
-	InitPipelines();
-	LoadImages();
-	LoadMeshes();
+void VulkanEngine::Init(const EngineConfig& config)
+{
+	m_Config = config;
+	m_Frames.resize(std::clamp<uint32_t>(m_Config.framesInFlight, 1, MAXFRAMESINFLIGHT));
+
+	if (!m_Config.headless)
+	{
+		// We initialize SDL and create a window with it. 
+		SDL_Init(SDL_INIT_VIDEO);
+
+		constexpr SDL_WindowFlags window_flags = static_cast<SDL_WindowFlags>(SDL_WINDOW_VULKAN | SDL_WINDOW_RESIZABLE);
+
+		_window = SDL_CreateWindow(
+			"Vulkan Engine",
+			SDL_WINDOWPOS_UNDEFINED,
+			SDL_WINDOWPOS_UNDEFINED,
+			m_WindowExtent.width,
+			m_WindowExtent.height,
+			window_flags
+		);
+	}
+
+	if (!m_Config.cameraPath.empty())
+	{
+		m_CameraPath.LoadFromFile(m_Config.cameraPath);
+	}
+	if (m_Config.headless && m_CameraPath.IsEmpty())
+	{
+		// scripted default so headless runs always look at the same views
+		m_CameraPath = CameraPath::Orbit({ 0.f, 20.f, 0.f }, 150.f, 20.f, 10.f);
+	}
+	m_DynamicResolution.Init(m_Config.frameBudgetMs, m_Config.minResolutionScale);
+
+	PROFILE_THREAD("main");
+	CpuProfiler::Get().BeginStartup();
+	{
+		PROFILE_SCOPE("startup");
+
+		// the loaders' "../../" paths resolve to the pack's entries first, loose files still work without one
+		std::error_code error;
+		if (!m_Config.assetPack.empty() && std::filesystem::exists(m_Config.assetPack, error))
+		{
+			m_FileSystem.Mount(m_Config.assetPack, "../../");
+		}
+		if (!m_Config.assetCache.empty())
+		{
+			m_AssetCache.Open(m_Config.assetCache);
+		}
+
+		//everything went fine
+		InitVulkan();
+		m_Registry.Init(*this);
+		InitSwapchain();
+		InitCommands();
+		InitRenderGraph();
+		InitSyncStructures();
+		InitDescriptorSetLayout();
+		InitPipelines();
+		InitLights();
+		InitShadows();
+		InitImgui();
+		LoadImages();
+		LoadMeshes();
+		m_AssetCache.PrintReport("startup bakes");
+	}
+	CpuProfiler::Get().EndStartup();
+
+	InitScene();
+	if (m_Config.hotReload && !m_Config.headless)
+	{
+		m_HotReloader.Init(*this);
+	}
 
 	_isInitialized = true;
 }
@@ -56,33 +120,74 @@ void VulkanEngine::Cleanup()
 {
 	if (_isInitialized)
 	{
-		std::vector<VkFence> fences;
-		fences.resize(FRAMESINFLIGHT);
-		for (size_t i = 0; i < fences.size(); i++)
-		{
-			fences[i] = m_Frames[i].renderFence;
-		}
+		CpuProfiler::Get().Finish();
+		m_HotReloader.Cleanup();
 
-		vkWaitForFences(m_Device, FRAMESINFLIGHT, &fences[0], VK_TRUE, UINT64_MAX);
+		// every frame and upload submitted so far is done once both timelines reached their last value
+		WaitTimeline(m_GraphicsTimeline, m_GraphicsValue, UINT64_MAX);
+		WaitTimeline(m_TransferTimeline, m_TransferValue, UINT64_MAX);
 
+		// the destroyers push into the frame deletion queues, flushed right below
+		m_Registry.Cleanup();
+		for (FrameData& frame : m_Frames)
+		{
+			frame.deletionQueue.Flush();
+		}
+		RetireCompleted();
 		m_DeletionQueue.Flush();
-		vmaDestroyAllocator(m_Allocator);
+		m_MemoryManager.Cleanup();
 
 		vkb::destroy_debug_utils_messenger(m_Instance, m_DebugMessenger);
 		vkDestroySurfaceKHR(m_Instance, m_Surface, nullptr);
 		vkDestroyDevice(m_Device, nullptr);
 		vkDestroyInstance(m_Instance, nullptr);
-		SDL_DestroyWindow(_window);
+		if (_window)
+		{
+			SDL_DestroyWindow(_window);
+		}
+		m_FileSystem.UnmountAll();
 	}
 }
 
 void VulkanEngine::draw()
 {
-	VKCHECK(vkWaitForFences(m_Device, 1, &GetCurrentFrame().renderFence, true, 1000000000));
-	VKCHECK(vkResetFences(m_Device, 1, &GetCurrentFrame().renderFence));
+	PROFILE_FUNCTION();
+	{
+		PROFILE_SCOPE("vkWaitSemaphores");
+		VKCHECK(WaitTimeline(m_GraphicsTimeline, GetCurrentFrame().timelineValue, 1000000000));
+	}
+	GetCurrentFrame().deletionQueue.Flush();
+	GetCurrentFrame().allocator.Reset();
+	RetireCompleted();
+	// swaps edited assets in, what they replace is retired behind the frames that may still use it
+	m_HotReloader.Update();
+	// nothing of this frame is recorded yet, so meshes can still move
+	m_GeometryPool.Update();
+	m_StagingStats.frameBytes = 0;
+
+	if (m_SwapchainDirty && !RecreateSwapchain())
+	{
+		return;
+	}
 
-	uint32_t swapchainImageIndex;
-	VKCHECK(vkAcquireNextImageKHR(m_Device, m_Swapchain, 1000000000, GetCurrentFrame().presentSmeraphore, nullptr, &swapchainImageIndex));
+	uint32_t swapchainImageIndex = 0;
+	if (!m_Config.headless)
+	{
+		PROFILE_SCOPE("vkAcquireNextImageKHR");
+		const VkResult acquire = vkAcquireNextImageKHR(m_Device, m_Swapchain, 1000000000, GetCurrentFrame().presentSmeraphore, nullptr, &swapchainImageIndex);
+		if (acquire == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			// nothing was signalled, the frame is skipped and the next one starts on a new swapchain
+			m_SwapchainDirty = true;
+			return;
+		}
+		// suboptimal still presents, the swapchain is replaced after this frame
+		m_SwapchainDirty = acquire == VK_SUBOPTIMAL_KHR;
+		if (acquire != VK_SUCCESS && acquire != VK_SUBOPTIMAL_KHR)
+		{
+			VKCHECK(acquire);
+		}
+	}
 	VKCHECK(vkResetCommandBuffer(GetCurrentFrame().commandBuffer, 0));
 
 	VkCommandBuffer cmd = GetCurrentFrame().commandBuffer;
@@ -94,40 +199,52 @@ void VulkanEngine::draw()
 	cmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
 	VKCHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
+	m_GpuProfiler.BeginFrame(cmd, m_FrameNumber);
+	m_MemoryManager.BeginFrame(cmd, m_FrameNumber);
+	m_TextureStreamer.Update(cmd, m_FrameNumber, GetFrameIndex());
+
+	// the slot's previous frame has retired, so its set can take the view streaming swapped in
+	const Material* defaultMaterial = m_Registry.Get(m_DefaultMaterial);
+	const TextureResource* texture = defaultMaterial ? m_Registry.Get(defaultMaterial->texture) : nullptr;
+	const VkImageView textureView = texture ? m_TextureStreamer.GetImageView(texture->streamerSlot) : VK_NULL_HANDLE;
+	if (textureView != VK_NULL_HANDLE && GetCurrentFrame().boundTextureView != textureView)
+	{
+		VkDescriptorImageInfo imageInfo;
+		imageInfo.sampler = m_TextureSampler;
+		imageInfo.imageView = textureView;
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+		VkWriteDescriptorSet write = vkinit::WriteDescriptorSet(GetCurrentFrame().cameraDescriptor, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageInfo);
+		vkUpdateDescriptorSets(m_Device, 1, &write, 0, nullptr);
+		GetCurrentFrame().boundTextureView = textureView;
+	}
+	const uint32_t frameZone = m_GpuProfiler.BeginZone(cmd, "frame");
 
-	VkClearValue clearValue;
-	clearValue.color = { {0.0f, 1, 1, 1.0f} };
-	VkClearValue depthClear;
-	depthClear.depthStencil.depth = 1.0;
-
-
-	VkRenderPassBeginInfo rpInfo{};
-	rpInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	rpInfo.pNext = nullptr;
-
-	rpInfo.renderPass = m_RenderPass;
-	rpInfo.renderArea.offset.x = 0;
-	rpInfo.renderArea.offset.y = 0;
-	rpInfo.renderArea.extent = m_WindowExtent;
-	rpInfo.framebuffer = m_Framebuffers[swapchainImageIndex];
-
-	rpInfo.clearValueCount = 2;
-	VkClearValue clears[2] = { clearValue, depthClear };
-	rpInfo.pClearValues = &clears[0];
-
-
-	vkCmdBeginRenderPass(cmd, &rpInfo, VK_SUBPASS_CONTENTS_INLINE);
+	// timings resolve frames late, each one is matched with the scale its frame was rendered at.
+	// the scene targets keep the window extent, a smaller scale only shrinks the viewport
+	if (m_GpuProfiler.HasTimings())
+	{
+		m_DynamicResolution.AddGpuTime(m_GpuProfiler.GetTimingsFrame(), m_GpuProfiler.GetLastMs("frame"));
+	}
+	const float resolutionScale = m_DynamicResolution.BeginFrame(m_FrameNumber);
+	m_RenderExtent.width = std::clamp(static_cast<uint32_t>(m_WindowExtent.width * resolutionScale + 0.5f), 1u, m_WindowExtent.width);
+	m_RenderExtent.height = std::clamp(static_cast<uint32_t>(m_WindowExtent.height * resolutionScale + 0.5f), 1u, m_WindowExtent.height);
 
+	ApplySimulation();
 
-	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_MeshPipeline);
 	glm::vec3 camPos = { 0.f, -40.f, -150.f };
 	glm::mat4 view = glm::translate(glm::mat4(1.0f), camPos);
-	glm::mat4 projection = glm::perspective(glm::radians(70.f), 1700.f / 900.f, 0.1f, 200.f);
+	if (!m_CameraPath.IsEmpty())
+	{
+		view = glm::lookAt(m_SimulationState.eye, m_SimulationState.target, glm::vec3(0.f, 1.f, 0.f));
+	}
+	const float aspect = static_cast<float>(m_WindowExtent.width) / static_cast<float>(m_WindowExtent.height);
+	const float fovY = glm::radians(70.f);
+	const float zNear = 0.1f;
+	const float zFar = 200.f;
+	glm::mat4 projection = glm::perspective(fovY, aspect, zNear, zFar);
 	projection[1][1] *= -1;
 
-	glm::mat4 model = glm::rotate(glm::mat4(1.f), glm::radians(m_FrameNumber * 0.2f), glm::vec3(0.0, 1, 0));
-
-
 	GPUCameraData camData;
 	camData.viewMatrix = view;
 	camData.projectionMatrix = projection;
@@ -138,38 +255,64 @@ void VulkanEngine::draw()
 	memcpy(data, &camData, sizeof(GPUCameraData));
 	vmaUnmapMemory(m_Allocator, GetCurrentFrame().cameraBuffer.allocation);
 
-	MeshPushConstants constants;
-	constants.renderMatrix = model;
-
-	vkCmdPushConstants(cmd, m_MeshPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &constants);
-	std::array<VkDescriptorSet, 2> descriptorSets = { GetCurrentFrame().cameraDescriptor };
-	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_MeshPipelineLayout, 0, 1, descriptorSets.data(), 0, nullptr);
+	m_ViewProjection = camData.viewProjectionMatrix;
+	m_CameraPosition = glm::vec3(glm::inverse(view)[3]);
+	m_ClusteredLights.Update(GetFrameIndex(), m_SceneTime, view, projection, zNear, zFar, m_RenderExtent);
+	m_ShadowMaps.Update(GetFrameIndex(), view, fovY, aspect, zNear);
+	// stale static caches are rendered before the graph copies them into this frame's shadow maps
+	m_ShadowMaps.RefreshCaches(cmd, GetFrameIndex());
 
-	VkDeviceSize offset = 0;
-	vkCmdBindVertexBuffers(cmd, 0, 1, &m_Monke.vertexBuffer.buffer, &offset);
-	vkCmdDraw(cmd, m_Monke.vertices.size(), 1, 0, 0);
+	m_RenderGraph.SetImportedImage(m_SwapchainTarget, m_SwapchainImages[swapchainImageIndex], m_SwapchainImageViews[swapchainImageIndex]);
+	m_RenderGraph.SetImportedBuffer(m_LightGrid, m_ClusteredLights.GetGridBuffer(GetFrameIndex()));
+	m_RenderGraph.SetImportedBuffer(m_LightIndices, m_ClusteredLights.GetIndexBuffer(GetFrameIndex()));
+	m_RenderGraph.Execute(cmd);
 
-	vkCmdEndRenderPass(cmd);
+	m_GpuProfiler.EndZone(cmd, frameZone);
 	VKCHECK(vkEndCommandBuffer(cmd));
 
+	// the GPU holds the frame back until the uploads submitted before it finished, no CPU wait involved
+	GetCurrentFrame().timelineValue = ++m_GraphicsValue;
+	GetCurrentFrame().inputTime = m_InputTime;
+	GetCurrentFrame().latencyPending = !m_Config.headless;
+	const VkSemaphore waitSemaphores[] = { GetCurrentFrame().presentSmeraphore, m_TransferTimeline };
+	const uint64_t waitValues[] = { 0, m_TransferValue };
+	const VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT };
+	const VkSemaphore signalSemaphores[] = { GetCurrentFrame().renderSemaphore, m_GraphicsTimeline };
+	const uint64_t signalValues[] = { 0, m_GraphicsValue };
+	// headless frames have nothing to acquire or present, they skip the binary semaphores
+	const uint32_t first = m_Config.headless ? 1 : 0;
+
+	VkTimelineSemaphoreSubmitInfoKHR timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+	timelineInfo.pNext = nullptr;
+	timelineInfo.waitSemaphoreValueCount = 2 - first;
+	timelineInfo.pWaitSemaphoreValues = waitValues + first;
+	timelineInfo.signalSemaphoreValueCount = 2 - first;
+	timelineInfo.pSignalSemaphoreValues = signalValues + first;
+
 	VkSubmitInfo submit{};
 	submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submit.pNext = nullptr;
-
-	VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	submit.pNext = &timelineInfo;
 
-	submit.pWaitDstStageMask = &waitStage;
+	submit.waitSemaphoreCount = 2 - first;
+	submit.pWaitSemaphores = waitSemaphores + first;
+	submit.pWaitDstStageMask = waitStages + first;
 
-	submit.waitSemaphoreCount = 1;
-	submit.pWaitSemaphores = &GetCurrentFrame().presentSmeraphore;
-
-	submit.signalSemaphoreCount = 1;
-	submit.pSignalSemaphores = &GetCurrentFrame().renderSemaphore;
+	submit.signalSemaphoreCount = 2 - first;
+	submit.pSignalSemaphores = signalSemaphores + first;
 
 	submit.commandBufferCount = 1;
 	submit.pCommandBuffers = &cmd;
 
-	VKCHECK(vkQueueSubmit(m_GraphicsQueue, 1, &submit, GetCurrentFrame().renderFence));
+	{
+		PROFILE_SCOPE("vkQueueSubmit");
+		VKCHECK(vkQueueSubmit(m_GraphicsQueue, 1, &submit, VK_NULL_HANDLE));
+	}
+
+	if (m_Config.headless)
+	{
+		return;
+	}
 
 
 	VkPresentInfoKHR presentInfo{};
@@ -184,49 +327,274 @@ void VulkanEngine::draw()
 
 	presentInfo.pImageIndices = &swapchainImageIndex;
 
-	VKCHECK(vkQueuePresentKHR(m_GraphicsQueue, &presentInfo));
+	{
+		PROFILE_SCOPE("vkQueuePresentKHR");
+		const VkResult present = vkQueuePresentKHR(m_GraphicsQueue, &presentInfo);
+		if (present == VK_ERROR_OUT_OF_DATE_KHR || present == VK_SUBOPTIMAL_KHR)
+		{
+			m_SwapchainDirty = true;
+		}
+		else
+		{
+			VKCHECK(present);
+		}
+	}
 
 	_frameNumber++;
 }
 
 void VulkanEngine::run()
 {
+	if (m_Config.headless)
+	{
+		RunHeadless();
+		return;
+	}
+
 	SDL_Event e;
 	bool bQuit = false;
+	auto lastTime = std::chrono::steady_clock::now();
+	// the scene moves on its own thread from here on, frames render its newest snapshot
+	m_Simulation.Start();
+	m_HeapAllocations = GetThreadHeapAllocations();
 
 	//main loop
 	while (!bQuit)
 	{
-		//Handle events on queue
-		while (SDL_PollEvent(&e) != 0)
+		// the previous iteration from top to bottom, input, the HUD and the profilers included
+		m_FrameStats.heapAllocations = CountHeapAllocations();
+		CpuProfiler::Get().OnFrame(m_FrameNumber);
+		PROFILE_SCOPE("frame");
+
+		PaceFrame();
+
+		{
+			PROFILE_SCOPE("events");
+			m_InputTime = std::chrono::steady_clock::now();
+			//Handle events on queue
+			while (SDL_PollEvent(&e) != 0)
+			{
+				//close the window when user alt-f4s or clicks the X button			
+				if (e.type == SDL_QUIT) bQuit = true;
+				if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F1) m_PerfHud.Toggle();
+				if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F2)
+				{
+					SetPresentMode(static_cast<PresentMode>((static_cast<int>(m_Config.presentMode) + 1) % 3));
+				}
+				if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F3) SetLowLatency(!m_Config.lowLatency);
+				if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) m_SwapchainDirty = true;
+				if (e.type == SDL_MOUSEMOTION) m_MousePosition = glm::vec2(static_cast<float>(e.motion.x), static_cast<float>(e.motion.y));
+				ImGui_ImplSDL2_ProcessEvent(&e);
+			}
+		}
+
+		// nothing can be presented while minimized, block until the window comes back
+		if (SDL_GetWindowFlags(_window) & SDL_WINDOW_MINIMIZED)
+		{
+			SDL_WaitEvent(nullptr);
+			lastTime = std::chrono::steady_clock::now();
+			continue;
+		}
+
 		{
-			//close the window when user alt-f4s or clicks the X button			
-			if (e.type == SDL_QUIT) bQuit = true;
+			PROFILE_SCOPE("imgui");
+			ImGui_ImplVulkan_NewFrame();
+			ImGui_ImplSDL2_NewFrame(_window);
+			ImGui::NewFrame();
+
+			m_PerfHud.Draw(*this);
+
+			ImGui::Render();
 		}
 
+		const auto now = std::chrono::steady_clock::now();
+		const float deltaTime = std::chrono::duration<float>(now - lastTime).count();
+		lastTime = now;
+		m_PerfHud.AddFrame(deltaTime * 1000.f, m_GpuProfiler.GetLastMs("frame"));
+
 		draw();
+		m_FrameStats.frameAllocatorBytes = GetCurrentFrame().allocator.GetUsed();
 		m_FrameNumber++;
 	}
+	m_Simulation.Stop();
 }
 
-bool VulkanEngine::LoadShaderModule(const std::string& filename, VkShaderModule* shaderModule)
+void VulkanEngine::ApplySimulation()
+{
+	PROFILE_FUNCTION();
+	// windowed frames show the simulation one tick late, between the two newest ticks, so motion stays smooth at any frame rate
+	const FrameSnapshot& snapshot = m_Simulation.AcquireLatest();
+	const float alpha = m_Config.headless ? 1.f : m_Simulation.GetAlpha(snapshot, std::chrono::steady_clock::now());
+	Simulation::Interpolate(snapshot, alpha, m_SimulationState);
+	m_SceneTime = static_cast<float>(m_SimulationState.time);
+	SetSceneTransform(glm::rotate(glm::mat4(1.f), glm::radians(SIMULATION_SCENE_SPIN) * m_SceneTime, glm::vec3(0.f, 1.f, 0.f)));
+
+	// the simulation's bodies are the dynamic renderables besides the turning scene in order, a scene mesh reload keeps that order
+	size_t body = 0;
+	for (RenderObject& object : m_Renderables)
+	{
+		if (object.dynamic && object.mesh != m_Monke && body < m_SimulationState.transforms.size())
+		{
+			object.transformMatrix = m_SimulationState.transforms[body++];
+		}
+	}
+}
+
+void VulkanEngine::PaceFrame()
+{
+	PROFILE_FUNCTION();
+	if (m_Config.fpsLimit > 0.f)
+	{
+		// sleeping here rather than after the frame moves the wait in front of input sampling
+		const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(1.f / m_Config.fpsLimit));
+		std::this_thread::sleep_until(m_NextFrameTime);
+		m_NextFrameTime = std::max(m_NextFrameTime + period, std::chrono::steady_clock::now());
+	}
+
+	if (m_Config.lowLatency)
+	{
+		// the CPU no longer runs ahead, so input is sampled as late as the GPU allows
+		PROFILE_SCOPE("low latency wait");
+		VKCHECK(WaitTimeline(m_GraphicsTimeline, m_GraphicsValue, 1000000000));
+	}
+
+	// frames whose completion is noticed here get their latency, so without the wait above it is only known to a frame
+	uint64_t completed = 0;
+	m_GetSemaphoreCounterValue(m_Device, m_GraphicsTimeline, &completed);
+	const auto now = std::chrono::steady_clock::now();
+	for (FrameData& frame : m_Frames)
+	{
+		if (!frame.latencyPending || frame.timelineValue > completed)
+		{
+			continue;
+		}
+		frame.latencyPending = false;
+
+		const float latencyMs = std::chrono::duration<float, std::milli>(now - frame.inputTime).count();
+		m_LatencyStats.lastMs = latencyMs;
+		m_LatencyStats.averageMs = m_LatencyStats.averageMs > 0.f ? m_LatencyStats.averageMs * 0.95f + latencyMs * 0.05f : latencyMs;
+		m_LatencyStats.worstMs = std::max(m_LatencyStats.worstMs * 0.999f, latencyMs);
+	}
+}
+
+uint32_t VulkanEngine::CountHeapAllocations()
+{
+	const uint64_t heapAllocations = GetThreadHeapAllocations();
+	const uint32_t count = static_cast<uint32_t>(heapAllocations - m_HeapAllocations);
+	m_HeapAllocations = heapAllocations;
+	return count;
+}
+
+void VulkanEngine::RunHeadless()
 {
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+	PROFILE_FUNCTION();
+	m_FrameTimings.clear();
+	m_FrameTimings.reserve(m_Config.frameCount);
+	m_HeapAllocations = GetThreadHeapAllocations();
+
+	for (uint32_t frame = 0; frame < m_Config.frameCount; ++frame)
+	{
+		// a frame's count is only known once its whole iteration ended, the next one fills it in
+		if (frame > 0)
+		{
+			m_FrameTimings.back().stats.heapAllocations = CountHeapAllocations();
+		}
+		CpuProfiler::Get().OnFrame(m_FrameNumber);
+		PROFILE_SCOPE("frame");
+
+		// one simulation tick per frame at the fixed timestep, every run sees the same views whatever the device speed.
+		// frame 0 renders the tick the simulation started with
+		if (frame > 0)
+		{
+			m_Simulation.Tick();
+		}
+
+		const auto begin = std::chrono::steady_clock::now();
+		draw();
+		m_FrameStats.frameAllocatorBytes = GetCurrentFrame().allocator.GetUsed();
+		const float cpuMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - begin).count();
+		m_FrameTimings.push_back({ frame, cpuMs, -1.f, m_FrameStats });
+
+		// draw resolved the timestamps of the frame that used this slot before
+		if (m_GpuProfiler.HasTimings() && m_GpuProfiler.GetTimingsFrame() + GetFramesInFlight() == static_cast<uint64_t>(m_FrameNumber))
+		{
+			m_FrameTimings[m_FrameTimings.size() - 1 - GetFramesInFlight()].gpuMs = m_GpuProfiler.GetLastMs("frame");
+		}
+		m_FrameNumber++;
+	}
+	if (!m_FrameTimings.empty())
+	{
+		m_FrameTimings.back().stats.heapAllocations = CountHeapAllocations();
+	}
+
+	vkDeviceWaitIdle(m_Device);
+
+	const uint32_t firstFrame = m_FrameNumber - static_cast<uint32_t>(m_FrameTimings.size());
+	for (size_t i = m_FrameTimings.size() > GetFramesInFlight() ? m_FrameTimings.size() - GetFramesInFlight() : 0; i < m_FrameTimings.size(); ++i)
+	{
+		if (m_GpuProfiler.ResolveFrame(firstFrame + i))
+		{
+			m_FrameTimings[i].gpuMs = m_GpuProfiler.GetLastMs("frame");
+		}
+	}
+
+	float cpuTotal = 0.f;
+	float gpuTotal = 0.f;
+	uint32_t gpuCount = 0;
+	for (const FrameTiming& timing : m_FrameTimings)
+	{
+		cpuTotal += timing.cpuMs;
+		if (timing.gpuMs >= 0.f)
+		{
+			gpuTotal += timing.gpuMs;
+			gpuCount++;
+		}
+	}
+	if (!m_FrameTimings.empty())
+	{
+		std::cout << "headless: " << m_FrameTimings.size() << " frames, cpu avg " << cpuTotal / m_FrameTimings.size() << "ms, gpu avg "
+			<< (gpuCount ? gpuTotal / gpuCount : 0.f) << "ms" << std::endl;
+	}
+
+	if (!m_Config.statsPath.empty())
+	{
+		WriteFrameTimings(m_Config.statsPath);
+	}
+	if (!m_Config.readbackPath.empty())
+	{
+		vkutil::SaveImageToFile(*this, m_OffscreenImage.image, m_WindowExtent, m_Config.readbackPath.c_str());
+	}
+}
 
+void VulkanEngine::WriteFrameTimings(const std::string& path) const
+{
+	std::ofstream file(path);
 	if (!file.is_open())
 	{
-		std::cout << "Failed to open file: " << filename << std::endl;
-		return false;
+		std::cout << "failed to open " << path << std::endl;
+		return;
 	}
 
-	size_t fileSize = (size_t)file.tellg();
+	file << "frame,cpu_ms,gpu_ms,draw_calls,triangles,heap_allocations\n";
+	for (const FrameTiming& timing : m_FrameTimings)
+	{
+		file << timing.frame << "," << timing.cpuMs << "," << timing.gpuMs << "," << timing.stats.drawCalls << "," << timing.stats.triangles << "," << timing.stats.heapAllocations << "\n";
+	}
+}
 
-	std::vector<uint32_t> buffer(fileSize / sizeof(uint32_t));
+bool VulkanEngine::LoadShaderModule(const std::string& filename, VkShaderModule* shaderModule)
+{
+	const FileData file = m_FileSystem.Open(filename);
 
-	file.seekg(0);
-	file.read(reinterpret_cast<char*>(buffer.data()), fileSize);
+	if (!file.IsValid())
+	{
+		std::cout << "Failed to open file: " << filename << std::endl;
+		return false;
+	}
 
-	file.close();
+	// SPIR-V is read as words, a copy makes sure they are aligned
+	std::vector<uint32_t> buffer(file.GetSize() / sizeof(uint32_t));
+	memcpy(buffer.data(), file.GetData(), buffer.size() * sizeof(uint32_t));
 
 	VkShaderModuleCreateInfo shaderModuleCreateInfo{};
 	shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
@@ -247,12 +615,15 @@ bool VulkanEngine::LoadShaderModule(const std::string& filename, VkShaderModule*
 
 void VulkanEngine::InitVulkan()
 {
+	PROFILE_FUNCTION();
 	vkb::InstanceBuilder builder;
 
+	// headless instances skip the surface extensions, so CPU implementations like lavapipe qualify
 	auto instanceRect = builder.set_app_name("Göteborg")
 		.request_validation_layers(true)
 		.require_api_version(1, 1)
 		.use_default_debug_messenger()
+		.set_headless(m_Config.headless)
 		.build();
 
 	vkb::Instance vkbInstance = instanceRect.value();
@@ -261,36 +632,138 @@ void VulkanEngine::InitVulkan()
 
 	m_DebugMessenger = vkbInstance.debug_messenger;
 
-	SDL_Vulkan_CreateSurface(_window, m_Instance, &m_Surface);
-
 	vkb::PhysicalDeviceSelector selector{ vkbInstance };
-	vkb::PhysicalDevice physicalDevice = selector.set_minimum_version(1, 1).set_surface(m_Surface).select().value();
+	selector.set_minimum_version(1, 1);
+	selector.add_desired_extension(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+	selector.add_desired_extension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	// core in 1.2, the instance asks for 1.1 so it comes from the extension
+	selector.add_required_extension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+	if (!m_Config.headless)
+	{
+		SDL_Vulkan_CreateSurface(_window, m_Instance, &m_Surface);
+		selector.set_surface(m_Surface);
+	}
+	vkb::PhysicalDevice physicalDevice = selector.select().value();
+
+	// desired extensions the device supports are enabled by the device builder
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(physicalDevice.physical_device, nullptr, &extensionCount, nullptr);
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(physicalDevice.physical_device, nullptr, &extensionCount, extensions.data());
+	auto supportsExtension = [&](const char* name)
+	{
+		return std::any_of(extensions.begin(), extensions.end(), [&](const VkExtensionProperties& extension)
+			{
+				return strcmp(extension.extensionName, name) == 0;
+			});
+	};
+	const bool creationFeedback = supportsExtension(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+	const bool memoryBudget = supportsExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice.physical_device, &supportedFeatures);
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(physicalDevice.physical_device, &deviceProperties);
+
+	// meshlet draws go through one indirect call when the device can take several commands at once
+	m_SupportsMultiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+	m_MaxDrawIndirectCount = m_SupportsMultiDrawIndirect ? deviceProperties.limits.maxDrawIndirectCount : 1;
+	m_SupportsTextureFeedback = supportedFeatures.fragmentStoresAndAtomics == VK_TRUE;
+
+	VkPhysicalDeviceFeatures2 enabledFeatures{};
+	enabledFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	enabledFeatures.pNext = nullptr;
+	enabledFeatures.features.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	enabledFeatures.features.fragmentStoresAndAtomics = supportedFeatures.fragmentStoresAndAtomics;
+
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures{};
+	timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+	timelineFeatures.pNext = nullptr;
+	timelineFeatures.timelineSemaphore = VK_TRUE;
 
 	vkb::DeviceBuilder deviceBuilder{ physicalDevice };
 
-	vkb::Device vkbDevice = deviceBuilder.build().value();
+	vkb::Device vkbDevice = deviceBuilder.add_pNext(&enabledFeatures).add_pNext(&timelineFeatures).build().value();
 
 	m_Device = vkbDevice.device;
 	m_PhysicalDevice = physicalDevice.physical_device;
 
 	m_GraphicsQueue = vkbDevice.get_queue(vkb::QueueType::graphics).value();
 	m_GraphicsQueueFamily = vkbDevice.get_queue_index(vkb::QueueType::graphics).value();
+	m_TransferQueue = m_GraphicsQueue;
+
+	// extension entry points are not exported by the loader
+	m_WaitSemaphores = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(vkGetDeviceProcAddr(m_Device, "vkWaitSemaphoresKHR"));
+	m_GetSemaphoreCounterValue = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(vkGetDeviceProcAddr(m_Device, "vkGetSemaphoreCounterValueKHR"));
+
+	m_Allocator = m_MemoryManager.Init(m_Instance, m_PhysicalDevice, m_Device, GetFramesInFlight(), memoryBudget);
+
+	m_GpuProfiler.Init(m_Device, m_PhysicalDevice, m_GraphicsQueueFamily, GetFramesInFlight());
+	m_DeletionQueue.PushFunction([=]
+		{
+			m_GpuProfiler.Cleanup();
+		});
 
-	VmaAllocatorCreateInfo allocatorInfo{};
-	allocatorInfo.physicalDevice = m_PhysicalDevice;
-	allocatorInfo.device = m_Device;
-	allocatorInfo.instance = m_Instance;
-	vmaCreateAllocator(&allocatorInfo, &m_Allocator);
+	m_PipelineCache.Init(m_Device, m_PhysicalDevice, "pipeline_cache.bin", creationFeedback);
+	m_DeletionQueue.PushFunction([=]
+		{
+			m_PipelineCache.Save();
+			m_PipelineCache.Cleanup();
+		});
 }
 
 void VulkanEngine::InitSwapchain()
 {
+	PROFILE_FUNCTION();
+	if (m_Config.headless)
+	{
+		InitOffscreenTarget();
+		return;
+	}
+
+	CreateSwapchain(VK_NULL_HANDLE);
+
+	m_DepthFormat = VK_FORMAT_D32_SFLOAT;
+
+	// whatever swapchain is current at shutdown, recreated ones retire their predecessors
+	m_DeletionQueue.PushFunction([=]
+		{
+			for (VkImageView view : m_SwapchainImageViews)
+			{
+				vkDestroyImageView(m_Device, view, nullptr);
+			}
+			vkDestroySwapchainKHR(m_Device, m_Swapchain, nullptr);
+		});
+}
+
+void VulkanEngine::CreateSwapchain(VkSwapchainKHR oldSwapchain)
+{
+	PROFILE_FUNCTION();
+	VkPresentModeKHR desired = VK_PRESENT_MODE_FIFO_KHR;
+	switch (m_Config.presentMode)
+	{
+	case PresentMode::Fifo: desired = VK_PRESENT_MODE_FIFO_KHR; break;
+	case PresentMode::Mailbox: desired = VK_PRESENT_MODE_MAILBOX_KHR; break;
+	case PresentMode::Immediate: desired = VK_PRESENT_MODE_IMMEDIATE_KHR; break;
+	}
+
+	// FIFO is the only mode every surface has
+	uint32_t modeCount = 0;
+	vkGetPhysicalDeviceSurfacePresentModesKHR(m_PhysicalDevice, m_Surface, &modeCount, nullptr);
+	std::vector<VkPresentModeKHR> modes(modeCount);
+	vkGetPhysicalDeviceSurfacePresentModesKHR(m_PhysicalDevice, m_Surface, &modeCount, modes.data());
+	m_PresentMode = std::find(modes.begin(), modes.end(), desired) != modes.end() ? desired : VK_PRESENT_MODE_FIFO_KHR;
+
 	vkb::SwapchainBuilder swapchainBuilder{ m_PhysicalDevice, m_Device, m_Surface };
 
 	vkb::Swapchain vkbSwapchain = swapchainBuilder
 		.use_default_format_selection()
-		.set_desired_present_mode(VK_PRESENT_MODE_MAILBOX_KHR)
+		// the upscale pass blits into the swapchain image
+		.add_image_usage_flags(m_DynamicResolution.IsEnabled() ? static_cast<VkImageUsageFlags>(VK_IMAGE_USAGE_TRANSFER_DST_BIT) : 0)
+		.set_desired_present_mode(m_PresentMode)
 		.set_desired_extent(m_WindowExtent.width, m_WindowExtent.height)
+		.set_old_swapchain(oldSwapchain)
 		.build()
 		.value();
 
@@ -298,40 +771,103 @@ void VulkanEngine::InitSwapchain()
 	m_SwapchainImages = vkbSwapchain.get_images().value();
 	m_SwapchainImageViews = vkbSwapchain.get_image_views().value();
 	m_SwapchainImageFormat = vkbSwapchain.image_format;
+	// the surface may clamp the extent
+	m_WindowExtent = vkbSwapchain.extent;
+}
+
+bool VulkanEngine::RecreateSwapchain()
+{
+	PROFILE_FUNCTION();
+	int width = 0;
+	int height = 0;
+	SDL_Vulkan_GetDrawableSize(_window, &width, &height);
+	if (width == 0 || height == 0)
+	{
+		return false;
+	}
+	m_SwapchainDirty = false;
+	m_WindowExtent = { static_cast<uint32_t>(width), static_cast<uint32_t>(height) };
+
+	// frames in flight may still render into or present the old images
+	const VkSwapchainKHR oldSwapchain = m_Swapchain;
+	const std::vector<VkImageView> oldViews = m_SwapchainImageViews;
+	CreateSwapchain(oldSwapchain);
+	RetireAfterFrames([=]
+		{
+			for (VkImageView view : oldViews)
+			{
+				vkDestroyImageView(m_Device, view, nullptr);
+			}
+			vkDestroySwapchainKHR(m_Device, oldSwapchain, nullptr);
+		});
+
+	// depth and framebuffers follow the new extent, the render passes stay compatible with the built pipelines
+	m_RenderGraph.SetImageExtent(m_SwapchainTarget, m_WindowExtent);
+	m_RenderGraph.SetImageExtent(m_DepthTarget, m_WindowExtent);
+	if (m_SceneColor != RG_INVALID)
+	{
+		m_RenderGraph.SetImageExtent(m_SceneColor, m_WindowExtent);
+	}
+	m_RenderGraph.Recompile([this](std::function<void()>&& func)
+		{
+			RetireAfterFrames(std::move(func));
+		});
+	return true;
+}
 
-	VkExtent3D depthImageExtent = { m_WindowExtent.width, m_WindowExtent.height, 1 };
+void VulkanEngine::SetPresentMode(PresentMode mode)
+{
+	m_Config.presentMode = mode;
+	m_SwapchainDirty = !m_Config.headless;
+}
 
-	m_DepthFormat = VK_FORMAT_D32_SFLOAT;
+const char* VulkanEngine::GetPresentModeName() const
+{
+	if (m_Config.headless)
+	{
+		return "none";
+	}
+	switch (m_PresentMode)
+	{
+	case VK_PRESENT_MODE_IMMEDIATE_KHR: return "immediate";
+	case VK_PRESENT_MODE_MAILBOX_KHR: return "mailbox";
+	case VK_PRESENT_MODE_FIFO_KHR: return "fifo";
+	default: return "other";
+	}
+}
 
-	VkImageCreateInfo depthImInfo = vkinit::ImageCreateInfo(m_DepthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, depthImageExtent);
-	VmaAllocationCreateInfo depthAllocInfo{};
-	depthAllocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
-	depthAllocInfo.requiredFlags = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+void VulkanEngine::InitOffscreenTarget()
+{
+	// a single color image takes the swapchain's place, everything downstream sees image index 0
+	m_SwapchainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	m_DepthFormat = VK_FORMAT_D32_SFLOAT;
 
-	vmaCreateImage(m_Allocator, &depthImInfo, &depthAllocInfo, &m_DepthImage.image, &m_DepthImage.allocation, nullptr);
+	const VkExtent3D extent{ m_WindowExtent.width, m_WindowExtent.height, 1 };
+	VkImageCreateInfo imageInfo = vkinit::ImageCreateInfo(m_SwapchainImageFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, extent);
 
-	VkImageViewCreateInfo depthImViewInfo = vkinit::ImageViewCreateInfo(m_DepthFormat, m_DepthImage.image, VK_IMAGE_ASPECT_DEPTH_BIT);
-	VKCHECK(vkCreateImageView(m_Device, &depthImViewInfo, nullptr, &m_DepthImageView));
+	VmaAllocationCreateInfo allocInfo{};
+	allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+	VKCHECK(vmaCreateImage(m_Allocator, &imageInfo, &allocInfo, &m_OffscreenImage.image, &m_OffscreenImage.allocation, nullptr));
 
-	for (uint32_t i = 0; i < m_SwapchainImageViews.size(); i++)
-	{
-		m_DeletionQueue.PushFunction([=]
-			{
-				vkDestroyImageView(m_Device, m_SwapchainImageViews[i], nullptr);
-			});
+	VkImageView view;
+	VkImageViewCreateInfo viewInfo = vkinit::ImageViewCreateInfo(m_SwapchainImageFormat, m_OffscreenImage.image, VK_IMAGE_ASPECT_COLOR_BIT);
+	VKCHECK(vkCreateImageView(m_Device, &viewInfo, nullptr, &view));
 
-	}
+	m_SwapchainImages = { m_OffscreenImage.image };
+	m_SwapchainImageViews = { view };
 
 	m_DeletionQueue.PushFunction([=]
 		{
-			vkDestroySwapchainKHR(m_Device, m_Swapchain, nullptr);
+			vkDestroyImageView(m_Device, view, nullptr);
+			vmaDestroyImage(m_Allocator, m_OffscreenImage.image, m_OffscreenImage.allocation);
 		});
 }
 
 void VulkanEngine::InitCommands()
 {
+	PROFILE_FUNCTION();
 	VkCommandPoolCreateInfo poolInfo = vkinit::CommandPoolCreateInfo(m_GraphicsQueueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
-	for (size_t i = 0; i < FRAMESINFLIGHT; i++)
+	for (size_t i = 0; i < m_Frames.size(); i++)
 	{
 		VKCHECK(vkCreateCommandPool(m_Device, &poolInfo, nullptr, &m_Frames[i].commandPool));
 		VkCommandBufferAllocateInfo cmdAllocInfo = vkinit::CommandBufferAllocateInfo(m_Frames[i].commandPool, 1, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
@@ -343,30 +879,69 @@ void VulkanEngine::InitCommands()
 	}
 
 	VkCommandPoolCreateInfo uploadCommandPoolBuffer = vkinit::CommandPoolCreateInfo(m_GraphicsQueueFamily);
-	VKCHECK(vkCreateCommandPool(m_Device, &uploadCommandPoolBuffer, nullptr, &m_UploadContext.commandPool));
-	m_DeletionQueue.PushFunction([=]
-		{
-			vkDestroyCommandPool(m_Device, m_UploadContext.commandPool, nullptr);
-		});
-	VkCommandBufferAllocateInfo cmdAllocInfo = vkinit::CommandBufferAllocateInfo(m_UploadContext.commandPool, 1);
-
-	VkCommandBuffer cmd;
-	VKCHECK(vkAllocateCommandBuffers(m_Device, &cmdAllocInfo, &m_UploadContext.commandBuffer));
+	for (UploadContext& upload : m_UploadContexts)
+	{
+		VKCHECK(vkCreateCommandPool(m_Device, &uploadCommandPoolBuffer, nullptr, &upload.commandPool));
+		const VkCommandPool pool = upload.commandPool;
+		m_DeletionQueue.PushFunction([=]
+			{
+				vkDestroyCommandPool(m_Device, pool, nullptr);
+			});
+		VkCommandBufferAllocateInfo cmdAllocInfo = vkinit::CommandBufferAllocateInfo(upload.commandPool, 1);
+		VKCHECK(vkAllocateCommandBuffers(m_Device, &cmdAllocInfo, &upload.commandBuffer));
+	}
 
 }
 
 void VulkanEngine::InitPipelines()
 {
-	VkShaderModule triangleFragShader;
-	if (!LoadShaderModule("../../shaders/tri_mesh.frag.spv", &triangleFragShader))
-	{
-		std::cout << "Failed to load Fragment shader\n";
-	}
+	PROFILE_FUNCTION();
+	VkPipelineLayoutCreateInfo meshPipelineLayout = vkinit::PipelineLayoutCreateInfo();
 
-	PipelineBuilder pipelineBuilder;
-	pipelineBuilder.m_VertexInputState = vkinit::PipelineVertexInputStateCreateInfo();
+	VkPushConstantRange pushConstant;
+	pushConstant.offset = 0;
+	pushConstant.size = sizeof(MeshPushConstants);
+	pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
 
-	pipelineBuilder.m_InputAssemblyState = vkinit::PipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+	meshPipelineLayout.pPushConstantRanges = &pushConstant;
+	meshPipelineLayout.pushConstantRangeCount = 1;
+
+	const std::array<VkDescriptorSetLayout, 2> setLayouts = { m_GlobalSetlayout, m_ObjectSetLayout };
+	meshPipelineLayout.setLayoutCount = static_cast<uint32_t>(setLayouts.size());
+	meshPipelineLayout.pSetLayouts = setLayouts.data();
+
+	VKCHECK(vkCreatePipelineLayout(m_Device, &meshPipelineLayout, nullptr, &m_MeshPipelineLayout));
+
+	BuildMeshPipelines(m_MeshPipeline, m_AlphaTestedPipeline);
+	m_DefaultMaterial = CreateMaterial(m_MeshPipeline, m_MeshPipelineLayout, "defaultmesh");
+	m_AlphaTestedMaterial = CreateMaterial(m_AlphaTestedPipeline, m_MeshPipelineLayout, "alphatested");
+
+	// hot reload may have replaced the pipelines by the time this runs
+	m_DeletionQueue.PushFunction([=]
+		{
+			vkDestroyPipeline(m_Device, m_MeshPipeline, nullptr);
+			vkDestroyPipeline(m_Device, m_AlphaTestedPipeline, nullptr);
+			vkDestroyPipelineLayout(m_Device, m_MeshPipelineLayout, nullptr);
+		});
+}
+
+bool VulkanEngine::BuildMeshPipelines(VkPipeline& outMeshPipeline, VkPipeline& outAlphaTestedPipeline)
+{
+	PROFILE_FUNCTION();
+	outMeshPipeline = VK_NULL_HANDLE;
+	outAlphaTestedPipeline = VK_NULL_HANDLE;
+
+	VkShaderModule triangleFragShader;
+	if (!LoadShaderModule(SHADERDIRECTORY "tri_mesh.frag.spv", &triangleFragShader))
+	{
+		std::cout << "Failed to load Fragment shader\n";
+		return false;
+	}
+
+	PipelineBuilder pipelineBuilder;
+	pipelineBuilder.m_VertexInputState = vkinit::PipelineVertexInputStateCreateInfo();
+
+	pipelineBuilder.m_InputAssemblyState = vkinit::PipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
 
 	pipelineBuilder.m_Viewport.x = 0.0f;
 	pipelineBuilder.m_Viewport.y = 0.0f;
@@ -377,6 +952,8 @@ void VulkanEngine::InitPipelines()
 
 	pipelineBuilder.m_Scissor.offset = { 0,0 };
 	pipelineBuilder.m_Scissor.extent = m_WindowExtent;
+	// the swapchain can be resized, so viewport and scissor come from the command buffer
+	pipelineBuilder.m_DynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
 	pipelineBuilder.m_DepthStencilState = vkinit::PipelineDepthStencilCreateInfo(true, true, VK_COMPARE_OP_LESS_OR_EQUAL);
 
 	pipelineBuilder.m_Rasterizer = vkinit::PipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL);
@@ -392,215 +969,343 @@ void VulkanEngine::InitPipelines()
 	pipelineBuilder.m_VertexInputState.vertexBindingDescriptionCount = static_cast<uint32_t>(vertexDescription.bindings.size());
 
 	VkShaderModule meshVertShader;
-	if (!LoadShaderModule("../../shaders/tri_mesh.vert.spv", &meshVertShader))
+	if (!LoadShaderModule(SHADERDIRECTORY "tri_mesh.vert.spv", &meshVertShader))
 	{
 		std::cout << "Failed to load Vert shader\n";
+		vkDestroyShaderModule(m_Device, triangleFragShader, nullptr);
+		return false;
 	}
 
+	// constant_id 0 of tri_mesh.frag switches the streaming feedback writes, constant_id 1 the alpha test
+	struct
+	{
+		VkBool32 writeFeedback;
+		VkBool32 alphaTest;
+	} fragConstants{ m_SupportsTextureFeedback ? VK_TRUE : VK_FALSE, VK_FALSE };
+	const std::array<VkSpecializationMapEntry, 2> fragEntries = { {
+		{ 0, 0, sizeof(VkBool32) },
+		{ 1, sizeof(VkBool32), sizeof(VkBool32) } } };
+	VkSpecializationInfo fragSpecialization{ static_cast<uint32_t>(fragEntries.size()), fragEntries.data(), sizeof(fragConstants), &fragConstants };
+
 	pipelineBuilder.m_ShaderStages.push_back(vkinit::PipelineShaderStageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT, meshVertShader));
 	pipelineBuilder.m_ShaderStages.push_back(vkinit::PipelineShaderStageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT, triangleFragShader));
-
-	VkPipelineLayoutCreateInfo meshPipelineLayout = vkinit::PipelineLayoutCreateInfo();
-
-	VkPushConstantRange pushConstant;
-	pushConstant.offset = 0;
-	pushConstant.size = sizeof(MeshPushConstants);
-	pushConstant.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-
-	meshPipelineLayout.pPushConstantRanges = &pushConstant;
-	meshPipelineLayout.pushConstantRangeCount = 1;
-
-	meshPipelineLayout.setLayoutCount = 1;
-	meshPipelineLayout.pSetLayouts = &m_GlobalSetlayout;
-
-	VKCHECK(vkCreatePipelineLayout(m_Device, &meshPipelineLayout, nullptr, &m_MeshPipelineLayout));
+	pipelineBuilder.m_ShaderStages.back().pSpecializationInfo = &fragSpecialization;
 
 	pipelineBuilder.m_PipelineLayout = m_MeshPipelineLayout;
 
+	outMeshPipeline = pipelineBuilder.BuildPipeline(m_Device, m_RenderGraph.GetRenderPass(m_ForwardPass), &m_PipelineCache);
 
-	m_MeshPipeline = pipelineBuilder.BuildPipeline(m_Device, m_RenderPass);
-
+	fragConstants.alphaTest = VK_TRUE;
+	outAlphaTestedPipeline = pipelineBuilder.BuildPipeline(m_Device, m_RenderGraph.GetRenderPass(m_ForwardPass), &m_PipelineCache);
 
 	vkDestroyShaderModule(m_Device, triangleFragShader, nullptr);
 	vkDestroyShaderModule(m_Device, meshVertShader, nullptr);
-
-	m_DeletionQueue.PushFunction([=]
-		{
-			vkDestroyPipeline(m_Device, m_MeshPipeline, nullptr);
-			vkDestroyPipelineLayout(m_Device, m_MeshPipelineLayout, nullptr);
-		});
+	return outMeshPipeline != VK_NULL_HANDLE && outAlphaTestedPipeline != VK_NULL_HANDLE;
 }
 
-void VulkanEngine::InitDefaultRenderpass()
-{
-	VkAttachmentDescription colorAttachment{};
-	colorAttachment.format = m_SwapchainImageFormat;
-	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-	VkAttachmentReference colorAttachmentRef{};
-	colorAttachmentRef.attachment = 0;
-	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-	VkSubpassDescription subpass{};
-	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subpass.colorAttachmentCount = 1;
-	subpass.pColorAttachments = &colorAttachmentRef;
-
-	VkAttachmentDescription depthAttachment{};
-	depthAttachment.flags = 0;
-	depthAttachment.format = m_DepthFormat;
-	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-	VkAttachmentReference depthAttachmentRef{};
-	depthAttachmentRef.attachment = 1;
-	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-	VkSubpassDescription depthSubpass{};
-	depthSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	depthSubpass.colorAttachmentCount = 1;
-	depthSubpass.pColorAttachments = &colorAttachmentRef;
-	depthSubpass.pDepthStencilAttachment = &depthAttachmentRef;
-
-	VkAttachmentDescription attachments[2] = { colorAttachment, depthAttachment };
-
-	VkSubpassDependency dependency{};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-	VkSubpassDependency depthDependency{};
-	depthDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	depthDependency.dstSubpass = 0;
-	depthDependency.srcStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-	depthDependency.srcAccessMask = 0;
-	depthDependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-	depthDependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-
-	VkSubpassDependency dependencies[2] = { dependency, depthDependency };
-
-	VkRenderPassCreateInfo renderPassInfo{};
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassInfo.attachmentCount = 2;
-	renderPassInfo.pAttachments = &attachments[0];
-	renderPassInfo.subpassCount = 1;
-	renderPassInfo.pSubpasses = &depthSubpass;
-	renderPassInfo.dependencyCount = 2;
-	renderPassInfo.pDependencies = &dependencies[0];
-
-	VKCHECK(vkCreateRenderPass(m_Device, &renderPassInfo, nullptr, &m_RenderPass));
+bool VulkanEngine::ReloadPipelines()
+{
+	PROFILE_FUNCTION();
+	VkPipeline meshPipeline;
+	VkPipeline alphaTestedPipeline;
+	// light_cull.comp or shadow.vert may be the shader that changed, each keeps its old pipeline on its own when it fails
+	const auto retire = [this](std::function<void()>&& func)
+	{
+		RetireAfterFrames(std::move(func));
+	};
+	m_ClusteredLights.ReloadPipeline(retire);
+	m_ShadowMaps.ReloadPipeline(retire);
+	if (!BuildMeshPipelines(meshPipeline, alphaTestedPipeline))
+	{
+		std::cout << "keeping the current pipelines" << std::endl;
+		vkDestroyPipeline(m_Device, meshPipeline, nullptr);
+		vkDestroyPipeline(m_Device, alphaTestedPipeline, nullptr);
+		return false;
+	}
 
-	m_DeletionQueue.PushFunction([=]
+	// frames in flight may still be drawing with the old ones
+	const VkPipeline retiredMesh = m_MeshPipeline;
+	const VkPipeline retiredAlphaTested = m_AlphaTestedPipeline;
+	RetireAfterFrames([=]
 		{
-			vkDestroyRenderPass(m_Device, m_RenderPass, nullptr);
+			vkDestroyPipeline(m_Device, retiredMesh, nullptr);
+			vkDestroyPipeline(m_Device, retiredAlphaTested, nullptr);
 		});
+
+	m_MeshPipeline = meshPipeline;
+	m_AlphaTestedPipeline = alphaTestedPipeline;
+	if (Material* material = m_Registry.Get(m_DefaultMaterial))
+	{
+		material->pipeline = meshPipeline;
+	}
+	if (Material* material = m_Registry.Get(m_AlphaTestedMaterial))
+	{
+		material->pipeline = alphaTestedPipeline;
+	}
+	std::cout << "reloaded the mesh pipelines" << std::endl;
+	return true;
 }
 
-void VulkanEngine::InitFramebuffer()
+void VulkanEngine::InitRenderGraph()
 {
-	VkFramebufferCreateInfo framebufferInfo{};
-	framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-	framebufferInfo.pNext = nullptr;
+	PROFILE_FUNCTION();
+	m_RenderGraph.Init(m_Device, m_Allocator);
+	m_RenderGraph.SetProfiler(&m_GpuProfiler);
 
-	framebufferInfo.renderPass = m_RenderPass;
-	framebufferInfo.attachmentCount = 1;
-	framebufferInfo.width = m_WindowExtent.width;
-	framebufferInfo.height = m_WindowExtent.height;
-	framebufferInfo.layers = 1;
-
-	const uint32_t swapchainImageCount = m_SwapchainImages.size();
-	m_Framebuffers = std::vector<VkFramebuffer>(swapchainImageCount);
+	// the acquire semaphore is waited on at color output, so the first write to the swapchain image starts there
+	RGImageDesc swapchainDesc{ m_SwapchainImageFormat, m_WindowExtent };
+	if (m_Config.headless)
+	{
+		// the offscreen image is reused every frame and left ready for the final readback copy
+		m_SwapchainTarget = m_RenderGraph.ImportImage("offscreen", swapchainDesc, VK_NULL_HANDLE, VK_NULL_HANDLE,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+	}
+	else
+	{
+		m_SwapchainTarget = m_RenderGraph.ImportImage("swapchain", swapchainDesc, VK_NULL_HANDLE, VK_NULL_HANDLE,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0);
+	}
 
-	for (size_t i = 0; i < swapchainImageCount; ++i)
+	// static casters are rendered into a cache per cascade outside of the graph, only when it went stale.
+	// every frame copies the caches into the sampled shadow maps and draws the dynamic casters on top
+	const RGImageDesc shadowDesc{ SHADOWMAPS_FORMAT, { SHADOWMAPS_RESOLUTION, SHADOWMAPS_RESOLUTION } };
+	for (uint32_t i = 0; i < SHADOWMAPS_CASCADES; ++i)
 	{
-		VkImageView attachments[2];
-		attachments[0] = m_SwapchainImageViews[i];
-		attachments[1] = m_DepthImageView;
+		m_ShadowCaches[i] = m_RenderGraph.ImportImage("shadow cache " + std::to_string(i), shadowDesc, VK_NULL_HANDLE, VK_NULL_HANDLE,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+		// one set of maps for all frames in flight, the graph waits for the previous frame's reads before writing
+		m_ShadowTargets[i] = m_RenderGraph.ImportImage("shadow map " + std::to_string(i), shadowDesc, VK_NULL_HANDLE, VK_NULL_HANDLE,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+	}
+	m_ShadowCompositePass = m_RenderGraph.AddPass("shadow composite", RGPassType::Transfer, [&](RenderGraphBuilder& builder)
+		{
+			for (uint32_t i = 0; i < SHADOWMAPS_CASCADES; ++i)
+			{
+				builder.ReadTransfer(m_ShadowCaches[i]);
+				builder.WriteTransfer(m_ShadowTargets[i]);
+			}
+		},
+		[this](VkCommandBuffer cmd)
+		{
+			m_ShadowMaps.CopyCaches(cmd);
+		});
+	for (uint32_t i = 0; i < SHADOWMAPS_CASCADES; ++i)
+	{
+		m_ShadowCascadePasses[i] = m_RenderGraph.AddPass("shadow cascade " + std::to_string(i), RGPassType::Graphics, [&](RenderGraphBuilder& builder)
+			{
+				builder.WriteDepth(m_ShadowTargets[i]);
+			},
+			[this, i](VkCommandBuffer cmd)
+			{
+				m_ShadowMaps.DrawDynamic(cmd, GetFrameIndex(), i);
+			});
+	}
 
-		framebufferInfo.attachmentCount = 2;
-		framebufferInfo.pAttachments = &attachments[0];
+	// bins the frame's lights into the cluster grid the forward pass shades from
+	m_LightGrid = m_RenderGraph.ImportBuffer("light grid", VK_NULL_HANDLE);
+	m_LightIndices = m_RenderGraph.ImportBuffer("light indices", VK_NULL_HANDLE);
+	m_LightCullPass = m_RenderGraph.AddPass("light culling", RGPassType::Compute, [&](RenderGraphBuilder& builder)
+		{
+			builder.WriteBuffer(m_LightGrid, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+			// the append counter is cleared with a transfer first
+			builder.WriteBuffer(m_LightIndices, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+		},
+		[this](VkCommandBuffer cmd)
+		{
+			m_ClusteredLights.Cull(cmd, GetCurrentFrame().cameraDescriptor, GetFrameIndex());
+		});
 
+	m_ForwardPass = m_RenderGraph.AddPass("forward", RGPassType::Graphics, [&](RenderGraphBuilder& builder)
+		{
+			RGImageDesc depthDesc{ m_DepthFormat, m_WindowExtent };
+			m_DepthTarget = builder.CreateImage("depth", depthDesc);
+			// dynamic resolution renders into the top left corner of a window sized target
+			if (m_DynamicResolution.IsEnabled())
+			{
+				m_SceneColor = builder.CreateImage("scene color", RGImageDesc{ m_SwapchainImageFormat, m_WindowExtent });
+			}
 
-		VKCHECK(vkCreateFramebuffer(m_Device, &framebufferInfo, nullptr, &m_Framebuffers[i]));
-		m_DeletionQueue.PushFunction([=]
+			builder.WriteColor(m_SceneColor != RG_INVALID ? m_SceneColor : m_SwapchainTarget, { {0.0f, 1, 1, 1.0f} });
+			builder.WriteDepth(m_DepthTarget, 1.0f);
+			builder.ReadBuffer(m_LightGrid, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+			builder.ReadBuffer(m_LightIndices, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+			for (RGResource shadowMap : m_ShadowTargets)
+			{
+				builder.ReadTexture(shadowMap);
+			}
+		},
+		[this](VkCommandBuffer cmd)
+		{
+			DrawObjects(cmd, m_ViewProjection, m_CameraPosition);
+		});
+
+	if (m_SceneColor != RG_INVALID)
+	{
+		// filtered blit of the rendered corner to the whole output, the hud is drawn afterwards at full resolution
+		m_UpscalePass = m_RenderGraph.AddPass("upscale", RGPassType::Transfer, [&](RenderGraphBuilder& builder)
+			{
+				builder.ReadTransfer(m_SceneColor);
+				builder.WriteTransfer(m_SwapchainTarget);
+			},
+			[this](VkCommandBuffer cmd)
+			{
+				VkImageBlit blit{};
+				blit.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+				blit.srcOffsets[1] = { static_cast<int32_t>(m_RenderExtent.width), static_cast<int32_t>(m_RenderExtent.height), 1 };
+				blit.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+				blit.dstOffsets[1] = { static_cast<int32_t>(m_WindowExtent.width), static_cast<int32_t>(m_WindowExtent.height), 1 };
+				vkCmdBlitImage(cmd, m_RenderGraph.GetImage(m_SceneColor), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+					m_RenderGraph.GetImage(m_SwapchainTarget), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+			});
+	}
+
+	if (!m_Config.headless)
+	{
+		m_ImguiPass = m_RenderGraph.AddPass("imgui", RGPassType::Graphics, [&](RenderGraphBuilder& builder)
+			{
+				builder.WriteColor(m_SwapchainTarget);
+			},
+			[](VkCommandBuffer cmd)
 			{
-				vkDestroyFramebuffer(m_Device, m_Framebuffers[i], nullptr);
+				ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
 			});
 	}
+
+	m_RenderGraph.Compile();
+	if (!m_Config.graphDumpPath.empty())
+	{
+		std::ofstream file(m_Config.graphDumpPath);
+		if (file.is_open())
+		{
+			file << m_RenderGraph.Dump();
+			std::cout << "wrote the render graph to " << m_Config.graphDumpPath << std::endl;
+		}
+		else
+		{
+			std::cout << "failed to open " << m_Config.graphDumpPath << std::endl;
+		}
+	}
+
 	m_DeletionQueue.PushFunction([=]
 		{
-			vkDestroyImageView(m_Device, m_DepthImageView, nullptr);
-			vmaDestroyImage(m_Allocator, m_DepthImage.image, m_DepthImage.allocation);
+			m_RenderGraph.Destroy();
 		});
-
 }
 
 void VulkanEngine::InitSyncStructures()
 {
-	VkFenceCreateInfo fenceCreateInfo{};
-	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceCreateInfo.pNext = nullptr;
-
-	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
+	PROFILE_FUNCTION();
 	VkSemaphoreCreateInfo semaphoreCreateInfo{};
 	semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 	semaphoreCreateInfo.pNext = nullptr;
 
 	semaphoreCreateInfo.flags = 0;
-	for (size_t i = 0; i < FRAMESINFLIGHT; ++i)
+	for (size_t i = 0; i < m_Frames.size(); ++i)
 	{
-		VKCHECK(vkCreateFence(m_Device, &fenceCreateInfo, nullptr, &m_Frames[i].renderFence));
-
 		VKCHECK(vkCreateSemaphore(m_Device, &semaphoreCreateInfo, nullptr, &m_Frames[i].presentSmeraphore));
 		VKCHECK(vkCreateSemaphore(m_Device, &semaphoreCreateInfo, nullptr, &m_Frames[i].renderSemaphore));
 
 		m_DeletionQueue.PushFunction([=]
 			{
-				vkDestroyFence(m_Device, m_Frames[i].renderFence, nullptr);
 				vkDestroySemaphore(m_Device, m_Frames[i].presentSmeraphore, nullptr);
 				vkDestroySemaphore(m_Device, m_Frames[i].renderSemaphore, nullptr);
 			});
 	}
-	VkFenceCreateInfo uploadFenceCreateInfo{};
-	uploadFenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	uploadFenceCreateInfo.pNext = nullptr;
 
-	VKCHECK(vkCreateFence(m_Device, &uploadFenceCreateInfo, nullptr, &m_UploadContext.uploadFence));
+	m_GraphicsTimeline = CreateTimelineSemaphore();
+	m_TransferTimeline = CreateTimelineSemaphore();
 	m_DeletionQueue.PushFunction([=]
 		{
-			vkDestroyFence(m_Device, m_UploadContext.uploadFence, nullptr);
+			vkDestroySemaphore(m_Device, m_GraphicsTimeline, nullptr);
+			vkDestroySemaphore(m_Device, m_TransferTimeline, nullptr);
 		});
 }
 
+VkSemaphore VulkanEngine::CreateTimelineSemaphore()
+{
+	VkSemaphoreTypeCreateInfoKHR typeInfo{};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+	typeInfo.pNext = nullptr;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+	typeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &typeInfo;
+	semaphoreInfo.flags = 0;
+
+	VkSemaphore semaphore;
+	VKCHECK(vkCreateSemaphore(m_Device, &semaphoreInfo, nullptr, &semaphore));
+	return semaphore;
+}
+
+VkResult VulkanEngine::WaitTimeline(VkSemaphore semaphore, uint64_t value, uint64_t timeout) const
+{
+	VkSemaphoreWaitInfoKHR waitInfo{};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+	waitInfo.pNext = nullptr;
+	waitInfo.flags = 0;
+	waitInfo.semaphoreCount = 1;
+	waitInfo.pSemaphores = &semaphore;
+	waitInfo.pValues = &value;
+	return m_WaitSemaphores(m_Device, &waitInfo, timeout);
+}
+
+void VulkanEngine::RetireCompleted()
+{
+	const auto retire = [this](std::deque<RetiredObject>& retired, VkSemaphore timeline)
+	{
+		if (retired.empty())
+		{
+			return;
+		}
+
+		uint64_t completed = 0;
+		m_GetSemaphoreCounterValue(m_Device, timeline, &completed);
+		while (!retired.empty() && retired.front().value <= completed)
+		{
+			retired.front().func();
+			retired.pop_front();
+		}
+	};
+	retire(m_RetiredUploads, m_TransferTimeline);
+	retire(m_RetiredFrames, m_GraphicsTimeline);
+}
+
+void VulkanEngine::RetireAfterFrames(std::function<void()>&& func)
+{
+	m_RetiredFrames.push_back({ m_GraphicsValue, std::move(func) });
+}
+
+void VulkanEngine::RetireAfterUpload(uint64_t value, std::function<void()>&& func)
+{
+	m_RetiredUploads.push_back({ value, std::move(func) });
+}
+
 void VulkanEngine::InitDescriptorSetLayout()
 {
+	PROFILE_FUNCTION();
 	std::vector<VkDescriptorPoolSize> sizes
 	{
-		{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 10},
-		{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 10}
+		// camera and shadow data per frame
+		{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 10 + 2 * MAXFRAMESINFLIGHT},
+		// object, feedback and the three light buffers per frame
+		{VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 10 + 5 * MAXFRAMESINFLIGHT},
+		// texture and shadow maps per frame
+		{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 10 + (1 + SHADOWMAPS_CASCADES) * MAXFRAMESINFLIGHT}
 	};
 
 	VkDescriptorPoolCreateInfo poolInfo{};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.pNext = nullptr;
 	poolInfo.flags = 0;
-	poolInfo.maxSets = 10;
+	// camera and object set per frame, the rest for one-off sets
+	poolInfo.maxSets = 10 + 2 * MAXFRAMESINFLIGHT;
 	poolInfo.poolSizeCount = sizes.size();
 	poolInfo.pPoolSizes = sizes.data();
 
@@ -620,20 +1325,71 @@ void VulkanEngine::InitDescriptorSetLayout()
 	ImageBuffer.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	ImageBuffer.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-	const std::array<VkDescriptorSetLayoutBinding, 2> bindings = { camBufferBinding, ImageBuffer };
+	// the fragment shader reports the lod it sampled streamed textures at
+	VkDescriptorSetLayoutBinding feedbackBinding{};
+	feedbackBinding.binding = 2;
+	feedbackBinding.descriptorCount = 1;
+
+	feedbackBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	feedbackBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	// lights, cluster grid and light indices, written by the culling compute pass and read by the fragment shader
+	std::array<VkDescriptorSetLayoutBinding, 3> lightBindings{};
+	for (uint32_t i = 0; i < lightBindings.size(); ++i)
+	{
+		lightBindings[i].binding = 3 + i;
+		lightBindings[i].descriptorCount = 1;
+		lightBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		lightBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	}
+
+	// one shadow map per cascade and the cascade matrices
+	VkDescriptorSetLayoutBinding shadowMapBinding{};
+	shadowMapBinding.binding = 6;
+	shadowMapBinding.descriptorCount = SHADOWMAPS_CASCADES;
+	shadowMapBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	shadowMapBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutBinding shadowDataBinding{};
+	shadowDataBinding.binding = 7;
+	shadowDataBinding.descriptorCount = 1;
+	shadowDataBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	shadowDataBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	const std::array<VkDescriptorSetLayoutBinding, 8> bindings = { camBufferBinding, ImageBuffer, feedbackBinding, lightBindings[0], lightBindings[1], lightBindings[2],
+		shadowMapBinding, shadowDataBinding };
 	VkDescriptorSetLayoutCreateInfo setInfo{};
 	setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 	setInfo.pNext = nullptr;
 
-	setInfo.bindingCount = 2;
+	setInfo.bindingCount = static_cast<uint32_t>(bindings.size());
 	setInfo.pBindings = bindings.data();
 	setInfo.flags = 0;
 
 	vkCreateDescriptorSetLayout(m_Device, &setInfo, nullptr, &m_GlobalSetlayout);
 
-	for (size_t i = 0; i < FRAMESINFLIGHT; ++i)
+	VkDescriptorSetLayoutBinding objectBufferBinding{};
+	objectBufferBinding.binding = 0;
+	objectBufferBinding.descriptorCount = 1;
+
+	objectBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	objectBufferBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+	VkDescriptorSetLayoutCreateInfo objectSetInfo{};
+	objectSetInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	objectSetInfo.pNext = nullptr;
+
+	objectSetInfo.bindingCount = 1;
+	objectSetInfo.pBindings = &objectBufferBinding;
+	objectSetInfo.flags = 0;
+
+	vkCreateDescriptorSetLayout(m_Device, &objectSetInfo, nullptr, &m_ObjectSetLayout);
+
+	for (size_t i = 0; i < m_Frames.size(); ++i)
 	{
-		m_Frames[i].cameraBuffer = CreateBuffer(sizeof(GPUCameraData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+		m_Frames[i].cameraBuffer = CreateBuffer(sizeof(GPUCameraData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, MemoryCategory::PerFrame);
+		m_Frames[i].indirectBuffer = CreateBuffer(MAXINDIRECTCOMMANDS * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, MemoryCategory::PerFrame);
+		m_Frames[i].objectBuffer = CreateBuffer(MAXOBJECTS * sizeof(GPUObjectData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU, MemoryCategory::PerFrame);
 
 		VkDescriptorSetAllocateInfo allocInfo{};
 		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
@@ -662,42 +1418,397 @@ void VulkanEngine::InitDescriptorSetLayout()
 		writeInfo.pBufferInfo = &bufferInfo;
 
 		vkUpdateDescriptorSets(m_Device, 1, &writeInfo, 0, nullptr);
+
+		allocInfo.pSetLayouts = &m_ObjectSetLayout;
+		vkAllocateDescriptorSets(m_Device, &allocInfo, &m_Frames[i].objectDescriptor);
+
+		VkDescriptorBufferInfo objectBufferInfo{};
+		objectBufferInfo.buffer = m_Frames[i].objectBuffer.buffer;
+		objectBufferInfo.offset = 0;
+		objectBufferInfo.range = MAXOBJECTS * sizeof(GPUObjectData);
+
+		VkWriteDescriptorSet objectWrite{};
+		objectWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		objectWrite.pNext = nullptr;
+
+		objectWrite.dstBinding = 0;
+		objectWrite.dstSet = m_Frames[i].objectDescriptor;
+
+		objectWrite.descriptorCount = 1;
+		objectWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		objectWrite.pBufferInfo = &objectBufferInfo;
+
+		vkUpdateDescriptorSets(m_Device, 1, &objectWrite, 0, nullptr);
 	}
 
-	for (size_t i = 0; i < FRAMESINFLIGHT; ++i)
+	for (size_t i = 0; i < m_Frames.size(); ++i)
 	{
 		m_DeletionQueue.PushFunction([=]
 			{
 				vmaDestroyBuffer(m_Allocator, m_Frames[i].cameraBuffer.buffer, m_Frames[i].cameraBuffer.allocation);
+				vmaDestroyBuffer(m_Allocator, m_Frames[i].indirectBuffer.buffer, m_Frames[i].indirectBuffer.allocation);
+				vmaDestroyBuffer(m_Allocator, m_Frames[i].objectBuffer.buffer, m_Frames[i].objectBuffer.allocation);
 			});
 	}
 	m_DeletionQueue.PushFunction([=]
 		{
 			vkDestroyDescriptorSetLayout(m_Device, m_GlobalSetlayout, nullptr);
+			vkDestroyDescriptorSetLayout(m_Device, m_ObjectSetLayout, nullptr);
 			vkDestroyDescriptorPool(m_Device, m_DescriptorPool, nullptr);
 		});
 }
 
+void VulkanEngine::InitLights()
+{
+	PROFILE_FUNCTION();
+	m_ClusteredLights.Init(*this, m_GlobalSetlayout);
+	m_DeletionQueue.PushFunction([=]
+		{
+			m_ClusteredLights.Cleanup();
+		});
+
+	for (size_t i = 0; i < m_Frames.size(); ++i)
+	{
+		const uint32_t frameIndex = static_cast<uint32_t>(i);
+		const std::array<VkDescriptorBufferInfo, 3> bufferInfos = { {
+			{ m_ClusteredLights.GetLightBuffer(frameIndex), 0, ClusteredLights::GetLightBufferSize() },
+			{ m_ClusteredLights.GetGridBuffer(frameIndex), 0, ClusteredLights::GetGridBufferSize() },
+			{ m_ClusteredLights.GetIndexBuffer(frameIndex), 0, ClusteredLights::GetIndexBufferSize() } } };
+
+		std::array<VkWriteDescriptorSet, 3> writes{};
+		for (uint32_t binding = 0; binding < writes.size(); ++binding)
+		{
+			writes[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			writes[binding].pNext = nullptr;
+			writes[binding].dstBinding = 3 + binding;
+			writes[binding].dstSet = m_Frames[i].cameraDescriptor;
+			writes[binding].descriptorCount = 1;
+			writes[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			writes[binding].pBufferInfo = &bufferInfos[binding];
+		}
+		vkUpdateDescriptorSets(m_Device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+}
+
+void VulkanEngine::InitShadows()
+{
+	PROFILE_FUNCTION();
+	m_ShadowMaps.Init(*this, m_ObjectSetLayout);
+	m_DeletionQueue.PushFunction([=]
+		{
+			m_ShadowMaps.Cleanup();
+		});
+
+	for (uint32_t i = 0; i < SHADOWMAPS_CASCADES; ++i)
+	{
+		m_RenderGraph.SetImportedImage(m_ShadowCaches[i], m_ShadowMaps.GetCacheImage(i), m_ShadowMaps.GetCacheView(i));
+		m_RenderGraph.SetImportedImage(m_ShadowTargets[i], m_ShadowMaps.GetShadowImage(i), m_ShadowMaps.GetShadowView(i));
+	}
+
+	std::array<VkDescriptorImageInfo, SHADOWMAPS_CASCADES> shadowMapInfos;
+	for (uint32_t i = 0; i < SHADOWMAPS_CASCADES; ++i)
+	{
+		shadowMapInfos[i].sampler = m_ShadowMaps.GetSampler();
+		shadowMapInfos[i].imageView = m_ShadowMaps.GetShadowView(i);
+		shadowMapInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	}
+	for (size_t i = 0; i < m_Frames.size(); ++i)
+	{
+		VkWriteDescriptorSet shadowMapWrite = vkinit::WriteDescriptorSet(m_Frames[i].cameraDescriptor, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6, shadowMapInfos.data());
+		shadowMapWrite.descriptorCount = SHADOWMAPS_CASCADES;
+
+		VkDescriptorBufferInfo shadowDataInfo{ m_ShadowMaps.GetShadowDataBuffer(static_cast<uint32_t>(i)), 0, sizeof(GPUShadowData) };
+		VkWriteDescriptorSet shadowDataWrite{};
+		shadowDataWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		shadowDataWrite.pNext = nullptr;
+		shadowDataWrite.dstBinding = 7;
+		shadowDataWrite.dstSet = m_Frames[i].cameraDescriptor;
+		shadowDataWrite.descriptorCount = 1;
+		shadowDataWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		shadowDataWrite.pBufferInfo = &shadowDataInfo;
+
+		const std::array<VkWriteDescriptorSet, 2> writes = { shadowMapWrite, shadowDataWrite };
+		vkUpdateDescriptorSets(m_Device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+}
+
+bool VulkanEngine::GetSceneBounds(glm::vec3& outMin, glm::vec3& outMax) const
+{
+	const Mesh* scene = m_Registry.Get(m_Monke);
+	if (!scene || scene->vertices.empty())
+	{
+		return false;
+	}
+	// the scene turns about the up axis through the origin, the box holds it at every angle
+	float radius = 0.f;
+	float minY = std::numeric_limits<float>::max();
+	float maxY = std::numeric_limits<float>::lowest();
+	for (const Vertex& vertex : scene->vertices)
+	{
+		radius = std::max(radius, vertex.position.x * vertex.position.x + vertex.position.z * vertex.position.z);
+		minY = std::min(minY, vertex.position.y);
+		maxY = std::max(maxY, vertex.position.y);
+	}
+	radius = std::sqrt(radius);
+	outMin = glm::vec3(-radius, minY, -radius);
+	outMax = glm::vec3(radius, maxY, radius);
+	return true;
+}
+
+bool VulkanEngine::PickScene(float x, float y, RayHit& outHit) const
+{
+	PROFILE_FUNCTION();
+	outHit = RayHit{};
+	if (m_SceneBvh.IsEmpty() || m_WindowExtent.width == 0 || m_WindowExtent.height == 0)
+	{
+		return false;
+	}
+
+	// the projection flips y, so window and clip space y both point down. two depths on the pixel's line give the ray
+	const glm::vec2 ndc(x / m_WindowExtent.width * 2.f - 1.f, y / m_WindowExtent.height * 2.f - 1.f);
+	const glm::mat4 inverseViewProjection = glm::inverse(m_ViewProjection);
+	const glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc, 0.f, 1.f);
+	const glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc, 1.f, 1.f);
+	const glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+	const glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+
+	// the bvh is in mesh space, the scene transform is a rotation so distances along the ray are the same in both
+	const glm::mat4 toScene = glm::inverse(m_SceneTransform);
+	const glm::vec3 sceneOrigin = glm::vec3(toScene * glm::vec4(origin, 1.f));
+	const glm::vec3 sceneDirection = glm::mat3(toScene) * direction;
+	return m_SceneBvh.Intersect({ sceneOrigin, std::numeric_limits<float>::max(), sceneDirection }, outHit);
+}
+
 void VulkanEngine::LoadMeshes()
 {
-	m_TriMesh.vertices.resize(3);
+	PROFILE_FUNCTION();
+	m_GeometryPool.Init(*this, 2 * 1024 * 1024, 8 * 1024 * 1024);
+	m_DeletionQueue.PushFunction([=]
+		{
+			m_GeometryPool.Cleanup();
+		});
+
+	Mesh triMesh;
+	triMesh.vertices.resize(3);
+
+	triMesh.vertices[0].position = { -0.5f, -0.5f, 0.0f };
+	triMesh.vertices[1].position = { 0.5f, -0.5f, 0.0f };
+	triMesh.vertices[2].position = { 0.0f, 0.5f, 0.0f };
+
+	triMesh.vertices[0].color = { 1.0f, 0.0f, 0.0f };
+	triMesh.vertices[1].color = { 0.0f, 1.0f, 0.0f };
+	triMesh.vertices[2].color = { 0.0f, 0.0f, 1.0f };
+
+	triMesh.indices = { 0, 1, 2 };
+
+	Mesh sceneMesh;
+	sceneMesh.LoadFromObj(m_FileSystem, m_Config.meshPath.c_str(), m_Config.objImporter);
+
+	vkutil::BuildMeshlets(triMesh);
+	vkutil::BuildMeshlets(sceneMesh);
+
+	// the geometry pool keeps a pointer to the mesh, so upload from its place in the registry
+	m_TriMesh = m_Registry.GetMeshes().Create(std::move(triMesh));
+	m_Monke = m_Registry.GetMeshes().Create(std::move(sceneMesh));
+	// a mesh that does not fit is released, its objects are skipped like those of any released mesh
+	if (!UploadMesh(*m_Registry.Get(m_TriMesh)))
+	{
+		m_Registry.GetMeshes().Release(m_TriMesh);
+	}
+	if (!UploadMesh(*m_Registry.Get(m_Monke)))
+	{
+		std::cout << "drawing without the scene mesh" << std::endl;
+		m_Registry.GetMeshes().Release(m_Monke);
+	}
+
+}
+
+void VulkanEngine::InitScene()
+{
+	PROFILE_FUNCTION();
+	AddSceneObjects();
+
+	// the lights wander through the scene mesh's bounds, which the sun's shadows also have to cover
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	if (GetSceneBounds(boundsMin, boundsMax))
+	{
+		m_ClusteredLights.Scatter(m_Config.lightCount, boundsMin, boundsMax);
+		m_ShadowMaps.SetSceneBounds(boundsMin, boundsMax);
+	}
+	// picking follows the mouse, headless runs have none
+	if (const Mesh* scene = m_Registry.Get(m_Monke); scene && !m_Config.headless)
+	{
+		m_SceneBvh.Build(*scene);
+	}
+
+	// a field of identical props, drawn as a single instanced group
+	for (int x = -20; x <= 20; x++)
+	{
+		for (int y = -20; y <= 20; y++)
+		{
+			RenderObject tri;
+			tri.mesh = m_TriMesh;
+			tri.material = GetMaterial("defaultmesh");
+			glm::mat4 translation = glm::translate(glm::mat4(1.f), glm::vec3(x, 0, y));
+			glm::mat4 scale = glm::scale(glm::mat4(1.f), glm::vec3(0.2f, 0.2f, 0.2f));
+			tri.transformMatrix = translation * scale;
+			tri.dynamic = true;
+			m_Renderables.push_back(tri);
+		}
+	}
+
+	std::vector<glm::mat4> bodies;
+	for (const RenderObject& object : m_Renderables)
+	{
+		if (object.dynamic && object.mesh != m_Monke)
+		{
+			bodies.push_back(object.transformMatrix);
+		}
+	}
+	// headless runs tick once per frame, at the rate their fixed timestep implies
+	m_Simulation.Init(m_CameraPath, bodies, m_Config.headless ? 1.f / m_Config.timestep : m_Config.simulationRate);
+}
+
+bool VulkanEngine::ReplaceSceneMesh(Mesh&& mesh)
+{
+	PROFILE_FUNCTION();
+	// the old mesh's ranges stay allocated until the frames drawing it retired, the pool needs room for both
+	const MeshHandle replacement = m_Registry.GetMeshes().Create(std::move(mesh));
+	if (!m_GeometryPool.Upload(*m_Registry.Get(replacement)))
+	{
+		std::cout << "keeping the current scene mesh" << std::endl;
+		m_Registry.GetMeshes().Release(replacement);
+		return false;
+	}
+
+	const MeshHandle retired = m_Monke;
+	m_Renderables.erase(std::remove_if(m_Renderables.begin(), m_Renderables.end(), [&](const RenderObject& object) { return object.mesh == retired; }),
+		m_Renderables.end());
+	m_Registry.GetMeshes().Release(retired);
+	m_Monke = replacement;
+	AddSceneObjects();
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	if (GetSceneBounds(boundsMin, boundsMax))
+	{
+		m_ShadowMaps.SetSceneBounds(boundsMin, boundsMax);
+	}
+	if (!m_SceneBvh.IsEmpty())
+	{
+		m_SceneBvh.Build(*m_Registry.Get(m_Monke));
+	}
+	std::cout << "replaced the scene mesh" << std::endl;
+	return true;
+}
+
+void VulkanEngine::AddSceneObjects()
+{
+	// one object per run of sections that share an engine material, the importer sorted them by render state.
+	// the scene turns, so it is a dynamic caster and the static shadow caches stay valid while it does
+	const Mesh* scene = m_Registry.Get(m_Monke);
+	if (!scene)
+	{
+		return;
+	}
+	const uint32_t sectionCount = static_cast<uint32_t>(scene->sections.size());
+	uint32_t firstSection = 0;
+	while (firstSection < sectionCount)
+	{
+		const MaterialHandle material = GetMaterialFor(scene->materials[scene->sections[firstSection].material]);
+		uint32_t endSection = firstSection + 1;
+		while (endSection < sectionCount && GetMaterialFor(scene->materials[scene->sections[endSection].material]) == material)
+		{
+			endSection++;
+		}
+
+		RenderObject batch;
+		batch.mesh = m_Monke;
+		batch.material = material;
+		batch.transformMatrix = m_SceneTransform;
+		batch.firstSection = firstSection;
+		batch.sectionCount = endSection - firstSection;
+		batch.dynamic = true;
+		m_Renderables.push_back(batch);
+		firstSection = endSection;
+	}
+	if (sectionCount == 0)
+	{
+		RenderObject empire;
+		empire.mesh = m_Monke;
+		empire.material = GetMaterial("defaultmesh");
+		empire.transformMatrix = m_SceneTransform;
+		empire.dynamic = true;
+		m_Renderables.push_back(empire);
+	}
+}
+
+void VulkanEngine::SetSceneTransform(const glm::mat4& transform)
+{
+	if (transform == m_SceneTransform)
+	{
+		return;
+	}
+	m_SceneTransform = transform;
+	for (RenderObject& object : m_Renderables)
+	{
+		if (object.mesh == m_Monke)
+		{
+			object.transformMatrix = transform;
+		}
+	}
+}
 
-	m_TriMesh.vertices[0].position = { -0.5f, -0.5f, 0.0f };
-	m_TriMesh.vertices[1].position = { 0.5f, -0.5f, 0.0f };
-	m_TriMesh.vertices[2].position = { 0.0f, 0.5f, 0.0f };
+MaterialHandle VulkanEngine::CreateMaterial(VkPipeline pipeline, VkPipelineLayout layout, const std::string& name)
+{
+	Material material;
+	material.pipeline = pipeline;
+	material.pipelineLayout = layout;
 
-	m_TriMesh.vertices[0].color = { 1.0f, 0.0f, 0.0f };
-	m_TriMesh.vertices[1].color = { 0.0f, 1.0f, 0.0f };
-	m_TriMesh.vertices[2].color = { 0.0f, 0.0f, 1.0f };
+	// a material registered again under the same name drops the name's reference to the old one
+	auto it = m_MaterialNames.find(name);
+	if (it != m_MaterialNames.end())
+	{
+		m_Registry.GetMaterials().Release(it->second);
+	}
+	const MaterialHandle handle = m_Registry.GetMaterials().Create(std::move(material));
+	m_MaterialNames[name] = handle;
+	return handle;
+}
 
-	m_Monke.LoadFromObj("../../assets/lost_empire.obj");
+MaterialHandle VulkanEngine::GetMaterialFor(const MeshMaterial& material) const
+{
+	// every lost empire material samples the same atlas, only the alpha test needs its own pipeline
+	return material.alphaTested ? m_AlphaTestedMaterial : m_DefaultMaterial;
+}
 
-	UploadMesh(m_TriMesh);
-	UploadMesh(m_Monke);
+MaterialHandle VulkanEngine::GetMaterial(const std::string& name) const
+{
+	auto it = m_MaterialNames.find(name);
+	if (it == m_MaterialNames.end())
+	{
+		return {};
+	}
+	return it->second;
+}
 
+VkDeviceSize VulkanEngine::CalculateGpuMemoryUsage() const
+{
+	VmaStats stats;
+	vmaCalculateStats(m_Allocator, &stats);
+	return stats.total.usedBytes;
 }
 
-AllocatedBuffer VulkanEngine::CreateBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage)
+AllocatedBuffer VulkanEngine::CreateStagingBuffer(size_t allocSize)
+{
+	m_StagingStats.uploads++;
+	m_StagingStats.totalBytes += allocSize;
+	m_StagingStats.frameBytes += allocSize;
+	m_StagingStats.largestBytes = std::max<VkDeviceSize>(m_StagingStats.largestBytes, allocSize);
+	return CreateBuffer(allocSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY, MemoryCategory::Staging);
+}
+
+AllocatedBuffer VulkanEngine::CreateBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, MemoryCategory category)
 {
 	VkBufferCreateInfo bufferInfo{};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -706,170 +1817,561 @@ AllocatedBuffer VulkanEngine::CreateBuffer(size_t allocSize, VkBufferUsageFlags
 	bufferInfo.size = allocSize;
 	bufferInfo.usage = usage;
 
-	VmaAllocationCreateInfo allocInfo{};
-	allocInfo.usage = memoryUsage;
-
 	AllocatedBuffer newBuffer;
 
-	VKCHECK(vmaCreateBuffer(m_Allocator, &bufferInfo, &allocInfo, &newBuffer.buffer, &newBuffer.allocation, nullptr));
+	VKCHECK(m_MemoryManager.CreateBuffer(bufferInfo, memoryUsage, category, newBuffer));
 
 	return newBuffer;
 }
 
-void VulkanEngine::UploadMesh(Mesh& mesh)
+bool VulkanEngine::UploadMesh(Mesh& mesh)
 {
-	const size_t bufferSize = mesh.vertices.size() * sizeof(Vertex);
-
-	VkBufferCreateInfo stagingBufferInfo{};
-	stagingBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	stagingBufferInfo.pNext = nullptr;
+	return m_GeometryPool.Upload(mesh);
+}
 
-	stagingBufferInfo.size = bufferSize;
-	stagingBufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+void VulkanEngine::UnloadMesh(Mesh& mesh)
+{
+	m_GeometryPool.Free(mesh);
+}
 
-	VmaAllocationCreateInfo vmaallocInfo{};
-	vmaallocInfo.usage = VMA_MEMORY_USAGE_CPU_ONLY;
+void VulkanEngine::DrawObjects(VkCommandBuffer cmd, const glm::mat4& viewProjection, const glm::vec3& cameraPosition)
+{
+	PROFILE_FUNCTION();
+	struct DrawBatch
+	{
+		const Material* material;
+		uint32_t firstCommand;
+		uint32_t commandCount;
+	};
 
-	AllocatedBuffer stagingBuffer;
+	m_MeshletStats = {};
+	m_FrameStats = {};
+	const uint32_t objectCount = static_cast<uint32_t>(std::min<size_t>(m_Renderables.size(), MAXOBJECTS));
+	m_FrameStats.objects = objectCount;
 
-	VKCHECK(vmaCreateBuffer(m_Allocator, &stagingBufferInfo, &vmaallocInfo, &stagingBuffer.buffer, &stagingBuffer.allocation, nullptr));
+	// copies of the same mesh and material end up next to each other, each run becomes one instanced draw
+	m_DrawOrder.resize(objectCount);
+	for (uint32_t i = 0; i < objectCount; ++i)
+	{
+		m_DrawOrder[i] = i;
+	}
+	std::sort(m_DrawOrder.begin(), m_DrawOrder.end(), [this](uint32_t a, uint32_t b)
+		{
+			const RenderObject& lhs = m_Renderables[a];
+			const RenderObject& rhs = m_Renderables[b];
+			if (lhs.material != rhs.material)
+			{
+				return lhs.material < rhs.material;
+			}
+			if (lhs.mesh != rhs.mesh)
+			{
+				return lhs.mesh < rhs.mesh;
+			}
+			if (lhs.firstSection != rhs.firstSection)
+			{
+				return lhs.firstSection < rhs.firstSection;
+			}
+			return a < b;
+		});
 
-	void* data;
-	vmaMapMemory(m_Allocator, stagingBuffer.allocation, &data);
-	memcpy(data, mesh.vertices.data(), sizeof(Vertex) * mesh.vertices.size());
-	vmaUnmapMemory(m_Allocator, stagingBuffer.allocation);
+	void* objectData;
+	vmaMapMemory(m_Allocator, GetCurrentFrame().objectBuffer.allocation, &objectData);
+	GPUObjectData* objects = static_cast<GPUObjectData*>(objectData);
 
+	void* indirectData;
+	vmaMapMemory(m_Allocator, GetCurrentFrame().indirectBuffer.allocation, &indirectData);
+	VkDrawIndexedIndirectCommand* commands = static_cast<VkDrawIndexedIndirectCommand*>(indirectData);
 
-	VkBufferCreateInfo vertexBufferInfo{};
-	vertexBufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	vertexBufferInfo.pNext = nullptr;
+	FrameVector<DrawBatch> batches(GetFrameAllocator());
+	uint32_t commandCount = 0;
+	uint32_t groupStart = 0;
+	while (groupStart < objectCount && commandCount < MAXINDIRECTCOMMANDS)
+	{
+		const RenderObject& first = m_Renderables[m_DrawOrder[groupStart]];
 
-	vertexBufferInfo.size = bufferSize;
-	vertexBufferInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		// the shader reads objects[gl_InstanceIndex], so a group's transforms are laid out back to back.
+		// sectioned objects cull their chunks with their own transform, each one is a group of its own
+		uint32_t groupEnd = groupStart;
+		while (groupEnd < objectCount)
+		{
+			const RenderObject& object = m_Renderables[m_DrawOrder[groupEnd]];
+			if (object.mesh != first.mesh || object.material != first.material || object.firstSection != first.firstSection || object.sectionCount != first.sectionCount
+				|| (first.sectionCount > 0 && groupEnd > groupStart))
+			{
+				break;
+			}
+			objects[groupEnd].modelMatrix = object.transformMatrix;
+			groupEnd++;
+		}
+		const uint32_t instanceCount = groupEnd - groupStart;
 
-	vmaallocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+		// objects whose mesh or material was released are skipped until they are removed
+		const Mesh* groupMesh = m_Registry.Get(first.mesh);
+		const Material* material = m_Registry.Get(first.material);
+		if (!groupMesh || !material)
+		{
+			groupStart = groupEnd;
+			continue;
+		}
+		const Mesh& mesh = *groupMesh;
 
-	VKCHECK(vmaCreateBuffer(m_Allocator, &vertexBufferInfo, &vmaallocInfo, &mesh.vertexBuffer.buffer, &mesh.vertexBuffer.allocation, nullptr));
+		if (batches.empty() || batches.back().material != material)
+		{
+			batches.push_back({ material, commandCount, 0 });
+		}
 
-	ImmediateSubmit([=](VkCommandBuffer cmd)
+		// chunks and clusters are culled per object, a group of several copies draws the whole mesh once for every copy
+		if (first.sectionCount > 0)
 		{
-			VkBufferCopy copy;
-			copy.dstOffset = 0;
-			copy.srcOffset = 0;
-			copy.size = bufferSize;
-			vkCmdCopyBuffer(cmd, stagingBuffer.buffer, mesh.vertexBuffer.buffer, 1, &copy);
-		});
-	m_DeletionQueue.PushFunction([=]
+			commandCount = AppendSectionDraws(mesh, first, viewProjection, cameraPosition, groupStart, commands, commandCount);
+		}
+		else if (instanceCount == 1 && m_MeshletCulling)
 		{
-			vmaDestroyBuffer(m_Allocator, mesh.vertexBuffer.buffer, mesh.vertexBuffer.allocation);
-		});
-	vmaDestroyBuffer(m_Allocator, stagingBuffer.buffer, stagingBuffer.allocation);
+			commandCount = AppendMeshletDraws(mesh, 0, static_cast<uint32_t>(mesh.meshlets.size()), first.transformMatrix, viewProjection, cameraPosition, groupStart, commands, commandCount);
+		}
+		else if (!mesh.indices.empty())
+		{
+			VkDrawIndexedIndirectCommand command;
+			command.indexCount = static_cast<uint32_t>(mesh.indices.size());
+			command.instanceCount = instanceCount;
+			command.firstIndex = mesh.indexAllocation.offset;
+			command.vertexOffset = static_cast<int32_t>(mesh.vertexAllocation.offset);
+			command.firstInstance = groupStart;
+			commands[commandCount++] = command;
+
+			m_MeshletStats.visibleTriangles += command.indexCount / 3 * instanceCount;
+		}
+
+		batches.back().commandCount = commandCount - batches.back().firstCommand;
+		groupStart = groupEnd;
+	}
+	// objects that found the buffer full
+	m_MeshletStats.droppedDraws += objectCount - groupStart;
+
+	vmaUnmapMemory(m_Allocator, GetCurrentFrame().indirectBuffer.allocation);
+	vmaUnmapMemory(m_Allocator, GetCurrentFrame().objectBuffer.allocation);
+	m_MeshletStats.drawCommands = commandCount;
+	m_FrameStats.drawCommands = commandCount;
+	m_FrameStats.triangles = m_MeshletStats.visibleTriangles;
+
+	VkViewport viewport{ 0.f, 0.f, static_cast<float>(m_RenderExtent.width), static_cast<float>(m_RenderExtent.height), 0.f, 1.f };
+	VkRect2D scissor{ { 0, 0 }, m_RenderExtent };
+	vkCmdSetViewport(cmd, 0, 1, &viewport);
+	vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+	m_GeometryPool.Bind(cmd);
+	const std::array<VkDescriptorSet, 2> descriptorSets = { GetCurrentFrame().cameraDescriptor, GetCurrentFrame().objectDescriptor };
+	for (const DrawBatch& batch : batches)
+	{
+		if (batch.commandCount == 0)
+		{
+			continue;
+		}
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, batch.material->pipeline);
+		vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, batch.material->pipelineLayout, 0, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data(), 0, nullptr);
+
+		const TextureResource* texture = m_Registry.Get(batch.material->texture);
+		MeshPushConstants constants;
+		constants.data = glm::vec4(texture ? static_cast<float>(texture->streamerSlot) : 0.f, 0.f, 0.f, 0.f);
+		constants.renderMatrix = glm::mat4(1.f);
+		vkCmdPushConstants(cmd, batch.material->pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(MeshPushConstants), &constants);
+		DrawIndirect(cmd, GetCurrentFrame().indirectBuffer.buffer, batch.firstCommand, batch.commandCount);
+	}
 }
 
-bool VulkanEngine::LoadFromObj(const char* filename)
+uint32_t VulkanEngine::AppendMeshletDraws(const Mesh& mesh, uint32_t firstMeshlet, uint32_t meshletCount, const glm::mat4& model, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, uint32_t firstInstance, VkDrawIndexedIndirectCommand* commands, uint32_t commandCount)
 {
-	tinyobj::attrib_t attrib;
-	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
+	const glm::vec3 localCameraPosition = glm::vec3(glm::inverse(model) * glm::vec4(cameraPosition, 1.f));
+	vkutil::CullMeshlets(mesh.meshletCullData, firstMeshlet, meshletCount, viewProjection * model, localCameraPosition, m_MeshletVisibility, m_MeshletStats);
 
-	std::string warn;
-	std::string err;
+	// the indirect buffer is write combined memory, so the open command is built here and only written once closed
+	VkDrawIndexedIndirectCommand pending{};
+	for (size_t i = firstMeshlet; i < firstMeshlet + meshletCount; ++i)
+	{
+		if (!m_MeshletVisibility[i])
+		{
+			continue;
+		}
+
+		const Meshlet& meshlet = mesh.meshlets[i];
+		const uint32_t firstIndex = mesh.indexAllocation.offset + meshlet.firstIndex;
+
+		// clusters are contiguous in the index buffer, so visible neighbours collapse into one draw
+		if (pending.indexCount > 0 && pending.firstIndex + pending.indexCount == firstIndex)
+		{
+			pending.indexCount += meshlet.indexCount;
+			m_MeshletStats.visibleTriangles += meshlet.indexCount / 3;
+			continue;
+		}
 
-	tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename, nullptr);
-	if (!warn.empty()) std::cout << "WARN: " << warn << std::endl;
-	if (!err.empty())
+		if (pending.indexCount > 0)
+		{
+			commands[commandCount++] = pending;
+			pending.indexCount = 0;
+		}
+		if (commandCount == MAXINDIRECTCOMMANDS)
+		{
+			// the buffer is full, this and the remaining visible clusters are left out of the frame
+			m_MeshletStats.droppedDraws += static_cast<uint32_t>(std::count(m_MeshletVisibility.begin() + i, m_MeshletVisibility.begin() + firstMeshlet + meshletCount, 1));
+			break;
+		}
+		m_MeshletStats.visibleTriangles += meshlet.indexCount / 3;
+		pending.indexCount = meshlet.indexCount;
+		pending.instanceCount = 1;
+		pending.firstIndex = firstIndex;
+		pending.vertexOffset = static_cast<int32_t>(mesh.vertexAllocation.offset);
+		pending.firstInstance = firstInstance;
+	}
+	if (pending.indexCount > 0)
 	{
-		std::cerr << err << std::endl;
-		return false;
+		commands[commandCount++] = pending;
+	}
+
+	return commandCount;
+}
+
+uint32_t VulkanEngine::AppendSectionDraws(const Mesh& mesh, const RenderObject& object, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, uint32_t firstInstance, VkDrawIndexedIndirectCommand* commands, uint32_t commandCount)
+{
+	const uint32_t endSection = std::min(object.firstSection + object.sectionCount, static_cast<uint32_t>(mesh.sections.size()));
+	if (object.firstSection >= endSection)
+	{
+		return commandCount;
 	}
+	vkutil::CullSections(mesh.sections, object.firstSection, endSection - object.firstSection, viewProjection * object.transformMatrix, m_SectionVisibility, m_MeshletStats);
 
-	for (size_t s = 0; s < shapes.size(); s++)
+	VkDrawIndexedIndirectCommand pending{};
+	for (uint32_t s = object.firstSection; s < endSection; ++s)
 	{
-		size_t indexOffset = 0;
-		for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++)
+		if (!m_SectionVisibility[s])
+		{
+			continue;
+		}
+		const MeshSection& section = mesh.sections[s];
+
+		// visible chunks are culled further per cluster, those draws are closed per section
+		if (m_MeshletCulling)
 		{
-			int fv = 3;
-			for (size_t v = 0; v < fv; v++)
+			if (pending.indexCount > 0)
 			{
-				tinyobj::index_t idx = shapes[s].mesh.indices[indexOffset + v];
-				Vertex vertex;
-				vertex.position = { attrib.vertices[3 * idx.vertex_index + 0], attrib.vertices[3 * idx.vertex_index + 1], attrib.vertices[3 * idx.vertex_index + 2] };
-				vertex.normal = { attrib.normals[3 * idx.normal_index + 0], attrib.normals[3 * idx.normal_index + 1], attrib.normals[3 * idx.normal_index + 2] };
-				vertex.color = { attrib.normals[3 * idx.normal_index + 0], attrib.normals[3 * idx.normal_index + 1], attrib.normals[3 * idx.normal_index + 2] };
-				m_TriMesh.vertices.push_back(vertex);
+				commands[commandCount++] = pending;
+				pending.indexCount = 0;
 			}
-			indexOffset += fv;
+			if (commandCount == MAXINDIRECTCOMMANDS)
+			{
+				m_MeshletStats.droppedDraws += static_cast<uint32_t>(std::count(m_SectionVisibility.begin() + s, m_SectionVisibility.begin() + endSection, 1));
+				break;
+			}
+			commandCount = AppendMeshletDraws(mesh, section.firstMeshlet, section.meshletCount, object.transformMatrix, viewProjection, cameraPosition, firstInstance, commands, commandCount);
+			continue;
 		}
+
+		const uint32_t firstIndex = mesh.indexAllocation.offset + section.firstIndex;
+
+		// a material's chunks are contiguous, so visible neighbours collapse into one draw
+		if (pending.indexCount > 0 && pending.firstIndex + pending.indexCount == firstIndex)
+		{
+			pending.indexCount += section.indexCount;
+			m_MeshletStats.visibleTriangles += section.indexCount / 3;
+			continue;
+		}
+
+		if (pending.indexCount > 0)
+		{
+			commands[commandCount++] = pending;
+			pending.indexCount = 0;
+		}
+		if (commandCount == MAXINDIRECTCOMMANDS)
+		{
+			// the buffer is full, this and the remaining visible chunks are left out of the frame
+			m_MeshletStats.droppedDraws += static_cast<uint32_t>(std::count(m_SectionVisibility.begin() + s, m_SectionVisibility.begin() + endSection, 1));
+			break;
+		}
+		m_MeshletStats.visibleTriangles += section.indexCount / 3;
+		pending.indexCount = section.indexCount;
+		pending.instanceCount = 1;
+		pending.firstIndex = firstIndex;
+		pending.vertexOffset = static_cast<int32_t>(mesh.vertexAllocation.offset);
+		pending.firstInstance = firstInstance;
+	}
+	if (pending.indexCount > 0)
+	{
+		commands[commandCount++] = pending;
 	}
 
-	return true;
+	return commandCount;
 }
 
-void VulkanEngine::LoadImages()
+void VulkanEngine::DrawIndirect(VkCommandBuffer cmd, VkBuffer indirectBuffer, uint32_t firstCommand, uint32_t drawCount)
 {
-	Texture lostEmpire;
-
-	auto res = vkutil::LoadImageFromFile(*this, "../../assets/lost_empire-RGBA.png", lostEmpire.image);
+	constexpr uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	for (uint32_t first = 0; first < drawCount; first += m_MaxDrawIndirectCount)
+	{
+		const uint32_t count = std::min(drawCount - first, m_MaxDrawIndirectCount);
+		vkCmdDrawIndexedIndirect(cmd, indirectBuffer, static_cast<VkDeviceSize>(firstCommand + first) * stride, count, stride);
+		m_FrameStats.drawCalls++;
+	}
+}
 
-	VkImageViewCreateInfo imageInfo = vkinit::ImageViewCreateInfo(VK_FORMAT_R8G8B8A8_SRGB, lostEmpire.image.image, VK_IMAGE_ASPECT_COLOR_BIT);
-	vkCreateImageView(m_Device, &imageInfo, nullptr, &lostEmpire.imageView);
+void VulkanEngine::LoadImages()
+{
+	PROFILE_FUNCTION();
+	// only the startup mips are uploaded here, the rest streams in once the texture is seen
+	m_TextureStreamer.Init(*this, static_cast<VkDeviceSize>(m_Config.textureBudgetMb) * 1024 * 1024);
 	m_DeletionQueue.PushFunction([=]
 		{
-			vkDestroyImageView(m_Device, lostEmpire.imageView, nullptr);
+			m_TextureStreamer.Cleanup();
 		});
 
-	m_LoadedTextures["empire_diffuse"] = lostEmpire;
+	TextureResource empire;
+	empire.sourcePath = "../../assets/lost_empire-RGBA.png";
+	if (!m_TextureStreamer.AddTexture(empire.sourcePath, empire.streamerSlot))
+	{
+		std::cout << "Failed to load the lost empire texture" << std::endl;
+	}
+	const TextureHandle empireTexture = m_Registry.GetTextures().Create(std::move(empire));
+	m_TextureNames["empire_diffuse"] = empireTexture;
+
+	// every material keeps the texture alive on its own reference
+	for (MaterialHandle material : { m_DefaultMaterial, m_AlphaTestedMaterial })
+	{
+		m_Registry.Get(material)->texture = empireTexture;
+		m_Registry.GetTextures().AddRef(empireTexture);
+	}
+	const uint32_t empireSlot = m_Registry.Get(empireTexture)->streamerSlot;
 
 	VkSamplerCreateInfo samplerInfo = vkinit::SamplerCreateInfo(VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_REPEAT);
+	// every mip the streamer made resident is allowed
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
-	VkSampler blockSampler;
-	vkCreateSampler(m_Device, &samplerInfo, nullptr, &blockSampler);
+	vkCreateSampler(m_Device, &samplerInfo, nullptr, &m_TextureSampler);
 
 	m_DeletionQueue.PushFunction([=]
 		{
-			vkDestroySampler(m_Device, blockSampler, nullptr);
+			vkDestroySampler(m_Device, m_TextureSampler, nullptr);
 		});
 
-	for (size_t i = 0; i < FRAMESINFLIGHT; ++i)
+	for (size_t i = 0; i < m_Frames.size(); ++i)
 	{
-	
-
 		VkDescriptorImageInfo imageBufferInfo;
-		imageBufferInfo.sampler = blockSampler;
-		imageBufferInfo.imageView = m_LoadedTextures["empire_diffuse"].imageView;
+		imageBufferInfo.sampler = m_TextureSampler;
+		imageBufferInfo.imageView = m_TextureStreamer.GetImageView(empireSlot);
 		imageBufferInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		m_Frames[i].boundTextureView = imageBufferInfo.imageView;
 
 		VkWriteDescriptorSet text = vkinit::WriteDescriptorSet(m_Frames[i].cameraDescriptor, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageBufferInfo);
-		vkUpdateDescriptorSets(m_Device, 1, &text, 0, nullptr);
+
+		VkDescriptorBufferInfo feedbackInfo{};
+		feedbackInfo.buffer = m_TextureStreamer.GetFeedbackBuffer(static_cast<uint32_t>(i));
+		feedbackInfo.offset = 0;
+		feedbackInfo.range = m_TextureStreamer.GetFeedbackSize();
+
+		VkWriteDescriptorSet feedbackWrite{};
+		feedbackWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		feedbackWrite.pNext = nullptr;
+		feedbackWrite.dstBinding = 2;
+		feedbackWrite.dstSet = m_Frames[i].cameraDescriptor;
+		feedbackWrite.descriptorCount = 1;
+		feedbackWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		feedbackWrite.pBufferInfo = &feedbackInfo;
+
+		const std::array<VkWriteDescriptorSet, 2> writes = { text, feedbackWrite };
+		vkUpdateDescriptorSets(m_Device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+}
+
+
+bool VulkanEngine::ReloadTexture(const std::string& sourcePath)
+{
+	PROFILE_FUNCTION();
+	for (auto& named : m_TextureNames)
+	{
+		const TextureResource* texture = m_Registry.Get(named.second);
+		if (!texture || !SamePath(texture->sourcePath, sourcePath))
+		{
+			continue;
+		}
+
+		TextureResource replacement;
+		replacement.sourcePath = texture->sourcePath;
+		if (!m_TextureStreamer.AddTexture(replacement.sourcePath, replacement.streamerSlot))
+		{
+			std::cout << "keeping the current version of " << sourcePath << std::endl;
+			return false;
+		}
+		const TextureHandle retired = named.second;
+		const TextureHandle handle = m_Registry.GetTextures().Create(std::move(replacement));
+
+		// materials move their reference over, the old image is retired with the last one and
+		// every frame slot binds the new view when it starts its next frame
+		for (auto& material : m_MaterialNames)
+		{
+			Material* resource = m_Registry.Get(material.second);
+			if (resource && resource->texture == retired)
+			{
+				resource->texture = handle;
+				m_Registry.GetTextures().AddRef(handle);
+				m_Registry.GetTextures().Release(retired);
+			}
+		}
+		m_Registry.GetTextures().Release(retired);
+		named.second = handle;
+		std::cout << "reloaded " << sourcePath << std::endl;
+		return true;
 	}
+	return false;
 }
 
+bool VulkanEngine::IsTextureSource(const std::string& path) const
+{
+	for (const auto& named : m_TextureNames)
+	{
+		const TextureResource* texture = m_Registry.Get(named.second);
+		if (texture && SamePath(texture->sourcePath, path))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+std::vector<std::string> VulkanEngine::GetTextureSources() const
+{
+	std::vector<std::string> sources;
+	for (const auto& named : m_TextureNames)
+	{
+		const TextureResource* texture = m_Registry.Get(named.second);
+		if (texture)
+		{
+			sources.push_back(texture->sourcePath);
+		}
+	}
+	return sources;
+}
 
 void VulkanEngine::ImmediateSubmit(std::function<void(VkCommandBuffer cmd)>&& func)
 {
-	VkCommandBuffer cmd = m_UploadContext.commandBuffer;
+	PROFILE_FUNCTION();
+	const uint64_t value = SubmitUpload([&](VkCommandBuffer cmd)
+		{
+			m_GpuProfiler.BeginImmediate(cmd);
+			func(cmd);
+			m_GpuProfiler.EndImmediate(cmd);
+		});
+
+	{
+		PROFILE_SCOPE("vkWaitSemaphores upload");
+		VKCHECK(WaitTimeline(m_TransferTimeline, value, UINT64_MAX));
+	}
+	m_GpuProfiler.ResolveImmediate();
+}
+
+uint64_t VulkanEngine::SubmitUpload(std::function<void(VkCommandBuffer cmd)>&& func)
+{
+	PROFILE_FUNCTION();
+	UploadContext& upload = m_UploadContexts[m_NextUploadContext];
+	m_NextUploadContext = (m_NextUploadContext + 1) % UPLOADCONTEXTS;
+
+	// only blocks when all upload contexts are still in use
+	VKCHECK(WaitTimeline(m_TransferTimeline, upload.timelineValue, UINT64_MAX));
+	VKCHECK(vkResetCommandPool(m_Device, upload.commandPool, 0));
+
+	VkCommandBuffer cmd = upload.commandBuffer;
 	VkCommandBufferBeginInfo cmdBeginInfo = vkinit::CommandBufferBeginInfo(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 
 	VKCHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
 	func(cmd);
 	VKCHECK(vkEndCommandBuffer(cmd));
 
+	upload.timelineValue = ++m_TransferValue;
+
+	VkTimelineSemaphoreSubmitInfoKHR timelineInfo{};
+	timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+	timelineInfo.pNext = nullptr;
+	timelineInfo.signalSemaphoreValueCount = 1;
+	timelineInfo.pSignalSemaphoreValues = &upload.timelineValue;
+
 	VkSubmitInfo submit = vkinit::SubmitInfo(&cmd);
+	submit.pNext = &timelineInfo;
+	submit.signalSemaphoreCount = 1;
+	submit.pSignalSemaphores = &m_TransferTimeline;
 
-	VKCHECK(vkQueueSubmit(m_GraphicsQueue, 1, &submit, m_UploadContext.uploadFence));
+	VKCHECK(vkQueueSubmit(m_TransferQueue, 1, &submit, VK_NULL_HANDLE));
+	return upload.timelineValue;
+}
 
-	vkWaitForFences(m_Device, 1, &m_UploadContext.uploadFence, true, 9999999999999);
-	vkResetFences(m_Device, 1, &m_UploadContext.uploadFence);
+void VulkanEngine::InitImgui()
+{
+	PROFILE_FUNCTION();
+	if (m_Config.headless)
+	{
+		return;
+	}
+
+	VkDescriptorPoolSize poolSizes[] =
+	{
+		{ VK_DESCRIPTOR_TYPE_SAMPLER, 1000 },
+		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000 },
+		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000 },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 1000 },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1000 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1000 },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1000 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, 1000 },
+		{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1000 }
+	};
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+	poolInfo.maxSets = 1000;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(std::size(poolSizes));
+	poolInfo.pPoolSizes = poolSizes;
+
+	VKCHECK(vkCreateDescriptorPool(m_Device, &poolInfo, nullptr, &m_ImguiPool));
+
+	ImGui::CreateContext();
+	ImGui_ImplSDL2_InitForVulkan(_window);
+
+	ImGui_ImplVulkan_InitInfo initInfo{};
+	initInfo.Instance = m_Instance;
+	initInfo.PhysicalDevice = m_PhysicalDevice;
+	initInfo.Device = m_Device;
+	initInfo.QueueFamily = m_GraphicsQueueFamily;
+	initInfo.Queue = m_GraphicsQueue;
+	initInfo.PipelineCache = m_PipelineCache.GetCache();
+	initInfo.DescriptorPool = m_ImguiPool;
+	initInfo.MinImageCount = 2;
+	// the backend rotates its vertex buffers over ImageCount frames, it has to cover every frame in flight
+	initInfo.ImageCount = std::max(static_cast<uint32_t>(m_SwapchainImages.size()), GetFramesInFlight());
+	initInfo.MSAASamples = VK_SAMPLE_COUNT_1_BIT;
+
+	// the overlay is drawn by the graph's imgui pass, so the backend builds its pipeline against that render pass
+	ImGui_ImplVulkan_Init(&initInfo, m_RenderGraph.GetRenderPass(m_ImguiPass));
+
+	ImmediateSubmit([&](VkCommandBuffer cmd)
+		{
+			ImGui_ImplVulkan_CreateFontsTexture(cmd);
+		});
+	ImGui_ImplVulkan_DestroyFontUploadObjects();
 
-	vkResetCommandPool(m_Device, m_UploadContext.commandPool, 0);
+	m_DeletionQueue.PushFunction([=]
+		{
+			vkDestroyDescriptorPool(m_Device, m_ImguiPool, nullptr);
+			ImGui_ImplVulkan_Shutdown();
+			ImGui_ImplSDL2_Shutdown();
+			ImGui::DestroyContext();
+		});
 }
 
 FrameData& VulkanEngine::GetCurrentFrame()
 {
-	return m_Frames[m_FrameNumber % FRAMESINFLIGHT];
+	return m_Frames[GetFrameIndex()];
 }
 
-VkPipeline PipelineBuilder::BuildPipeline(VkDevice device, VkRenderPass renderPass)
+VkPipeline PipelineBuilder::BuildPipeline(VkDevice device, VkRenderPass renderPass, PipelineCache* cache)
 {
 	VkPipelineViewportStateCreateInfo viewportState{};
 	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
@@ -885,8 +2387,9 @@ VkPipeline PipelineBuilder::BuildPipeline(VkDevice device, VkRenderPass renderPa
 	colorBlendState.pNext = nullptr;
 	colorBlendState.logicOpEnable = VK_FALSE;
 	colorBlendState.logicOp = VK_LOGIC_OP_COPY;
-	colorBlendState.attachmentCount = 1;
-	colorBlendState.pAttachments = &m_ColorBlendAttachmentState;
+	const std::vector<VkPipelineColorBlendAttachmentState> blendAttachments(m_ColorAttachmentCount, m_ColorBlendAttachmentState);
+	colorBlendState.attachmentCount = m_ColorAttachmentCount;
+	colorBlendState.pAttachments = blendAttachments.data();
 
 	VkGraphicsPipelineCreateInfo pipelineInfo{};
 	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -907,7 +2410,24 @@ VkPipeline PipelineBuilder::BuildPipeline(VkDevice device, VkRenderPass renderPa
 
 	pipelineInfo.pDepthStencilState = &m_DepthStencilState;
 
+	VkPipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.pNext = nullptr;
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(m_DynamicStates.size());
+	dynamicState.pDynamicStates = m_DynamicStates.data();
+	pipelineInfo.pDynamicState = m_DynamicStates.empty() ? nullptr : &dynamicState;
+
 	VkPipeline newPipeline;
+	if (cache)
+	{
+		newPipeline = cache->CreateGraphicsPipeline(pipelineInfo);
+		if (newPipeline == VK_NULL_HANDLE)
+		{
+			std::cout << "failed to create pipeline\n";
+		}
+		return newPipeline;
+	}
+
 	if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &newPipeline) != VK_SUCCESS)
 	{
 		std::cout << "failed to create pipeline\n";
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <deque>
 #include <functional>
 #include <string>
@@ -10,27 +11,86 @@
 #include <vector>
 
 #include "vk_Mesh.h"
+#include "vk_GeometryPool.h"
+#include "vk_RenderGraph.h"
+#include "vk_GpuProfiler.h"
+#include "CameraPath.h"
+#include "vk_PerfHud.h"
+#include "vk_PipelineCache.h"
+#include "vk_MemoryManager.h"
+#include "TextureStreamer.h"
+#include "ResourceRegistry.h"
+#include "FrameAllocator.h"
+#include "VirtualFileSystem.h"
+#include "AssetCache.h"
+#include "HotReloader.h"
+#include "vk_ClusteredLights.h"
+#include "vk_ShadowMaps.h"
+#include "DynamicResolution.h"
+#include "Simulation.h"
+#include "Bvh.h"
 #include "glm/glm.hpp"
 
-#define FRAMESINFLIGHT 2
+// upper bound of EngineConfig::framesInFlight
+#define MAXFRAMESINFLIGHT 4
+// uploads that may run on the GPU at once before SubmitUpload waits for the oldest
+#define UPLOADCONTEXTS 4
+#define MAXINDIRECTCOMMANDS 16384
+#define MAXOBJECTS 100000
+// where the engine loads its SPIR-V from, hot reload watches it for edited glsl
+#define SHADERDIRECTORY "../../shaders/"
+
+struct DeletionQueue
+{
+	std::deque<std::function<void()>> deletors;
+	void PushFunction(std::function<void()>&& func)
+	{
+		deletors.push_back(func);
+	}
+
+	void Flush()
+	{
+		for (auto it = deletors.begin(); it != deletors.end(); ++it)
+		{
+			(*it)();
+		}
+		deletors.clear();
+	}
+};
 
 struct FrameData
 {
+	// binary, acquire and present only take those
 	VkSemaphore presentSmeraphore, renderSemaphore;
-	VkFence renderFence;
+	// graphics timeline value signalled by the frame's last submit, the slot is free again once it is reached
+	uint64_t timelineValue{ 0 };
+	// when the input the frame was recorded with was sampled, compared against its completion for the latency stats
+	std::chrono::steady_clock::time_point inputTime;
+	bool latencyPending{ false };
 
 	VkCommandPool commandPool;
 	VkCommandBuffer commandBuffer;
 	AllocatedBuffer cameraBuffer;
+	AllocatedBuffer indirectBuffer;
+	AllocatedBuffer objectBuffer;
 	VkDescriptorSet cameraDescriptor;
+	VkDescriptorSet objectDescriptor;
 	VkDescriptorSet textureDescriptor;
+	// streamed texture view the camera set samples, rebound when streaming swapped the image
+	VkImageView boundTextureView{ VK_NULL_HANDLE };
+
+	// flushed once the graphics timeline reaches timelineValue again, for resources the GPU may still be reading
+	DeletionQueue deletionQueue;
+	// transient CPU data of the frame being recorded, reset together with the deletion queue
+	FrameAllocator allocator;
 };
 
 struct UploadContext
 {
-	VkFence uploadFence;
 	VkCommandPool commandPool;
 	VkCommandBuffer commandBuffer;
+	// transfer timeline value of the last upload recorded into the command buffer
+	uint64_t timelineValue{ 0 };
 };
 
 struct MeshPushConstants
@@ -46,28 +106,114 @@ struct GPUCameraData
 	glm::mat4 viewProjectionMatrix;
 };
 
-struct Texture
+struct GPUObjectData
 {
-	AllocatedImage image;
-	VkImageView imageView;
+	glm::mat4 modelMatrix;
 };
 
-struct DeletionQueue
+struct RenderObject
 {
-	std::deque<std::function<void()>> deletors;
-	void PushFunction(std::function<void()>&& func)
-	{
-		deletors.push_back(func);
-	}
+	MeshHandle mesh;
+	MaterialHandle material;
+	glm::mat4 transformMatrix;
+	// range of Mesh::sections to draw, 0 sections draws the whole mesh
+	uint32_t firstSection{ 0 };
+	uint32_t sectionCount{ 0 };
+	// may move every frame, drawn into the shadow maps each frame instead of their static caches
+	bool dynamic{ false };
+};
 
-	void Flush()
-	{
-		for (auto it = deletors.begin(); it != deletors.end(); ++it)
-		{
-			(*it)();
-		}
-		deletors.clear();
-	}
+enum class PresentMode
+{
+	// vsynced queue, never tears, up to a swapchain's worth of latency
+	Fifo,
+	// vsynced, a newer frame replaces the queued one
+	Mailbox,
+	// presents right away and may tear
+	Immediate
+};
+
+struct EngineConfig
+{
+	// no window, surface or swapchain, frames are rendered into an offscreen target
+	bool headless = false;
+	// headless runs stop after this many frames
+	uint32_t frameCount = 600;
+	// per-frame cpu and gpu times as csv, empty to skip
+	std::string statsPath;
+	// the last headless frame as a ppm, empty to skip
+	std::string readbackPath;
+	// fixed simulation step of headless frames in seconds
+	float timestep = 1.f / 60.f;
+	// the compiled render graph's passes, barriers and aliasing as text, empty to skip
+	std::string graphDumpPath;
+
+	std::string meshPath = "../../assets/lost_empire.obj";
+	ObjImporter objImporter = ObjImporter::Fast;
+	// asset pack built by inferno_pack, mounted at "../../" when the file exists
+	std::string assetPack = "../../inferno.ipak";
+	// bake outputs by content hash, shared with inferno_bake and inferno_pack. empty bakes every time
+	std::string assetCache = "../../.assetcache";
+	// CameraPath::LoadFromFile format, headless runs orbit the scene when empty
+	std::string cameraPath;
+	// VRAM streamed textures may use beyond their startup mips
+	uint32_t textureBudgetMb = 256;
+	// frames the CPU may record ahead of the GPU, clamped to 1..MAXFRAMESINFLIGHT
+	uint32_t framesInFlight = 2;
+	// falls back to FIFO when the surface does not support it
+	PresentMode presentMode = PresentMode::Mailbox;
+	// waits for the GPU to finish the previous frame before input is sampled, trades throughput for latency
+	bool lowLatency = false;
+	// frame cap in fps, 0 leaves pacing to the present mode
+	float fpsLimit = 0.f;
+	// recompiles, rebakes and swaps in edited shaders, textures and the scene mesh, windowed runs only
+	bool hotReload = true;
+	std::string glslangPath = "glslangValidator";
+	// animated point lights spread over the scene, clamped to CLUSTEREDLIGHTS_MAX_LIGHTS
+	uint32_t lightCount = 1024;
+	// gpu frame time in ms the scene resolution is scaled to fit, then upscaled to the window. 0 renders at window resolution
+	float frameBudgetMs = 0.f;
+	// smallest fraction of the window resolution the scene is rendered at
+	float minResolutionScale = 0.5f;
+	// ticks per second of the simulation thread, headless runs tick once per frame instead
+	float simulationRate = 60.f;
+};
+
+// time from sampling input to the GPU finishing the frame recorded with it, scan-out not included
+struct LatencyStats
+{
+	float lastMs = 0.f;
+	float averageMs = 0.f;
+	float worstMs = 0.f;
+};
+
+// what DrawObjects submitted for one frame
+struct FrameStats
+{
+	uint32_t drawCalls = 0;
+	uint32_t drawCommands = 0;
+	uint32_t objects = 0;
+	uint64_t triangles = 0;
+	// operator new calls made by the frame's whole loop iteration, 0 in steady state
+	uint32_t heapAllocations = 0;
+	size_t frameAllocatorBytes = 0;
+};
+
+struct StagingStats
+{
+	uint32_t uploads = 0;
+	VkDeviceSize totalBytes = 0;
+	VkDeviceSize frameBytes = 0;
+	VkDeviceSize largestBytes = 0;
+};
+
+struct FrameTiming
+{
+	uint32_t frame;
+	float cpuMs;
+	// negative until the frame's timestamps have been read back
+	float gpuMs;
+	FrameStats stats;
 };
 
 class VulkanEngine
@@ -78,11 +224,13 @@ public:
 	int _frameNumber {0};
 
 	VkExtent2D m_WindowExtent{ 1700 , 900 };
+	// what the scene is rendered at, below the window extent while dynamic resolution scales it down
+	VkExtent2D m_RenderExtent{ 1700 , 900 };
 
 	struct SDL_Window* _window{ nullptr };
 
 	//initializes everything in the engine
-	void Init();
+	void Init(const EngineConfig& config = EngineConfig{});
 
 	//shuts down the engine
 	void Cleanup();
@@ -94,46 +242,197 @@ public:
 	void run();
 	VkDevice m_Device;
 	bool LoadShaderModule(const std::string& filename, VkShaderModule* shaderModule);
-	AllocatedBuffer CreateBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage);
+	// the category picks the VMA pool the buffer is placed in
+	AllocatedBuffer CreateBuffer(size_t allocSize, VkBufferUsageFlags usage, VmaMemoryUsage memoryUsage, MemoryCategory category = MemoryCategory::General);
+	// host visible transfer source, counted in the staging stats
+	AllocatedBuffer CreateStagingBuffer(size_t allocSize);
+	// records and submits an upload, then waits on the CPU until it finished
 	void ImmediateSubmit(std::function<void(VkCommandBuffer cmd)>&& func);
+	// records and submits an upload without waiting, the returned transfer timeline value signals its completion.
+	// frames submitted afterwards wait for it on the GPU
+	uint64_t SubmitUpload(std::function<void(VkCommandBuffer cmd)>&& func);
+	// runs func once the transfer timeline reached value, call with values in submission order
+	void RetireAfterUpload(uint64_t value, std::function<void()>&& func);
+	uint32_t GetFramesInFlight() const { return static_cast<uint32_t>(m_Frames.size()); }
+	uint32_t GetFrameIndex() const { return static_cast<uint32_t>(m_FrameNumber) % GetFramesInFlight(); }
 	VmaAllocator& GetAllocator() { return m_Allocator; }
+	MemoryManager& GetMemoryManager() { return m_MemoryManager; }
+	TextureStreamer& GetTextureStreamer() { return m_TextureStreamer; }
+	const TextureStreamer& GetTextureStreamer() const { return m_TextureStreamer; }
+	ResourceRegistry& GetRegistry() { return m_Registry; }
+	const VirtualFileSystem& GetFileSystem() const { return m_FileSystem; }
+	VirtualFileSystem& GetFileSystem() { return m_FileSystem; }
+	AssetCache& GetAssetCache() { return m_AssetCache; }
 	DeletionQueue& GetDeletionQueue(){return m_DeletionQueue;}
+	DeletionQueue& GetFrameDeletionQueue() { return GetCurrentFrame().deletionQueue; }
+	FrameAllocator& GetFrameAllocator() { return GetCurrentFrame().allocator; }
+
+	void UnloadMesh(Mesh& mesh);
+	MaterialHandle CreateMaterial(VkPipeline pipeline, VkPipelineLayout layout, const std::string& name);
+	// name lookups are for loading, the frame loop only works with handles
+	MaterialHandle GetMaterial(const std::string& name) const;
+	std::vector<RenderObject>& GetRenderables() { return m_Renderables; }
+
+	GeometryPool& GetGeometryPool() { return m_GeometryPool; }
+
+	// hot reload entry points, call at a frame boundary. each keeps what it replaces when the new version fails
+	bool ReloadPipelines();
+	bool ReloadTexture(const std::string& sourcePath);
+	// the scene mesh's objects are rebuilt from the new mesh's sections
+	bool ReplaceSceneMesh(Mesh&& mesh);
+	bool IsTextureSource(const std::string& path) const;
+	std::vector<std::string> GetTextureSources() const;
+	const EngineConfig& GetConfig() const { return m_Config; }
+
+	const RenderGraph& GetRenderGraph() const { return m_RenderGraph; }
+	GpuProfiler& GetGpuProfiler() { return m_GpuProfiler; }
+
+	// the simulation takes its copy when the scene is set up
+	void SetCameraPath(const CameraPath& path) { m_CameraPath = path; }
+	const std::vector<FrameTiming>& GetFrameTimings() const { return m_FrameTimings; }
+	const FrameStats& GetFrameStats() const { return m_FrameStats; }
+	const StagingStats& GetStagingStats() const { return m_StagingStats; }
+	const PipelineCache& GetPipelineCache() const { return m_PipelineCache; }
+	PipelineCache& GetPipelineCache() { return m_PipelineCache; }
+	// bytes held by VMA allocations, walks every block so keep it out of the frame loop
+	VkDeviceSize CalculateGpuMemoryUsage() const;
+
+	const MeshletStats& GetMeshletStats() const { return m_MeshletStats; }
+	const std::vector<uint8_t>& GetMeshletVisibility() const { return m_MeshletVisibility; }
+	void SetMeshletCulling(bool enabled) { m_MeshletCulling = enabled; }
+
+	// the swapchain is rebuilt with the new mode before the next frame
+	void SetPresentMode(PresentMode mode);
+	// what the swapchain actually uses, which can differ from the requested mode
+	const char* GetPresentModeName() const;
+	void SetLowLatency(bool enabled) { m_Config.lowLatency = enabled; }
+	bool IsLowLatency() const { return m_Config.lowLatency; }
+	const LatencyStats& GetLatencyStats() const { return m_LatencyStats; }
+
+	// world space direction the sun shines in, the shadow caches are rendered again when it changes
+	void SetSunDirection(const glm::vec3& direction) { m_ShadowMaps.SetLightDirection(direction); }
+	const ShadowMaps& GetShadowMaps() const { return m_ShadowMaps; }
+	const DynamicResolution& GetDynamicResolution() const { return m_DynamicResolution; }
+	const Simulation& GetSimulation() const { return m_Simulation; }
+
+	// BVH over the scene mesh for CPU ray queries, built for windowed runs only
+	const Bvh& GetSceneBvh() const { return m_SceneBvh; }
+	// closest scene triangle under a window pixel, as last frame's camera saw it
+	bool PickScene(float x, float y, RayHit& outHit) const;
+	const glm::vec2& GetMousePosition() const { return m_MousePosition; }
 	
 private:
 	void InitVulkan();
 	void InitSwapchain();
+	void CreateSwapchain(VkSwapchainKHR oldSwapchain);
+	// false while the window has no area to present to
+	bool RecreateSwapchain();
+	void InitOffscreenTarget();
+	void RunHeadless();
+	void WriteFrameTimings(const std::string& path) const;
 	void InitCommands();
 	void InitPipelines();
-	void InitDefaultRenderpass();
-	void InitFramebuffer();
+	// the two mesh pipelines from the current SPIR-V, false when a shader or pipeline failed
+	bool BuildMeshPipelines(VkPipeline& outMeshPipeline, VkPipeline& outAlphaTestedPipeline);
+	void InitRenderGraph();
 	void InitSyncStructures();
 	void InitDescriptorSetLayout();
+	// light culling pipeline and the light buffers in every frame's global set
+	void InitLights();
+	// shadow maps and their cascade data in every frame's global set
+	void InitShadows();
+	// box the turning scene mesh sweeps through, false without one
+	bool GetSceneBounds(glm::vec3& outMin, glm::vec3& outMax) const;
+	void InitImgui();
 	void LoadMeshes();
-	void UploadMesh(Mesh& mesh);
-	bool LoadFromObj(const char* filename);
+	void InitScene();
+	// the scene mesh's objects, one per run of sections sharing a material
+	void AddSceneObjects();
+	// moves every object of the scene mesh, the static shadow caches it is in are refreshed
+	void SetSceneTransform(const glm::mat4& transform);
+	// false when the geometry pool has no room, the mesh then has no allocations and must not be drawn
+	bool UploadMesh(Mesh& mesh);
+	void DrawObjects(VkCommandBuffer cmd, const glm::mat4& viewProjection, const glm::vec3& cameraPosition);
+	uint32_t AppendMeshletDraws(const Mesh& mesh, uint32_t firstMeshlet, uint32_t meshletCount, const glm::mat4& model, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, uint32_t firstInstance, VkDrawIndexedIndirectCommand* commands, uint32_t commandCount);
+	// chunk culling of a sectioned object, visible neighbouring sections share one command
+	uint32_t AppendSectionDraws(const Mesh& mesh, const RenderObject& object, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, uint32_t firstInstance, VkDrawIndexedIndirectCommand* commands, uint32_t commandCount);
+	// the engine material an imported mtl material is drawn with
+	MaterialHandle GetMaterialFor(const MeshMaterial& material) const;
+	void DrawIndirect(VkCommandBuffer cmd, VkBuffer indirectBuffer, uint32_t firstCommand, uint32_t drawCount);
 	void LoadImages();
-	int m_FrameNumber;
+	// heap allocations since the previous call, called once per loop iteration it counts the whole iteration
+	uint32_t CountHeapAllocations();
+	uint64_t m_HeapAllocations{ 0 };
+	int m_FrameNumber{ 0 };
+	EngineConfig m_Config;
+	CameraPath m_CameraPath;
+	float m_SceneTime{ 0.f };
+	std::vector<FrameTiming> m_FrameTimings;
+	FrameStats m_FrameStats;
+	StagingStats m_StagingStats;
+	PerfHud m_PerfHud;
 	FrameData& GetCurrentFrame();
+	VkSemaphore CreateTimelineSemaphore();
+	VkResult WaitTimeline(VkSemaphore semaphore, uint64_t value, uint64_t timeout) const;
+	// runs the retired functions whose uploads or frames have finished
+	void RetireCompleted();
+	// runs func once every frame submitted so far has finished
+	void RetireAfterFrames(std::function<void()>&& func);
+	// limiter, low latency wait and latency measurement, run right before input is sampled
+	void PaceFrame();
+	// interpolates the newest simulation snapshot into the scene time, camera, scene and dynamic transforms
+	void ApplySimulation();
 
 	VkDescriptorSetLayout m_GlobalSetlayout;
 	VkDescriptorSetLayout m_TextureSetlayout;
+	VkDescriptorSetLayout m_ObjectSetLayout;
 
 	VkDescriptorSet m_TextureDescriptorSet;
 
 	VkDescriptorPool m_DescriptorPool;
 
 	DeletionQueue m_DeletionQueue;
-	FrameData m_Frames[FRAMESINFLIGHT];
+	std::vector<FrameData> m_Frames;
 
-	VkRenderPass m_RenderPass;
-	std::vector<VkFramebuffer> m_Framebuffers;
+	// one monotonically increasing value per submission stream, a resource is free once its value was reached
+	VkSemaphore m_GraphicsTimeline;
+	uint64_t m_GraphicsValue{ 0 };
+	VkSemaphore m_TransferTimeline;
+	uint64_t m_TransferValue{ 0 };
 
-	VkImageView m_DepthImageView;
-	AllocatedImage m_DepthImage;
+	struct RetiredObject
+	{
+		uint64_t value;
+		std::function<void()> func;
+	};
+	std::deque<RetiredObject> m_RetiredUploads;
+	std::deque<RetiredObject> m_RetiredFrames;
+
+	RenderGraph m_RenderGraph;
+	RGResource m_SwapchainTarget;
+	RGResource m_DepthTarget;
+	RGPass m_ShadowCompositePass;
+	RGPass m_ShadowCascadePasses[SHADOWMAPS_CASCADES];
+	RGResource m_ShadowCaches[SHADOWMAPS_CASCADES];
+	RGResource m_ShadowTargets[SHADOWMAPS_CASCADES];
+	RGPass m_LightCullPass;
+	RGPass m_ForwardPass;
+	// with dynamic resolution the forward pass renders here and the upscale pass blits it to the swapchain
+	RGResource m_SceneColor{ RG_INVALID };
+	RGPass m_UpscalePass{ RG_INVALID };
+	// the frame slot's buffers are swapped in every frame
+	RGResource m_LightGrid;
+	RGResource m_LightIndices;
+	RGPass m_ImguiPass;
 	VkFormat m_DepthFormat;
 
 	VkQueue m_GraphicsQueue;
 	uint32_t m_GraphicsQueueFamily;
+	// uploads record image layout changes with shader stages, so they stay on a graphics capable queue
+	VkQueue m_TransferQueue;
+
+	PFN_vkWaitSemaphoresKHR m_WaitSemaphores{ nullptr };
+	PFN_vkGetSemaphoreCounterValueKHR m_GetSemaphoreCounterValue{ nullptr };
 
 	VkCommandPool m_CommandPool;
 	VkCommandBuffer m_CommandBuffer;
@@ -142,28 +441,80 @@ private:
 	VkFormat m_SwapchainImageFormat;
 	std::vector<VkImage> m_SwapchainImages;
 	std::vector<VkImageView> m_SwapchainImageViews;
+	VkPresentModeKHR m_PresentMode{ VK_PRESENT_MODE_FIFO_KHR };
+	// set on resize or an out of date swapchain, the next frame recreates it first
+	bool m_SwapchainDirty{ false };
+
+	std::chrono::steady_clock::time_point m_InputTime;
+	std::chrono::steady_clock::time_point m_NextFrameTime;
+	LatencyStats m_LatencyStats;
+	// headless stand-in for the swapchain image
+	AllocatedImage m_OffscreenImage;
 
 	VkInstance m_Instance;
 	VkDebugUtilsMessengerEXT m_DebugMessenger;
 
 	VkPhysicalDevice m_PhysicalDevice;
+	bool m_SupportsMultiDrawIndirect{ false };
+	// the mesh fragment shader only writes streaming feedback with fragmentStoresAndAtomics
+	bool m_SupportsTextureFeedback{ false };
+	uint32_t m_MaxDrawIndirectCount{ 1 };
 
 	VkSurfaceKHR m_Surface;
 
 	VmaAllocator m_Allocator;
+	MemoryManager m_MemoryManager;
 
-	UploadContext m_UploadContext;
+	UploadContext m_UploadContexts[UPLOADCONTEXTS];
+	uint32_t m_NextUploadContext{ 0 };
+
+	GpuProfiler m_GpuProfiler;
+	DynamicResolution m_DynamicResolution;
+	Simulation m_Simulation;
+	// what this frame renders, kept around so interpolating does not allocate
+	SimulationState m_SimulationState;
+	PipelineCache m_PipelineCache;
+	VkDescriptorPool m_ImguiPool;
 
 	VkPipelineLayout m_TrianglePipelineLayout;
 	VkPipeline m_TrianglePipeline;
 
 	VkPipelineLayout m_MeshPipelineLayout;
 	VkPipeline m_MeshPipeline;
-	Mesh m_TriMesh;
-	Mesh m_Monke;
-
-
-	std::unordered_map<std::string, Texture> m_LoadedTextures;
+	// same layout, discards texels with alpha below one half
+	VkPipeline m_AlphaTestedPipeline;
+	MaterialHandle m_AlphaTestedMaterial;
+	GeometryPool m_GeometryPool;
+	ResourceRegistry m_Registry;
+	MeshHandle m_TriMesh;
+	MeshHandle m_Monke;
+	glm::mat4 m_SceneTransform{ 1.f };
+
+	bool m_MeshletCulling{ true };
+	MeshletStats m_MeshletStats;
+	std::vector<uint8_t> m_MeshletVisibility;
+	std::vector<uint8_t> m_SectionVisibility;
+
+	glm::mat4 m_ViewProjection{ 1.f };
+	glm::vec3 m_CameraPosition;
+	Bvh m_SceneBvh;
+	glm::vec2 m_MousePosition{ 0.f };
+
+	std::vector<RenderObject> m_Renderables;
+	std::vector<uint32_t> m_DrawOrder;
+	std::unordered_map<std::string, MaterialHandle> m_MaterialNames;
+	MaterialHandle m_DefaultMaterial;
+
+	VirtualFileSystem m_FileSystem;
+	AssetCache m_AssetCache;
+	TextureStreamer m_TextureStreamer;
+	std::unordered_map<std::string, TextureHandle> m_TextureNames;
+	VkSampler m_TextureSampler;
+
+	ClusteredLights m_ClusteredLights;
+	ShadowMaps m_ShadowMaps;
+
+	HotReloader m_HotReloader;
 };
 
 class PipelineBuilder
@@ -179,6 +530,10 @@ public:
 	VkPipelineMultisampleStateCreateInfo m_Multisampling;
 	VkPipelineLayout m_PipelineLayout;
 	VkPipelineDepthStencilStateCreateInfo m_DepthStencilState;
+	// m_Viewport and m_Scissor are ignored for states listed here
+	std::vector<VkDynamicState> m_DynamicStates;
+	// 0 for depth only passes, m_ColorBlendAttachmentState is used for every attachment
+	uint32_t m_ColorAttachmentCount{ 1 };
 
-	VkPipeline BuildPipeline(VkDevice device, VkRenderPass renderPass);
+	VkPipeline BuildPipeline(VkDevice device, VkRenderPass renderPass, PipelineCache* cache = nullptr);
 };